@@ -0,0 +1,67 @@
+#include "pch.h"
+
+#include "measuring/allocation_tracking.h"
+
+#include <vector>
+
+// Replaces operator new and delete for the whole executable, which is why
+// these tests don't live in autoscaling.test
+AS_DEFINE_ALLOCATION_TRACKING_OPERATORS;
+
+namespace {
+
+struct alignas(64) aligned_block {
+  char data[64];
+};
+
+// Keeps the compiler from eliding matching new and delete expressions
+uint64_t* volatile s_array = nullptr;
+aligned_block* volatile s_block = nullptr;
+
+void allocating_function() {
+  MEASURE_FUNCTION_ALLOCATIONS;
+  std::vector<char> buffer(1 << 20);
+  buffer[0] = 1;
+}
+
+}  // namespace
+
+TEST(allocation_tracking_operators, enabled) {
+  EXPECT_TRUE(as::is_allocation_tracking_enabled());
+}
+
+TEST(allocation_tracking_operators, new_and_delete) {
+  const auto before = as::get_thread_allocation_counters();
+  s_array = new uint64_t[1000];
+  const auto allocated = as::get_thread_allocation_counters() - before;
+  delete[] s_array;
+  const auto freed = as::get_thread_allocation_counters() - before;
+
+  EXPECT_EQ(allocated.allocations, 1ull);
+  EXPECT_GE(allocated.allocated_bytes, 1000 * sizeof(uint64_t));
+  EXPECT_EQ(freed.deallocations, 1ull);
+  EXPECT_EQ(freed.live_bytes(), 0);
+}
+
+TEST(allocation_tracking_operators, aligned_new_and_delete) {
+  const auto before = as::get_thread_allocation_counters();
+  s_block = new aligned_block;
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(s_block) % alignof(aligned_block),
+            0u);
+  delete s_block;
+  const auto round_trip = as::get_thread_allocation_counters() - before;
+
+  EXPECT_EQ(round_trip.allocations, 1ull);
+  EXPECT_EQ(round_trip.deallocations, 1ull);
+  EXPECT_EQ(round_trip.live_bytes(), 0);
+}
+
+TEST(allocation_tracking_operators, scope_allocations) {
+  allocating_function();
+  const auto measurements =
+      as::get_measurements<as::memory>("allocating_function");
+  ASSERT_EQ(measurements.size(), 1ull);
+  EXPECT_GE(measurements[0].data.get_size(), 1ull << 20);
+
+  as::clear_measurements<as::memory>();
+}
@@ -0,0 +1,62 @@
+//
+// benchmark.h
+// Helpers for the benchmarks, which run as part of the tests. Run only the
+// benchmarks with --gtest_filter=*benchmark*
+//
+
+#pragma once
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+namespace as {
+namespace test {
+
+/// <summary>
+/// Returns the mean wall time of a single call of the operation, measured
+/// over the given number of calls after a short warm-up
+/// </summary>
+template <typename Operation>
+std::chrono::nanoseconds measure_time_per_call(size_t iterations,
+                                               Operation&& operation) {
+  for (size_t idx = 0; idx < std::min<size_t>(iterations / 10, 1000); ++idx)
+    operation();
+
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t idx = 0; idx < iterations; ++idx) operation();
+  const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+  return elapsed / static_cast<int64_t>(std::max<size_t>(iterations, 1));
+}
+
+/// <summary>
+/// Prints the time per call and records it as a property of the current test,
+/// so that it also shows up in the XML report of --gtest_output=xml
+/// </summary>
+inline void report_time_per_call(const std::string& name,
+                                 std::chrono::nanoseconds time) {
+  ::testing::Test::RecordProperty(name + "_ns", std::to_string(time.count()));
+  std::printf("[ BENCHMARK] %-52s %8lld ns\n", name.c_str(),
+              static_cast<long long>(time.count()));
+}
+
+}  // namespace test
+}  // namespace as
+
+/// <summary>
+/// Checks that a measured time stays within the budget. Only checked in
+/// optimized builds, timings of debug builds aren't representative
+/// </summary>
+#ifdef NDEBUG
+#define EXPECT_WITHIN_BUDGET(time, budget) EXPECT_LE(time, budget)
+#else
+#define EXPECT_WITHIN_BUDGET(time, budget) \
+  do {                                     \
+    (void)(time);                          \
+    (void)(budget);                        \
+  } while (false)
+#endif
@@ -0,0 +1,47 @@
+#include "pch.h"
+
+#include "benchmark/benchmark.h"
+#include "scaling/composite_policy.h"
+#include "simulation/virtual_clock.h"
+
+#include <string>
+
+using namespace std::chrono_literals;
+
+TEST(composite_policy_benchmark, decide_500_rules) {
+  const auto start = as::timestamp_t{} + 99h;
+  as::virtual_clock clock{start};
+  as::scoped_clock guard{clock};
+
+  // 500 rules over 20 series with a measurement per second each
+  constexpr int series_count = 20;
+  for (int second = 1; second <= 60; ++second) {
+    clock.set(start + std::chrono::seconds{second});
+    for (int idx = 0; idx < series_count; ++idx) {
+      as::add_measurement<double>(
+          as::intern_name("composite_benchmark." + std::to_string(idx)),
+          static_cast<double>(idx * second % 97));
+    }
+  }
+
+  as::composite_policy policy;
+  for (int idx = 0; idx < 500; ++idx) {
+    const auto name = as::intern_name("composite_benchmark." +
+                                      std::to_string(idx % series_count));
+    auto p90 = policy.aggregate<double>(name, as::aggregation::quantile, 30s,
+                                        0.9);
+    auto mean = policy.aggregate<double>(name, as::aggregation::mean, 60s);
+    policy.add_rule(p90 > 90.0 + idx % 7 && mean > 40.0,
+                    as::scaling_action::scale_out);
+  }
+  as::scaling_inputs inputs;
+  inputs.current_capacity = 4;
+
+  const auto time = as::test::measure_time_per_call(
+      100, [&]() { policy.decide(inputs, as::now()); });
+  as::test::report_time_per_call("composite_policy::decide, 500 rules", time);
+  // Evaluating 500 rules must take less than a millisecond
+  EXPECT_WITHIN_BUDGET(time, std::chrono::nanoseconds{1ms});
+
+  as::clear_measurements<double>();
+}
@@ -0,0 +1,54 @@
+#include "pch.h"
+
+#include "benchmark/benchmark.h"
+#include "measuring/cpu_timing.h"
+
+namespace {
+
+// Each call stores a measurement, so fewer calls than for the scope timings
+constexpr size_t iterations = 100000;
+
+void wall_time_function() { MEASURE_FUNCTION_TIMING; }
+
+void cpu_time_function() { MEASURE_FUNCTION_CPU_TIMING_MODE(cpu_time); }
+
+void cpu_time_and_context_switches_function() {
+  MEASURE_FUNCTION_CPU_TIMING_MODE(cpu_time_and_context_switches);
+}
+
+}  // namespace
+
+TEST(cpu_timing_benchmark, measure_function_timing) {
+  const auto time =
+      as::test::measure_time_per_call(iterations, wall_time_function);
+  as::test::report_time_per_call("MEASURE_FUNCTION_TIMING", time);
+  as::clear_measurements<as::function_timing>();
+}
+
+TEST(cpu_timing_benchmark, cpu_time) {
+  const auto time =
+      as::test::measure_time_per_call(iterations, cpu_time_function);
+  as::test::report_time_per_call("CPU timing, cpu_time", time);
+  as::clear_measurements<as::function_cpu_timing>();
+}
+
+TEST(cpu_timing_benchmark, cpu_time_and_context_switches) {
+  const auto time = as::test::measure_time_per_call(
+      iterations, cpu_time_and_context_switches_function);
+  as::test::report_time_per_call("CPU timing, cpu_time_and_context_switches",
+                                 time);
+  as::clear_measurements<as::function_cpu_timing>();
+}
+
+TEST(cpu_timing_benchmark, get_thread_cpu_usage) {
+  for (auto mode : {as::cpu_timing_mode::cpu_time,
+                    as::cpu_timing_mode::cpu_time_and_context_switches}) {
+    const auto time = as::test::measure_time_per_call(
+        iterations, [mode]() { as::get_thread_cpu_usage(mode); });
+    as::test::report_time_per_call(
+        mode == as::cpu_timing_mode::cpu_time
+            ? "get_thread_cpu_usage, cpu_time"
+            : "get_thread_cpu_usage, cpu_time_and_context_switches",
+        time);
+  }
+}
@@ -0,0 +1,29 @@
+#include "pch.h"
+
+#include "benchmark/benchmark.h"
+#include "measuring/scope_timing.h"
+
+namespace {
+
+void timed_scope() { MEASURE_SCOPE_TIMING("benchmark.timed_scope"); }
+
+void nested_timed_scopes() {
+  MEASURE_SCOPE_TIMING("benchmark.outer_scope");
+  timed_scope();
+}
+
+}  // namespace
+
+TEST(scope_timing_benchmark, measure_scope_timing) {
+  const auto time = as::test::measure_time_per_call(1000000, timed_scope);
+  as::test::report_time_per_call("MEASURE_SCOPE_TIMING", time);
+  // The overhead of a scope must stay in the tens of nanoseconds
+  EXPECT_WITHIN_BUDGET(time, std::chrono::nanoseconds{100});
+}
+
+TEST(scope_timing_benchmark, nested_measure_scope_timing) {
+  const auto time =
+      as::test::measure_time_per_call(1000000, nested_timed_scopes);
+  as::test::report_time_per_call("MEASURE_SCOPE_TIMING nested", time);
+  EXPECT_WITHIN_BUDGET(time, std::chrono::nanoseconds{200});
+}
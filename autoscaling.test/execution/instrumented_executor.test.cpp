@@ -0,0 +1,157 @@
+#include "pch.h"
+
+#include "execution/instrumented_executor.h"
+
+#include <stdexcept>
+
+namespace {
+
+as::executor_options make_options(const char* name, size_t worker_count) {
+  as::executor_options options;
+  options.name = name;
+  options.worker_count = worker_count;
+  // Collect manually
+  options.collect_interval = std::chrono::milliseconds{60000};
+  return options;
+}
+
+}  // namespace
+
+TEST(instrumented_executor, executes_tasks) {
+  as::instrumented_executor executor{make_options("executes_tasks", 2)};
+  std::atomic<int> sum{0};
+  for (int idx = 1; idx <= 100; ++idx)
+    executor.submit([&, idx]() { sum += idx; });
+  executor.wait_for_idle();
+
+  EXPECT_EQ(sum.load(), 5050);
+  auto statistics = executor.get_statistics();
+  EXPECT_EQ(statistics.worker_count, 2ull);
+  EXPECT_EQ(statistics.executed_tasks, 100ull);
+  EXPECT_EQ(statistics.queue_length, 0ull);
+  EXPECT_EQ(statistics.queue_wait_time.count(), 100ull);
+  EXPECT_EQ(statistics.execution_time.count(), 100ull);
+}
+
+TEST(instrumented_executor, async) {
+  as::instrumented_executor executor{make_options("async", 2)};
+  auto result = executor.async([]() { return 42; });
+  EXPECT_EQ(result.get(), 42);
+
+  auto failing = executor.async([]() -> int { throw std::runtime_error{""}; });
+  EXPECT_THROW(failing.get(), std::runtime_error);
+}
+
+TEST(instrumented_executor, failed_tasks) {
+  as::instrumented_executor executor{make_options("failed_tasks", 1)};
+  executor.submit([]() { throw std::runtime_error{""}; });
+  executor.wait_for_idle();
+
+  EXPECT_EQ(executor.get_statistics().failed_tasks, 1ull);
+}
+
+TEST(instrumented_executor, dropped_timings) {
+  auto options = make_options("dropped_timings", 1);
+  options.buffer_capacity_per_worker = 4;
+  as::instrumented_executor executor{options};
+  for (int idx = 0; idx < 10; ++idx) executor.submit([]() {});
+  executor.wait_for_idle();
+
+  auto statistics = executor.get_statistics();
+  EXPECT_EQ(statistics.executed_tasks, 10ull);
+  EXPECT_EQ(statistics.dropped_timings, 6ull);
+  executor.collect();
+  EXPECT_EQ(
+      as::get_measurements<as::timespan_t>(executor.get_queue_wait_name())
+          .size(),
+      4ull);
+
+  as::clear_measurements<as::timespan_t>();
+  as::clear_measurements<size_t>();
+  as::clear_measurements<double>();
+}
+
+TEST(instrumented_executor, nested_submit) {
+  as::instrumented_executor executor{make_options("nested_submit", 2)};
+  std::atomic<int> count{0};
+  executor.submit([&]() {
+    for (int idx = 0; idx < 10; ++idx) executor.submit([&]() { ++count; });
+  });
+  executor.wait_for_idle();
+
+  EXPECT_EQ(count.load(), 10);
+}
+
+TEST(instrumented_executor, destructor_finishes_queued_tasks) {
+  std::atomic<int> count{0};
+  {
+    as::instrumented_executor executor{
+        make_options("destructor_finishes_queued_tasks", 1)};
+    for (int idx = 0; idx < 10; ++idx) {
+      executor.submit([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        ++count;
+      });
+    }
+  }
+  EXPECT_EQ(count.load(), 10);
+}
+
+TEST(instrumented_executor, set_worker_count) {
+  auto options = make_options("set_worker_count", 1);
+  options.max_worker_count = 3;
+  as::instrumented_executor executor{options};
+  EXPECT_EQ(executor.get_worker_count(), 1ull);
+  EXPECT_EQ(executor.get_max_worker_count(), 3ull);
+
+  executor.set_worker_count(10);
+  EXPECT_EQ(executor.get_worker_count(), 3ull);
+
+  std::atomic<int> count{0};
+  for (int idx = 0; idx < 30; ++idx) executor.submit([&]() { ++count; });
+  // Tasks queued on retired workers are stolen by the remaining one
+  executor.set_worker_count(1);
+  executor.wait_for_idle();
+  EXPECT_EQ(count.load(), 30);
+  EXPECT_EQ(executor.get_statistics().worker_count, 1ull);
+}
+
+TEST(instrumented_executor, records_series) {
+  {
+    as::instrumented_executor executor{make_options("records_series", 2)};
+    for (int idx = 0; idx < 10; ++idx) {
+      executor.submit([]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds{5});
+      });
+    }
+    executor.wait_for_idle();
+    executor.collect();
+
+    EXPECT_GT(executor.get_statistics().utilization, 0.0);
+  }
+
+  auto queue_wait =
+      as::get_measurements<as::timespan_t>("records_series.queue_wait");
+  auto execution_time =
+      as::get_measurements<as::timespan_t>("records_series.execution_time");
+  ASSERT_EQ(queue_wait.size(), 10ull);
+  ASSERT_EQ(execution_time.size(), 10ull);
+  for (auto& measurement : execution_time)
+    EXPECT_GE(measurement.data, std::chrono::milliseconds{5});
+
+  // Collected explicitly and by the destructor
+  auto utilization = as::get_measurements<double>("records_series.utilization");
+  ASSERT_EQ(utilization.size(), 2ull);
+  EXPECT_GT(utilization[0].data, 0.0);
+  EXPECT_LE(utilization[0].data, 1.0);
+  EXPECT_EQ(
+      as::get_measurements<double>("records_series.worker.0.busy_fraction")
+          .size(),
+      2ull);
+  EXPECT_EQ(as::get_measurements<size_t>("records_series.queue_length").size(),
+            2ull);
+
+  as::clear_measurements<as::timespan_t>();
+  as::clear_measurements<double>();
+  as::clear_measurements<size_t>();
+}
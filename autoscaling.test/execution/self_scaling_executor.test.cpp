@@ -0,0 +1,54 @@
+#include "pch.h"
+
+#include "execution/self_scaling_executor.h"
+
+using namespace std::chrono_literals;
+
+TEST(self_scaling_executor, scales_with_load) {
+  as::self_scaling_executor_options options;
+  options.executor.name = "self_scaling";
+  options.executor.worker_count = 1;
+  options.executor.collect_interval = 60s;
+  options.policy.target_latency = 1ms;
+  options.policy.min_capacity = 1;
+  options.policy.max_capacity = 4;
+  options.policy.scale_out_cooldown = 0ms;
+  options.policy.scale_in_cooldown = 0ms;
+  // Evaluate manually
+  options.evaluation_interval = 60s;
+
+  {
+    as::self_scaling_executor executor{options};
+    EXPECT_EQ(executor.get_worker_count(), 1ull);
+    EXPECT_EQ(executor.get_executor().get_max_worker_count(), 4ull);
+
+    for (int idx = 0; idx < 20; ++idx)
+      executor.submit([]() { std::this_thread::sleep_for(2ms); });
+    std::this_thread::sleep_for(20ms);
+
+    auto decision = executor.evaluate();
+    EXPECT_EQ(decision.action, as::scaling_action::scale_out);
+    EXPECT_GT(decision.target_capacity, 1ull);
+    EXPECT_EQ(executor.get_worker_count(), decision.target_capacity);
+
+    executor.wait_for_idle();
+    executor.evaluate();
+    std::this_thread::sleep_for(20ms);
+
+    decision = executor.evaluate();
+    EXPECT_EQ(decision.action, as::scaling_action::scale_in);
+    EXPECT_LT(executor.get_worker_count(), 4ull);
+
+    // Still works after scaling in
+    EXPECT_EQ(executor.async([]() { return 42; }).get(), 42);
+  }
+
+  auto worker_counts =
+      as::get_measurements<size_t>("self_scaling.worker_count");
+  ASSERT_GE(worker_counts.size(), 3ull);
+  EXPECT_EQ(worker_counts[0].data, 1ull);
+
+  as::clear_measurements<size_t>();
+  as::clear_measurements<as::timespan_t>();
+  as::clear_measurements<double>();
+}
@@ -0,0 +1,178 @@
+#include "pch.h"
+
+#include "measuring/allocation_tracking.h"
+
+#include <memory>
+
+// The tests allocate through the tracking functions directly instead of
+// expanding AS_DEFINE_ALLOCATION_TRACKING_OPERATORS, which would replace
+// operator new and delete for all tests of this executable. The operators
+// are tested by autoscaling.allocation_tracking.test
+
+namespace {
+
+/// <summary>
+/// Heap buffer allocated through the tracking functions, like the operators
+/// of AS_DEFINE_ALLOCATION_TRACKING_OPERATORS do
+/// </summary>
+struct tracked_buffer {
+  explicit tracked_buffer(size_t size)
+      : data(static_cast<char*>(as::detail::tracked_allocate(size))) {
+    data[0] = 1;
+  }
+  ~tracked_buffer() { as::detail::tracked_deallocate(data); }
+
+  tracked_buffer(const tracked_buffer&) = delete;
+  tracked_buffer& operator=(const tracked_buffer&) = delete;
+
+  char* data;
+};
+
+void allocating_function() {
+  MEASURE_FUNCTION_ALLOCATIONS;
+  tracked_buffer buffer{1 << 20};
+}
+
+std::unique_ptr<tracked_buffer> s_retained;
+
+void memory_function() {
+  MEASURE_FUNCTION_MEMORY;
+  { tracked_buffer temporary{1 << 20}; }
+  s_retained = std::make_unique<tracked_buffer>(4096);
+}
+
+}  // namespace
+
+TEST(allocation_tracking, disabled) {
+  if (as::is_allocation_tracking_enabled())
+    GTEST_SKIP() << "Allocation tracking was enabled by an earlier test";
+
+  allocating_function();
+  EXPECT_TRUE(as::get_measurements<as::memory>("allocating_function").empty());
+}
+
+TEST(allocation_tracking, enabled) {
+  as::detail::enable_allocation_tracking();
+  EXPECT_TRUE(as::is_allocation_tracking_enabled());
+}
+
+TEST(allocation_tracking, thread_counters) {
+  const auto before = as::get_thread_allocation_counters();
+  auto* ptr = as::detail::tracked_allocate(1000);
+  const auto allocated = as::get_thread_allocation_counters();
+  as::detail::tracked_deallocate(ptr);
+  const auto freed = as::get_thread_allocation_counters();
+
+  const auto allocation = allocated - before;
+  EXPECT_EQ(allocation.allocations, 1ull);
+  EXPECT_GE(allocation.allocated_bytes, 1000ull);
+  EXPECT_EQ(allocation.deallocations, 0ull);
+
+  const auto round_trip = freed - before;
+  EXPECT_EQ(round_trip.deallocations, 1ull);
+  EXPECT_EQ(round_trip.live_bytes(), 0);
+}
+
+TEST(allocation_tracking, aligned_allocation) {
+  const auto alignment = std::align_val_t{64};
+  const auto before = as::get_thread_allocation_counters();
+  auto* ptr = as::detail::tracked_allocate_aligned(64, alignment);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % 64, 0u);
+  as::detail::tracked_deallocate_aligned(ptr, alignment);
+  const auto delta = as::get_thread_allocation_counters() - before;
+
+  EXPECT_EQ(delta.allocations, 1ull);
+  EXPECT_EQ(delta.live_bytes(), 0);
+}
+
+TEST(allocation_tracking, process_counters) {
+  const auto before = as::get_process_allocation_counters();
+  // Large allocations are flushed immediately
+  tracked_buffer buffer{1 << 20};
+  const auto after = as::get_process_allocation_counters();
+
+  EXPECT_GE(after.allocated_bytes - before.allocated_bytes, 1ull << 20);
+}
+
+TEST(allocation_tracking, other_thread_flushes_on_exit) {
+  const auto before = as::get_process_allocation_counters();
+  std::thread{[]() {
+    // Small allocations that stay below the flush thresholds
+    for (int idx = 0; idx < 10; ++idx) tracked_buffer buffer{16};
+  }}.join();
+  const auto after = as::get_process_allocation_counters();
+
+  EXPECT_GE(after.allocations - before.allocations, 10ull);
+}
+
+TEST(allocation_tracking, scope_measurement) {
+  as::detail::enable_allocation_tracking();
+  allocating_function();
+
+  auto measurements = as::get_measurements<as::memory>("allocating_function");
+  ASSERT_EQ(measurements.size(), 1ull);
+  EXPECT_GE(measurements[0].data.get_size(), 1ull << 20);
+
+  as::clear_measurements<as::memory>();
+}
+
+TEST(allocation_tracking, sampler) {
+  as::detail::enable_allocation_tracking();
+  {
+    as::allocation_sampler sampler{
+        as::allocation_sampler_options{std::chrono::milliseconds{60000}}};
+    tracked_buffer buffer{1 << 20};
+    sampler.sample();
+  }
+
+  auto live_bytes = as::get_measurements<as::memory>(as::heap_live_bytes_name);
+  ASSERT_EQ(live_bytes.size(), 2ull);
+  EXPECT_GT(live_bytes[1].data.get_size(), live_bytes[0].data.get_size());
+
+  auto allocation_rate =
+      as::get_measurements<as::rate>(as::heap_allocation_rate_name);
+  ASSERT_EQ(allocation_rate.size(), 1ull);
+  EXPECT_GT(allocation_rate[0].data.get_per_second(), 0.0);
+
+  as::clear_measurements<as::memory>();
+  as::clear_measurements<as::rate>();
+}
+
+TEST(allocation_tracking, scope_memory) {
+  as::detail::enable_allocation_tracking();
+  memory_function();
+
+  auto measurements =
+      as::get_measurements<as::scope_memory>("memory_function");
+  ASSERT_EQ(measurements.size(), 1ull);
+  auto& value = measurements[0].data;
+  EXPECT_GE(value.peak.get_size(), 1ull << 20);
+  EXPECT_GE(value.net.get_size(), 4096ull);
+  EXPECT_LT(value.net.get_size(), 1ull << 20);
+
+  s_retained.reset();
+  as::clear_measurements<as::scope_memory>();
+}
+
+TEST(allocation_tracking, nested_scope_memory) {
+  as::detail::enable_allocation_tracking();
+  {
+    MEASURE_SCOPE_MEMORY("outer");
+    tracked_buffer outer_buffer{1 << 16};
+    {
+      MEASURE_SCOPE_MEMORY("inner");
+      tracked_buffer inner_buffer{1 << 20};
+    }
+  }
+
+  auto outer = as::get_measurements<as::scope_memory>("outer");
+  auto inner = as::get_measurements<as::scope_memory>("inner");
+  ASSERT_EQ(outer.size(), 1ull);
+  ASSERT_EQ(inner.size(), 1ull);
+  // The peak of the outer scope includes the peak of the inner scope
+  EXPECT_GE(inner[0].data.peak.get_size(), 1ull << 20);
+  EXPECT_GE(outer[0].data.peak.get_size(), (1ull << 20) + (1ull << 16));
+  EXPECT_EQ(inner[0].data.net.get_size(), 0ull);
+
+  as::clear_measurements<as::scope_memory>();
+}
@@ -0,0 +1,110 @@
+#include "pch.h"
+
+#include "measuring/cpu_timing.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+volatile uint64_t s_sink = 0;
+
+void busy_function() {
+  MEASURE_FUNCTION_CPU_TIMING;
+  const auto end = as::now() + 20ms;
+  while (as::now() < end) {
+    for (int idx = 0; idx < 1000; ++idx) s_sink = s_sink + idx;
+  }
+}
+
+void sleeping_function() {
+  MEASURE_FUNCTION_CPU_TIMING;
+  std::this_thread::sleep_for(20ms);
+}
+
+void cpu_time_only_function() {
+  MEASURE_FUNCTION_CPU_TIMING_MODE(cpu_time);
+  std::this_thread::sleep_for(20ms);
+}
+
+as::measurement<as::function_cpu_timing> make_timing(
+    as::timespan_t wall_time, as::timespan_t cpu_time) {
+  as::function_cpu_timing timing;
+  timing.wall_time = wall_time;
+  timing.cpu_time = cpu_time;
+  timing.voluntary_context_switches = 1;
+  return {as::now(), timing};
+}
+
+}  // namespace
+
+TEST(cpu_timing, thread_cpu_usage_increases) {
+  auto before = as::get_thread_cpu_usage(as::cpu_timing_mode::cpu_time);
+  const auto end = as::now() + 10ms;
+  while (as::now() < end) {
+  }
+  auto after = as::get_thread_cpu_usage(as::cpu_timing_mode::cpu_time);
+
+#if defined(__linux__) || defined(_WIN32)
+  EXPECT_GT(after.cpu_time, before.cpu_time);
+#endif
+}
+
+TEST(cpu_timing, off_cpu_time) {
+  as::function_cpu_timing timing;
+  timing.wall_time = 10ms;
+  timing.cpu_time = 4ms;
+  EXPECT_EQ(timing.off_cpu_time(), 6ms);
+
+  // Clocks of different resolution may make the CPU time exceed the wall time
+  timing.cpu_time = 11ms;
+  EXPECT_EQ(timing.off_cpu_time(), 0ms);
+}
+
+TEST(cpu_timing, summarize) {
+  auto summary = as::summarize_cpu_timings(
+      {make_timing(10ms, 10ms), make_timing(10ms, 0ms)});
+
+  EXPECT_EQ(summary.count, 2ull);
+  EXPECT_EQ(summary.wall_time.sum(), 20ms);
+  EXPECT_EQ(summary.on_cpu_time.sum(), 10ms);
+  EXPECT_EQ(summary.off_cpu_time.sum(), 10ms);
+  EXPECT_EQ(summary.voluntary_context_switches, 2ull);
+  EXPECT_DOUBLE_EQ(summary.get_cpu_fraction(), 0.5);
+}
+
+TEST(cpu_timing, busy_vs_sleeping) {
+  busy_function();
+  sleeping_function();
+
+  auto busy = as::get_measurements<as::function_cpu_timing>("busy_function");
+  auto sleeping =
+      as::get_measurements<as::function_cpu_timing>("sleeping_function");
+  ASSERT_EQ(busy.size(), 1ull);
+  ASSERT_EQ(sleeping.size(), 1ull);
+
+  EXPECT_GE(busy[0].data.wall_time, 20ms);
+  EXPECT_GE(sleeping[0].data.wall_time, 20ms);
+#if defined(__linux__) || defined(_WIN32)
+  EXPECT_GT(busy[0].data.cpu_time, 10ms);
+  EXPECT_LT(sleeping[0].data.cpu_time, 10ms);
+  EXPECT_GT(sleeping[0].data.off_cpu_time(), 10ms);
+#endif
+#if defined(__linux__)
+  EXPECT_GE(sleeping[0].data.voluntary_context_switches, 1ull);
+#endif
+
+  as::clear_measurements<as::function_cpu_timing>();
+}
+
+TEST(cpu_timing, cpu_time_only_mode) {
+  cpu_time_only_function();
+
+  auto timings =
+      as::get_measurements<as::function_cpu_timing>("cpu_time_only_function");
+  ASSERT_EQ(timings.size(), 1ull);
+  EXPECT_GE(timings[0].data.wall_time, 20ms);
+  EXPECT_EQ(timings[0].data.voluntary_context_switches, 0ull);
+  EXPECT_EQ(timings[0].data.involuntary_context_switches, 0ull);
+
+  as::clear_measurements<as::function_cpu_timing>();
+}
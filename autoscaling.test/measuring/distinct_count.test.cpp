@@ -0,0 +1,104 @@
+#include "pch.h"
+
+#include "measuring/distinct_count.h"
+
+using namespace std::chrono_literals;
+
+TEST(distinct_count, counts_per_window) {
+  const auto start = as::timestamp_t{} + 100h;
+  as::set_distinct_count_options("distinct_test.sessions",
+                                 as::distinct_count_options{1min, 12, 10});
+
+  // Four threads see overlapping sessions, 1000 distinct ones per minute
+  std::vector<std::thread> threads;
+  for (uint64_t thread = 0; thread < 4; ++thread) {
+    threads.emplace_back([start, thread]() {
+      for (int minute = 0; minute < 3; ++minute) {
+        for (uint64_t session = 0; session < 1000; session += thread + 1) {
+          as::add_measurement<as::distinct_key>(
+              "distinct_test.sessions", start + minute * 1min + 1s,
+              as::distinct_key{minute * 500ull + session});
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  const auto windows = as::get_distinct_counts("distinct_test.sessions",
+                                               start, start + 1h);
+  ASSERT_EQ(windows.size(), 3ull);
+  for (int minute = 0; minute < 3; ++minute) {
+    EXPECT_EQ(windows[minute].timestamp, start + minute * 1min);
+    EXPECT_NEAR(windows[minute].data.estimate(), 1000.0, 50.0);
+  }
+
+  // Half of the sessions continue into the next minute
+  EXPECT_NEAR(as::estimate_distinct_count("distinct_test.sessions", start,
+                                          start + 1h),
+              2000.0, 100.0);
+  EXPECT_NEAR(as::estimate_distinct_count("distinct_test.sessions",
+                                          start + 90s, start + 1h),
+              1500.0, 75.0);
+
+  EXPECT_THROW(as::get_measurements<as::distinct_key>("distinct_test.sessions"),
+               std::runtime_error);
+  as::clear_measurements<as::distinct_key>("distinct_test.sessions");
+  EXPECT_DOUBLE_EQ(as::estimate_distinct_count("distinct_test.sessions"), 0.0);
+}
+
+TEST(distinct_count, keeps_a_bounded_number_of_windows) {
+  const auto start = as::timestamp_t{} + 200h;
+  as::set_distinct_count_options("distinct_test.keys",
+                                 as::distinct_count_options{1s, 8, 5});
+  for (int second = 0; second < 20; ++second) {
+    as::add_measurement<as::distinct_key>(
+        "distinct_test.keys", start + std::chrono::seconds{second},
+        as::distinct_key{"key." + std::to_string(second)});
+  }
+  // Older than the kept windows
+  as::add_measurement<as::distinct_key>("distinct_test.keys", start,
+                                        as::distinct_key{"late"});
+
+  const auto windows =
+      as::get_distinct_counts("distinct_test.keys", start, start + 1h);
+  ASSERT_EQ(windows.size(), 5ull);
+  EXPECT_EQ(windows.front().timestamp, start + 15s);
+  EXPECT_EQ(windows.front().data.get_precision(), 8u);
+
+  EXPECT_THROW(as::set_distinct_count_options(
+                   "distinct_test.keys", as::distinct_count_options{1s, 20}),
+               std::runtime_error);
+  as::clear_measurements<as::distinct_key>();
+}
+
+TEST(distinct_count, merges_windows_of_exited_threads) {
+  const auto start = as::timestamp_t{} + 300h;
+  as::set_distinct_count_options("distinct_test.exited",
+                                 as::distinct_count_options{1s, 10, 3});
+
+  // Each thread records into a window of its own and the shared one
+  for (int second = 0; second < 6; ++second) {
+    std::thread{[start, second]() {
+      for (uint64_t key = 0; key < 100; ++key) {
+        as::add_measurement<as::distinct_key>(
+            "distinct_test.exited", start + std::chrono::seconds{second},
+            as::distinct_key{second * 1000 + key});
+        as::add_measurement<as::distinct_key>(
+            "distinct_test.exited", start + 10s,
+            as::distinct_key{second * 1000 + key});
+      }
+    }}.join();
+  }
+
+  // The exited threads share one set of windows, so only the newest are kept
+  const auto windows =
+      as::get_distinct_counts("distinct_test.exited", start, start + 1h);
+  ASSERT_EQ(windows.size(), 3ull);
+  EXPECT_EQ(windows[0].timestamp, start + 4s);
+  EXPECT_EQ(windows[1].timestamp, start + 5s);
+  EXPECT_EQ(windows[2].timestamp, start + 10s);
+  EXPECT_NEAR(windows[0].data.estimate(), 100.0, 10.0);
+  EXPECT_NEAR(windows[2].data.estimate(), 600.0, 60.0);
+
+  as::clear_measurements<as::distinct_key>();
+}
@@ -0,0 +1,140 @@
+#include "pch.h"
+
+#include "measuring/folded_stacks.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+as::call_tree_node make_node(std::string name, uint64_t count,
+                             int64_t self_ns,
+                             std::vector<as::call_tree_node> children = {}) {
+  as::call_tree_node node;
+  node.name = std::move(name);
+  node.count = count;
+  node.self_time = std::chrono::nanoseconds{self_ns};
+  node.total_time = node.self_time;
+  for (auto& child : children) node.total_time += child.total_time;
+  node.children = std::move(children);
+  return node;
+}
+
+as::call_tree make_tree(uint32_t thread_index,
+                        std::vector<as::call_tree_node> children) {
+  as::call_tree tree;
+  tree.thread_index = thread_index;
+  tree.root.children = std::move(children);
+  return tree;
+}
+
+std::vector<as::call_tree> make_trees() {
+  return {make_tree(0, {make_node("handle", 1, 100,
+                                  {make_node("parse", 1, 20),
+                                   make_node("db;call", 2, 300)})}),
+          make_tree(1, {make_node("handle", 3, 50, {make_node("parse", 3, 10)}),
+                        make_node("idle", 1, 0)})};
+}
+
+std::string to_folded_stacks(const std::vector<as::call_tree>& trees,
+                             as::folded_stack_options options) {
+  std::stringstream ss;
+  as::write_folded_stacks(ss, trees, options);
+  return ss.str();
+}
+
+}  // namespace
+
+TEST(folded_stacks, merged_self_time) {
+  auto folded = to_folded_stacks(make_trees(), {});
+
+  EXPECT_EQ(folded,
+            "handle 150\n"
+            "handle;parse 30\n"
+            "handle;db_call 300\n");
+}
+
+TEST(folded_stacks, merged_call_count) {
+  as::folded_stack_options options;
+  options.weight = as::folded_stack_weight::call_count;
+  auto folded = to_folded_stacks(make_trees(), options);
+
+  EXPECT_EQ(folded,
+            "handle 4\n"
+            "handle;parse 4\n"
+            "handle;db_call 2\n"
+            "idle 1\n");
+}
+
+TEST(folded_stacks, per_thread) {
+  as::folded_stack_options options;
+  options.merge_threads = false;
+  auto folded = to_folded_stacks(make_trees(), options);
+
+  EXPECT_EQ(folded,
+            "thread-0;handle 100\n"
+            "thread-0;handle;parse 20\n"
+            "thread-0;handle;db_call 300\n"
+            "thread-1;handle 50\n"
+            "thread-1;handle;parse 10\n");
+
+  auto trees = make_trees();
+  trees[1].exited_threads = true;
+  folded = to_folded_stacks(trees, options);
+  EXPECT_NE(folded.find("exited-threads;handle;parse 10\n"),
+            std::string::npos);
+}
+
+TEST(folded_stacks, exemplars) {
+  auto trees = make_trees();
+  auto& parse = trees[0].root.children[0].children[0];
+  as::exemplar slow;
+  slow.value = std::chrono::nanoseconds{15};
+  slow.timestamp = as::timestamp_t{std::chrono::nanoseconds{5000}};
+  slow.request_id = 7;
+  slow.thread_index = 0;
+  parse.exemplars = {slow};
+
+  as::folded_stack_options options;
+  options.merge_threads = false;
+  EXPECT_EQ(to_folded_stacks(trees, options),
+            "thread-0;handle 100\n"
+            "thread-0;handle;parse 20\n"
+            "# exemplar thread-0;handle;parse duration_ns=15 request_id=7 "
+            "timestamp_ns=5000 thread=0\n"
+            "thread-0;handle;db_call 300\n"
+            "thread-1;handle 50\n"
+            "thread-1;handle;parse 10\n");
+
+  // Merged trees keep the exemplars of all threads
+  EXPECT_NE(to_folded_stacks(trees, {}).find(
+                "handle;parse 30\n"
+                "# exemplar handle;parse duration_ns=15 request_id=7 "
+                "timestamp_ns=5000 thread=0\n"),
+            std::string::npos);
+
+  options.exemplars = false;
+  EXPECT_EQ(to_folded_stacks(trees, options).find("# exemplar"),
+            std::string::npos);
+}
+
+TEST(folded_stacks, export_in_background) {
+  as::clear_call_trees();
+  { MEASURE_SCOPE_TIMING("folded_stacks_export"); }
+
+  const auto path =
+      (std::filesystem::temp_directory_path() / "as_folded_stacks.test.txt")
+          .string();
+  as::folded_stack_options options;
+  options.weight = as::folded_stack_weight::call_count;
+  as::export_folded_stacks(path, options).get();
+
+  std::ifstream file{path};
+  std::stringstream ss;
+  ss << file.rdbuf();
+  EXPECT_NE(ss.str().find("folded_stacks_export 1\n"), std::string::npos);
+
+  file.close();
+  std::filesystem::remove(path);
+}
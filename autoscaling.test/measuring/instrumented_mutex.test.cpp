@@ -0,0 +1,108 @@
+#include "pch.h"
+
+#include "measuring/instrumented_mutex.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+as::lock_statistics get_statistics(const std::string& name) {
+  auto statistics = as::get_lock_statistics();
+  auto itr = std::find_if(statistics.begin(), statistics.end(),
+                          [&](auto& s) { return s.name == name; });
+  if (itr == statistics.end()) return {};
+  return *itr;
+}
+
+}  // namespace
+
+TEST(instrumented_mutex, uncontended) {
+  {
+    as::instrumented_mutex<> mutex{"uncontended"};
+    for (uint32_t idx = 0; idx < 10 * as::hold_sample_interval; ++idx) {
+      std::lock_guard<as::instrumented_mutex<>> guard{mutex};
+    }
+    EXPECT_TRUE(mutex.try_lock());
+    mutex.unlock();
+  }
+
+  auto statistics = get_statistics("uncontended");
+  EXPECT_EQ(statistics.acquisitions, 10 * as::hold_sample_interval + 1);
+  EXPECT_EQ(statistics.contended_acquisitions, 0ull);
+  EXPECT_EQ(statistics.wait_time.count(), 0ull);
+  // Only every hold_sample_interval-th acquisition measures the hold time
+  EXPECT_EQ(statistics.hold_time.count(), 10ull);
+  EXPECT_DOUBLE_EQ(statistics.get_contention_ratio(), 0.0);
+
+  as::clear_lock_statistics();
+}
+
+TEST(instrumented_mutex, contended) {
+  {
+    as::instrumented_mutex<> mutex{"contended"};
+    mutex.lock();
+    std::atomic<bool> waiting{false};
+    std::thread waiter{[&]() {
+      waiting = true;
+      std::lock_guard<as::instrumented_mutex<>> guard{mutex};
+    }};
+    while (!waiting) std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    mutex.unlock();
+    waiter.join();
+  }
+
+  auto statistics = get_statistics("contended");
+  EXPECT_EQ(statistics.acquisitions, 2ull);
+  EXPECT_EQ(statistics.contended_acquisitions, 1ull);
+  ASSERT_EQ(statistics.wait_time.count(), 1ull);
+  EXPECT_GE(statistics.wait_time.max(), std::chrono::milliseconds{10});
+  EXPECT_DOUBLE_EQ(statistics.get_contention_ratio(), 0.5);
+
+  as::clear_lock_statistics();
+}
+
+TEST(instrumented_mutex, shared_names) {
+  {
+    as::instrumented_mutex<> first{"shared_name"};
+    as::instrumented_mutex<> second{"shared_name"};
+    first.lock();
+    first.unlock();
+    second.lock();
+    second.unlock();
+  }
+
+  EXPECT_EQ(get_statistics("shared_name").acquisitions, 2ull);
+
+  as::clear_lock_statistics();
+}
+
+TEST(instrumented_mutex, shared_mutex) {
+  {
+    as::instrumented_shared_mutex<> mutex{"shared_mutex"};
+    mutex.lock_shared();
+    EXPECT_TRUE(mutex.try_lock_shared());
+    EXPECT_FALSE(mutex.try_lock());
+    mutex.unlock_shared();
+    mutex.unlock_shared();
+
+    mutex.lock();
+    std::atomic<bool> waiting{false};
+    std::thread reader{[&]() {
+      waiting = true;
+      std::shared_lock<as::instrumented_shared_mutex<>> guard{mutex};
+    }};
+    while (!waiting) std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    mutex.unlock();
+    reader.join();
+  }
+
+  auto statistics = get_statistics("shared_mutex");
+  EXPECT_EQ(statistics.contended_shared_acquisitions, 1ull);
+  EXPECT_EQ(statistics.shared_wait_time.count(), 1ull);
+  EXPECT_EQ(statistics.acquisitions, 1ull);
+
+  as::clear_lock_statistics();
+}
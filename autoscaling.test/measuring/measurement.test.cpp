@@ -1,6 +1,7 @@
 #include "pch.h"
 
 #include "measuring/measurement.h"
+#include "measuring/name_index.h"
 
 void api_description() {
   // Some use cases
@@ -149,6 +150,30 @@ TEST(measurement, add_measurement_primitive_type) {
   as::clear_measurements<type>();
 }
 
+TEST(measurement, add_measurement_with_timestamp) {
+  using type = int;
+  std::string name{"test"};
+
+  auto timestamp = as::now() - std::chrono::seconds{10};
+  as::add_measurement<type>(name, timestamp, 42);
+
+  auto measurements = as::get_measurements<type>(name);
+  ASSERT_EQ(measurements.size(), 1ull);
+  ASSERT_EQ(measurements[0].data, 42);
+  ASSERT_TRUE(timestamp == measurements[0].timestamp);
+
+  as::clear_measurements<type>();
+}
+
+TEST(measurement, intern_name) {
+  std::string name{"interned"};
+  auto interned = as::intern_name(name);
+  name = "changed";
+
+  ASSERT_EQ(interned, "interned");
+  ASSERT_EQ(as::intern_name("interned").data(), interned.data());
+}
+
 TEST(measurement, add_measurement_complex_type) {
   using type = std::string;
   std::string name{"test"};
@@ -264,6 +289,233 @@ TEST(measurement, add_multiple_measurements_different_names) {
   as::clear_measurements<int>();
 }
 
+TEST(measurement, get_measurements_in_time_range) {
+  using namespace std::chrono_literals;
+  const auto start = as::timestamp_t{} + 1h;
+  as::add_measurement<int>("time_range", start + 2s, 2);
+  as::add_measurement<int>("time_range", start, 0);
+  as::add_measurement<int>("time_range", start + 1s, 1);
+
+  auto measurements =
+      as::get_measurements<int>("time_range", start + 1s, start + 2s);
+  ASSERT_EQ(measurements.size(), 2ull);
+  EXPECT_EQ(measurements[0].data, 2);
+  EXPECT_EQ(measurements[1].data, 1);
+
+  EXPECT_EQ(as::get_measurements<int>("time_range").size(), 3ull);
+  EXPECT_EQ(as::get_measurements<int>("time_range", start + 3s).size(), 0ull);
+
+  as::clear_measurements<int>();
+}
+
+TEST(measurement, get_measurements_in_time_range_ordered) {
+  using namespace std::chrono_literals;
+  const auto start = as::timestamp_t{} + 1h;
+  const auto values = [](const std::vector<as::measurement<int>>& ms) {
+    std::vector<int> ret;
+    for (auto& m : ms) ret.push_back(m.data);
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  };
+  for (int idx = 0; idx < 10; ++idx) {
+    as::add_measurement<int>("ordered", start + idx * 1s, idx);
+    as::add_measurement<int>("ordered_cache", start + idx * 1s, idx);
+  }
+  as::add_measurement<int>("ordered", start + 9s, 10);
+  as::set_cache_size<int>("ordered_cache", 8);
+
+  for (auto name : {"ordered", "ordered_cache"}) {
+    EXPECT_EQ(values(as::get_measurements<int>(name, start + 3s, start + 5s)),
+              (std::vector<int>{3, 4, 5}));
+    EXPECT_TRUE(as::get_measurements<int>(name, start + 10s).empty());
+  }
+  EXPECT_EQ(values(as::get_measurements<int>("ordered", start + 9s)),
+            (std::vector<int>{9, 10}));
+  EXPECT_EQ(values(as::get_measurements<int>("ordered_cache", start,
+                                             start + 2s)),
+            (std::vector<int>{2}));
+
+  // Older measurements added later are still found
+  as::add_measurement<int>("ordered", start + 4s, 11);
+  as::add_measurement<int>("ordered_cache", start + 4s, 11);
+  for (auto name : {"ordered", "ordered_cache"}) {
+    EXPECT_EQ(values(as::get_measurements<int>(name, start + 3s, start + 5s)),
+              (std::vector<int>{3, 4, 5, 11}));
+  }
+
+  as::clear_measurements<int>();
+}
+
+TEST(measurement, set_cache_size) {
+  for (int idx = 0; idx < 10; ++idx) as::add_measurement<int>("cached", idx);
+
+  // Keeps the newest measurements
+  as::set_cache_size<int>("cached", 4);
+  auto measurements = as::get_measurements<int>("cached");
+  ASSERT_EQ(measurements.size(), 4ull);
+  for (int idx = 10; idx < 20; ++idx) as::add_measurement<int>("cached", idx);
+  measurements = as::get_measurements<int>("cached");
+  ASSERT_EQ(measurements.size(), 4ull);
+  std::vector<int> values;
+  for (auto& m : measurements) values.push_back(m.data);
+  std::sort(values.begin(), values.end());
+  EXPECT_EQ(values, (std::vector<int>{16, 17, 18, 19}));
+
+  // Dropped measurements stay dropped
+  as::set_cache_size<int>("cached", as::cache_size_infinite);
+  for (int idx = 20; idx < 30; ++idx) as::add_measurement<int>("cached", idx);
+  EXPECT_EQ(as::get_measurements<int>("cached").size(), 14ull);
+
+  as::clear_measurements<int>();
+}
+
+TEST(measurement, set_storage_options_sample) {
+  using namespace std::chrono_literals;
+  const auto start = as::timestamp_t{} + 2h;
+  for (int idx = 0; idx < 100; ++idx)
+    as::add_measurement<int>("sampled", start + std::chrono::seconds{idx}, idx);
+
+  // The existing measurements are sampled too
+  as::set_storage_options<int>(
+      "sampled", as::storage_options{as::storage_mode::uniform_sample, 20});
+  EXPECT_EQ(as::get_measurements<int>("sampled", start, start + 1h).size(),
+            20ull);
+  for (int idx = 100; idx < 10000; ++idx)
+    as::add_measurement<int>("sampled", start + std::chrono::seconds{idx}, idx);
+  auto measurements = as::get_measurements<int>("sampled", start, start + 5h);
+  ASSERT_EQ(measurements.size(), 20ull);
+  const auto old = std::count_if(measurements.begin(), measurements.end(),
+                                 [](const auto& m) { return m.data < 5000; });
+  EXPECT_GT(old, 0);
+
+  // Newer measurements dominate a decaying sample
+  as::set_storage_options<int>(
+      "sampled", as::storage_options{as::storage_mode::decaying_sample, 20,
+                                     std::chrono::seconds{60}});
+  for (int idx = 10000; idx < 20000; ++idx)
+    as::add_measurement<int>("sampled", start + std::chrono::seconds{idx}, idx);
+  measurements = as::get_measurements<int>("sampled", start, start + 10h);
+  ASSERT_EQ(measurements.size(), 20ull);
+  for (auto& m : measurements) EXPECT_GE(m.data, 19000);
+
+  as::clear_measurements<int>();
+}
+
+TEST(measurement, set_series_limit) {
+  // A type of its own, so that series of other tests do not count
+  struct tenant_request {
+    int tenant;
+  };
+  as::set_series_limit<tenant_request>(as::series_limit{3, "other", 4});
+
+  // Tenant 0 is hot, the others are rare
+  for (int idx = 0; idx < 1000; ++idx) {
+    const auto tenant = idx % 2 ? 0 : idx % 50;
+    // The storage copies the names of the series it creates
+    as::add_measurement<tenant_request>("tenant." + std::to_string(tenant),
+                                        tenant_request{tenant});
+  }
+
+  // The first three tenants have a series, all others overflow
+  EXPECT_EQ(as::get_measurements<tenant_request>("tenant.0").size(), 520ull);
+  EXPECT_EQ(as::get_measurements<tenant_request>("tenant.2").size(), 20ull);
+  EXPECT_EQ(as::get_measurements<tenant_request>("tenant.4").size(), 20ull);
+  EXPECT_TRUE(as::get_measurements<tenant_request>("tenant.6").empty());
+  EXPECT_EQ(as::get_measurements<tenant_request>("other").size(), 440ull);
+  EXPECT_EQ(as::get_series_names<tenant_request>("tenant").size(), 3ull);
+
+  const auto top = as::get_heavy_hitters<tenant_request>();
+  ASSERT_EQ(top.size(), 4ull);
+  EXPECT_EQ(top[0].name, "tenant.0");
+  EXPECT_EQ(top[0].count, 520ull);
+  EXPECT_EQ(top[0].error, 0ull);
+  EXPECT_GE(as::estimate_measurement_count<tenant_request>("tenant.48"),
+            20ull);
+  EXPECT_LT(as::estimate_measurement_count<tenant_request>("tenant.48"),
+            100ull);
+
+  as::clear_measurements<tenant_request>();
+  EXPECT_TRUE(as::get_heavy_hitters<tenant_request>().empty());
+}
+
+TEST(measurement, labels) {
+  using namespace std::chrono_literals;
+  const auto a = as::intern_labels({{"endpoint", "/a"}, {"shard", "1"}});
+  EXPECT_EQ(a, as::intern_labels({{"shard", "1"}, {"endpoint", "/a"}}));
+  EXPECT_NE(a, as::label_set_t{});
+  EXPECT_EQ(as::get_label(a, "shard"), "1");
+  EXPECT_TRUE(as::get_label(a, "region").empty());
+  ASSERT_EQ(as::get_labels(a).size(), 2ull);
+  EXPECT_EQ(as::get_labels(a)[0].first, "endpoint");
+  EXPECT_THROW(as::intern_labels({{"shard", "1"}, {"shard", "2"}}),
+               std::runtime_error);
+
+  // Four series of the same name and an unlabeled one
+  const auto start = as::timestamp_t{} + 3h;
+  int value = 0;
+  for (auto endpoint : {"/a", "/b"}) {
+    for (auto shard : {"1", "2"}) {
+      const auto labels =
+          as::intern_labels({{"endpoint", endpoint}, {"shard", shard}});
+      for (int idx = 0; idx < 3; ++idx) {
+        ++value;
+        as::add_measurement<int>("labeled", labels,
+                                 start + std::chrono::seconds{value}, value);
+      }
+    }
+  }
+  as::add_measurement<int>("labeled", start, 100);
+
+  EXPECT_EQ(as::get_measurements<int>("labeled", start, start + 1h).size(),
+            1ull);
+  EXPECT_EQ(as::get_measurements<int>("labeled", a, start, start + 1h).size(),
+            3ull);
+
+  auto selected = as::select_measurements<int>(
+      "labeled", {{"endpoint", as::label_match::equal, "/b"}}, start,
+      start + 1h);
+  ASSERT_EQ(selected.size(), 2ull);
+  for (auto& series : selected) {
+    EXPECT_EQ(as::get_label(series.labels, "endpoint"), "/b");
+    EXPECT_EQ(series.measurements.size(), 3ull);
+  }
+  selected = as::select_measurements<int>(
+      "labeled",
+      {{"shard", as::label_match::not_equal, "2"},
+       {"endpoint", as::label_match::regex, "/[ab]"}},
+      start, start + 1h);
+  EXPECT_EQ(selected.size(), 2ull);
+  // Missing labels are empty, which selects the unlabeled series
+  selected = as::select_measurements<int>(
+      "labeled", {{"endpoint", as::label_match::equal, ""}}, start,
+      start + 1h);
+  ASSERT_EQ(selected.size(), 1ull);
+  EXPECT_EQ(selected[0].measurements[0].data, 100);
+
+  // Across shards, for each endpoint
+  const auto by_endpoint = as::aggregate_measurements<int>(
+      "labeled", {{"endpoint", as::label_match::not_equal, ""}}, {"endpoint"},
+      start, start + 1h);
+  ASSERT_EQ(by_endpoint.size(), 2ull);
+  for (auto& group : by_endpoint) {
+    ASSERT_EQ(group.measurements.size(), 6ull);
+    EXPECT_EQ(as::get_labels(group.labels).size(), 1ull);
+    EXPECT_TRUE(std::is_sorted(group.measurements.begin(),
+                               group.measurements.end(),
+                               [](const auto& l, const auto& r) {
+                                 return l.timestamp < r.timestamp;
+                               }));
+  }
+  const auto total =
+      as::aggregate_measurements<int>("labeled", {}, {}, start, start + 1h);
+  ASSERT_EQ(total.size(), 1ull);
+  EXPECT_EQ(total[0].labels, as::label_set_t{});
+  EXPECT_EQ(total[0].measurements.size(), 13ull);
+
+  as::clear_measurements<int>("labeled");
+  EXPECT_TRUE(as::select_measurements<int>("labeled", {}).empty());
+}
+
 TEST(measurement, is_thread_local_false) {
   ASSERT_FALSE(as::is_measured_for_each_thread<int>("test"));
 }
@@ -0,0 +1,223 @@
+#include "pch.h"
+
+#include "measuring/metric_config.h"
+#include "simulation/virtual_clock.h"
+
+#include <cstdio>
+#include <fstream>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+/// <summary>
+/// Removes the metric configuration at the end of a test
+/// </summary>
+struct scoped_metric_config {
+  explicit scoped_metric_config(as::metric_config config) {
+    as::set_metric_config(
+        std::make_shared<const as::metric_config>(std::move(config)));
+  }
+  ~scoped_metric_config() { as::set_metric_config(nullptr); }
+};
+
+void write_file(const std::string& path, std::string_view content) {
+  std::ofstream file{path, std::ios::binary | std::ios::trunc};
+  file << content;
+}
+
+}  // namespace
+
+TEST(metric_config, parse) {
+  const auto config = as::metric_config::parse(R"(
+# Production overrides
+[*]
+sampling_rate = 0.25
+
+[config_test.a]   # trailing comment
+enabled = false
+for_each_thread = true
+cache_size = 100
+retention = 10m
+
+[config_test.b]
+cache_size = infinite
+retention = 0
+)");
+  EXPECT_EQ(config.size(), 2ull);
+
+  const auto* a = config.find("config_test.a");
+  ASSERT_NE(a, nullptr);
+  EXPECT_FALSE(a->enabled);
+  EXPECT_TRUE(a->for_each_thread);
+  EXPECT_EQ(a->cache_size.value_or(0), 100ull);
+  EXPECT_EQ(a->retention, 10min);
+  EXPECT_DOUBLE_EQ(a->sampling_rate, 1.0);
+
+  const auto* b = config.find("config_test.b");
+  ASSERT_NE(b, nullptr);
+  EXPECT_EQ(b->cache_size.value_or(0), as::cache_size_infinite);
+
+  const auto* other = config.find("config_test.other");
+  ASSERT_NE(other, nullptr);
+  EXPECT_DOUBLE_EQ(other->sampling_rate, 0.25);
+  EXPECT_FALSE(other->cache_size.has_value());
+  EXPECT_EQ(as::metric_config::parse("[x]").find("y"), nullptr);
+
+  const auto message = [](std::string_view text) -> std::string {
+    try {
+      as::metric_config::parse(text);
+    } catch (const std::runtime_error& e) {
+      return e.what();
+    }
+    return "";
+  };
+  EXPECT_EQ(message("enabled = true"),
+            "Invalid metric configuration at line 1: property outside of a "
+            "section");
+  EXPECT_EQ(message("[x]\nenabled = yes"),
+            "Invalid metric configuration at line 2: expected true or false");
+  EXPECT_EQ(message("[x]\n\nsampling_rate = 2"),
+            "Invalid metric configuration at line 3: sampling_rate must be in "
+            "[0;1]");
+  EXPECT_EQ(message("[x]\nretention = 5d"),
+            "Invalid metric configuration at line 2: expected a unit of ms, s, "
+            "m or h");
+  EXPECT_EQ(message("[x]\nretention = 99999999999999999999s"),
+            "Invalid metric configuration at line 2: duration out of range");
+  EXPECT_EQ(message("[x]\nretention = 9223372036854775807h"),
+            "Invalid metric configuration at line 2: duration out of range");
+  EXPECT_EQ(message("[x]\nretention = -5s"),
+            "Invalid metric configuration at line 2: expected a duration");
+  EXPECT_EQ(message("[x]\ncolor = red"),
+            "Invalid metric configuration at line 2: unknown property 'color'");
+  EXPECT_EQ(message("[x"),
+            "Invalid metric configuration at line 1: expected ']'");
+}
+
+TEST(metric_config, applies_to_recording) {
+  const auto start = as::timestamp_t{} + 130h;
+  as::virtual_clock clock{start};
+  as::scoped_clock guard{clock};
+
+  scoped_metric_config config{as::metric_config::parse(R"(
+[config_test.disabled]
+enabled = false
+[config_test.sampled]
+sampling_rate = 0.5
+[config_test.cached]
+cache_size = 10
+[config_test.retained]
+retention = 10s
+[config_test.threads]
+for_each_thread = true
+)")};
+
+  for (int idx = 1; idx <= 1000; ++idx) {
+    clock.set(start + std::chrono::seconds{idx});
+    as::add_measurement<int>("config_test.disabled", idx);
+    as::add_measurement<int>("config_test.sampled", idx);
+    as::add_measurement<int>("config_test.cached", idx);
+    as::add_measurement<int>("config_test.retained", idx);
+  }
+
+  EXPECT_TRUE(as::get_measurements<int>("config_test.disabled").empty());
+  const auto sampled = as::get_measurements<int>("config_test.sampled").size();
+  EXPECT_GT(sampled, 400ull);
+  EXPECT_LT(sampled, 600ull);
+
+  const auto cached = as::get_measurements<int>("config_test.cached");
+  ASSERT_EQ(cached.size(), 10ull);
+  std::vector<int> values;
+  for (auto& m : cached) values.push_back(m.data);
+  std::sort(values.begin(), values.end());
+  EXPECT_EQ(values.front(), 991);
+  EXPECT_EQ(values.back(), 1000);
+
+  // Seconds 990 to 1000
+  EXPECT_EQ(as::get_measurements<int>("config_test.retained").size(), 11ull);
+
+  EXPECT_TRUE(as::is_measured_for_each_thread<int>("config_test.threads"));
+  as::add_measurement<int>("config_test.threads", 1);
+  EXPECT_EQ(as::get_measurements_for_thread<int>("config_test.threads",
+                                                 std::this_thread::get_id())
+                .size(),
+            1ull);
+
+  as::clear_measurements<int>();
+}
+
+TEST(metric_config, applies_changes_to_existing_series) {
+  const auto add = [](int value) {
+    as::add_measurement<int>("config_test.changed", value);
+  };
+  add(1);
+  {
+    scoped_metric_config config{as::metric_config::parse(R"(
+[config_test.changed]
+enabled = true
+)")};
+    add(2);
+    // The cached properties are replaced by the new configuration
+    as::set_metric_config(std::make_shared<const as::metric_config>(
+        as::metric_config::parse("[config_test.changed]\nenabled = false")));
+    add(3);
+  }
+  add(4);
+
+  std::vector<int> values;
+  for (auto& m : as::get_measurements<int>("config_test.changed"))
+    values.push_back(m.data);
+  EXPECT_EQ(values, (std::vector<int>{1, 2, 4}));
+
+  as::clear_measurements<int>();
+}
+
+TEST(metric_config, keeps_cache_size_set_in_code) {
+  as::set_cache_size<int>("config_test.code_cached", 3);
+  scoped_metric_config config{as::metric_config::parse(R"(
+[*]
+sampling_rate = 1
+)")};
+
+  for (int idx = 0; idx < 13; ++idx)
+    as::add_measurement<int>("config_test.code_cached", idx);
+  EXPECT_EQ(as::get_measurements<int>("config_test.code_cached").size(), 3ull);
+
+  as::set_cache_size<int>("config_test.code_cached", as::cache_size_infinite);
+  as::clear_measurements<int>();
+}
+
+TEST(metric_config, watcher_reloads_changes) {
+  const std::string path = "metric_config_test.conf";
+  write_file(path, "[config_test.watched]\nenabled = false\n");
+  {
+    as::metric_config_watcher watcher{{path, 10ms}};
+    EXPECT_EQ(watcher.get_reload_count(), 1ull);
+    ASSERT_NE(as::get_metric_config(), nullptr);
+    EXPECT_FALSE(as::get_metric_config()->find("config_test.watched")->enabled);
+
+    // Unchanged content is not applied again
+    EXPECT_FALSE(watcher.reload());
+    EXPECT_EQ(watcher.get_reload_count(), 1ull);
+
+    // Invalid content keeps the applied configuration
+    write_file(path, "[config_test.watched]\nenabled = maybe\n");
+    EXPECT_FALSE(watcher.reload());
+    EXPECT_NE(watcher.get_last_error().find("line 2"), std::string::npos);
+    EXPECT_FALSE(as::get_metric_config()->find("config_test.watched")->enabled);
+
+    // The background thread picks up the change
+    write_file(path, "[config_test.watched]\nenabled = true\n");
+    for (int idx = 0; idx < 500 && watcher.get_reload_count() < 2; ++idx)
+      std::this_thread::sleep_for(10ms);
+    EXPECT_EQ(watcher.get_reload_count(), 2ull);
+    EXPECT_TRUE(watcher.get_last_error().empty());
+    EXPECT_TRUE(as::get_metric_config()->find("config_test.watched")->enabled);
+  }
+  as::set_metric_config(nullptr);
+  std::remove(path.c_str());
+
+  EXPECT_THROW(as::metric_config_watcher({"does_not_exist.conf"}),
+               std::runtime_error);
+}
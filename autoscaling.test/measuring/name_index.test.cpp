@@ -0,0 +1,67 @@
+#include "pch.h"
+
+#include "measuring/name_index.h"
+
+using namespace std::chrono_literals;
+
+TEST(name_index, enumerates_prefixes) {
+  as::add_measurement<double>("index_test.db.pool.wait", 1.0);
+  as::add_measurement<double>("index_test.db.query.parse", 2.0);
+  as::add_measurement<double>("index_test.db.query.execute", 3.0);
+  as::add_measurement<int>("index_test.db.connections", 4);
+  as::add_measurement<double>("index_test.dbx", 5.0);
+
+  const auto names = as::get_series_names("index_test.db");
+  const std::vector<std::string_view> expected{
+      "index_test.db.connections", "index_test.db.pool.wait",
+      "index_test.db.query.execute", "index_test.db.query.parse"};
+  EXPECT_EQ(names, expected);
+  EXPECT_EQ(as::get_series_names("index_test.db.query.").size(), 2ull);
+  EXPECT_EQ(as::get_series_names<int>("index_test.db").size(), 1ull);
+  EXPECT_TRUE(as::get_series_names("index_test.none").empty());
+  EXPECT_EQ(as::get_series_names("index_test.db.query.parse").size(), 1ull);
+
+  as::clear_measurements<double>();
+  as::clear_measurements<int>();
+}
+
+TEST(name_index, aggregates_prefixes) {
+  const auto start = as::timestamp_t{} + 4h;
+  const auto shard = as::intern_labels({{"shard", "1"}});
+  as::add_measurement<int>("index_test.cache.hits", start + 3s, 3);
+  as::add_measurement<int>("index_test.cache.misses", start + 1s, 1);
+  as::add_measurement<int>("index_test.cache.misses", shard, start + 2s, 2);
+  as::add_measurement<int>("index_test.cachex", start + 4s, 4);
+
+  const auto measurements =
+      as::get_measurements_by_prefix<int>("index_test.cache", start,
+                                          start + 1h);
+  ASSERT_EQ(measurements.size(), 3ull);
+  for (int idx = 0; idx < 3; ++idx)
+    EXPECT_EQ(measurements[idx].data, idx + 1);
+
+  as::clear_measurements<int>();
+}
+
+TEST(name_index, disables_prefixes) {
+  as::set_prefix_enabled("index_test.noisy", false);
+  as::add_measurement<int>("index_test.noisy.a", 1);
+  as::add_measurement<int>("index_test.noisy.b.c", 1);
+  as::add_measurement<int>("index_test.noisyx", 1);
+  EXPECT_TRUE(as::get_measurements<int>("index_test.noisy.a").empty());
+  EXPECT_TRUE(as::get_measurements<int>("index_test.noisy.b.c").empty());
+  EXPECT_EQ(as::get_measurements<int>("index_test.noisyx").size(), 1ull);
+
+  // A nested prefix can't enable names while the outer prefix is disabled
+  as::set_prefix_enabled("index_test.noisy.b", true);
+  as::add_measurement<int>("index_test.noisy.b.c", 1);
+  EXPECT_TRUE(as::get_measurements<int>("index_test.noisy.b.c").empty());
+
+  as::set_prefix_enabled("index_test.noisy.", true);
+  as::add_measurement<int>("index_test.noisy.a", 1);
+  EXPECT_EQ(as::get_measurements<int>("index_test.noisy.a").size(), 1ull);
+  as::add_measurement<int>("index_test.noisy.b.c", 1);
+  EXPECT_EQ(as::get_measurements<int>("index_test.noisy.b.c").size(), 1ull);
+
+  as::clear_measurements<int>();
+}
@@ -0,0 +1,90 @@
+#include "pch.h"
+
+#include "measuring/perf_counters.h"
+
+#include <vector>
+
+namespace {
+
+volatile uint64_t s_sink = 0;
+
+void counted_function() {
+  MEASURE_FUNCTION_PERF_COUNTERS;
+  for (int idx = 0; idx < 1000000; ++idx) s_sink = s_sink + idx;
+  // Touch fresh memory to cause page faults
+  std::vector<char> memory(16 << 20);
+  for (size_t idx = 0; idx < memory.size(); idx += 4096) memory[idx] = 1;
+  s_sink = s_sink + memory[4096];
+}
+
+}  // namespace
+
+TEST(perf_counters, instructions_per_cycle) {
+  as::perf_counter_values values;
+  EXPECT_EQ(values.get_instructions_per_cycle(), 0.0);
+
+  values.cycles = 1000;
+  values.instructions = 2500;
+  EXPECT_DOUBLE_EQ(values.get_instructions_per_cycle(), 2.5);
+}
+
+TEST(perf_counters, difference) {
+  as::perf_counter_values l, r;
+  l.cycles = 10;
+  l.page_faults = 5;
+  r.cycles = 4;
+  r.page_faults = 2;
+
+  auto delta = l - r;
+  EXPECT_EQ(delta.cycles, 6ull);
+  EXPECT_EQ(delta.page_faults, 3ull);
+}
+
+TEST(perf_counters, scaled) {
+  as::perf_counter_values values;
+  values.cycles = 1000;
+  values.instructions = 3000;
+  values.page_faults = 7;
+  values.time_enabled = as::timespan_t{400};
+  values.time_running = as::timespan_t{400};
+  EXPECT_FALSE(values.is_multiplexed());
+  EXPECT_EQ(values.get_scaled().cycles, 1000ull);
+
+  // Counting only a quarter of the time, software counters aren't scaled
+  values.time_running = as::timespan_t{100};
+  EXPECT_TRUE(values.is_multiplexed());
+  auto scaled = values.get_scaled();
+  EXPECT_EQ(scaled.cycles, 4000ull);
+  EXPECT_EQ(scaled.instructions, 12000ull);
+  EXPECT_EQ(scaled.page_faults, 7ull);
+  EXPECT_DOUBLE_EQ(scaled.get_instructions_per_cycle(), 3.0);
+
+  values.time_running = as::timespan_t{0};
+  EXPECT_EQ(values.get_scaled().cycles, 1000ull);
+}
+
+TEST(perf_counters, scope_measurement) {
+  counted_function();
+
+  auto measurements =
+      as::get_measurements<as::perf_counter_values>("counted_function");
+  const auto source = as::get_perf_counter_source();
+  if (source == as::perf_counter_source::unavailable) {
+    EXPECT_TRUE(measurements.empty());
+    return;
+  }
+
+  ASSERT_EQ(measurements.size(), 1ull);
+  auto& values = measurements[0].data;
+  EXPECT_GT(values.task_clock, as::timespan_t{0});
+  EXPECT_GT(values.page_faults, 0ull);
+  if (source == as::perf_counter_source::hardware) {
+    EXPECT_GT(values.time_enabled, as::timespan_t{0});
+    EXPECT_GT(values.cycles, 0ull);
+    EXPECT_GT(values.instructions, 1000000ull);
+  } else {
+    EXPECT_EQ(values.cycles, 0ull);
+  }
+
+  as::clear_measurements<as::perf_counter_values>();
+}
@@ -0,0 +1,224 @@
+#include "pch.h"
+
+#include "measuring/query.h"
+#include "scaling/composite_policy.h"
+#include "simulation/virtual_clock.h"
+
+#include <clocale>
+#include <cmath>
+#include <string>
+
+using namespace std::chrono_literals;
+
+TEST(query, functions_of_windows) {
+  const auto start = as::timestamp_t{} + 120h;
+  as::virtual_clock clock{start};
+  as::scoped_clock guard{clock};
+
+  // 1 to 10, only 6 to 10 within a 5s window
+  for (int second = 1; second <= 10; ++second) {
+    clock.set(start + std::chrono::seconds{second});
+    as::add_measurement<double>("query_test.values",
+                                static_cast<double>(second));
+  }
+
+  const auto evaluate = [](std::string_view text) {
+    return as::query{text}.evaluate();
+  };
+  EXPECT_DOUBLE_EQ(evaluate("last(double{name=\"query_test.values\"}[5s])"),
+                   10.0);
+  EXPECT_DOUBLE_EQ(evaluate("count(double{name=\"query_test.values\"}[5s])"),
+                   5.0);
+  EXPECT_DOUBLE_EQ(evaluate("sum(double{name=\"query_test.values\"}[5s])"),
+                   40.0);
+  EXPECT_DOUBLE_EQ(evaluate("avg(double{name=\"query_test.values\"}[5s])"),
+                   8.0);
+  EXPECT_DOUBLE_EQ(evaluate("min(double{name=\"query_test.values\"}[5s])"),
+                   6.0);
+  EXPECT_DOUBLE_EQ(evaluate("max(double{name=\"query_test.values\"}[1m])"),
+                   10.0);
+  EXPECT_DOUBLE_EQ(evaluate("rate(double{name=\"query_test.values\"}[5s])"),
+                   1.0);
+  EXPECT_DOUBLE_EQ(evaluate("p50(double{name=\"query_test.values\"}[5s])"),
+                   8.0);
+  EXPECT_DOUBLE_EQ(
+      evaluate("quantile(0.2, double{name=\"query_test.values\"}[10s])"),
+      2.0);
+  EXPECT_DOUBLE_EQ(
+      evaluate("-(max(double{name=\"query_test.values\"}[5s]) - "
+               "min(double{name=\"query_test.values\"}[5s])) * 2 / 4 + 1"),
+      -1.0);
+  EXPECT_DOUBLE_EQ(
+      evaluate("count(double{name=\"query_test.values\"}[5s]) > 4 && "
+               "!(last(double{name=\"query_test.values\"}[5s]) >= 11)"),
+      1.0);
+  EXPECT_DOUBLE_EQ(evaluate("1 < 2 || 3 <= 2"), 1.0);
+
+  // Empty windows
+  EXPECT_DOUBLE_EQ(evaluate("count(double{name=\"query_test.none\"}[5s])"),
+                   0.0);
+  EXPECT_TRUE(
+      std::isnan(evaluate("p99(double{name=\"query_test.none\"}[5s])")));
+  EXPECT_DOUBLE_EQ(evaluate("p99(double{name=\"query_test.none\"}[5s]) > 1"),
+                   0.0);
+
+  as::clear_measurements<double>();
+}
+
+TEST(query, updates_incrementally) {
+  const auto start = as::timestamp_t{} + 121h;
+  as::virtual_clock clock{start};
+  as::scoped_clock guard{clock};
+
+  as::query latency_per_request{
+      "p99(function_timing{name=\"query_test.handle\"}[1m]) / "
+      "rate(periodic_event{name=\"query_test.request\"}[1m]) + "
+      "0 * max(function_timing{name=\"query_test.handle\"}[1m])"};
+  EXPECT_EQ(latency_per_request.get_window_count(), 2ull);
+
+  for (int second = 1; second <= 300; ++second) {
+    clock.set(start + std::chrono::seconds{second});
+    // 10 requests per second, one slow request every 100
+    for (int request = 0; request < 10; ++request) {
+      as::add_measurement<as::periodic_event>("query_test.request");
+      as::add_measurement<as::function_timing>(
+          "query_test.handle",
+          (second * 10 + request) % 100 == 0 ? 500ms : 10ms);
+    }
+
+    const auto value = latency_per_request.evaluate();
+    if (second >= 60) {
+      // p99 of 600 calls with 6 slow ones over 10 requests per second
+      EXPECT_NEAR(value, 0.01 / 10.0, 1e-9);
+    }
+  }
+  // Every measurement was read exactly once
+  EXPECT_EQ(latency_per_request.get_samples_read(), 300ull * 10 * 2);
+
+  // Matches a query compiled from scratch
+  as::query fresh{latency_per_request.get_text()};
+  EXPECT_DOUBLE_EQ(fresh.evaluate(), latency_per_request.evaluate());
+
+  // Slow calls only
+  for (int second = 301; second <= 420; ++second) {
+    clock.set(start + std::chrono::seconds{second});
+    as::add_measurement<as::periodic_event>("query_test.request");
+    as::add_measurement<as::function_timing>("query_test.handle", 2s);
+    latency_per_request.evaluate();
+  }
+  EXPECT_NEAR(latency_per_request.evaluate(), 2.0 / (60.0 / 60.0), 1e-9);
+
+  as::clear_measurements<as::periodic_event>();
+  as::clear_measurements<as::function_timing>();
+}
+
+TEST(query, parse_errors) {
+  const auto message = [](std::string_view text) -> std::string {
+    try {
+      as::query{text};
+    } catch (const std::runtime_error& e) {
+      return e.what();
+    }
+    return "";
+  };
+  EXPECT_EQ(message(""), "Invalid query at 0: expected an identifier");
+  EXPECT_EQ(message("p98(double{name=\"x\"}[1s])"),
+            "Invalid query at 0: unknown function 'p98'");
+  EXPECT_EQ(message("avg(string{name=\"x\"}[1s])"),
+            "Invalid query at 10: unknown type 'string'");
+  EXPECT_EQ(message("avg(double{name=\"x\"}[1d])"),
+            "Invalid query at 22: expected a unit of ms, s, m or h");
+  EXPECT_EQ(message("avg(double{name=\"x\"}[1s]"),
+            "Invalid query at 24: expected ')'");
+  EXPECT_EQ(message("avg(double{host=\"x\"}[1s])"),
+            "Invalid query at 19: expected the label 'name'");
+  EXPECT_EQ(message("avg(double{name=\"x\", host=~\"(\"}[1s])"),
+            "Invalid query at 27: invalid regular expression");
+  EXPECT_EQ(message("quantile(2, double{name=\"x\"}[1s])"),
+            "Invalid query at 10: quantile must be in [0;1]");
+  EXPECT_EQ(message("1 + 2 )"), "Invalid query at 6: unexpected input");
+}
+
+TEST(query, numbers_ignore_locale) {
+  const char* const decimal_comma_locales[] = {"de_DE.UTF-8", "de_DE",
+                                               "German_Germany.1252"};
+  const std::string previous = std::setlocale(LC_NUMERIC, nullptr);
+  bool changed = false;
+  for (auto locale : decimal_comma_locales)
+    changed = changed || std::setlocale(LC_NUMERIC, locale);
+  if (!changed) GTEST_SKIP() << "No locale with a decimal comma installed";
+
+  EXPECT_DOUBLE_EQ(as::query{"0.25 * 2"}.evaluate(), 0.5);
+  EXPECT_NO_THROW(
+      as::query{"quantile(0.99, double{name=\"query_test.x\"}[1.5s])"});
+  std::setlocale(LC_NUMERIC, previous.c_str());
+}
+
+TEST(query, label_matchers) {
+  const auto start = as::timestamp_t{} + 123h;
+  as::virtual_clock clock{start};
+  as::scoped_clock guard{clock};
+
+  const auto eu_1 = as::intern_labels({{"region", "eu-1"}, {"shard", "1"}});
+  const auto eu_2 = as::intern_labels({{"region", "eu-2"}, {"shard", "2"}});
+  const auto us = as::intern_labels({{"region", "us"}, {"shard", "1"}});
+  clock.set(start + 1s);
+  as::add_measurement<double>("query_test.labeled", eu_1, 1.0);
+  as::add_measurement<double>("query_test.labeled", eu_2, 2.0);
+  as::add_measurement<double>("query_test.labeled", us, 4.0);
+  as::add_measurement<double>("query_test.labeled", 8.0);
+
+  const auto evaluate = [](std::string_view text) {
+    return as::query{text}.evaluate();
+  };
+  EXPECT_DOUBLE_EQ(evaluate("sum(double{name=\"query_test.labeled\"}[1m])"),
+                   8.0);
+  EXPECT_DOUBLE_EQ(
+      evaluate("sum(double{name=\"query_test.labeled\", "
+               "region=~\"eu-.*\"}[1m])"),
+      3.0);
+  EXPECT_DOUBLE_EQ(
+      evaluate("sum(double{shard=\"1\", name=\"query_test.labeled\"}[1m])"),
+      5.0);
+  EXPECT_DOUBLE_EQ(
+      evaluate("sum(double{name=\"query_test.labeled\", region!~\"eu-.*\", "
+               "shard!=\"\"}[1m])"),
+      4.0);
+
+  // Selectors with different matchers don't share their window
+  as::query query{
+      "max(double{name=\"query_test.labeled\", region=\"us\"}[1m]) - "
+      "max(double{name=\"query_test.labeled\", region!=\"us\"}[1m])"};
+  EXPECT_EQ(query.get_window_count(), 2ull);
+  EXPECT_DOUBLE_EQ(query.evaluate(), -4.0);
+
+  as::clear_measurements<double>();
+}
+
+TEST(query, composite_policy_rules) {
+  const auto start = as::timestamp_t{} + 122h;
+  as::virtual_clock clock{start};
+  as::scoped_clock guard{clock};
+
+  as::composite_policy policy;
+  const auto text = "p99(timespan{name=\"query_test.latency\"}[10s]) > 0.1";
+  auto condition = policy.from_query(text);
+  EXPECT_EQ(policy.from_query(text).get_id(), condition.get_id());
+  policy.add_rule(condition, as::scaling_action::scale_out, 1, "slow");
+
+  as::scaling_inputs inputs;
+  inputs.current_capacity = 2;
+  clock.set(start + 1s);
+  as::add_measurement<as::timespan_t>("query_test.latency", 50ms);
+  EXPECT_EQ(policy.decide(inputs, as::now()).action,
+            as::scaling_action::none);
+
+  clock.set(start + 2s);
+  as::add_measurement<as::timespan_t>("query_test.latency", 200ms);
+  auto decision = policy.decide(inputs, as::now());
+  EXPECT_EQ(decision.action, as::scaling_action::scale_out);
+  EXPECT_STREQ(decision.reason, "slow");
+  EXPECT_THROW(policy.from_query("p99("), std::runtime_error);
+
+  as::clear_measurements<as::timespan_t>();
+}
@@ -0,0 +1,54 @@
+#include "pch.h"
+
+#include "measuring/resource_sampler.h"
+
+TEST(resource_sampler, read_usage) {
+  if (!as::resource_sampler::is_supported()) {
+    EXPECT_THROW(as::resource_sampler{}, std::runtime_error);
+    return;
+  }
+
+  as::resource_sampler sampler{as::resource_sampler_options{
+      std::chrono::milliseconds{60000}}};
+  as::process_resource_usage usage;
+  ASSERT_TRUE(sampler.read_usage(usage));
+
+  EXPECT_GT(usage.rss.get_size(), 0ull);
+  EXPECT_GE(usage.peak_rss.get_size(), usage.rss.get_size());
+  EXPECT_GE(usage.virtual_memory.get_size(), usage.rss.get_size());
+  // The test thread and the sampling thread
+  EXPECT_GE(usage.threads, 2ull);
+  EXPECT_GT(usage.open_fds, 0ull);
+
+  as::clear_measurements<as::memory>();
+  as::clear_measurements<as::rate>();
+  as::clear_measurements<size_t>();
+}
+
+TEST(resource_sampler, records_series) {
+  if (!as::resource_sampler::is_supported()) return;
+
+  {
+    as::resource_sampler sampler{as::resource_sampler_options{
+        std::chrono::milliseconds{60000}}};
+    // Burn some CPU time between the samples
+    volatile uint64_t sink = 0;
+    for (int idx = 0; idx < 10000000; ++idx) sink = sink + idx;
+    ASSERT_TRUE(sampler.sample());
+  }
+
+  EXPECT_EQ(as::get_measurements<as::memory>(as::process_rss_name).size(),
+            2ull);
+  EXPECT_EQ(as::get_measurements<size_t>(as::process_threads_name).size(),
+            2ull);
+  EXPECT_EQ(as::get_measurements<size_t>(as::process_open_fds_name).size(),
+            2ull);
+
+  auto cpu_usage = as::get_measurements<as::rate>(as::process_cpu_usage_name);
+  ASSERT_EQ(cpu_usage.size(), 1ull);
+  EXPECT_GE(cpu_usage[0].data.get_per_second(), 0.0);
+
+  as::clear_measurements<as::memory>();
+  as::clear_measurements<as::rate>();
+  as::clear_measurements<size_t>();
+}
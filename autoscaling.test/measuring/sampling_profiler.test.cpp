@@ -0,0 +1,110 @@
+#include "pch.h"
+
+#include "measuring/sampling_profiler.h"
+
+#include <stdlib.h>
+
+namespace {
+
+volatile uint64_t s_sink = 0;
+
+void burn_cpu(std::chrono::milliseconds duration) {
+  const auto end = as::now() + duration;
+  while (as::now() < end) {
+    for (int idx = 0; idx < 1000; ++idx) s_sink = s_sink + idx;
+  }
+}
+
+}  // namespace
+
+TEST(sampling_profiler, unsupported_platform_throws) {
+  if (as::sampling_profiler::is_supported())
+    GTEST_SKIP() << "Sampling profiler is supported";
+  EXPECT_THROW(as::sampling_profiler{}, std::runtime_error);
+}
+
+TEST(sampling_profiler, samples_registered_thread) {
+  if (!as::sampling_profiler::is_supported())
+    GTEST_SKIP() << "Sampling profiler is not supported";
+
+  as::clear_measurements<as::stack_sample>();
+  const auto start = as::now();
+  {
+    as::sampling_profiler_options options;
+    options.frequency_hz = 1000;
+    as::sampling_profiler profiler{options};
+
+    profiler.register_this_thread();
+    burn_cpu(std::chrono::milliseconds{200});
+    profiler.unregister_this_thread();
+  }
+  const auto end = as::now();
+
+  auto samples = as::get_measurements_for_thread<as::stack_sample>(
+      as::sampled_stacks_name, std::this_thread::get_id());
+  ASSERT_FALSE(samples.empty());
+  // Timestamps are taken on the monotonic clock and shifted onto as::now
+  const auto slack = std::chrono::milliseconds{10};
+  for (auto& sample : samples) {
+    EXPECT_GE(sample.data.depth, 1u);
+    EXPECT_EQ(sample.data.thread_index, as::get_thread_index());
+    EXPECT_GE(sample.timestamp, start - slack);
+    EXPECT_LE(sample.timestamp, end + slack);
+  }
+
+  as::clear_measurements<as::stack_sample>();
+}
+
+TEST(sampling_profiler, unregistered_thread_is_not_sampled) {
+  if (!as::sampling_profiler::is_supported())
+    GTEST_SKIP() << "Sampling profiler is not supported";
+
+  as::clear_measurements<as::stack_sample>();
+  {
+    as::sampling_profiler_options options;
+    options.frequency_hz = 1000;
+    as::sampling_profiler profiler{options};
+    burn_cpu(std::chrono::milliseconds{50});
+  }
+
+  auto samples = as::get_measurements_for_thread<as::stack_sample>(
+      as::sampled_stacks_name, std::this_thread::get_id());
+  EXPECT_TRUE(samples.empty());
+}
+
+TEST(sampling_profiler, bounded_storage) {
+  if (!as::sampling_profiler::is_supported())
+    GTEST_SKIP() << "Sampling profiler is not supported";
+
+  as::clear_measurements<as::stack_sample>();
+  {
+    as::sampling_profiler_options options;
+    options.frequency_hz = 1000;
+    options.max_stored_samples_per_thread = 5;
+    as::sampling_profiler profiler{options};
+
+    profiler.register_this_thread();
+    burn_cpu(std::chrono::milliseconds{100});
+    profiler.unregister_this_thread();
+  }
+
+  auto samples = as::get_measurements_for_thread<as::stack_sample>(
+      as::sampled_stacks_name, std::this_thread::get_id());
+  EXPECT_EQ(samples.size(), 5ull);
+
+  as::set_cache_size<as::stack_sample>(as::sampled_stacks_name,
+                                       as::cache_size_infinite);
+  as::clear_measurements<as::stack_sample>();
+}
+
+TEST(sampling_profiler, only_one_profiler) {
+  if (!as::sampling_profiler::is_supported())
+    GTEST_SKIP() << "Sampling profiler is not supported";
+
+  as::sampling_profiler profiler;
+  EXPECT_THROW(as::sampling_profiler{}, std::runtime_error);
+}
+
+TEST(sampling_profiler, symbol_name_fallback) {
+  EXPECT_EQ(as::get_symbol_name(0), "0x0");
+}
@@ -0,0 +1,262 @@
+#include "pch.h"
+
+#include "measuring/scope_timing.h"
+#include "simulation/virtual_clock.h"
+
+namespace {
+
+void spin_for(as::timespan_t duration) {
+  const auto end = as::now() + duration;
+  while (as::now() < end) {
+  }
+}
+
+/// <summary>
+/// Returns the name the function is measured under
+/// </summary>
+const char* timed_function(as::virtual_clock& clock,
+                           as::timespan_t duration) {
+  MEASURE_FUNCTION_TIMING;
+  clock.advance(duration);
+  return __FUNCTION__;
+}
+
+as::call_tree get_this_thread_call_tree() {
+  for (auto& tree : as::get_call_trees()) {
+    if (tree.thread_id == std::this_thread::get_id()) return tree;
+  }
+  return {};
+}
+
+const as::call_tree_node* find_child(const as::call_tree_node& node,
+                                     const std::string& name) {
+  for (auto& child : node.children) {
+    if (child.name == name) return &child;
+  }
+  return nullptr;
+}
+
+void parse() {
+  MEASURE_SCOPE_TIMING("parse");
+  spin_for(std::chrono::milliseconds{1});
+}
+
+void db_call() {
+  MEASURE_SCOPE_TIMING("db_call");
+  spin_for(std::chrono::milliseconds{2});
+}
+
+void handle_request() {
+  MEASURE_SCOPE_TIMING("handle_request");
+  parse();
+  db_call();
+  db_call();
+}
+
+}  // namespace
+
+TEST(scope_timing, nested_scopes) {
+  as::clear_call_trees();
+
+  handle_request();
+
+  auto tree = get_this_thread_call_tree();
+  ASSERT_EQ(tree.root.children.size(), 1ull);
+
+  auto& handle = tree.root.children[0];
+  EXPECT_EQ(handle.name, "handle_request");
+  EXPECT_EQ(handle.count, 1ull);
+  ASSERT_EQ(handle.children.size(), 2ull);
+  EXPECT_EQ(handle.children[0].name, "parse");
+  EXPECT_EQ(handle.children[1].name, "db_call");
+
+  auto* parse_node = find_child(handle, "parse");
+  auto* db_node = find_child(handle, "db_call");
+  ASSERT_NE(parse_node, nullptr);
+  ASSERT_NE(db_node, nullptr);
+
+  EXPECT_EQ(parse_node->count, 1ull);
+  EXPECT_EQ(db_node->count, 2ull);
+  EXPECT_EQ(db_node->total_time_sketch.count(), 2ull);
+  EXPECT_GE(db_node->total_time, std::chrono::milliseconds{4});
+  EXPECT_EQ(db_node->self_time, db_node->total_time);
+
+  EXPECT_EQ(handle.self_time,
+            handle.total_time - parse_node->total_time - db_node->total_time);
+  EXPECT_EQ(tree.root.total_time, handle.total_time);
+}
+
+TEST(scope_timing, same_name_different_parents) {
+  as::clear_call_trees();
+
+  db_call();
+  handle_request();
+
+  auto tree = get_this_thread_call_tree();
+  ASSERT_EQ(tree.root.children.size(), 2ull);
+
+  auto* outer_db = find_child(tree.root, "db_call");
+  auto* handle = find_child(tree.root, "handle_request");
+  ASSERT_NE(outer_db, nullptr);
+  ASSERT_NE(handle, nullptr);
+  EXPECT_EQ(outer_db->count, 1ull);
+  EXPECT_EQ(find_child(*handle, "db_call")->count, 2ull);
+}
+
+TEST(scope_timing, separate_tree_per_thread) {
+  as::clear_call_trees();
+
+  std::thread worker{[]() {
+    parse();
+    ASSERT_EQ(get_this_thread_call_tree().root.children.size(), 1ull);
+    EXPECT_EQ(get_this_thread_call_tree().root.children[0].name, "parse");
+  }};
+  worker.join();
+  EXPECT_TRUE(get_this_thread_call_tree().root.children.empty());
+}
+
+TEST(scope_timing, retires_trees_of_exited_threads) {
+  as::clear_call_trees();
+  const auto tree_count = as::get_call_trees().size();
+
+  for (int idx = 0; idx < 10; ++idx) {
+    std::thread{parse}.join();
+  }
+
+  // The trees of the workers are merged into one
+  const auto trees = as::get_call_trees();
+  EXPECT_LE(trees.size(), tree_count + 1);
+  const as::call_tree* retired = nullptr;
+  for (auto& tree : trees) {
+    if (tree.exited_threads) retired = &tree;
+  }
+  ASSERT_NE(retired, nullptr);
+  auto* parse_node = find_child(retired->root, "parse");
+  ASSERT_NE(parse_node, nullptr);
+  EXPECT_EQ(parse_node->count, 10ull);
+  EXPECT_EQ(parse_node->total_time_sketch.count(), 10ull);
+
+  as::clear_call_trees();
+  for (auto& tree : as::get_call_trees()) {
+    EXPECT_FALSE(tree.exited_threads);
+  }
+}
+
+TEST(scope_timing, clear) {
+  parse();
+  as::clear_call_trees();
+
+  EXPECT_TRUE(get_this_thread_call_tree().root.children.empty());
+}
+
+TEST(scope_timing, clear_while_recording) {
+  std::atomic<int> phase{0};
+  std::atomic<bool> stopped{false};
+  as::thread_id_t worker_id;
+  std::thread worker{[&]() {
+    worker_id = std::this_thread::get_id();
+    while (phase == 0) {
+      MEASURE_SCOPE_TIMING("clear_test.busy");
+    }
+    stopped = true;
+    while (phase == 1) {
+    }
+    for (int idx = 0; idx < 3; ++idx) {
+      MEASURE_SCOPE_TIMING("clear_test.busy");
+    }
+  }};
+  for (int idx = 0; idx < 100; ++idx) as::clear_call_trees();
+  phase = 1;
+  while (!stopped) {
+  }
+
+  // The worker applies the clear when it exits its next scope, its tree is
+  // empty until then
+  as::clear_call_trees();
+  const auto find_tree = [](auto predicate) {
+    as::call_tree ret;
+    for (auto& tree : as::get_call_trees()) {
+      if (predicate(tree)) ret = std::move(tree);
+    }
+    return ret;
+  };
+  EXPECT_TRUE(find_tree([&worker_id](const as::call_tree& tree) {
+                return tree.thread_id == worker_id;
+              }).root.children.empty());
+
+  // The tree of the worker is retired when it exits
+  phase = 2;
+  worker.join();
+  const auto tree = find_tree(
+      [](const as::call_tree& tree) { return tree.exited_threads; });
+  ASSERT_EQ(tree.root.children.size(), 1ull);
+  EXPECT_EQ(tree.root.children[0].count, 3ull);
+  EXPECT_EQ(tree.root.children[0].total_time_sketch.count(), 3ull);
+}
+
+TEST(scope_timing, exemplars) {
+  as::clear_call_trees();
+  // Registered after the node was created by earlier tests and for new ones
+  as::keep_exemplars("db_call", 2);
+  as::keep_exemplars("exemplar_test.lookup", 2);
+
+  {
+    as::virtual_clock clock{as::timestamp_t{} + std::chrono::hours{140}};
+    as::scoped_clock guard{clock};
+    for (uint64_t idx = 1; idx <= 5; ++idx) {
+      as::set_request_id(idx);
+      MEASURE_SCOPE_TIMING("exemplar_test.lookup");
+      clock.advance(std::chrono::microseconds{idx == 3 ? 3000 : 100 * idx});
+    }
+  }
+  EXPECT_EQ(as::set_request_id(0), 5ull);
+  handle_request();
+
+  auto tree = get_this_thread_call_tree();
+  auto* lookup = find_child(tree.root, "exemplar_test.lookup");
+  ASSERT_NE(lookup, nullptr);
+  ASSERT_EQ(lookup->exemplars.size(), 2ull);
+  EXPECT_EQ(lookup->exemplars[0].request_id, 3ull);
+  EXPECT_EQ(lookup->exemplars[1].request_id, 5ull);
+  EXPECT_EQ(lookup->exemplars[0].value, std::chrono::milliseconds{3});
+  EXPECT_EQ(lookup->exemplars[0].thread_index, tree.thread_index);
+
+  auto* db = find_child(*find_child(tree.root, "handle_request"), "db_call");
+  ASSERT_NE(db, nullptr);
+  EXPECT_EQ(db->exemplars.size(), 2ull);
+  EXPECT_TRUE(find_child(tree.root, "handle_request")->exemplars.empty());
+
+  const auto merged = as::merge_call_trees({tree, tree});
+  auto* merged_lookup = find_child(merged, "exemplar_test.lookup");
+  ASSERT_NE(merged_lookup, nullptr);
+  EXPECT_EQ(merged_lookup->exemplars.size(), 2ull);
+
+  as::clear_call_trees();
+  EXPECT_TRUE(get_this_thread_call_tree().root.children.empty());
+}
+
+TEST(scope_timing, function_exemplars) {
+  as::virtual_clock clock{as::timestamp_t{} + std::chrono::hours{140}};
+  as::scoped_clock guard{clock};
+  const auto* name = timed_function(clock, as::timespan_t{0});
+  as::keep_exemplars(name, 2);
+
+  for (uint64_t idx = 1; idx <= 5; ++idx) {
+    as::set_request_id(idx);
+    timed_function(clock,
+                   std::chrono::microseconds{idx == 3 ? 3000 : 100 * idx});
+  }
+  as::set_request_id(0);
+
+  const auto exemplars = as::get_function_exemplars(name);
+  ASSERT_EQ(exemplars.size(), 2ull);
+  EXPECT_EQ(exemplars[0].request_id, 3ull);
+  EXPECT_EQ(exemplars[1].request_id, 5ull);
+  EXPECT_EQ(exemplars[0].value, std::chrono::milliseconds{3});
+  EXPECT_EQ(exemplars[0].thread_index, as::get_thread_index());
+  EXPECT_EQ(as::get_measurements<as::function_timing>(name).size(), 6ull);
+
+  as::clear_call_trees();
+  EXPECT_TRUE(as::get_function_exemplars(name).empty());
+  as::clear_measurements<as::function_timing>();
+}
@@ -0,0 +1,203 @@
+#include "pch.h"
+
+#include "measuring/scope_timing.h"
+#include "measuring/trace.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+std::string get_trace_path() {
+  return (std::filesystem::temp_directory_path() / "as_trace.test.json")
+      .string();
+}
+
+std::string read_file(const std::string& path) {
+  std::ifstream file{path};
+  std::stringstream ss;
+  ss << file.rdbuf();
+  return ss.str();
+}
+
+size_t count_occurrences(const std::string& str, const std::string& pattern) {
+  size_t count = 0;
+  for (auto pos = str.find(pattern); pos != std::string::npos;
+       pos = str.find(pattern, pos + pattern.size())) {
+    ++count;
+  }
+  return count;
+}
+
+void traced_function() { MEASURE_FUNCTION_TIMING; }
+
+void traced_scope() { MEASURE_SCOPE_TIMING("traced_scope"); }
+
+void exemplar_function() { MEASURE_FUNCTION_TIMING; }
+
+/// <summary>
+/// Records a span when the thread exits, after the span buffer of the thread
+/// was released
+/// </summary>
+struct span_on_thread_exit {
+  ~span_on_thread_exit() {
+    as::detail::record_span("late_span", as::now(), as::now());
+  }
+};
+
+}  // namespace
+
+TEST(trace, no_spans_without_exporter) {
+  const auto path = get_trace_path();
+  traced_scope();
+  { as::chrome_trace_exporter exporter{path}; }
+
+  auto content = read_file(path);
+  EXPECT_EQ(count_occurrences(content, "\"ph\":\"X\""), 0ull);
+
+  std::filesystem::remove(path);
+}
+
+TEST(trace, export_spans) {
+  const auto path = get_trace_path();
+  uint64_t exported_spans = 0;
+  {
+    as::chrome_trace_exporter exporter{path};
+
+    std::vector<std::thread> threads;
+    for (auto idx = 0; idx < 4; ++idx) {
+      threads.emplace_back([]() {
+        for (auto call = 0; call < 10; ++call) {
+          traced_function();
+          traced_scope();
+        }
+      });
+    }
+    for (auto& t : threads) t.join();
+
+    exporter.flush();
+    exported_spans = exporter.get_exported_span_count();
+    EXPECT_EQ(exporter.get_dropped_span_count(), 0ull);
+  }
+  EXPECT_EQ(exported_spans, 80ull);
+
+  auto content = read_file(path);
+  EXPECT_EQ(content.front(), '[');
+  EXPECT_EQ(content.substr(content.size() - 2), "]\n");
+  EXPECT_EQ(count_occurrences(content, "\"ph\":\"X\""), 80ull);
+  EXPECT_EQ(count_occurrences(content, "\"name\":\"traced_scope\""), 40ull);
+
+  as::clear_measurements<as::function_timing>();
+  std::filesystem::remove(path);
+}
+
+TEST(trace, dropped_spans) {
+  const auto path = get_trace_path();
+  {
+    as::trace_export_options options;
+    options.buffer_capacity_per_thread = 4;
+    options.flush_interval = std::chrono::hours{1};
+    as::chrome_trace_exporter exporter{path, options};
+
+    std::thread thread{[]() {
+      for (auto call = 0; call < 10; ++call) traced_scope();
+    }};
+    thread.join();
+
+    EXPECT_EQ(exporter.get_dropped_span_count(), 6ull);
+    exporter.flush();
+    EXPECT_EQ(exporter.get_exported_span_count(), 4ull);
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(trace, only_one_exporter) {
+  const auto path = get_trace_path();
+  {
+    as::chrome_trace_exporter exporter{path};
+    EXPECT_THROW(as::chrome_trace_exporter{path + ".2"}, std::runtime_error);
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(trace, spans_after_thread_exit) {
+  const auto path = get_trace_path();
+  {
+    as::chrome_trace_exporter exporter{path};
+    std::thread thread{[]() {
+      // Constructed before the span buffer of the thread, so destroyed after
+      thread_local span_on_thread_exit t_late_span;
+      (void)t_late_span;
+      traced_scope();
+    }};
+    thread.join();
+    exporter.flush();
+    EXPECT_EQ(exporter.get_exported_span_count(), 1ull);
+  }
+  EXPECT_EQ(count_occurrences(read_file(path), "late_span"), 0ull);
+  std::filesystem::remove(path);
+}
+
+TEST(trace, export_exemplars) {
+  const auto path = get_trace_path();
+  as::keep_exemplars("trace_exemplar_scope", 2);
+  as::keep_exemplars("exemplar_function", 2);
+  { MEASURE_SCOPE_TIMING("trace_exemplar_scope"); }
+  {
+    as::chrome_trace_exporter exporter{path};
+    const auto previous = as::set_request_id(42);
+    { MEASURE_SCOPE_TIMING("trace_exemplar_scope"); }
+    exemplar_function();
+    as::set_request_id(previous);
+  }
+
+  // Only the exemplars that started while the exporter was running
+  const auto content = read_file(path);
+  EXPECT_EQ(content.substr(content.size() - 2), "]\n");
+  EXPECT_EQ(count_occurrences(content, "\"cat\":\"exemplar\""), 2ull);
+  EXPECT_EQ(count_occurrences(content, "\"request_id\":\"42\""), 2ull);
+  EXPECT_EQ(count_occurrences(
+                content, "{\"name\":\"trace_exemplar_scope\",\"cat\":"),
+            1ull);
+  EXPECT_EQ(
+      count_occurrences(content, "{\"name\":\"exemplar_function\",\"cat\":"),
+      1ull);
+  EXPECT_EQ(count_occurrences(content, "\"duration_us\":"), 2ull);
+
+  as::clear_call_trees();
+  as::clear_measurements<as::function_timing>();
+  std::filesystem::remove(path);
+}
+
+TEST(trace, no_spans_of_earlier_exporters) {
+  const auto path = get_trace_path();
+  const auto second_path = path + ".2";
+  std::atomic<int> phase{0};
+  std::atomic<bool> switched{false};
+  std::thread thread{[&phase, &switched]() {
+    while (phase == 0) as::detail::record_span("first", as::now(), as::now());
+    switched = true;
+    while (phase == 1) as::detail::record_span("second", as::now(), as::now());
+  }};
+  {
+    as::chrome_trace_exporter exporter{path};
+    std::this_thread::sleep_for(std::chrono::milliseconds{5});
+    // Spans recorded while the exporter shuts down are never exported by
+    // the next one
+  }
+  phase = 1;
+  while (!switched) {
+  }
+  {
+    as::chrome_trace_exporter exporter{second_path};
+    std::this_thread::sleep_for(std::chrono::milliseconds{5});
+    phase = 2;
+    thread.join();
+  }
+  const auto content = read_file(second_path);
+  EXPECT_EQ(count_occurrences(content, "\"name\":\"first\""), 0ull);
+  EXPECT_GT(count_occurrences(content, "\"name\":\"second\""), 0ull);
+  std::filesystem::remove(path);
+  std::filesystem::remove(second_path);
+}
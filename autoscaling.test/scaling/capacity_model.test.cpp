@@ -0,0 +1,145 @@
+#include "pch.h"
+
+#include "scaling/capacity_model.h"
+#include "simulation/queue_simulator.h"
+#include "simulation/virtual_clock.h"
+
+#include <cmath>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+double to_seconds(as::timespan_t timespan) {
+  return std::chrono::duration<double>(timespan).count();
+}
+
+struct fixed_policy : as::scaling_policy {
+  as::scaling_decision decide(const as::scaling_inputs& inputs,
+                              as::timestamp_t timestamp) override {
+    as::scaling_decision decision;
+    decision.timestamp = timestamp;
+    decision.current_capacity = inputs.current_capacity;
+    decision.target_capacity = inputs.current_capacity;
+    return decision;
+  }
+};
+
+}  // namespace
+
+TEST(capacity_model, erlang_c) {
+  // Offered load of 2 Erlang on 3 servers: C = 4/9, Wq = C / (c - A) * 1s
+  const as::workload workload{2.0, 1s};
+  EXPECT_DOUBLE_EQ(workload.offered_load(), 2.0);
+
+  const auto estimate = as::capacity_model::estimate(workload, 3);
+  EXPECT_TRUE(estimate.stable);
+  EXPECT_NEAR(estimate.utilization, 2.0 / 3.0, 1e-12);
+  EXPECT_NEAR(estimate.wait_probability, 4.0 / 9.0, 1e-12);
+  EXPECT_NEAR(to_seconds(estimate.mean_queue_wait), 4.0 / 9.0, 1e-6);
+  EXPECT_NEAR(to_seconds(estimate.mean_response_time), 13.0 / 9.0, 1e-6);
+  // Little's law: Lq = lambda * Wq
+  EXPECT_NEAR(estimate.mean_queue_length, 8.0 / 9.0, 1e-6);
+
+  const auto overloaded = as::capacity_model::estimate(workload, 2);
+  EXPECT_FALSE(overloaded.stable);
+  EXPECT_EQ(overloaded.mean_response_time, as::timespan_t::max());
+}
+
+TEST(capacity_model, mm1_quantiles) {
+  // M/M/1 response time is exponential with rate mu - lambda
+  const as::workload workload{5.0, 100ms};
+  const auto p95 = as::capacity_model::predict_latency(workload, 1, 0.95);
+  EXPECT_NEAR(to_seconds(p95), -std::log(0.05) / 5.0, 1e-6);
+
+  // Queue wait: P(W > t) = rho * exp(-(mu - lambda) * t)
+  const auto wait_p95 = as::capacity_model::predict_latency(
+      workload, 1, 0.95, as::latency_measure::queue_wait);
+  EXPECT_NEAR(to_seconds(wait_p95), std::log(0.5 / 0.05) / 5.0, 1e-6);
+  EXPECT_EQ(as::capacity_model::predict_latency(
+                workload, 1, 0.4, as::latency_measure::queue_wait),
+            0ns);
+
+  EXPECT_EQ(as::capacity_model::predict_latency(workload, 0, 0.95),
+            as::timespan_t::max());
+}
+
+TEST(capacity_model, required_servers) {
+  const as::workload workload{100.0, 50ms};
+
+  as::service_level_objective objective;
+  objective.latency = 200ms;
+  objective.quantile = 0.95;
+  const auto servers =
+      as::capacity_model::required_servers(workload, objective);
+  ASSERT_GT(servers, 5ull);
+  EXPECT_LE(as::capacity_model::predict_latency(workload, servers, 0.95),
+            200ms);
+  EXPECT_GT(as::capacity_model::predict_latency(workload, servers - 1, 0.95),
+            200ms);
+
+  objective.max_utilization = 0.5;
+  EXPECT_EQ(as::capacity_model::required_servers(workload, objective), 10ull);
+
+  // The p95 of the service time alone is about 150ms
+  objective.latency = 100ms;
+  EXPECT_EQ(as::capacity_model::required_servers(workload, objective), 0ull);
+
+  objective.measure = as::latency_measure::queue_wait;
+  objective.latency = 0ns;
+  objective.max_utilization = 1.0;
+  const auto no_wait_servers =
+      as::capacity_model::required_servers(workload, objective);
+  EXPECT_GT(as::capacity_model::estimate(workload, no_wait_servers)
+                .wait_probability,
+            0.0);
+  EXPECT_LE(as::capacity_model::estimate(workload, no_wait_servers)
+                .wait_probability,
+            0.05);
+}
+
+TEST(capacity_model, matches_simulation) {
+  const as::workload workload{25.0, 100ms};
+
+  as::queue_simulator_options options;
+  options.load = as::constant_load(workload.arrival_rate);
+  options.mean_service_time = workload.mean_service_time;
+  options.initial_capacity = 3;
+  options.duration = 10h;
+  options.record_series = false;
+  fixed_policy policy;
+  const auto result = as::queue_simulator{options}.run(policy);
+
+  const auto estimate = as::capacity_model::estimate(workload, 3);
+  EXPECT_NEAR(to_seconds(result.response_time.mean()),
+              to_seconds(estimate.mean_response_time),
+              0.05 * to_seconds(estimate.mean_response_time));
+  // The sketch quantiles are accurate to about 12.5%
+  const auto p95 = as::capacity_model::predict_latency(workload, 3, 0.95);
+  EXPECT_NEAR(to_seconds(result.response_time.quantile(0.95)),
+              to_seconds(p95), 0.15 * to_seconds(p95));
+}
+
+TEST(capacity_model, observes_workload) {
+  const auto start = as::timestamp_t{} + 48h;
+  as::virtual_clock clock{start};
+  {
+    as::scoped_clock guard{clock};
+    // 20 arrivals per second for 10 seconds, each served in 30ms
+    for (int idx = 0; idx < 200; ++idx) {
+      clock.advance(50ms);
+      as::add_measurement<as::periodic_event>("capacity_model_arrivals");
+      as::add_measurement<as::function_timing>("capacity_model_service",
+                                               30ms);
+    }
+  }
+
+  const auto workload = as::observe_workload(
+      "capacity_model_arrivals", "capacity_model_service", 5s, start + 10s);
+  EXPECT_NEAR(workload.arrival_rate, 20.0, 1e-9);
+  EXPECT_EQ(workload.mean_service_time, 30ms);
+  EXPECT_NEAR(workload.offered_load(), 0.6, 1e-9);
+
+  as::clear_measurements<as::periodic_event>();
+  as::clear_measurements<as::function_timing>();
+}
@@ -0,0 +1,223 @@
+#include "pch.h"
+
+#include "scaling/composite_policy.h"
+#include "simulation/virtual_clock.h"
+
+#include <cmath>
+#include <limits>
+#include <string>
+
+using namespace std::chrono_literals;
+
+TEST(composite_policy, combines_metrics_of_several_types) {
+  const auto start = as::timestamp_t{} + 96h;
+  as::virtual_clock clock{start};
+  as::scoped_clock guard{clock};
+
+  as::composite_policy policy;
+  auto p99 = policy.aggregate<as::timespan_t>(
+      "composite_test.latency", as::aggregation::quantile, 10s, 0.99);
+  auto memory = policy.aggregate<as::memory>(
+      "composite_test.memory", as::aggregation::last, 10s);
+  auto rising = policy.aggregate<as::rate>(
+      "composite_test.rate", as::aggregation::slope, 10s);
+  policy.add_rule(p99 > 0.1 || (memory > 800.0 && rising > 0.0),
+                  as::scaling_action::scale_out, 2, "overloaded");
+  policy.add_rule(p99 < 0.02, as::scaling_action::scale_in);
+
+  const auto decide = [&](size_t capacity) {
+    as::scaling_inputs inputs;
+    inputs.current_capacity = capacity;
+    return policy.decide(inputs, as::now());
+  };
+
+  // Without measurements no comparison holds
+  EXPECT_EQ(decide(4).action, as::scaling_action::none);
+  EXPECT_TRUE(std::isnan(policy.get_value(p99)));
+
+  // Latency of 50ms, memory high but rate constant
+  for (int second = 1; second <= 10; ++second) {
+    clock.set(start + std::chrono::seconds{second});
+    as::add_measurement<as::timespan_t>("composite_test.latency", 50ms);
+    as::add_measurement<as::memory>("composite_test.memory", as::memory{900});
+    as::add_measurement<as::rate>("composite_test.rate", as::rate{100.0});
+  }
+  EXPECT_EQ(decide(4).action, as::scaling_action::none);
+  EXPECT_NEAR(policy.get_value(p99), 0.05, 1e-9);
+  EXPECT_NEAR(policy.get_value(rising), 0.0, 1e-9);
+
+  // Rising rate
+  for (int second = 11; second <= 15; ++second) {
+    clock.set(start + std::chrono::seconds{second});
+    as::add_measurement<as::rate>("composite_test.rate",
+                                  as::rate{100.0 * second});
+  }
+  auto decision = decide(4);
+  EXPECT_EQ(decision.action, as::scaling_action::scale_out);
+  EXPECT_EQ(decision.target_capacity, 6ull);
+  EXPECT_STREQ(decision.reason, "overloaded");
+  EXPECT_GT(policy.get_value(rising), 0.0);
+
+  // Cooldown
+  clock.advance(500ms);
+  EXPECT_EQ(decide(6).action, as::scaling_action::none);
+
+  // A single slow request is the p99 of the window
+  clock.advance(1s);
+  as::add_measurement<as::timespan_t>("composite_test.latency", 200ms);
+  as::add_measurement<as::memory>("composite_test.memory", as::memory{100});
+  decision = decide(6);
+  EXPECT_EQ(decision.action, as::scaling_action::scale_out);
+  EXPECT_NEAR(policy.get_value(p99), 0.2, 1e-9);
+
+  // Fast requests once the slow ones left the window
+  for (int second = 17; second <= 40; ++second) {
+    clock.set(start + std::chrono::seconds{second});
+    as::add_measurement<as::timespan_t>("composite_test.latency", 10ms);
+  }
+  decision = decide(8);
+  EXPECT_EQ(decision.action, as::scaling_action::scale_in);
+  EXPECT_EQ(decision.target_capacity, 7ull);
+  EXPECT_STREQ(decision.reason, "composite rule");
+  EXPECT_STREQ(policy.get_name(), "composite");
+
+  as::clear_measurements<as::timespan_t>();
+  as::clear_measurements<as::memory>();
+  as::clear_measurements<as::rate>();
+}
+
+TEST(composite_policy, aggregates) {
+  const auto start = as::timestamp_t{} + 97h;
+  as::virtual_clock clock{start};
+  as::scoped_clock guard{clock};
+
+  as::composite_policy policy;
+  const auto name = "composite_test.aggregates";
+  const auto aggregate = [&](as::aggregation kind, double quantile = 0.5) {
+    return policy.aggregate<double>(name, kind, 5s, quantile);
+  };
+  auto last = aggregate(as::aggregation::last);
+  auto mean = aggregate(as::aggregation::mean);
+  auto min = aggregate(as::aggregation::min);
+  auto max = aggregate(as::aggregation::max);
+  auto sum = aggregate(as::aggregation::sum);
+  auto count = aggregate(as::aggregation::count);
+  auto median = aggregate(as::aggregation::quantile);
+  auto slope = aggregate(as::aggregation::slope);
+  auto ratio = (max - min) / count;
+
+  // 1 to 10, only 6 to 10 within the window
+  for (int second = 1; second <= 10; ++second) {
+    clock.set(start + std::chrono::seconds{second});
+    as::add_measurement<double>(name, static_cast<double>(second));
+  }
+  policy.decide(as::scaling_inputs{}, as::now());
+  EXPECT_DOUBLE_EQ(policy.get_value(last), 10.0);
+  EXPECT_DOUBLE_EQ(policy.get_value(mean), 8.0);
+  EXPECT_DOUBLE_EQ(policy.get_value(min), 6.0);
+  EXPECT_DOUBLE_EQ(policy.get_value(max), 10.0);
+  EXPECT_DOUBLE_EQ(policy.get_value(sum), 40.0);
+  EXPECT_DOUBLE_EQ(policy.get_value(count), 5.0);
+  EXPECT_DOUBLE_EQ(policy.get_value(median), 8.0);
+  EXPECT_NEAR(policy.get_value(slope), 1.0, 1e-9);
+  EXPECT_DOUBLE_EQ(policy.get_value(ratio), 0.8);
+
+  // Empty windows count zero measurements
+  clock.advance(1min);
+  policy.decide(as::scaling_inputs{}, as::now());
+  EXPECT_DOUBLE_EQ(policy.get_value(count), 0.0);
+  EXPECT_TRUE(std::isnan(policy.get_value(mean)));
+  EXPECT_TRUE(std::isnan(policy.get_value(ratio)));
+
+  as::clear_measurements<double>();
+}
+
+TEST(composite_policy, shares_subexpressions) {
+  as::composite_policy policy;
+  auto latency = policy.aggregate<as::timespan_t>(
+      "composite_test.shared", as::aggregation::mean, 10s);
+  auto utilization = policy.aggregate<double>("composite_test.utilization",
+                                              as::aggregation::max, 10s);
+  auto condition = latency > 0.1 && utilization > 0.8;
+  const auto nodes = policy.get_node_count();
+
+  // Identical aggregates, constants and commuted operands
+  auto same_latency = policy.aggregate<as::timespan_t>(
+      "composite_test.shared", as::aggregation::mean, 10s);
+  EXPECT_EQ(same_latency.get_id(), latency.get_id());
+  auto same_condition = utilization > 0.8 && latency > 0.1;
+  EXPECT_EQ(same_condition.get_id(), condition.get_id());
+  EXPECT_EQ(policy.get_node_count(), nodes);
+
+  // A longer window of the same series is a new aggregate but no new read
+  policy.aggregate<as::timespan_t>("composite_test.shared",
+                                   as::aggregation::mean, 60s);
+  EXPECT_EQ(policy.get_node_count(), nodes + 1);
+  for (int idx = 0; idx < 10; ++idx)
+    policy.add_rule(condition, as::scaling_action::scale_out);
+  policy.decide(as::scaling_inputs{}, as::now());
+  EXPECT_EQ(policy.get_statistics().series_reads, 2ull);
+  EXPECT_EQ(policy.get_statistics().aggregates, 3ull);
+  EXPECT_EQ(policy.get_statistics().rules, 10ull);
+
+  // Subtraction is not commutative
+  auto difference = latency - utilization;
+  EXPECT_NE((utilization - latency).get_id(), difference.get_id());
+
+  // Constants are compared by their bits, so NaN doesn't break the lookup
+  const auto nan = std::numeric_limits<double>::quiet_NaN();
+  EXPECT_EQ(policy.constant(nan).get_id(), policy.constant(nan).get_id());
+  EXPECT_NE(policy.constant(0.0).get_id(), policy.constant(nan).get_id());
+  EXPECT_EQ(policy.constant(0.8).get_id(), policy.constant(0.8).get_id());
+
+  as::composite_policy other;
+  EXPECT_THROW(policy.add_rule(other.constant(1.0),
+                               as::scaling_action::scale_out),
+               std::runtime_error);
+  EXPECT_THROW(policy.add_rule(condition, as::scaling_action::none),
+               std::runtime_error);
+  EXPECT_THROW(policy.combine(as::operation::logical_not, latency, latency),
+               std::runtime_error);
+
+  as::clear_measurements<as::timespan_t>();
+  as::clear_measurements<double>();
+}
+
+TEST(composite_policy, evaluates_many_rules) {
+  const auto start = as::timestamp_t{} + 98h;
+  as::virtual_clock clock{start};
+  as::scoped_clock guard{clock};
+
+  // 500 rules over 20 series with a measurement per second each
+  constexpr int series_count = 20;
+  for (int second = 1; second <= 60; ++second) {
+    clock.set(start + std::chrono::seconds{second});
+    for (int idx = 0; idx < series_count; ++idx) {
+      as::add_measurement<double>(
+          as::intern_name("composite_test.many." + std::to_string(idx)),
+          static_cast<double>(idx * second % 97));
+    }
+  }
+
+  as::composite_policy policy;
+  for (int idx = 0; idx < 500; ++idx) {
+    const auto name = as::intern_name("composite_test.many." +
+                                      std::to_string(idx % series_count));
+    auto p90 = policy.aggregate<double>(name, as::aggregation::quantile, 30s,
+                                        0.9);
+    auto mean = policy.aggregate<double>(name, as::aggregation::mean, 60s);
+    policy.add_rule(p90 > 90.0 + idx % 7 && mean > 40.0,
+                    as::scaling_action::scale_out);
+  }
+  as::scaling_inputs inputs;
+  inputs.current_capacity = 4;
+  policy.decide(inputs, as::now());
+
+  const auto& statistics = policy.get_statistics();
+  EXPECT_EQ(statistics.rules, 500ull);
+  EXPECT_EQ(statistics.series_reads, static_cast<size_t>(series_count));
+  EXPECT_EQ(statistics.aggregates, 2ull * series_count);
+  // The time budget is checked by composite_policy_benchmark
+
+  as::clear_measurements<double>();
+}
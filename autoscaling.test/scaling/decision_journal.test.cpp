@@ -0,0 +1,118 @@
+#include "pch.h"
+
+#include "scaling/decision_journal.h"
+#include "simulation/queue_simulator.h"
+#include "simulation/virtual_clock.h"
+
+using namespace std::chrono_literals;
+
+TEST(decision_journal, joins_decisions_with_metrics) {
+  const auto start = as::timestamp_t{} + 72h;
+  as::virtual_clock clock{start};
+  as::scoped_clock guard{clock};
+
+  as::decision_journal_options options;
+  options.name = "journal_test";
+  options.latency_name = "journal_test.latency";
+  options.utilization_name = "journal_test.utilization";
+  options.capacity_name = "journal_test.capacity";
+  options.before_window = 5s;
+  options.after_window = 5s;
+  as::decision_journal journal{options};
+
+  // Latency of 100ms until the capacity doubles after 3s, then 20ms
+  as::scaling_decision decision;
+  for (int second = 1; second <= 20; ++second) {
+    clock.set(start + std::chrono::seconds{second});
+    const auto scaled = second >= 13;
+    as::add_measurement<as::timespan_t>("journal_test.latency",
+                                        scaled ? 20ms : 100ms);
+    as::add_measurement<double>("journal_test.utilization",
+                                scaled ? 0.4 : 0.8);
+    as::add_measurement<size_t>("journal_test.capacity", scaled ? 4 : 2);
+
+    if (second == 10) {
+      as::scaling_inputs inputs;
+      inputs.current_capacity = 2;
+      inputs.latency = 100ms;
+      inputs.utilization = 0.8;
+      decision.timestamp = as::now();
+      decision.action = as::scaling_action::scale_out;
+      decision.current_capacity = 2;
+      decision.target_capacity = 4;
+      decision.reason = "latency above target";
+      journal.record(inputs, decision, "test_policy", 3);
+    }
+  }
+
+  auto decisions = journal.get_decisions();
+  ASSERT_EQ(decisions.size(), 1ull);
+  EXPECT_EQ(decisions[0].timestamp, start + 10s);
+  EXPECT_STREQ(decisions[0].data.policy_name, "test_policy");
+  EXPECT_EQ(decisions[0].data.policy_version, 3u);
+  EXPECT_EQ(decisions[0].data.inputs.latency, 100ms);
+  EXPECT_EQ(journal.get_decisions(start, start + 9s).size(), 0ull);
+
+  auto impact = journal.get_impact();
+  ASSERT_EQ(impact.size(), 1ull);
+  EXPECT_EQ(impact[0].record.decision.target_capacity, 4ull);
+  // Seconds 5 to 9 before, 11 to 15 after
+  EXPECT_EQ(impact[0].latency.before.count, 5ull);
+  EXPECT_NEAR(impact[0].latency.before.mean, 0.1, 1e-9);
+  EXPECT_EQ(impact[0].latency.after.count, 5ull);
+  EXPECT_NEAR(impact[0].latency.after.mean, (2 * 0.1 + 3 * 0.02) / 5, 1e-9);
+  EXPECT_NEAR(impact[0].latency.after.max, 0.1, 1e-9);
+  EXPECT_NEAR(impact[0].utilization.before.mean, 0.8, 1e-9);
+  EXPECT_EQ(impact[0].queue_length.before.count, 0ull);
+  EXPECT_TRUE(impact[0].reached_target);
+  EXPECT_EQ(impact[0].time_to_target, 3s);
+
+  as::clear_measurements<as::decision_record>();
+  as::clear_measurements<as::timespan_t>();
+  as::clear_measurements<double>();
+  as::clear_measurements<size_t>();
+}
+
+TEST(decision_journal, records_simulated_decisions) {
+  const auto start = as::timestamp_t{} + 96h;
+  std::vector<as::measurement<as::rate>> rates;
+  rates.emplace_back(start, as::rate{10.0});
+  rates.emplace_back(start + 5min, as::rate{100.0});
+
+  as::queue_simulator_options options;
+  options.name = "journal_simulation";
+  options.load = as::recorded_load(rates);
+  options.start_time = start;
+  options.duration = 10min;
+  options.mean_service_time = 50ms;
+  options.provisioning_delay = 5s;
+  as::latency_target_policy policy;
+  const auto result = as::queue_simulator{options}.run(policy);
+
+  as::decision_journal_options journal_options;
+  journal_options.name = "journal_simulation";
+  journal_options.capacity_name = "journal_simulation.capacity";
+  as::decision_journal journal{journal_options};
+
+  // Every evaluation is journaled, including those without an action
+  const auto end = start + 10min;
+  EXPECT_EQ(journal.get_decisions(start, end).size(), 600ull);
+
+  size_t reached = 0;
+  for (auto& impact : journal.get_impact(start + 5min, end)) {
+    EXPECT_STREQ(impact.record.policy_name, "latency_target");
+    if (impact.record.decision.action != as::scaling_action::scale_out ||
+        !impact.reached_target)
+      continue;
+    // Capacity is sampled at every evaluation, one second apart
+    EXPECT_LE(impact.time_to_target, options.provisioning_delay + 1s);
+    ++reached;
+  }
+  EXPECT_GT(reached, 0ull);
+  EXPECT_GT(result.scale_outs, 0ull);
+
+  as::clear_measurements<as::decision_record>();
+  as::clear_measurements<as::timespan_t>();
+  as::clear_measurements<double>();
+  as::clear_measurements<size_t>();
+}
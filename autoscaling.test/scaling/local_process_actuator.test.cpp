@@ -0,0 +1,142 @@
+#include "pch.h"
+
+#include "scaling/local_process_actuator.h"
+
+#include <filesystem>
+#include <numeric>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+/// <summary>
+/// The tests start this test executable as the worker process. In that case
+/// this reports to the actuator and then waits to be terminated, before any
+/// test runs
+/// </summary>
+const bool s_is_worker = []() {
+  if (!as::worker_reporter::is_available()) return false;
+
+  as::worker_reporter reporter;
+  reporter.report("utilization", 0.95);
+  reporter.report_ready();
+  for (;;) std::this_thread::sleep_for(1s);
+}();
+
+as::local_process_actuator_options make_options(const char* name) {
+  as::local_process_actuator_options options;
+  options.name = name;
+  options.command = {std::filesystem::read_symlink("/proc/self/exe").string()};
+  options.stop_timeout = 2s;
+  return options;
+}
+
+}  // namespace
+
+TEST(local_process_actuator, scale_out_and_in) {
+  if (!as::local_process_actuator::is_supported())
+    GTEST_SKIP() << "Local process actuator is not supported";
+
+  {
+    as::local_process_actuator actuator{make_options("fleet_scale")};
+    EXPECT_EQ(actuator.current_capacity(), 0ull);
+
+    actuator.scale_out(2);
+    EXPECT_EQ(actuator.target_capacity(), 2ull);
+    ASSERT_TRUE(actuator.wait_for_capacity(2, 10s));
+    EXPECT_EQ(actuator.current_capacity(), 2ull);
+
+    actuator.scale_in(1);
+    EXPECT_EQ(actuator.current_capacity(), 1ull);
+    EXPECT_EQ(actuator.target_capacity(), 1ull);
+    EXPECT_EQ(actuator.get_failed_worker_count(), 0ull);
+  }
+
+  auto latencies =
+      as::get_measurements<as::timespan_t>("fleet_scale.actuation_latency");
+  ASSERT_EQ(latencies.size(), 2ull);
+  for (auto& latency : latencies) EXPECT_GT(latency.data, 0ns);
+
+  auto capacities = as::get_measurements<size_t>("fleet_scale.capacity");
+  ASSERT_GE(capacities.size(), 3ull);
+  EXPECT_EQ(capacities.back().data, 1ull);
+
+  as::clear_measurements<as::timespan_t>();
+  as::clear_measurements<size_t>();
+  as::clear_measurements<double>();
+}
+
+TEST(local_process_actuator, closed_loop) {
+  if (!as::local_process_actuator::is_supported())
+    GTEST_SKIP() << "Local process actuator is not supported";
+
+  as::local_process_actuator actuator{make_options("fleet_loop")};
+  actuator.scale_out(1);
+  ASSERT_TRUE(actuator.wait_for_capacity(1, 10s));
+
+  // Workers report their utilization before they report ready
+  auto utilization = as::get_measurements<double>("fleet_loop.utilization");
+  ASSERT_EQ(utilization.size(), 1ull);
+
+  as::scaling_inputs inputs;
+  inputs.current_capacity = actuator.current_capacity();
+  inputs.utilization =
+      std::accumulate(utilization.begin(), utilization.end(), 0.0,
+                      [](double sum, const auto& m) { return sum + m.data; }) /
+      utilization.size();
+
+  as::latency_target_policy policy;
+  const auto decision = policy.decide(inputs, as::now());
+  ASSERT_EQ(decision.action, as::scaling_action::scale_out);
+  actuator.apply(decision);
+
+  EXPECT_EQ(actuator.target_capacity(), decision.target_capacity);
+  ASSERT_TRUE(actuator.wait_for_capacity(decision.target_capacity, 10s));
+
+  as::clear_measurements<as::timespan_t>();
+  as::clear_measurements<size_t>();
+  as::clear_measurements<double>();
+}
+
+TEST(local_process_actuator, bounded_metrics) {
+  if (!as::local_process_actuator::is_supported())
+    GTEST_SKIP() << "Local process actuator is not supported";
+
+  auto options = make_options("fleet_metrics");
+  options.max_metric_names = 2;
+  as::local_process_actuator actuator{options};
+  actuator.scale_out(1);
+  ASSERT_TRUE(actuator.wait_for_capacity(1, 10s));
+
+  // Reports from this process, pretending to be the worker with id 0 and one
+  // that doesn't exist
+  setenv(as::worker_socket_env, actuator.get_socket_path().c_str(), 1);
+  setenv(as::worker_id_env, "0", 1);
+  {
+    as::worker_reporter reporter;
+    reporter.report("latency", 1.0);
+    reporter.report("errors", 2.0);
+    reporter.report("latency", 3.0);
+  }
+  setenv(as::worker_id_env, "42", 1);
+  {
+    as::worker_reporter reporter;
+    reporter.report("latency", 4.0);
+  }
+  unsetenv(as::worker_socket_env);
+  unsetenv(as::worker_id_env);
+
+  for (int idx = 0; idx < 500 && actuator.get_dropped_metric_count() < 2;
+       ++idx)
+    std::this_thread::sleep_for(10ms);
+  EXPECT_EQ(actuator.get_dropped_metric_count(), 2ull);
+  EXPECT_EQ(as::get_measurements<double>("fleet_metrics.utilization").size(),
+            1ull);
+  EXPECT_EQ(as::get_measurements<double>("fleet_metrics.latency").size(),
+            2ull);
+  EXPECT_TRUE(as::get_measurements<double>("fleet_metrics.errors").empty());
+
+  as::clear_measurements<as::timespan_t>();
+  as::clear_measurements<size_t>();
+  as::clear_measurements<double>();
+}
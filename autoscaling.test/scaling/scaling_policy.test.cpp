@@ -0,0 +1,110 @@
+#include "pch.h"
+
+#include "scaling/scaling_policy.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+as::latency_target_policy_options make_options() {
+  as::latency_target_policy_options options;
+  options.target_latency = 10ms;
+  options.min_capacity = 1;
+  options.max_capacity = 8;
+  options.scale_out_cooldown = 1s;
+  options.scale_in_cooldown = 10s;
+  return options;
+}
+
+as::scaling_inputs make_inputs(size_t capacity, as::timespan_t latency,
+                               double utilization) {
+  as::scaling_inputs inputs;
+  inputs.current_capacity = capacity;
+  inputs.latency = latency;
+  inputs.latency_samples = 100;
+  inputs.utilization = utilization;
+  return inputs;
+}
+
+}  // namespace
+
+TEST(latency_target_policy, scale_out_on_latency) {
+  as::latency_target_policy policy{make_options()};
+  const auto start = as::now();
+
+  auto decision = policy.decide(make_inputs(2, 20ms, 0.6), start);
+  EXPECT_EQ(decision.action, as::scaling_action::scale_out);
+  EXPECT_EQ(decision.current_capacity, 2ull);
+  EXPECT_EQ(decision.target_capacity, 3ull);
+  EXPECT_STREQ(decision.reason, "latency above target");
+}
+
+TEST(latency_target_policy, scale_out_is_proportional_to_utilization) {
+  as::latency_target_policy policy{make_options()};
+
+  // 4 workers at 100% need ceil(4 / 0.7) = 6 workers for 70%
+  auto decision = policy.decide(make_inputs(4, 1ms, 1.0), as::now());
+  EXPECT_EQ(decision.action, as::scaling_action::scale_out);
+  EXPECT_EQ(decision.target_capacity, 6ull);
+  EXPECT_STREQ(decision.reason, "utilization above threshold");
+}
+
+TEST(latency_target_policy, respects_bounds) {
+  as::latency_target_policy policy{make_options()};
+  const auto start = as::now();
+
+  auto decision = policy.decide(make_inputs(8, 100ms, 1.0), start);
+  EXPECT_EQ(decision.action, as::scaling_action::none);
+
+  decision = policy.decide(make_inputs(10, 1ms, 0.5), start);
+  EXPECT_EQ(decision.action, as::scaling_action::scale_in);
+  EXPECT_EQ(decision.target_capacity, 8ull);
+}
+
+TEST(latency_target_policy, hysteresis) {
+  as::latency_target_policy policy{make_options()};
+
+  // Latency between half the target and the target, utilization between the
+  // thresholds: nothing happens
+  auto decision = policy.decide(make_inputs(4, 7ms, 0.6), as::now());
+  EXPECT_EQ(decision.action, as::scaling_action::none);
+  decision = policy.decide(make_inputs(4, 7ms, 0.2), as::now());
+  EXPECT_EQ(decision.action, as::scaling_action::none);
+}
+
+TEST(latency_target_policy, cooldowns) {
+  as::latency_target_policy policy{make_options()};
+  const auto start = as::now();
+
+  auto decision = policy.decide(make_inputs(2, 20ms, 0.6), start);
+  EXPECT_EQ(decision.action, as::scaling_action::scale_out);
+
+  // Within the scale out cooldown
+  decision = policy.decide(make_inputs(3, 20ms, 0.6), start + 500ms);
+  EXPECT_EQ(decision.action, as::scaling_action::none);
+  decision = policy.decide(make_inputs(3, 20ms, 0.6), start + 1s);
+  EXPECT_EQ(decision.action, as::scaling_action::scale_out);
+
+  // Scale in waits for the scale in cooldown after any scaling
+  decision = policy.decide(make_inputs(4, 1ms, 0.1), start + 5s);
+  EXPECT_EQ(decision.action, as::scaling_action::none);
+  decision = policy.decide(make_inputs(4, 1ms, 0.1), start + 11s);
+  EXPECT_EQ(decision.action, as::scaling_action::scale_in);
+  EXPECT_EQ(decision.target_capacity, 3ull);
+}
+
+TEST(latency_target_policy, scale_in_without_samples) {
+  as::latency_target_policy policy{make_options()};
+
+  auto inputs = make_inputs(3, 0ms, 0.0);
+  inputs.latency_samples = 0;
+  auto decision = policy.decide(inputs, as::now());
+  EXPECT_EQ(decision.action, as::scaling_action::scale_in);
+  EXPECT_EQ(decision.target_capacity, 2ull);
+
+  // Not while tasks are queued
+  inputs.queue_length = 1;
+  as::latency_target_policy other_policy{make_options()};
+  decision = other_policy.decide(inputs, as::now());
+  EXPECT_EQ(decision.action, as::scaling_action::none);
+}
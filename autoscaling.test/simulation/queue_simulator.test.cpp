@@ -0,0 +1,169 @@
+#include "pch.h"
+
+#include "simulation/queue_simulator.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+/// <summary>
+/// Policy that never changes the capacity
+/// </summary>
+struct fixed_policy : as::scaling_policy {
+  as::scaling_decision decide(const as::scaling_inputs& inputs,
+                              as::timestamp_t timestamp) override {
+    as::scaling_decision decision;
+    decision.timestamp = timestamp;
+    decision.current_capacity = inputs.current_capacity;
+    decision.target_capacity = inputs.current_capacity;
+    return decision;
+  }
+};
+
+/// <summary>
+/// Policy that checks that the clock of the simulation is installed
+/// </summary>
+struct clock_checking_policy : fixed_policy {
+  as::scaling_decision decide(const as::scaling_inputs& inputs,
+                              as::timestamp_t timestamp) override {
+    if (as::now() != timestamp) ++mismatches;
+    return fixed_policy::decide(inputs, timestamp);
+  }
+
+  int mismatches = 0;
+};
+
+}  // namespace
+
+TEST(queue_simulator, matches_mm1_response_time) {
+  as::queue_simulator_options options;
+  options.load = as::constant_load(5.0);
+  options.mean_service_time = 100ms;
+  options.duration = 10h;
+  options.record_series = false;
+
+  fixed_policy policy;
+  const auto result = as::queue_simulator{options}.run(policy);
+
+  // About 5 jobs per second over 10 hours
+  EXPECT_NEAR(static_cast<double>(result.arrived_jobs), 180000.0, 3000.0);
+  EXPECT_GE(result.completed_jobs + 100, result.arrived_jobs);
+  // M/M/1 with utilization 0.5: mean response time 1 / (mu - lambda)
+  const std::chrono::duration<double> mean_response_time =
+      result.response_time.mean();
+  EXPECT_NEAR(mean_response_time.count(), 0.2, 0.02);
+  EXPECT_NEAR(result.capacity_seconds, 36000.0, 1.0);
+  EXPECT_EQ(result.decisions.size(), 0ull);
+}
+
+TEST(queue_simulator, is_reproducible) {
+  as::queue_simulator_options options;
+  options.duration = 10min;
+  options.record_series = false;
+  as::queue_simulator simulator{options};
+
+  as::latency_target_policy first_policy;
+  as::latency_target_policy second_policy;
+  const auto first = simulator.run(first_policy);
+  const auto second = simulator.run(second_policy);
+  EXPECT_EQ(first.arrived_jobs, second.arrived_jobs);
+  EXPECT_EQ(first.completed_jobs, second.completed_jobs);
+  EXPECT_EQ(first.decisions.size(), second.decisions.size());
+  EXPECT_EQ(first.final_capacity, second.final_capacity);
+}
+
+TEST(queue_simulator, runs_concurrently) {
+  as::queue_simulator_options options;
+  options.duration = 10min;
+  options.record_series = false;
+  as::queue_simulator simulator{options};
+
+  as::latency_target_policy sequential_policy;
+  const auto sequential = simulator.run(sequential_policy);
+
+  // The simulations don't install their clocks, so they don't interfere
+  std::vector<as::simulation_result> results(4);
+  std::vector<std::thread> threads;
+  for (auto& result : results) {
+    threads.emplace_back([&simulator, &result]() {
+      as::latency_target_policy policy;
+      result = simulator.run(policy);
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  EXPECT_EQ(as::get_clock(), nullptr);
+  for (auto& result : results) {
+    EXPECT_EQ(result.arrived_jobs, sequential.arrived_jobs);
+    EXPECT_EQ(result.decisions.size(), sequential.decisions.size());
+    EXPECT_EQ(result.final_capacity, sequential.final_capacity);
+  }
+}
+
+TEST(queue_simulator, installs_clock) {
+  as::queue_simulator_options options;
+  options.duration = 1min;
+  options.start_time = as::timestamp_t{} + 48h;
+  options.record_series = false;
+  options.install_clock = true;
+
+  clock_checking_policy policy;
+  as::queue_simulator{options}.run(policy);
+  EXPECT_EQ(policy.mismatches, 0);
+  EXPECT_EQ(as::get_clock(), nullptr);
+}
+
+TEST(queue_simulator, scales_with_recorded_load) {
+  // Ten minutes of 10 jobs per second, then 100 jobs per second
+  const auto start = as::timestamp_t{} + 24h;
+  std::vector<as::measurement<as::rate>> rates;
+  rates.emplace_back(start, as::rate{10.0});
+  rates.emplace_back(start + 10min, as::rate{100.0});
+
+  as::queue_simulator_options options;
+  options.name = "queue_simulator_test";
+  options.load = as::recorded_load(rates);
+  options.start_time = start;
+  options.duration = 30min;
+  options.mean_service_time = 50ms;
+  options.provisioning_delay = 5s;
+
+  as::latency_target_policy_options policy_options;
+  policy_options.target_latency = 20ms;
+  policy_options.max_capacity = 20;
+  as::latency_target_policy policy{policy_options};
+
+  const auto wall_start = std::chrono::steady_clock::now();
+  const auto result = as::queue_simulator{options}.run(policy);
+  // Much faster than the 30 simulated minutes
+  EXPECT_LT(std::chrono::steady_clock::now() - wall_start, 30s);
+
+  // Offered load of 5 servers after the step
+  EXPECT_GE(result.final_capacity, 6ull);
+  EXPECT_LE(result.final_capacity, 14ull);
+  EXPECT_GE(result.max_capacity, result.final_capacity);
+  EXPECT_GE(result.scale_outs, 1ull);
+  EXPECT_EQ(result.decisions.size(), result.scale_outs + result.scale_ins);
+
+  // Series are timestamped with the virtual clock
+  auto capacity = as::get_measurements<size_t>(
+      "queue_simulator_test.capacity", start, start + 1h);
+  ASSERT_EQ(capacity.size(), 1800ull);
+  EXPECT_EQ(capacity.front().timestamp, start + 1s);
+  EXPECT_EQ(capacity.back().timestamp, start + 30min);
+  EXPECT_EQ(capacity.back().data, result.final_capacity);
+
+  // Half a server of load before the step doesn't need more than a few
+  for (auto& m : capacity) {
+    if (m.timestamp < start + 10min) {
+      EXPECT_LE(m.data, 5ull);
+    }
+  }
+
+  as::clear_measurements<size_t>();
+  as::clear_measurements<double>();
+  as::clear_measurements<as::timespan_t>();
+}
@@ -0,0 +1,47 @@
+#include "pch.h"
+
+#include "simulation/virtual_clock.h"
+
+using namespace std::chrono_literals;
+
+TEST(virtual_clock, replaces_now) {
+  const auto start = as::timestamp_t{} + 1h;
+  as::virtual_clock clock{start};
+  {
+    as::scoped_clock guard{clock};
+    EXPECT_EQ(as::get_clock(), &clock);
+    EXPECT_EQ(as::now(), start);
+
+    clock.advance(5s);
+    EXPECT_EQ(as::now(), start + 5s);
+    clock.set(start + 1min);
+    EXPECT_EQ(as::now(), start + 1min);
+  }
+  EXPECT_EQ(as::get_clock(), nullptr);
+  EXPECT_GT(as::now(), start + 1min);
+}
+
+TEST(virtual_clock, cannot_go_backwards) {
+  as::virtual_clock clock{as::timestamp_t{} + 1h};
+  EXPECT_THROW(clock.set(as::timestamp_t{}), std::runtime_error);
+  EXPECT_THROW(clock.advance(-1s), std::runtime_error);
+  EXPECT_EQ(clock.now(), as::timestamp_t{} + 1h);
+}
+
+TEST(virtual_clock, timestamps_measurements) {
+  as::virtual_clock clock{as::timestamp_t{} + 1h};
+  {
+    as::scoped_clock guard{clock};
+    as::add_measurement<double>("virtual_clock_test", 1.0);
+    clock.advance(10s);
+    as::add_measurement<double>("virtual_clock_test", 2.0);
+  }
+
+  auto measurements =
+      as::get_measurements<double>("virtual_clock_test", as::timestamp_t{},
+                                   as::timestamp_t{} + 2h);
+  ASSERT_EQ(measurements.size(), 2ull);
+  EXPECT_EQ(measurements[0].timestamp, as::timestamp_t{} + 1h);
+  EXPECT_EQ(measurements[1].timestamp, as::timestamp_t{} + 1h + 10s);
+  as::clear_measurements<double>();
+}
@@ -0,0 +1,67 @@
+#include "pch.h"
+
+#include "util/exemplars.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+as::exemplar make_exemplar(std::chrono::nanoseconds value,
+                           std::chrono::nanoseconds time,
+                           uint64_t request_id = 0) {
+  as::exemplar ret;
+  ret.value = value;
+  ret.timestamp = std::chrono::high_resolution_clock::time_point{} + time;
+  ret.request_id = request_id;
+  return ret;
+}
+
+}  // namespace
+
+TEST(top_exemplars, keeps_largest) {
+  as::top_exemplars exemplars{3, 1min};
+  for (uint64_t idx = 0; idx < 100; ++idx) {
+    // Largest values are 99, 98 and 97 at requests 99, 49 and 98
+    const auto value = std::chrono::nanoseconds{(idx * 2) % 100 + idx / 50};
+    exemplars.offer(make_exemplar(value, 1s, idx));
+  }
+  const auto result = exemplars.get_exemplars();
+  ASSERT_EQ(result.size(), 3ull);
+  EXPECT_EQ(result[0].value.count(), 99);
+  EXPECT_EQ(result[0].request_id, 99ull);
+  EXPECT_EQ(result[1].value.count(), 98);
+  EXPECT_EQ(result[2].value.count(), 97);
+
+  // Not larger than the smallest kept exemplar
+  EXPECT_FALSE(exemplars.offer(make_exemplar(97ns, 2s)));
+  EXPECT_TRUE(exemplars.offer(make_exemplar(98ns, 2s)));
+
+  exemplars.clear();
+  EXPECT_TRUE(exemplars.get_exemplars().empty());
+  EXPECT_TRUE(exemplars.offer(make_exemplar(1ns, 3s)));
+}
+
+TEST(top_exemplars, rolls_windows) {
+  as::top_exemplars exemplars{2, 1min};
+  exemplars.offer(make_exemplar(10ns, 10s, 1));
+  exemplars.offer(make_exemplar(20ns, 20s, 2));
+
+  // A small value starts a new window, the previous one is still reported
+  EXPECT_TRUE(exemplars.offer(make_exemplar(1ns, 70s, 3)));
+  auto result = exemplars.get_exemplars();
+  ASSERT_EQ(result.size(), 2ull);
+  EXPECT_EQ(result[0].request_id, 2ull);
+  EXPECT_EQ(result[1].request_id, 1ull);
+
+  exemplars.offer(make_exemplar(30ns, 80s, 4));
+  result = exemplars.get_exemplars();
+  ASSERT_EQ(result.size(), 2ull);
+  EXPECT_EQ(result[0].request_id, 4ull);
+  EXPECT_EQ(result[1].request_id, 2ull);
+
+  // Windows without samples in between drop everything older
+  exemplars.offer(make_exemplar(5ns, 300s, 5));
+  result = exemplars.get_exemplars();
+  ASSERT_EQ(result.size(), 1ull);
+  EXPECT_EQ(result[0].request_id, 5ull);
+}
@@ -0,0 +1,64 @@
+#include "pch.h"
+
+#include "util/heavy_hitters.h"
+
+#include <random>
+
+TEST(count_min_sketch, never_undercounts) {
+  as::count_min_sketch sketch{64, 4};
+  std::vector<uint64_t> counts(1000, 0);
+  std::minstd_rand random{1};
+  std::uniform_int_distribution<size_t> key{0, counts.size() - 1};
+  for (int idx = 0; idx < 10000; ++idx) {
+    const auto k = key(random);
+    ++counts[k];
+    sketch.add(k);
+  }
+  EXPECT_EQ(sketch.get_total(), 10000ull);
+
+  uint64_t overcount = 0;
+  for (size_t k = 0; k < counts.size(); ++k) {
+    const auto estimate = sketch.estimate(k);
+    EXPECT_GE(estimate, counts[k]);
+    overcount += estimate - counts[k];
+  }
+  // e / width of the total is the bound for most keys, the average is lower
+  EXPECT_LT(overcount / counts.size(), 10000ull * 3 / 64);
+
+  sketch.clear();
+  EXPECT_EQ(sketch.estimate(0), 0ull);
+}
+
+TEST(heavy_hitters, finds_most_frequent_names) {
+  // Three hot names and a long tail of cold ones
+  as::heavy_hitters hitters{10};
+  std::vector<std::string> stream;
+  const std::vector<std::pair<std::string, int>> hot{
+      {"tenant.a", 3000}, {"tenant.b", 2000}, {"tenant.c", 1000}};
+  for (auto& [name, count] : hot) stream.insert(stream.end(), count, name);
+  for (int k = 0; k < 200; ++k)
+    stream.insert(stream.end(), 10, "cold." + std::to_string(k));
+  std::shuffle(stream.begin(), stream.end(), std::minstd_rand{7});
+  for (auto& name : stream) hitters.add(name);
+
+  const auto top = hitters.get_top();
+  ASSERT_EQ(top.size(), 10ull);
+  for (size_t idx = 0; idx < hot.size(); ++idx) {
+    EXPECT_EQ(top[idx].name, hot[idx].first);
+    // The true count is within the bounds
+    const auto count = static_cast<uint64_t>(hot[idx].second);
+    EXPECT_GE(top[idx].count, count);
+    EXPECT_LE(top[idx].count - top[idx].error, count);
+  }
+
+  // The Count-Min sketch is much more precise for hot names
+  EXPECT_GE(hitters.estimate("tenant.a"), 3000ull);
+  EXPECT_LT(hitters.estimate("tenant.a"), 3050ull);
+  EXPECT_GE(hitters.estimate("cold.100"), 10ull);
+  EXPECT_LT(hitters.estimate("cold.100"), 50ull);
+  EXPECT_EQ(hitters.estimate("unknown"), 0ull);
+  EXPECT_EQ(hitters.get_total(), stream.size());
+
+  hitters.clear();
+  EXPECT_TRUE(hitters.get_top().empty());
+}
@@ -0,0 +1,42 @@
+#include "pch.h"
+
+#include "util/hyperloglog.h"
+
+TEST(hyperloglog, estimates_distinct_hashes) {
+  as::hyperloglog sketch;
+  EXPECT_TRUE(sketch.empty());
+  EXPECT_DOUBLE_EQ(sketch.estimate(), 0.0);
+  EXPECT_EQ(sketch.get_size(), 4096ull);
+
+  // Small cardinalities are almost exact
+  for (uint64_t key = 0; key < 100; ++key) sketch.add(as::math::mix_hash(key));
+  EXPECT_NEAR(sketch.estimate(), 100.0, 2.0);
+
+  // Duplicates do not count
+  for (uint64_t key = 0; key < 100; ++key) sketch.add(as::math::mix_hash(key));
+  EXPECT_NEAR(sketch.estimate(), 100.0, 2.0);
+
+  // Within 3 standard errors of 1.6%
+  for (uint64_t key = 100; key < 100000; ++key)
+    sketch.add(as::math::mix_hash(key));
+  EXPECT_NEAR(sketch.estimate(), 100000.0, 5000.0);
+
+  sketch.clear();
+  EXPECT_TRUE(sketch.empty());
+}
+
+TEST(hyperloglog, merge_is_union) {
+  as::hyperloglog a{10};
+  as::hyperloglog b{10};
+  for (uint64_t key = 0; key < 20000; ++key) {
+    if (key < 15000) a.add(as::math::mix_hash(key));
+    if (key >= 5000) b.add(as::math::mix_hash(key));
+  }
+  a.merge(b);
+  // Within 3 standard errors of 3.3%
+  EXPECT_NEAR(a.estimate(), 20000.0, 2000.0);
+
+  EXPECT_THROW(a.merge(as::hyperloglog{11}), std::runtime_error);
+  EXPECT_THROW(as::hyperloglog{3}, std::runtime_error);
+  EXPECT_THROW(as::hyperloglog{17}, std::runtime_error);
+}
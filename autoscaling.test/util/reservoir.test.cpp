@@ -0,0 +1,70 @@
+#include "pch.h"
+
+#include "util/reservoir.h"
+
+#include <numeric>
+
+TEST(reservoir, fills_up_to_capacity) {
+  as::reservoir<int> reservoir{4};
+  for (int idx = 0; idx < 3; ++idx) reservoir.insert(idx);
+  EXPECT_EQ(reservoir.size(), 3ull);
+  EXPECT_EQ(reservoir.capacity(), 4ull);
+
+  for (int idx = 3; idx < 1000; ++idx) reservoir.insert(idx);
+  EXPECT_EQ(reservoir.size(), 4ull);
+  EXPECT_EQ(reservoir.get_count(), 1000ull);
+
+  reservoir.clear();
+  EXPECT_EQ(reservoir.size(), 0ull);
+  EXPECT_EQ(reservoir.get_count(), 0ull);
+}
+
+TEST(reservoir, samples_uniformly) {
+  // How often each tenth of the stream is sampled over many runs
+  constexpr int stream = 10000;
+  constexpr int runs = 200;
+  std::vector<int> tenths(10, 0);
+  for (uint32_t run = 0; run < runs; ++run) {
+    as::reservoir<int> reservoir{50, run + 1};
+    for (int idx = 0; idx < stream; ++idx) reservoir.insert(idx);
+    for (auto value : reservoir) ++tenths[value * 10 / stream];
+  }
+  // 1000 expected per tenth, a newest-only cache would have all in the last
+  for (auto count : tenths) {
+    EXPECT_GT(count, 850);
+    EXPECT_LT(count, 1150);
+  }
+}
+
+TEST(decaying_reservoir, prefers_recent_elements) {
+  // With a half-life of a tenth of the stream, elements in the last tenth
+  // are much more likely to be kept than the ones in the first half
+  constexpr int stream = 10000;
+  std::vector<int> tenths(10, 0);
+  for (uint32_t run = 0; run < 50; ++run) {
+    as::decaying_reservoir<int> reservoir{50, stream / 10.0, run + 1};
+    for (int idx = 0; idx < stream; ++idx)
+      reservoir.insert(idx, static_cast<double>(idx));
+    EXPECT_EQ(reservoir.size(), 50ull);
+    for (auto value : reservoir) ++tenths[value * 10 / stream];
+  }
+  const auto first_half =
+      std::accumulate(tenths.begin(), tenths.begin() + 5, 0);
+  EXPECT_LT(first_half, tenths[9] / 10);
+  // Each tenth is about half as likely as the next one
+  EXPECT_GT(tenths[9], tenths[8]);
+  EXPECT_GT(tenths[8], tenths[7]);
+}
+
+TEST(decaying_reservoir, without_decay_samples_uniformly) {
+  constexpr int stream = 10000;
+  std::vector<int> halves(2, 0);
+  for (uint32_t run = 0; run < 100; ++run) {
+    as::decaying_reservoir<int> reservoir{50, 0.0, run + 1};
+    for (int idx = 0; idx < stream; ++idx)
+      reservoir.insert(idx, static_cast<double>(idx));
+    for (auto value : reservoir) ++halves[value * 2 / stream];
+  }
+  EXPECT_NEAR(halves[0], 2500, 250);
+  EXPECT_NEAR(halves[1], 2500, 250);
+}
@@ -0,0 +1,71 @@
+#include "pch.h"
+
+#include "util/ring_buffer.h"
+
+#include <thread>
+
+TEST(spsc_ring_buffer, capacity_rounded_up) {
+  as::spsc_ring_buffer<int> buffer{5};
+  EXPECT_EQ(buffer.capacity(), 8ull);
+  EXPECT_TRUE(buffer.empty());
+}
+
+TEST(spsc_ring_buffer, push_pop) {
+  as::spsc_ring_buffer<int> buffer{4};
+
+  EXPECT_TRUE(buffer.try_push(1));
+  EXPECT_TRUE(buffer.try_push(2));
+  EXPECT_EQ(buffer.size(), 2ull);
+
+  int value = 0;
+  EXPECT_TRUE(buffer.try_pop(value));
+  EXPECT_EQ(value, 1);
+  EXPECT_TRUE(buffer.try_pop(value));
+  EXPECT_EQ(value, 2);
+  EXPECT_FALSE(buffer.try_pop(value));
+}
+
+TEST(spsc_ring_buffer, full) {
+  as::spsc_ring_buffer<int> buffer{4};
+  for (int idx = 0; idx < 4; ++idx) EXPECT_TRUE(buffer.try_push(idx));
+
+  EXPECT_FALSE(buffer.try_push(4));
+  EXPECT_EQ(buffer.size(), 4ull);
+}
+
+TEST(spsc_ring_buffer, consume_all) {
+  as::spsc_ring_buffer<int> buffer{4};
+  for (int round = 0; round < 3; ++round) {
+    for (int idx = 0; idx < 3; ++idx) buffer.try_push(round * 3 + idx);
+
+    std::vector<int> consumed;
+    EXPECT_EQ(buffer.consume_all([&](int value) { consumed.push_back(value); }),
+              3ull);
+    EXPECT_EQ(consumed,
+              (std::vector<int>{round * 3, round * 3 + 1, round * 3 + 2}));
+    EXPECT_TRUE(buffer.empty());
+  }
+}
+
+TEST(spsc_ring_buffer, concurrent_producer_consumer) {
+  as::spsc_ring_buffer<int> buffer{64};
+  const int count = 100000;
+
+  std::thread producer{[&]() {
+    for (int idx = 0; idx < count; ++idx) {
+      while (!buffer.try_push(idx)) std::this_thread::yield();
+    }
+  }};
+
+  int expected = 0;
+  while (expected < count) {
+    int value;
+    if (!buffer.try_pop(value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    ASSERT_EQ(value, expected);
+    ++expected;
+  }
+  producer.join();
+}
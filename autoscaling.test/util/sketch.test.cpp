@@ -0,0 +1,82 @@
+#include "pch.h"
+
+#include "util/sketch.h"
+
+using namespace std::chrono_literals;
+
+TEST(timing_sketch, empty) {
+  as::timing_sketch sketch;
+
+  EXPECT_EQ(sketch.count(), 0ull);
+  EXPECT_EQ(sketch.sum(), 0ns);
+  EXPECT_EQ(sketch.mean(), 0ns);
+  EXPECT_EQ(sketch.quantile(0.5), 0ns);
+}
+
+TEST(timing_sketch, bucket_bounds) {
+  for (uint64_t ns : {0ull, 1ull, 7ull, 8ull, 9ull, 100ull, 12345ull,
+                      1000000000ull}) {
+    const auto idx = as::timing_sketch::bucket_index(ns);
+    EXPECT_LE(as::timing_sketch::bucket_lower_bound(idx), ns);
+    EXPECT_GT(as::timing_sketch::bucket_lower_bound(idx + 1), ns);
+  }
+}
+
+TEST(timing_sketch, small_values_are_exact) {
+  as::timing_sketch sketch;
+  for (int ns = 1; ns <= 4; ++ns) sketch.record(std::chrono::nanoseconds{ns});
+
+  EXPECT_EQ(sketch.count(), 4ull);
+  EXPECT_EQ(sketch.sum(), 10ns);
+  EXPECT_EQ(sketch.quantile(0.0), 1ns);
+  EXPECT_EQ(sketch.quantile(0.5), 2ns);
+  EXPECT_EQ(sketch.quantile(1.0), 4ns);
+  EXPECT_EQ(sketch.max(), 4ns);
+}
+
+TEST(timing_sketch, quantile_relative_error) {
+  as::timing_sketch sketch;
+  for (int us = 1; us <= 1000; ++us)
+    sketch.record(std::chrono::microseconds{us});
+
+  const auto p99 = static_cast<double>(sketch.quantile(0.99).count());
+  EXPECT_NEAR(p99, 990000.0, 990000.0 * 0.125);
+  EXPECT_EQ(sketch.mean(), std::chrono::nanoseconds{500500});
+}
+
+TEST(timing_sketch, merge) {
+  as::timing_sketch first, second;
+  first.record(10ns);
+  second.record(20ns);
+  second.record(30ns);
+
+  first.merge(second);
+
+  EXPECT_EQ(first.count(), 3ull);
+  EXPECT_EQ(first.sum(), 60ns);
+  EXPECT_EQ(first.max(), 30ns);
+}
+
+TEST(timing_sketch, subtract) {
+  as::timing_sketch sketch;
+  sketch.record(10ns);
+  const auto snapshot = sketch;
+  sketch.record(2000ns);
+  sketch.record(3000ns);
+
+  auto since_snapshot = sketch;
+  since_snapshot.subtract(snapshot);
+
+  EXPECT_EQ(since_snapshot.count(), 2ull);
+  EXPECT_EQ(since_snapshot.sum(), 5000ns);
+  EXPECT_GE(since_snapshot.quantile(0.0), 1500ns);
+}
+
+TEST(timing_sketch, clear) {
+  as::timing_sketch sketch;
+  sketch.record(10ns);
+  sketch.clear();
+
+  EXPECT_EQ(sketch.count(), 0ull);
+  EXPECT_EQ(sketch.max(), 0ns);
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+#include "util/ring_buffer.h"
+#include "util/sketch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace as {
+
+#pragma region executor_statistics
+
+/// <summary>
+/// Cumulative statistics of an executor since it was created
+/// </summary>
+struct executor_statistics {
+  size_t worker_count = 0;
+  /// <summary>
+  /// Number of tasks that were submitted and have not started yet
+  /// </summary>
+  size_t queue_length = 0;
+  uint64_t executed_tasks = 0;
+  /// <summary>
+  /// Number of tasks that exited with an exception
+  /// </summary>
+  uint64_t failed_tasks = 0;
+  /// <summary>
+  /// Number of task timings that were not recorded into the series because
+  /// the buffer of a worker was full, see buffer_capacity_per_worker. The
+  /// sketches of these statistics still contain them
+  /// </summary>
+  uint64_t dropped_timings = 0;
+  /// <summary>
+  /// Time from submitting a task until a worker started it
+  /// </summary>
+  timing_sketch queue_wait_time;
+  timing_sketch execution_time;
+  /// <summary>
+  /// Total time that the workers spent executing tasks
+  /// </summary>
+  timespan_t busy_time{0};
+  /// <summary>
+  /// Fraction of the time that the workers were executing tasks, in [0;1],
+  /// relative to the current worker count
+  /// </summary>
+  double utilization = 0.0;
+};
+
+#pragma endregion
+
+#pragma region instrumented_executor
+
+struct executor_options {
+  /// <summary>
+  /// Prefix of the names of the recorded series, e.g. "<name>.queue_wait"
+  /// </summary>
+  std::string name = "executor";
+  size_t worker_count = std::max(1u, std::thread::hardware_concurrency());
+  /// <summary>
+  /// Upper bound for set_worker_count, zero means worker_count. Threads for
+  /// all workers are started upfront; workers beyond the current worker count
+  /// are retired and block until they are needed again
+  /// </summary>
+  size_t max_worker_count = 0;
+  /// <summary>
+  /// Capacity of the buffer in which each worker stores the timings of its
+  /// tasks until they are collected. Timings that don't fit are dropped
+  /// </summary>
+  size_t buffer_capacity_per_worker = 1 << 12;
+  /// <summary>
+  /// Interval in which the buffered timings, the queue length and the busy
+  /// fractions are recorded into the series
+  /// </summary>
+  std::chrono::milliseconds collect_interval{100};
+};
+
+/// <summary>
+/// Work-stealing thread pool that records queueing metrics of its tasks:
+/// - "<name>.queue_wait" (timespan_t): time from submission to start of each
+///   task, timestamped with the start of the task
+/// - "<name>.execution_time" (timespan_t): execution time of each task
+/// - "<name>.queue_length" (size_t): tasks waiting to be started
+/// - "<name>.utilization" (double): busy fraction of all workers
+/// - "<name>.worker.<idx>.busy_fraction" (double): busy fraction per worker
+///
+/// Each worker has its own task queue and steals from the others when it
+/// runs out of work. Workers write the timings of their tasks into their own
+/// buffer without synchronization; a background thread moves them into the
+/// measurement storage, so the instrumentation doesn't serialize the pool.
+/// Idle and retired workers block on a condition variable
+/// </summary>
+class AS_API instrumented_executor {
+ public:
+  explicit instrumented_executor(executor_options options = {});
+
+  /// <summary>
+  /// Executes all tasks that are already queued, then stops the workers
+  /// </summary>
+  ~instrumented_executor();
+
+  instrumented_executor(const instrumented_executor&) = delete;
+  instrumented_executor& operator=(const instrumented_executor&) = delete;
+
+  /// <summary>
+  /// Queues the task. When called from a worker of this executor, the task
+  /// is queued on that worker, otherwise the workers are chosen round-robin.
+  /// Exceptions thrown by the task are counted as failed tasks and dropped
+  /// </summary>
+  void submit(std::function<void()> task);
+
+  /// <summary>
+  /// Queues the function and returns a future for its result
+  /// </summary>
+  template <typename Func>
+  auto async(Func&& func) -> std::future<std::invoke_result_t<Func>> {
+    using result_t = std::invoke_result_t<Func>;
+    auto task = std::make_shared<std::packaged_task<result_t()>>(
+        std::forward<Func>(func));
+    auto future = task->get_future();
+    submit([task]() { (*task)(); });
+    return future;
+  }
+
+  /// <summary>
+  /// Blocks until all submitted tasks have finished
+  /// </summary>
+  void wait_for_idle();
+
+  /// <summary>
+  /// Changes the number of workers that execute tasks, clamped to
+  /// [1;max_worker_count]. Retired workers finish their current task, their
+  /// queued tasks are stolen by the remaining workers
+  /// </summary>
+  void set_worker_count(size_t worker_count);
+
+  size_t get_worker_count() const;
+  size_t get_max_worker_count() const;
+  size_t get_queue_length() const;
+  executor_statistics get_statistics() const;
+
+  /// <summary>
+  /// Records the buffered timings, the queue length and the busy fractions
+  /// immediately instead of waiting for the next collect interval
+  /// </summary>
+  void collect();
+
+  std::string_view get_queue_wait_name() const;
+  std::string_view get_execution_time_name() const;
+  std::string_view get_queue_length_name() const;
+  std::string_view get_utilization_name() const;
+
+ private:
+  struct task_item {
+    std::function<void()> func;
+    timestamp_t submit_time;
+  };
+
+  struct task_timing {
+    timestamp_t start_time;
+    timespan_t queue_wait;
+    timespan_t execution_time;
+  };
+
+  struct worker {
+    explicit worker(size_t buffer_capacity) : timings(buffer_capacity) {}
+
+    std::mutex queue_lock;
+    std::deque<task_item> queue;
+
+    spsc_ring_buffer<task_timing> timings;
+    timing_sketch queue_wait_time;
+    timing_sketch execution_time;
+    std::atomic<uint64_t> executed_tasks{0};
+    std::atomic<uint64_t> failed_tasks{0};
+    std::atomic<uint64_t> dropped_timings{0};
+    std::atomic<int64_t> busy_ns{0};
+    /// <summary>
+    /// Start of the current task in nanoseconds since the epoch, zero if idle
+    /// </summary>
+    std::atomic<int64_t> task_start_ns{0};
+
+    // Collector state
+    std::string_view busy_fraction_name;
+    int64_t collected_busy_ns = 0;
+
+    std::thread thread;
+  };
+
+  void run_worker(size_t idx);
+  bool try_pop(size_t idx, task_item& task);
+  void execute(worker& worker, task_item& task);
+  int64_t get_busy_ns(const worker& worker, timestamp_t timestamp) const;
+  void run_collector();
+
+  const executor_options _options;
+  const timestamp_t _start_time;
+
+  std::string_view _queue_wait_name;
+  std::string_view _execution_time_name;
+  std::string_view _queue_length_name;
+  std::string_view _utilization_name;
+
+  std::vector<std::unique_ptr<worker>> _workers;
+  std::atomic<size_t> _active_workers;
+  std::atomic<size_t> _next_worker;
+  std::atomic<size_t> _queued;
+  std::atomic<size_t> _unfinished;
+
+  std::mutex _park_lock;
+  std::condition_variable _park_signal;
+  std::condition_variable _retire_signal;
+  std::atomic<size_t> _parked;
+  bool _stop_workers;
+
+  std::mutex _idle_lock;
+  std::condition_variable _idle_signal;
+
+  std::mutex _collect_lock;
+  timestamp_t _last_collect_time;
+
+  std::mutex _stop_lock;
+  std::condition_variable _stop_signal;
+  bool _stop;
+  std::thread _collector;
+};
+
+#pragma endregion
+
+}  // namespace as
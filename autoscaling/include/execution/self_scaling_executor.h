@@ -0,0 +1,97 @@
+#pragma once
+
+#include "api.h"
+#include "execution/instrumented_executor.h"
+#include "scaling/decision_journal.h"
+#include "scaling/scaling_policy.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace as {
+
+#pragma region self_scaling_executor
+
+struct self_scaling_executor_options {
+  /// <summary>
+  /// Options of the underlying executor. worker_count is the initial number
+  /// of workers, max_worker_count is replaced by the maximum capacity of the
+  /// policy
+  /// </summary>
+  executor_options executor;
+  latency_target_policy_options policy;
+  /// <summary>
+  /// Quantile of the queue wait time that is compared to the target latency
+  /// </summary>
+  double latency_quantile = 0.95;
+  std::chrono::milliseconds evaluation_interval{1000};
+};
+
+/// <summary>
+/// Executor that adjusts its number of workers to its own measurements. Every
+/// evaluation interval, the queue wait quantile and the utilization since the
+/// previous evaluation are passed to a latency_target_policy, whose decision
+/// is applied to the worker count right away. Each change of the worker
+/// count is recorded in the series "<name>.worker_count" (size_t), and every
+/// decision in the journal "<name>.decisions".
+///
+/// Threads for the maximum number of workers are created upfront. Retired
+/// and idle workers block on condition variables and don't consume CPU time
+/// </summary>
+class AS_API self_scaling_executor {
+ public:
+  explicit self_scaling_executor(self_scaling_executor_options options = {});
+  ~self_scaling_executor();
+
+  self_scaling_executor(const self_scaling_executor&) = delete;
+  self_scaling_executor& operator=(const self_scaling_executor&) = delete;
+
+  void submit(std::function<void()> task);
+
+  template <typename Func>
+  auto async(Func&& func) -> std::future<std::invoke_result_t<Func>> {
+    return _executor.async(std::forward<Func>(func));
+  }
+
+  void wait_for_idle();
+
+  size_t get_worker_count() const;
+  instrumented_executor& get_executor();
+  const decision_journal& get_journal() const;
+
+  /// <summary>
+  /// Evaluates the policy and applies its decision immediately instead of
+  /// waiting for the next evaluation interval
+  /// </summary>
+  scaling_decision evaluate();
+
+  std::string_view get_worker_count_name() const;
+
+ private:
+  static executor_options make_executor_options(
+      const self_scaling_executor_options& options);
+  static decision_journal_options make_journal_options(
+      const self_scaling_executor_options& options,
+      const instrumented_executor& executor);
+  void run();
+
+  const self_scaling_executor_options _options;
+  instrumented_executor _executor;
+  latency_target_policy _policy;
+  std::string_view _worker_count_name;
+  decision_journal _journal;
+
+  std::mutex _evaluate_lock;
+  timestamp_t _previous_timestamp;
+  executor_statistics _previous_statistics;
+
+  std::mutex _stop_lock;
+  std::condition_variable _stop_signal;
+  bool _stop;
+  std::thread _thread;
+};
+
+#pragma endregion
+
+}  // namespace as
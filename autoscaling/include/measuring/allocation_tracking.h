@@ -0,0 +1,285 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace as {
+
+#pragma region allocation_counters
+
+/// <summary>
+/// Names of the series that the allocation_sampler records
+/// </summary>
+constexpr const char* heap_live_bytes_name = "heap.live_bytes";
+/// <summary>
+/// Allocated bytes per second
+/// </summary>
+constexpr const char* heap_allocation_rate_name = "heap.allocation_rate";
+/// <summary>
+/// Allocations per second
+/// </summary>
+constexpr const char* heap_allocation_count_rate_name =
+    "heap.allocation_count_rate";
+
+/// <summary>
+/// Cumulative heap allocation counters. Sizes are the usable sizes reported
+/// by the allocator, which may be slightly larger than the requested sizes
+/// </summary>
+struct allocation_counters {
+  uint64_t allocated_bytes = 0;
+  uint64_t freed_bytes = 0;
+  uint64_t allocations = 0;
+  uint64_t deallocations = 0;
+
+  /// <summary>
+  /// Bytes allocated and not freed yet. For a single thread this can be
+  /// negative if the thread frees memory that other threads allocated
+  /// </summary>
+  int64_t live_bytes() const {
+    return static_cast<int64_t>(allocated_bytes - freed_bytes);
+  }
+};
+
+AS_API allocation_counters operator-(const allocation_counters& l,
+                                     const allocation_counters& r);
+
+/// <summary>
+/// True if the tracking operators were linked into the program with
+/// AS_DEFINE_ALLOCATION_TRACKING_OPERATORS
+/// </summary>
+AS_API bool is_allocation_tracking_enabled();
+
+/// <summary>
+/// Returns the exact counters of the calling thread. Cheap, as this only reads
+/// thread-local state
+/// </summary>
+AS_API allocation_counters get_thread_allocation_counters();
+
+/// <summary>
+/// Returns the counters of the whole process. Threads accumulate their
+/// counters locally and flush them every few hundred operations or on large
+/// allocations, so the result lags behind by at most that much per thread
+/// </summary>
+AS_API allocation_counters get_process_allocation_counters();
+
+namespace detail {
+AS_API void enable_allocation_tracking();
+
+AS_API void* tracked_allocate(size_t size);
+AS_API void* tracked_allocate_nothrow(size_t size) noexcept;
+AS_API void* tracked_allocate_aligned(size_t size, std::align_val_t alignment);
+AS_API void* tracked_allocate_aligned_nothrow(
+    size_t size, std::align_val_t alignment) noexcept;
+AS_API void tracked_deallocate(void* ptr) noexcept;
+AS_API void tracked_deallocate_aligned(void* ptr,
+                                       std::align_val_t alignment) noexcept;
+
+struct AS_API ScopeAllocationHelper {
+  explicit ScopeAllocationHelper(const char* name);
+  ~ScopeAllocationHelper();
+
+ private:
+  const char* _name;
+  bool _valid;
+  uint64_t _start_allocated_bytes;
+};
+}  // namespace detail
+
+#pragma endregion
+
+#pragma region scope_memory
+
+/// <summary>
+/// Heap usage of the calling thread inside a scope
+/// </summary>
+struct scope_memory {
+  /// <summary>
+  /// Bytes allocated and not freed inside the scope. Zero if the scope freed
+  /// more than it allocated
+  /// </summary>
+  memory net;
+  /// <summary>
+  /// Highest number of bytes allocated and not freed at any point inside the
+  /// scope
+  /// </summary>
+  memory peak;
+};
+
+namespace detail {
+struct AS_API ScopeMemoryHelper {
+  explicit ScopeMemoryHelper(const char* name);
+  ~ScopeMemoryHelper();
+
+ private:
+  const char* _name;
+  bool _valid;
+  int64_t _start_live_bytes;
+  int64_t _outer_peak_live_bytes;
+};
+}  // namespace detail
+
+#pragma endregion
+
+#pragma region allocation_sampler
+
+struct allocation_sampler_options {
+  std::chrono::milliseconds interval{1000};
+};
+
+/// <summary>
+/// Periodically records the process-wide live heap bytes and the allocation
+/// rates into the series named above. Requires allocation tracking to be
+/// enabled
+/// </summary>
+struct AS_API allocation_sampler {
+  /// <exception cref="std::runtime_error">If allocation tracking is not
+  /// enabled</exception>
+  explicit allocation_sampler(allocation_sampler_options options = {});
+  ~allocation_sampler();
+
+  allocation_sampler(const allocation_sampler&) = delete;
+  allocation_sampler& operator=(const allocation_sampler&) = delete;
+
+  /// <summary>
+  /// Takes and records a sample immediately
+  /// </summary>
+  void sample();
+
+ private:
+  void run();
+
+  const allocation_sampler_options _options;
+
+  std::mutex _sample_lock;
+  bool _has_previous_sample;
+  timestamp_t _previous_timestamp;
+  allocation_counters _previous_counters;
+
+  std::mutex _stop_lock;
+  std::condition_variable _stop_signal;
+  bool _stop;
+  std::thread _thread;
+};
+
+#pragma endregion
+
+#pragma region helper_macros
+
+/// <summary>
+/// Records the number of bytes that the current thread allocates inside the
+/// current scope as a measurement of type memory. Memory freed inside the
+/// scope is not subtracted. Records nothing if allocation tracking is not
+/// enabled
+/// </summary>
+#define MEASURE_SCOPE_ALLOCATIONS(name)                               \
+  as::detail::ScopeAllocationHelper AS_CONCAT(__measure_allocations_, \
+                                              __LINE__) {             \
+    name                                                              \
+  }
+
+/// <summary>
+/// Records the bytes allocated by the current function under the same name
+/// that MEASURE_FUNCTION_TIMING uses
+/// </summary>
+#define MEASURE_FUNCTION_ALLOCATIONS MEASURE_SCOPE_ALLOCATIONS(__FUNCTION__)
+
+/// <summary>
+/// Records the net and peak heap bytes of the calling thread inside the
+/// current scope as a measurement of type scope_memory. Records nothing if
+/// allocation tracking is not enabled
+/// </summary>
+#define MEASURE_SCOPE_MEMORY(name)                                       \
+  as::detail::ScopeMemoryHelper AS_CONCAT(__measure_memory_, __LINE__) { \
+    name                                                                 \
+  }
+
+/// <summary>
+/// Records the heap usage of the current function under the same name that
+/// MEASURE_FUNCTION_TIMING uses
+/// </summary>
+#define MEASURE_FUNCTION_MEMORY MEASURE_SCOPE_MEMORY(__FUNCTION__)
+
+/// <summary>
+/// Replaces the global operator new and delete with versions that count the
+/// allocations. Allocation tracking is opt-in: expand this macro once, at
+/// global scope, in a single source file of the executable
+/// </summary>
+#define AS_DEFINE_ALLOCATION_TRACKING_OPERATORS                            \
+  void* operator new(std::size_t size) {                                   \
+    return as::detail::tracked_allocate(size);                             \
+  }                                                                        \
+  void* operator new[](std::size_t size) {                                 \
+    return as::detail::tracked_allocate(size);                             \
+  }                                                                        \
+  void* operator new(std::size_t size, const std::nothrow_t&) noexcept {   \
+    return as::detail::tracked_allocate_nothrow(size);                     \
+  }                                                                        \
+  void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { \
+    return as::detail::tracked_allocate_nothrow(size);                     \
+  }                                                                        \
+  void* operator new(std::size_t size, std::align_val_t alignment) {       \
+    return as::detail::tracked_allocate_aligned(size, alignment);          \
+  }                                                                        \
+  void* operator new[](std::size_t size, std::align_val_t alignment) {     \
+    return as::detail::tracked_allocate_aligned(size, alignment);          \
+  }                                                                        \
+  void* operator new(std::size_t size, std::align_val_t alignment,         \
+                     const std::nothrow_t&) noexcept {                     \
+    return as::detail::tracked_allocate_aligned_nothrow(size, alignment);  \
+  }                                                                        \
+  void* operator new[](std::size_t size, std::align_val_t alignment,       \
+                       const std::nothrow_t&) noexcept {                   \
+    return as::detail::tracked_allocate_aligned_nothrow(size, alignment);  \
+  }                                                                        \
+  void operator delete(void* ptr) noexcept {                               \
+    as::detail::tracked_deallocate(ptr);                                   \
+  }                                                                        \
+  void operator delete[](void* ptr) noexcept {                             \
+    as::detail::tracked_deallocate(ptr);                                   \
+  }                                                                        \
+  void operator delete(void* ptr, std::size_t) noexcept {                  \
+    as::detail::tracked_deallocate(ptr);                                   \
+  }                                                                        \
+  void operator delete[](void* ptr, std::size_t) noexcept {                \
+    as::detail::tracked_deallocate(ptr);                                   \
+  }                                                                        \
+  void operator delete(void* ptr, const std::nothrow_t&) noexcept {        \
+    as::detail::tracked_deallocate(ptr);                                   \
+  }                                                                        \
+  void operator delete[](void* ptr, const std::nothrow_t&) noexcept {      \
+    as::detail::tracked_deallocate(ptr);                                   \
+  }                                                                        \
+  void operator delete(void* ptr, std::align_val_t alignment) noexcept {   \
+    as::detail::tracked_deallocate_aligned(ptr, alignment);                \
+  }                                                                        \
+  void operator delete[](void* ptr, std::align_val_t alignment) noexcept { \
+    as::detail::tracked_deallocate_aligned(ptr, alignment);                \
+  }                                                                        \
+  void operator delete(void* ptr, std::size_t,                             \
+                       std::align_val_t alignment) noexcept {              \
+    as::detail::tracked_deallocate_aligned(ptr, alignment);                \
+  }                                                                        \
+  void operator delete[](void* ptr, std::size_t,                           \
+                         std::align_val_t alignment) noexcept {            \
+    as::detail::tracked_deallocate_aligned(ptr, alignment);                \
+  }                                                                        \
+  void operator delete(void* ptr, std::align_val_t alignment,              \
+                       const std::nothrow_t&) noexcept {                   \
+    as::detail::tracked_deallocate_aligned(ptr, alignment);                \
+  }                                                                        \
+  void operator delete[](void* ptr, std::align_val_t alignment,            \
+                         const std::nothrow_t&) noexcept {                 \
+    as::detail::tracked_deallocate_aligned(ptr, alignment);                \
+  }                                                                        \
+  static const bool AS_CONCAT(__as_allocation_tracking_, __LINE__) =       \
+      (as::detail::enable_allocation_tracking(), true)
+
+#pragma endregion
+
+}  // namespace as
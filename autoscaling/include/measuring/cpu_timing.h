@@ -0,0 +1,129 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+#include "util/sketch.h"
+
+#include <vector>
+
+namespace as {
+
+#pragma region thread_cpu_usage
+
+/// <summary>
+/// Resource usage counters of a single thread
+/// </summary>
+struct thread_cpu_usage {
+  timespan_t cpu_time{0};
+  uint64_t voluntary_context_switches = 0;
+  uint64_t involuntary_context_switches = 0;
+};
+
+/// <summary>
+/// What a CPU timing reads on scope entry and exit
+/// </summary>
+enum class cpu_timing_mode {
+  /// <summary>
+  /// Only the CPU time of the thread. On Linux this is one
+  /// clock_gettime(CLOCK_THREAD_CPUTIME_ID) call, which is a real system call
+  /// and thus several times more expensive than reading the wall clock
+  /// </summary>
+  cpu_time,
+  /// <summary>
+  /// CPU time and context switches of the thread. On Linux this adds a
+  /// getrusage(RUSAGE_THREAD) call, which roughly doubles the cost again
+  /// </summary>
+  cpu_time_and_context_switches
+};
+
+/// <summary>
+/// Returns the resource usage of the calling thread. Context switches are only
+/// available on Linux and are zero elsewhere
+/// </summary>
+AS_API thread_cpu_usage get_thread_cpu_usage(cpu_timing_mode mode);
+
+#pragma endregion
+
+#pragma region function_cpu_timing
+
+/// <summary>
+/// Timing of a function call that distinguishes time spent running on a CPU
+/// from time spent waiting (blocked, sleeping or preempted)
+/// </summary>
+struct function_cpu_timing {
+  timespan_t wall_time{0};
+  timespan_t cpu_time{0};
+  uint64_t voluntary_context_switches = 0;
+  uint64_t involuntary_context_switches = 0;
+
+  /// <summary>
+  /// Time in which the thread was not running on a CPU
+  /// </summary>
+  timespan_t off_cpu_time() const {
+    return std::max(wall_time - cpu_time, timespan_t{0});
+  }
+};
+
+/// <summary>
+/// Aggregation of CPU timings with separate distributions for on-CPU and
+/// off-CPU time
+/// </summary>
+struct AS_API cpu_timing_summary {
+  uint64_t count = 0;
+  timing_sketch wall_time;
+  timing_sketch on_cpu_time;
+  timing_sketch off_cpu_time;
+  uint64_t voluntary_context_switches = 0;
+  uint64_t involuntary_context_switches = 0;
+
+  /// <summary>
+  /// Fraction of the wall time that was spent on a CPU, in [0;1]
+  /// </summary>
+  double get_cpu_fraction() const;
+};
+
+/// <summary>
+/// Aggregates the given CPU timings
+/// </summary>
+AS_API cpu_timing_summary
+summarize_cpu_timings(const std::vector<measurement<function_cpu_timing>>&
+                          measurements);
+
+namespace detail {
+struct AS_API FunctionCpuTimingHelper {
+  FunctionCpuTimingHelper(const char* name, cpu_timing_mode mode);
+  ~FunctionCpuTimingHelper();
+
+ private:
+  const char* _name;
+  const cpu_timing_mode _mode;
+  timestamp_t _start_time;
+  thread_cpu_usage _start_usage;
+};
+}  // namespace detail
+
+#pragma endregion
+
+#pragma region helper_macros
+
+/// <summary>
+/// Like MEASURE_FUNCTION_TIMING, but records a function_cpu_timing that also
+/// contains what the cpu_timing_mode reads of the calling thread. The mode is
+/// given by name, e.g. MEASURE_FUNCTION_CPU_TIMING_MODE(cpu_time)
+/// </summary>
+#define MEASURE_FUNCTION_CPU_TIMING_MODE(mode)    \
+  as::detail::FunctionCpuTimingHelper AS_CONCAT(  \
+      __measure_function_cpu_timing_, __LINE__) { \
+    __FUNCTION__, as::cpu_timing_mode::mode       \
+  }
+
+/// <summary>
+/// Like MEASURE_FUNCTION_TIMING, but records a function_cpu_timing that also
+/// contains the CPU time and the context switches of the calling thread
+/// </summary>
+#define MEASURE_FUNCTION_CPU_TIMING \
+  MEASURE_FUNCTION_CPU_TIMING_MODE(cpu_time_and_context_switches)
+
+#pragma endregion
+
+}  // namespace as
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+#include "util/hyperloglog.h"
+
+#include <string_view>
+#include <vector>
+
+namespace as {
+
+/// <summary>
+/// How the distinct keys of a series are counted. Keys are recorded with
+/// add_measurement of a distinct_key into one HyperLogLog sketch per thread
+/// and window, so recording never contends with other threads, and the
+/// sketches of all threads are merged when they are read. Memory is fixed
+/// at 2^precision bytes per thread and window. The windows of threads that
+/// exit are merged into one set of windows for all exited threads
+/// </summary>
+struct distinct_count_options {
+  /// <summary>
+  /// Length of a window, aligned to multiples of it since the clock's epoch
+  /// </summary>
+  timespan_t rollup_interval = std::chrono::minutes{1};
+  /// <summary>
+  /// Precision of the sketches in [4;16], see hyperloglog
+  /// </summary>
+  uint32_t precision = 12;
+  /// <summary>
+  /// Number of windows kept for each thread and for all exited threads,
+  /// older windows are dropped
+  /// </summary>
+  size_t max_windows = 60;
+};
+
+/// <summary>
+/// Changes how the distinct keys of the series are counted. Drops the
+/// windows recorded so far, since sketches of different precisions can't be
+/// merged
+/// </summary>
+AS_API void set_distinct_count_options(std::string_view name,
+                                       distinct_count_options options);
+
+/// <summary>
+/// Returns the sketches of the windows of the series that overlap
+/// [begin;end], merged over all threads, oldest first. The timestamp of a
+/// sketch is the start of its window
+/// </summary>
+AS_API std::vector<measurement<hyperloglog>> get_distinct_counts(
+    std::string_view name, timestamp_t begin = timestamp_t{},
+    timestamp_t end = now());
+
+/// <summary>
+/// Returns the estimated number of distinct keys of the series in the
+/// windows that overlap [begin;end]. Keys that occur in multiple windows are
+/// counted once
+/// </summary>
+AS_API double estimate_distinct_count(std::string_view name,
+                                      timestamp_t begin = timestamp_t{},
+                                      timestamp_t end = now());
+
+}  // namespace as
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/scope_timing.h"
+
+#include <future>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace as {
+
+/// <summary>
+/// What the value of a folded stack line represents
+/// </summary>
+enum class folded_stack_weight {
+  /// <summary>
+  /// Time spent in the innermost scope itself, in nanoseconds
+  /// </summary>
+  self_time,
+  /// <summary>
+  /// Number of times the innermost scope was exited
+  /// </summary>
+  call_count
+};
+
+struct folded_stack_options {
+  folded_stack_weight weight = folded_stack_weight::self_time;
+  /// <summary>
+  /// If true, the call trees of all threads are merged into one. Otherwise
+  /// every stack starts with a frame naming its thread, e.g. 'thread-3', or
+  /// 'exited-threads' for the merged tree of all threads that exited
+  /// </summary>
+  bool merge_threads = true;
+  /// <summary>
+  /// If true, the exemplars of each stack follow it as comment lines, e.g.
+  /// '# exemplar a;b;c duration_ns=1234 request_id=7 timestamp_ns=5678
+  /// thread=3', which flame graph tools skip as they don't end in a weight
+  /// </summary>
+  bool exemplars = true;
+};
+
+/// <summary>
+/// Writes the given call trees in the folded stack format ('a;b;c 1234', one
+/// line per stack) that flame graph tools like flamegraph.pl, inferno or
+/// speedscope consume directly. Stacks with a weight of zero are omitted
+/// </summary>
+AS_API void write_folded_stacks(std::ostream& stream,
+                                const std::vector<call_tree>& trees,
+                                folded_stack_options options = {});
+
+/// <summary>
+/// Takes a snapshot of the call trees of all threads on the calling thread and
+/// writes it to the given file in the folded stack format on a background
+/// thread
+/// </summary>
+/// <returns>Future that becomes ready once the file is written. It holds a
+/// std::runtime_error if the file could not be written</returns>
+AS_API std::future<void> export_folded_stacks(
+    const std::string& path, folded_stack_options options = {});
+
+}  // namespace as
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+#include "util/sketch.h"
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace as {
+
+#pragma region lock_statistics
+
+/// <summary>
+/// Snapshot of the lock timings of all mutexes with the same name
+/// </summary>
+struct lock_statistics {
+  std::string name;
+  /// <summary>
+  /// Number of exclusive acquisitions. Uncontended acquisitions are counted
+  /// in batches, so this lags behind by less than hold_sample_interval per
+  /// live mutex
+  /// </summary>
+  uint64_t acquisitions = 0;
+  /// <summary>
+  /// Number of exclusive acquisitions that had to wait
+  /// </summary>
+  uint64_t contended_acquisitions = 0;
+  /// <summary>
+  /// Number of shared acquisitions that had to wait. Uncontended shared
+  /// acquisitions are not counted, as that would require a write to shared
+  /// memory and defeat the purpose of a shared lock
+  /// </summary>
+  uint64_t contended_shared_acquisitions = 0;
+  /// <summary>
+  /// Time waited for contended exclusive acquisitions
+  /// </summary>
+  timing_sketch wait_time;
+  /// <summary>
+  /// Time waited for contended shared acquisitions
+  /// </summary>
+  timing_sketch shared_wait_time;
+  /// <summary>
+  /// Time the lock was held exclusively. Contains every contended
+  /// acquisition and every hold_sample_interval-th uncontended one
+  /// </summary>
+  timing_sketch hold_time;
+
+  /// <summary>
+  /// Fraction of the exclusive acquisitions that had to wait, in [0;1]
+  /// </summary>
+  double get_contention_ratio() const {
+    if (!acquisitions) return 0.0;
+    return static_cast<double>(contended_acquisitions) /
+           static_cast<double>(acquisitions);
+  }
+};
+
+/// <summary>
+/// Returns the lock statistics of all names that were used by an
+/// instrumented mutex, sorted by name
+/// </summary>
+AS_API std::vector<lock_statistics> get_lock_statistics();
+
+/// <summary>
+/// Resets the lock statistics of all names
+/// </summary>
+AS_API void clear_lock_statistics();
+
+namespace detail {
+
+/// <summary>
+/// Shared timings of all mutexes with the same name. Entries are never
+/// removed, so mutexes can keep a reference for their whole lifetime
+/// </summary>
+struct lock_timing {
+  std::atomic<uint64_t> acquisitions{0};
+  std::atomic<uint64_t> contended_acquisitions{0};
+  std::atomic<uint64_t> contended_shared_acquisitions{0};
+  timing_sketch wait_time;
+  timing_sketch shared_wait_time;
+  timing_sketch hold_time;
+};
+
+AS_API lock_timing& get_lock_timing(std::string_view name);
+
+}  // namespace detail
+
+#pragma endregion
+
+#pragma region instrumented_mutex
+
+/// <summary>
+/// Every hold_sample_interval-th uncontended acquisition measures how long
+/// the lock is held. All other uncontended acquisitions don't read the clock
+/// </summary>
+constexpr uint32_t hold_sample_interval = 16;
+
+/// <summary>
+/// Drop-in replacement for a mutex that records the time spent waiting for
+/// and holding the lock into the statistics of the given name.
+///
+/// Acquisition first tries try_lock, which succeeds without reading the
+/// clock if the lock is free. Only if that fails the wait is timed, so an
+/// uncontended lock costs little more than the wrapped mutex
+/// </summary>
+/// <typeparam name="Mutex">Mutex type that satisfies Lockable</typeparam>
+template <typename Mutex = std::mutex>
+class instrumented_mutex {
+ public:
+  instrumented_mutex() : instrumented_mutex("instrumented_mutex") {}
+
+  /// <param name="name">Name of the statistics, which may be shared by
+  /// several mutexes, e.g. all mutexes of one class</param>
+  explicit instrumented_mutex(std::string_view name)
+      : _timing(detail::get_lock_timing(name)) {}
+
+  ~instrumented_mutex() {
+    _timing.acquisitions.fetch_add(_unreported_acquisitions,
+                                   std::memory_order_relaxed);
+  }
+
+  instrumented_mutex(const instrumented_mutex&) = delete;
+  instrumented_mutex& operator=(const instrumented_mutex&) = delete;
+
+  void lock() {
+    if (_mutex.try_lock()) {
+      on_acquired();
+      return;
+    }
+
+    const auto start_time = now();
+    _mutex.lock();
+    const auto acquired_time = now();
+    _timing.wait_time.record(acquired_time - start_time);
+    _timing.contended_acquisitions.fetch_add(1, std::memory_order_relaxed);
+    ++_unreported_acquisitions;
+    _hold_start_time = acquired_time;
+    _hold_sampled = true;
+  }
+
+  bool try_lock() {
+    if (!_mutex.try_lock()) return false;
+    on_acquired();
+    return true;
+  }
+
+  void unlock() {
+    if (_hold_sampled) {
+      _hold_sampled = false;
+      _timing.hold_time.record(now() - _hold_start_time);
+    }
+    _mutex.unlock();
+  }
+
+  Mutex& native_mutex() { return _mutex; }
+
+ protected:
+  /// <summary>
+  /// Called with the lock held, so the members don't need to be atomic
+  /// </summary>
+  void on_acquired() {
+    if (++_unreported_acquisitions < hold_sample_interval) return;
+
+    _timing.acquisitions.fetch_add(_unreported_acquisitions,
+                                   std::memory_order_relaxed);
+    _unreported_acquisitions = 0;
+    _hold_start_time = now();
+    _hold_sampled = true;
+  }
+
+  Mutex _mutex;
+  detail::lock_timing& _timing;
+  uint32_t _unreported_acquisitions = 0;
+  bool _hold_sampled = false;
+  timestamp_t _hold_start_time;
+};
+
+/// <summary>
+/// Drop-in replacement for a shared mutex. Exclusive locking is measured like
+/// in instrumented_mutex; shared locking only records the wait time of
+/// contended acquisitions, because concurrent readers have no single place to
+/// store their hold start time
+/// </summary>
+/// <typeparam name="SharedMutex">Mutex type that satisfies
+/// SharedLockable</typeparam>
+template <typename SharedMutex = std::shared_mutex>
+class instrumented_shared_mutex : public instrumented_mutex<SharedMutex> {
+ public:
+  using instrumented_mutex<SharedMutex>::instrumented_mutex;
+
+  void lock_shared() {
+    if (this->_mutex.try_lock_shared()) return;
+
+    const auto start_time = now();
+    this->_mutex.lock_shared();
+    this->_timing.shared_wait_time.record(now() - start_time);
+    this->_timing.contended_shared_acquisitions.fetch_add(
+        1, std::memory_order_relaxed);
+  }
+
+  bool try_lock_shared() { return this->_mutex.try_lock_shared(); }
+
+  void unlock_shared() { this->_mutex.unlock_shared(); }
+};
+
+#pragma endregion
+
+}  // namespace as
@@ -2,18 +2,27 @@
 
 #include "api.h"
 #include "util/cache.h"
+#include "util/heavy_hitters.h"
 #include "util/math.h"
+#include "util/reservoir.h"
 
 #include <stdint.h>
 #include <algorithm>
 #include <any>
 #include <atomic>
 #include <chrono>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <string>
 #include <string_view>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <variant>
+#include <vector>
 
 namespace as {
 
@@ -33,6 +42,28 @@ using timespan_t = std::chrono::nanoseconds;
 /// <returns>Timestamp for the current point in time</returns>
 timestamp_t now();
 
+/// <summary>
+/// Source of the timestamps returned by now(), e.g. a virtual clock that a
+/// simulation advances
+/// </summary>
+class AS_API clock_source {
+ public:
+  virtual ~clock_source() = default;
+  virtual timestamp_t now() const = 0;
+};
+
+/// <summary>
+/// Makes now() and therefore every timestamp of the library come from the
+/// given clock. The clock must stay alive until it is replaced again
+/// </summary>
+/// <param name="clock">Clock to use, nullptr for the real clock</param>
+AS_API void set_clock(const clock_source* clock);
+
+/// <summary>
+/// Returns the clock set with set_clock, or nullptr for the real clock
+/// </summary>
+AS_API const clock_source* get_clock();
+
 #pragma endregion
 
 #pragma region thread
@@ -41,6 +72,68 @@ using thread_id_t = std::thread::id;
 
 static const thread_id_t thread_id_all_threads = {};
 
+/// <summary>
+/// Returns a small, dense index for the calling thread. Indices are assigned in
+/// the order in which threads first call this function and are never reused
+/// </summary>
+/// <returns>Index of the calling thread</returns>
+uint32_t get_thread_index();
+
+#pragma endregion
+
+#pragma region names
+
+/// <summary>
+/// Returns a view of a copy of the given name that stays valid until the
+/// program exits. The measurement storage copies the name of a series when it
+/// creates the series, so names built at runtime don't need to be interned to
+/// be measured. Interned names are never freed
+/// </summary>
+/// <param name="name">Name to intern</param>
+/// <returns>View of the interned name, equal names return equal views</returns>
+std::string_view intern_name(std::string_view name);
+
+#pragma endregion
+
+#pragma region labels
+
+/// <summary>
+/// Handle of an interned label set, see intern_labels. The default handle is
+/// the empty label set
+/// </summary>
+struct label_set_t {
+  uint32_t id = 0;
+};
+
+inline bool operator==(label_set_t l, label_set_t r) { return l.id == r.id; }
+inline bool operator!=(label_set_t l, label_set_t r) { return l.id != r.id; }
+
+/// <summary>
+/// Key and value of a label, e.g. {"endpoint", "/a"}
+/// </summary>
+using label = std::pair<std::string_view, std::string_view>;
+
+/// <summary>
+/// Interns a set of labels that adds dimensions to a series beyond its name,
+/// so that they don't have to be encoded into the name. Interning takes a
+/// lock, so it should be done once and the handle reused when recording
+/// </summary>
+/// <param name="labels">Labels in any order, keys must be unique</param>
+/// <returns>Handle of the label set, equal sets return equal handles</returns>
+AS_API label_set_t intern_labels(std::vector<label> labels);
+
+/// <summary>
+/// Returns the labels of an interned label set sorted by key. The views stay
+/// valid until the program exits
+/// </summary>
+AS_API const std::vector<label>& get_labels(label_set_t labels);
+
+/// <summary>
+/// Returns the value of the label with the given key, or an empty view if
+/// the label set doesn't have it
+/// </summary>
+AS_API std::string_view get_label(label_set_t labels, std::string_view key);
+
 #pragma endregion
 
 #pragma region types
@@ -130,6 +223,46 @@ memory AS_API operator"" _GB(size_t size);
 
 }  // namespace literals
 
+/// <summary>
+/// Number of events (or units like bytes or CPU seconds) per second
+/// </summary>
+struct AS_API rate {
+  rate();
+  explicit rate(double per_second);
+
+  rate(const rate&) = default;
+  rate& operator=(const rate&) = default;
+
+  double get_per_second() const;
+
+  /// <summary>
+  /// Computes the rate of a counter that increased by the given amount within
+  /// the given timespan
+  /// </summary>
+  static rate from_delta(double delta, timespan_t timespan);
+
+ private:
+  double _per_second;
+};
+
+/// <summary>
+/// Key of which the number of distinct values is counted, e.g. a session id.
+/// Only a hash of the key is recorded, into the HyperLogLog sketch of the
+/// current window, see distinct_count.h
+/// </summary>
+struct AS_API distinct_key {
+  explicit distinct_key(std::string_view key);
+  explicit distinct_key(uint64_t key);
+
+  distinct_key(const distinct_key&) = default;
+  distinct_key& operator=(const distinct_key&) = default;
+
+  uint64_t get_hash() const;
+
+ private:
+  uint64_t _hash;
+};
+
 using function_timing = timespan_t;
 
 namespace detail {
@@ -179,16 +312,213 @@ type_id_t get_type_id() {
 
 #pragma endregion
 
+#pragma region metric_properties
+
+/// <summary>
+/// Infinite cache size for measurements
+/// </summary>
+constexpr size_t cache_size_infinite = std::numeric_limits<size_t>::max();
+
+/// <summary>
+/// How a series keeps its measurements
+/// </summary>
+enum class storage_mode {
+  /// <summary>
+  /// Every measurement
+  /// </summary>
+  all,
+  /// <summary>
+  /// The newest measurements, see set_cache_size. Long-window statistics of
+  /// such series only reflect the latest burst
+  /// </summary>
+  newest,
+  /// <summary>
+  /// A uniform random sample of all measurements ever added, see reservoir
+  /// </summary>
+  uniform_sample,
+  /// <summary>
+  /// A random sample in which newer measurements are more likely to be kept,
+  /// see decaying_reservoir
+  /// </summary>
+  decaying_sample
+};
+
+struct storage_options {
+  storage_mode mode = storage_mode::all;
+  /// <summary>
+  /// Number of measurements kept, ignored for storage_mode::all
+  /// </summary>
+  size_t size = cache_size_infinite;
+  /// <summary>
+  /// A measurement one half-life newer is twice as likely to be kept, only
+  /// used by storage_mode::decaying_sample
+  /// </summary>
+  timespan_t half_life{0};
+};
+
+/// <summary>
+/// Bounds the number of series of a type, e.g. when names are built from
+/// endpoints or tenants at runtime
+/// </summary>
+struct series_limit {
+  /// <summary>
+  /// Measurements of new series beyond this number are added to the overflow
+  /// series instead. Series are counted for each thread
+  /// </summary>
+  size_t max_series = std::numeric_limits<size_t>::max();
+  std::string_view overflow_name = "overflow";
+  /// <summary>
+  /// Number of most frequent names that are tracked, see get_heavy_hitters.
+  /// Zero disables the tracking
+  /// </summary>
+  size_t heavy_hitters = 20;
+};
+
+/// <summary>
+/// Properties of a series that can be changed at runtime through a metric
+/// configuration, see metric_config.h
+/// </summary>
+struct metric_properties {
+  /// <summary>
+  /// Measurements of disabled series are dropped when they are added
+  /// </summary>
+  bool enabled = true;
+  /// <summary>
+  /// Fraction of the measurements that is recorded, chosen at random
+  /// </summary>
+  double sampling_rate = 1.0;
+  /// <summary>
+  /// Measures the series for each thread, like measure_for_each_thread
+  /// </summary>
+  bool for_each_thread = false;
+  /// <summary>
+  /// Replaces the cache size set with set_cache_size, if set
+  /// </summary>
+  std::optional<size_t> cache_size;
+  /// <summary>
+  /// Measurements older than this are dropped, zero keeps them forever
+  /// </summary>
+  std::chrono::milliseconds retention{0};
+};
+
+namespace detail {
+
+/// <summary>
+/// Returns the properties of the series in the current metric configuration
+/// or nullptr if it has none. The returned pointer keeps the configuration
+/// alive, so it is never torn by a concurrent reload
+/// </summary>
+AS_API std::shared_ptr<const metric_properties> get_configured_properties(
+    std::string_view name);
+
+/// <summary>
+/// Returns a number that changes whenever a metric configuration is set, or
+/// zero while none is set. Lets the configured properties of a series be
+/// cached until the configuration changes
+/// </summary>
+AS_API uint64_t get_metric_config_version();
+
+/// <summary>
+/// Returns true with the given probability
+/// </summary>
+AS_API bool sample_measurement(double sampling_rate);
+
+/// <summary>
+/// Adds the name of a new series to the prefix index, see name_index.h
+/// </summary>
+AS_API void register_series_name(std::string_view name, type_id_t type);
+
+/// <summary>
+/// Returns true if the name is under a prefix that was disabled with
+/// set_prefix_enabled. Only looks up the name if any prefix is disabled
+/// </summary>
+AS_API bool is_disabled_by_prefix(std::string_view name);
+
+/// <summary>
+/// Records a distinct key into the sketches of distinct_count.h instead of
+/// storing it as a measurement
+/// </summary>
+AS_API void add_distinct_key(std::string_view name, timestamp_t timestamp,
+                             distinct_key key);
+
+AS_API void clear_distinct_keys();
+AS_API void clear_distinct_keys(std::string_view name);
+
+/// <summary>
+/// Moves the beginning of a range of measurements past the retention of the
+/// series
+/// </summary>
+inline timestamp_t apply_retention(const metric_properties* properties,
+                                   timestamp_t begin) {
+  if (!properties || properties->retention.count() <= 0) return begin;
+  return std::max(begin, now() - properties->retention);
+}
+
+}  // namespace detail
+
+#pragma endregion
+
 #pragma region measure
 
+enum class label_match {
+  equal,
+  not_equal,
+  /// <summary>
+  /// The whole value matches the regular expression (ECMAScript grammar)
+  /// </summary>
+  regex,
+  not_regex
+};
+
+/// <summary>
+/// Condition on a label of a series. A missing label has the empty value, so
+/// {"shard", label_match::equal, ""} selects the series without a shard
+/// </summary>
+struct label_matcher {
+  std::string key;
+  label_match type = label_match::equal;
+  std::string value;
+};
+
+inline bool operator==(const label_matcher& l, const label_matcher& r) {
+  return l.key == r.key && l.type == r.type && l.value == r.value;
+}
+
+/// <summary>
+/// Measurements of one label set, e.g. one group of an aggregation
+/// </summary>
+template <typename T>
+struct labeled_measurements {
+  label_set_t labels;
+  std::vector<measurement<T>> measurements;
+};
+
 namespace detail {
 
+/// <summary>
+/// Returns the label sets that match all matchers. Each regular expression
+/// is compiled once per call
+/// </summary>
+/// <exception cref="std::regex_error">If a regular expression is
+/// invalid</exception>
+AS_API std::vector<label_set_t> select_label_sets(
+    std::vector<label_set_t> label_sets,
+    const std::vector<label_matcher>& matchers);
+
+/// <summary>
+/// Returns the label set that only has the labels with the given keys
+/// </summary>
+AS_API label_set_t project_labels(label_set_t labels,
+                                  const std::vector<std::string_view>& keys);
+
 struct measurement_lookup {
   thread_id_t thread_id;
   std::string_view name;
+  label_set_t labels;
 
-  measurement_lookup(thread_id_t thread_id, std::string_view name)
-      : thread_id(thread_id), name(std::move(name)) {}
+  measurement_lookup(thread_id_t thread_id, std::string_view name,
+                     label_set_t labels = {})
+      : thread_id(thread_id), name(std::move(name)), labels(labels) {}
 };
 
 }  // namespace detail
@@ -202,6 +532,7 @@ struct std::hash<as::detail::measurement_lookup> {
     size_t hash = 0;
     as::math::hash_combine(hash, lookup.name);
     as::math::hash_combine(hash, lookup.thread_id);
+    as::math::hash_combine(hash, lookup.labels.id);
     return hash;
   }
 };
@@ -210,7 +541,8 @@ template <>
 struct std::equal_to<as::detail::measurement_lookup> {
   constexpr bool operator()(const as::detail::measurement_lookup& l,
                             const as::detail::measurement_lookup& r) const {
-    return l.name == r.name && l.thread_id == r.thread_id;
+    return l.name == r.name && l.thread_id == r.thread_id &&
+           l.labels == r.labels;
   }
 };
 
@@ -220,32 +552,116 @@ namespace detail {
 
 template <typename T>
 struct measurement_storage {
+  /// <param name="properties">Configured properties of the series, which
+  /// replace its cache size and add a retention</param>
   void add_measurement(measurement<T> measurement, std::string_view name,
-                       thread_id_t thread_id = thread_id_all_threads) {
-    measurement_lookup lookup{thread_id, name};
+                       thread_id_t thread_id = thread_id_all_threads,
+                       const metric_properties* properties = nullptr,
+                       label_set_t labels = {}) {
+    std::lock_guard<std::mutex> guard{_measurements_lock};
+    add_to_series(std::move(measurement), name, thread_id, properties, labels);
+  }
+
+  /// <summary>
+  /// Adds a measurement of as::add_measurement, applying the metric
+  /// configuration. The configured properties of a name are resolved once
+  /// for each version of the configuration and cached with its series, so
+  /// adding a measurement doesn't read the shared configuration
+  /// </summary>
+  void add_configured_measurement(measurement<T> measurement,
+                                  std::string_view name, label_set_t labels) {
+    const auto config_version = get_metric_config_version();
 
     std::lock_guard<std::mutex> guard{_measurements_lock};
-    auto& container = _measurements[lookup];
-    insert_measurement(std::move(measurement), container);
+    const auto* properties = get_cached_properties(name, config_version);
+    if (properties) {
+      if (!properties->enabled) return;
+      if (properties->sampling_rate < 1.0 &&
+          !sample_measurement(properties->sampling_rate))
+        return;
+    }
+    const auto for_each_thread = (properties && properties->for_each_thread) ||
+                                 is_measured_for_each_thread(name);
+    add_to_series(
+        std::move(measurement), name,
+        for_each_thread ? std::this_thread::get_id() : thread_id_all_threads,
+        properties, labels);
   }
 
   std::vector<measurement<T>> get_copy_of_measurements(
-      std::string_view name, thread_id_t thread_id = thread_id_all_threads) {
-    measurement_lookup lookup{thread_id, name};
+      std::string_view name, thread_id_t thread_id = thread_id_all_threads,
+      timestamp_t begin = timestamp_t::min(),
+      timestamp_t end = timestamp_t::max(), label_set_t labels = {}) {
+    measurement_lookup lookup{thread_id, name, labels};
 
     std::lock_guard<std::mutex> guard{_measurements_lock};
-    auto& measurements = _measurements[lookup];
-    return container_to_vector(measurements);
+    const auto itr = _measurements.find(lookup);
+    if (itr == _measurements.end()) return {};
+    return container_to_vector(itr->second, begin, end);
+  }
+
+  /// <summary>
+  /// Returns the measurements of all series of the name whose labels match
+  /// all matchers, merged over threads and ordered by timestamp. Series are
+  /// grouped by the values of the labels with the given keys, or by their
+  /// whole label set if there are no keys. Only the series of the name are
+  /// visited and the matchers are evaluated once per label set
+  /// </summary>
+  std::vector<labeled_measurements<T>> get_copy_of_labeled_measurements(
+      std::string_view name, const std::vector<label_matcher>& matchers,
+      const std::vector<std::string_view>* group_by, timestamp_t begin,
+      timestamp_t end) {
+    std::vector<labeled_measurements<T>> ret;
+
+    std::lock_guard<std::mutex> guard{_measurements_lock};
+    const auto series = _series_by_name.find(name);
+    if (series == _series_by_name.end()) return ret;
+
+    std::vector<label_set_t> label_sets;
+    for (auto& lookup : series->second.lookups)
+      label_sets.push_back(lookup.labels);
+    // Index of the group in the result by label set and by group
+    std::unordered_map<uint32_t, size_t> selected;
+    std::unordered_map<uint32_t, size_t> groups;
+    for (auto labels : select_label_sets(std::move(label_sets), matchers)) {
+      const auto group = group_by ? project_labels(labels, *group_by) : labels;
+      const auto itr = groups.emplace(group.id, ret.size()).first;
+      if (itr->second == ret.size())
+        ret.push_back(labeled_measurements<T>{group, {}});
+      selected[labels.id] = itr->second;
+    }
+
+    for (auto& lookup : series->second.lookups) {
+      const auto group = selected.find(lookup.labels.id);
+      if (group == selected.end()) continue;
+      auto measurements =
+          container_to_vector(_measurements.at(lookup), begin, end);
+      auto& target = ret[group->second].measurements;
+      target.insert(target.end(), std::make_move_iterator(measurements.begin()),
+                    std::make_move_iterator(measurements.end()));
+    }
+    for (auto& group : ret) {
+      std::stable_sort(group.measurements.begin(), group.measurements.end(),
+                       [](const auto& l, const auto& r) {
+                         return l.timestamp < r.timestamp;
+                       });
+    }
+    return ret;
   }
 
   std::unordered_map<thread_id_t, std::vector<measurement<T>>>
-  get_copy_of_measurements_for_all_threads(std::string_view name) {
+  get_copy_of_measurements_for_all_threads(
+      std::string_view name, timestamp_t begin = timestamp_t::min(),
+      timestamp_t end = timestamp_t::max()) {
     std::unordered_map<thread_id_t, std::vector<measurement<T>>> ret;
 
     std::lock_guard<std::mutex> guard{_measurements_lock};
-    for (auto& kv : _measurements) {
-      if (kv.first.name != name) continue;
-      ret[kv.first.thread_id] = container_to_vector(kv.second);
+    const auto series = _series_by_name.find(name);
+    if (series == _series_by_name.end()) return ret;
+    for (auto& lookup : series->second.lookups) {
+      if (lookup.labels != label_set_t{}) continue;
+      ret[lookup.thread_id] =
+          container_to_vector(_measurements.at(lookup), begin, end);
     }
     return ret;
   }
@@ -253,72 +669,430 @@ struct measurement_storage {
   void clear() {
     std::lock_guard<std::mutex> guard{_measurements_lock};
     _measurements.clear();
+    _series_by_name.clear();
+    if (_heavy_hitters) _heavy_hitters->clear();
   }
 
   void clear(std::string_view name) {
     std::lock_guard<std::mutex> guard{_measurements_lock};
-    auto iter = std::remove_if(
-        _measurements.begin(), _measurements.end(),
-        [&name](const auto& kv) { return kv.first.name == name; });
-    _measurements.erase(iter, _measurements.end());
+    const auto series = _series_by_name.find(name);
+    if (series == _series_by_name.end()) return;
+    for (auto& lookup : series->second.lookups) _measurements.erase(lookup);
+    _series_by_name.erase(series);
+  }
+
+  /// <summary>
+  /// Changes how the series keeps its measurements, see set_storage_options
+  /// </summary>
+  void set_storage_options(std::string_view name, storage_options options) {
+    std::lock_guard<std::mutex> guard{_measurements_lock};
+    _storage_options[intern_name(name)] = options;
+    for (auto& kv : _measurements) {
+      if (kv.first.name == name) resize_container(kv.second, options);
+    }
+  }
+
+  /// <summary>
+  /// Bounds the number of series, see as::set_series_limit. Existing series
+  /// are kept even if there are more of them
+  /// </summary>
+  void set_series_limit(series_limit limit) {
+    std::lock_guard<std::mutex> guard{_measurements_lock};
+    _overflow_name = limit.overflow_name;
+    limit.overflow_name = _overflow_name;
+    if (!limit.heavy_hitters) {
+      _heavy_hitters.reset();
+    } else if (!_heavy_hitters ||
+               _heavy_hitters->capacity() != limit.heavy_hitters) {
+      _heavy_hitters = std::make_unique<heavy_hitters>(limit.heavy_hitters);
+    }
+    _series_limit = limit;
+  }
+
+  std::vector<heavy_hitter> get_heavy_hitters() {
+    std::lock_guard<std::mutex> guard{_measurements_lock};
+    if (!_heavy_hitters) return {};
+    return _heavy_hitters->get_top();
+  }
+
+  uint64_t estimate_count(std::string_view name) {
+    std::lock_guard<std::mutex> guard{_measurements_lock};
+    if (!_heavy_hitters) return 0;
+    return _heavy_hitters->estimate(name);
   }
 
   bool is_measured_for_each_thread(std::string_view name) {
     std::lock_guard<std::mutex> guard{_measured_for_each_thread_lock};
-    return _measured_for_each_thread[name];
+    return _measured_for_each_thread.count(name) > 0;
   }
 
   void set_measured_for_each_thread(std::string_view name) {
+    const auto interned = intern_name(name);
     std::lock_guard<std::mutex> guard{_measured_for_each_thread_lock};
-    _measured_for_each_thread[name] = true;
+    _measured_for_each_thread.insert(interned);
   }
 
  private:
   using measurement_container_t =
-      std::variant<std::vector<measurement<T>>, as::cache<measurement<T>>>;
+      std::variant<std::vector<measurement<T>>, as::cache<measurement<T>>,
+                   as::reservoir<measurement<T>>,
+                   as::decaying_reservoir<measurement<T>>>;
+
+  /// <summary>
+  /// Measurements of a series. As long as they were added in timestamp
+  /// order, ranges are found by binary search instead of checking every
+  /// measurement, so reading the newest ones costs O(log n + k)
+  /// </summary>
+  struct series_t {
+    measurement_container_t container;
+    bool ordered = true;
+  };
+
+  /// <summary>
+  /// Series of a name and the configured properties of the name, resolved
+  /// for the version of the metric configuration
+  /// </summary>
+  struct named_series_t {
+    /// <summary>
+    /// Copy of the name, which the keys of the name and its series view
+    /// </summary>
+    std::unique_ptr<const std::string> name;
+    std::vector<measurement_lookup> lookups;
+    uint64_t config_version = 0;
+    std::shared_ptr<const metric_properties> properties;
+  };
+
+  void add_to_series(measurement<T>&& measurement, std::string_view name,
+                     thread_id_t thread_id, const metric_properties* properties,
+                     label_set_t labels) {
+    measurement_lookup lookup{thread_id, name, labels};
+    if (_heavy_hitters) _heavy_hitters->add(name);
+    auto& series = find_or_create_series(lookup);
+    resize_container(series, get_storage_options(lookup.name, properties));
+    if (properties && properties->retention.count() > 0)
+      prune_container(series.container,
+                      measurement.timestamp - properties->retention,
+                      properties->retention);
+    insert_measurement(std::move(measurement), series);
+  }
+
+  /// <summary>
+  /// Returns the configured properties of the name, which are only resolved
+  /// again once the configuration changed. Names are remembered while the
+  /// series limit isn't reached, beyond it they are resolved every time
+  /// </summary>
+  const metric_properties* get_cached_properties(std::string_view name,
+                                                 uint64_t config_version) {
+    if (!config_version) return nullptr;
+    auto itr = _series_by_name.find(name);
+    if (itr == _series_by_name.end()) {
+      if (_series_by_name.size() >= _series_limit.max_series ||
+          _measurements.size() >= _series_limit.max_series) {
+        _uncached_properties = get_configured_properties(name);
+        return _uncached_properties.get();
+      }
+      itr = create_name(name);
+    }
+    auto& named = itr->second;
+    if (named.config_version != config_version) {
+      named.properties = get_configured_properties(name);
+      named.config_version = config_version;
+    }
+    return named.properties.get();
+  }
+
+  /// series are not created and the lookup is redirected to the overflow
+  /// series
+  /// </summary>
+  series_t& find_or_create_series(measurement_lookup& lookup) {
+    auto itr = _measurements.find(lookup);
+    if (itr != _measurements.end()) return itr->second;
+    if (_measurements.size() >= _series_limit.max_series) {
+      lookup.name = _series_limit.overflow_name;
+      lookup.labels = label_set_t{};
+      itr = _measurements.find(lookup);
+      if (itr != _measurements.end()) return itr->second;
+    }
+    auto named = _series_by_name.find(lookup.name);
+    if (named == _series_by_name.end()) named = create_name(lookup.name);
+    // The series keeps a view of the copy, not of the caller's name
+    lookup.name = *named->second.name;
+    auto& lookups = named->second.lookups;
+    if (lookups.empty()) register_series_name(lookup.name, get_type_id<T>());
+    lookups.push_back(lookup);
+    return _measurements[lookup];
+  }
+
+  /// <summary>
+  /// Adds a name that isn't known yet, copying it. Only called for names
+  /// that get a series or whose properties are cached, so names redirected
+  /// to the overflow series are never copied
+  /// </summary>
+  typename std::unordered_map<std::string_view, named_series_t>::iterator
+  create_name(std::string_view name) {
+    auto copy = std::make_unique<const std::string>(name);
+    const std::string_view key = *copy;
+    auto itr = _series_by_name.emplace(key, named_series_t{}).first;
+    itr->second.name = std::move(copy);
+    return itr;
+  }
+
+  /// <summary>
+  /// Position of a measurement in a decaying_reservoir, in seconds
+  /// </summary>
+  static double to_position(timestamp_t timestamp) {
+    return std::chrono::duration<double>(timestamp.time_since_epoch()).count();
+  }
 
   static void insert_measurement(measurement<T>&& measurement,
-                                 measurement_container_t& container) {
+                                 series_t& series) {
     std::visit(
-        [m = std::move(measurement)](auto&& arg) mutable {
+        [m = std::move(measurement), &series](auto&& arg) mutable {
           using U = std::decay_t<decltype(arg)>;
           if constexpr (std::is_same_v<U, std::vector<as::measurement<T>>>) {
+            if (!arg.empty() && m.timestamp < arg.back().timestamp)
+              series.ordered = false;
             arg.push_back(std::move(m));
           } else if constexpr (std::is_same_v<U,
                                               as::cache<as::measurement<T>>>) {
+            if (arg.size() && m.timestamp < arg.youngest().timestamp)
+              series.ordered = false;
             arg.insert(std::move(m));
+          } else if constexpr (std::is_same_v<
+                                   U, as::reservoir<as::measurement<T>>>) {
+            arg.insert(std::move(m));
+          } else if constexpr (std::is_same_v<U, as::decaying_reservoir<
+                                                     as::measurement<T>>>) {
+            const auto position = to_position(m.timestamp);
+            arg.insert(std::move(m), position);
           } else {
             static_assert(false, "Non-exhaustive visitor!");
           }
         },
-        container);
+        series.container);
   }
 
-  static std::vector<as::measurement<T>> container_to_vector(
-      const measurement_container_t& container) {
+  /// <summary>
+  /// Returns the storage options of the series. A configured cache size
+  /// replaces a cache size set in code, but not a sample. Sections without a
+  /// cache size keep the one set in code
+  /// </summary>
+  storage_options get_storage_options(
+      std::string_view name, const metric_properties* properties) const {
+    storage_options ret;
+    if (!_storage_options.empty()) {
+      auto itr = _storage_options.find(name);
+      if (itr != _storage_options.end()) ret = itr->second;
+    }
+    if (properties && properties->cache_size) {
+      if (*properties->cache_size != cache_size_infinite) {
+        ret = storage_options{storage_mode::newest, *properties->cache_size};
+      } else if (ret.mode == storage_mode::newest) {
+        ret = storage_options{};
+      }
+    }
+    return ret;
+  }
+
+  /// <summary>
+  /// Returns the measurements of the series from oldest to newest, which
+  /// keep their order when they are inserted into the resized container
+  /// </summary>
+  static std::vector<as::measurement<T>> take_measurements(series_t& series) {
     std::vector<as::measurement<T>> ret;
     std::visit(
         [&ret](auto&& arg) {
           using U = std::decay_t<decltype(arg)>;
           if constexpr (std::is_same_v<U, std::vector<as::measurement<T>>>) {
-            ret = arg;
+            ret = std::move(arg);
           } else if constexpr (std::is_same_v<U,
                                               as::cache<as::measurement<T>>>) {
+            // Caches iterate from youngest to oldest
             ret.reserve(arg.size());
-            std::copy(arg.begin(), arg.end(), std::back_inserter(ret));
+            for (auto& m : arg) ret.push_back(std::move(m));
+            std::reverse(ret.begin(), ret.end());
           } else {
-            static_assert(false, "Non-exhaustive visitor!");
+            // Samples are in slot order
+            ret.reserve(arg.size());
+            for (auto& m : arg) ret.push_back(std::move(m));
+            std::stable_sort(ret.begin(), ret.end(),
+                             [](const auto& l, const auto& r) {
+                               return l.timestamp < r.timestamp;
+                             });
           }
         },
-        container);
+        series.container);
+    series.ordered = std::is_sorted(ret.begin(), ret.end(),
+                                    [](const auto& l, const auto& r) {
+                                      return l.timestamp < r.timestamp;
+                                    });
+    return ret;
+  }
+
+  /// <summary>
+  /// Turns the container into the kind of container and size of the
+  /// options, keeping the newest measurements for caches and sampling the
+  /// existing measurements for samples. Does nothing if the container
+  /// already matches, which is the case for all but the first insertion
+  /// after the options changed
+  /// </summary>
+  static void resize_container(series_t& series,
+                               const storage_options& options) {
+    auto& container = series.container;
+    const auto size = std::max<size_t>(options.size, 1);
+    switch (options.mode) {
+      case storage_mode::all:
+        if (!std::holds_alternative<std::vector<as::measurement<T>>>(
+                container))
+          container = take_measurements(series);
+        break;
+      case storage_mode::newest: {
+        if (options.size == cache_size_infinite) {
+          resize_container(series, storage_options{});
+          break;
+        }
+        auto* cache = std::get_if<as::cache<as::measurement<T>>>(&container);
+        if (cache && cache->capacity() == size) break;
+
+        auto measurements = take_measurements(series);
+        as::cache<as::measurement<T>> resized{size};
+        const auto first =
+            measurements.size() > size ? measurements.size() - size : 0;
+        for (auto idx = first; idx < measurements.size(); ++idx)
+          resized.insert(std::move(measurements[idx]));
+        container = std::move(resized);
+        break;
+      }
+      case storage_mode::uniform_sample: {
+        auto* sample =
+            std::get_if<as::reservoir<as::measurement<T>>>(&container);
+        if (sample && sample->capacity() == size) break;
+
+        auto measurements = take_measurements(series);
+        as::reservoir<as::measurement<T>> resized{size};
+        for (auto& m : measurements) resized.insert(std::move(m));
+        container = std::move(resized);
+        break;
+      }
+      case storage_mode::decaying_sample: {
+        const auto half_life =
+            std::chrono::duration<double>(options.half_life).count();
+        auto* sample =
+            std::get_if<as::decaying_reservoir<as::measurement<T>>>(
+                &container);
+        if (sample && sample->capacity() == size &&
+            sample->get_half_life() == half_life)
+          break;
+
+        auto measurements = take_measurements(series);
+        as::decaying_reservoir<as::measurement<T>> resized{size, half_life};
+        for (auto& m : measurements) {
+          const auto position = to_position(m.timestamp);
+          resized.insert(std::move(m), position);
+        }
+        container = std::move(resized);
+        break;
+      }
+    }
+  }
+
+  /// <summary>
+  /// Drops the measurements before the cutoff from vectors once the oldest
+  /// one is a whole retention older than the cutoff, so that pruning costs
+  /// O(1) amortized per insertion. Caches and samples are bounded anyway
+  /// </summary>
+  static void prune_container(measurement_container_t& container,
+                              timestamp_t cutoff, timespan_t retention) {
+    auto* vector = std::get_if<std::vector<as::measurement<T>>>(&container);
+    if (!vector || vector->empty() ||
+        vector->front().timestamp >= cutoff - retention)
+      return;
+    vector->erase(std::remove_if(vector->begin(), vector->end(),
+                                 [cutoff](const as::measurement<T>& m) {
+                                   return m.timestamp < cutoff;
+                                 }),
+                  vector->end());
+  }
+
+  /// <summary>
+  /// Copies the measurements with timestamps in [begin;end]. Measurements
+  /// may be added with timestamps out of order, in which case all of them
+  /// are checked
+  /// </summary>
+  static std::vector<as::measurement<T>> container_to_vector(
+      const series_t& series, timestamp_t begin, timestamp_t end) {
+    std::vector<as::measurement<T>> ret;
+    const auto in_range = [begin, end](const as::measurement<T>& m) {
+      return m.timestamp >= begin && m.timestamp <= end;
+    };
+    std::visit(
+        [&ret, &in_range, &series, begin, end](auto&& arg) {
+          using U = std::decay_t<decltype(arg)>;
+          if constexpr (std::is_same_v<U, std::vector<as::measurement<T>>>) {
+            if (!series.ordered) {
+              std::copy_if(arg.begin(), arg.end(), std::back_inserter(ret),
+                           in_range);
+              return;
+            }
+            const auto first = std::lower_bound(
+                arg.begin(), arg.end(), begin,
+                [](const as::measurement<T>& m, timestamp_t begin) {
+                  return m.timestamp < begin;
+                });
+            const auto last = std::upper_bound(
+                first, arg.end(), end,
+                [](timestamp_t end, const as::measurement<T>& m) {
+                  return end < m.timestamp;
+                });
+            ret.assign(first, last);
+          } else if constexpr (std::is_same_v<U,
+                                              as::cache<as::measurement<T>>>) {
+            if (!series.ordered) {
+              std::copy_if(arg.begin(), arg.end(), std::back_inserter(ret),
+                           in_range);
+              return;
+            }
+            // From youngest to oldest, up to the first one before the range
+            for (auto& m : arg) {
+              if (m.timestamp < begin) break;
+              if (m.timestamp <= end) ret.push_back(m);
+            }
+          } else {
+            // Samples
+            std::copy_if(arg.begin(), arg.end(), std::back_inserter(ret),
+                         in_range);
+          }
+        },
+        series.container);
     return ret;
   }
 
   std::mutex _measurements_lock;
-  std::unordered_map<measurement_lookup, measurement_container_t> _measurements;
+  std::unordered_map<measurement_lookup, series_t> _measurements;
+  std::unordered_map<std::string_view, storage_options> _storage_options;
+  /// <summary>
+  /// Series of each name, so that queries by name and labels don't visit
+  /// the series of other names
+  /// </summary>
+  std::unordered_map<std::string_view, named_series_t> _series_by_name;
+  /// <summary>
+  /// Properties of the last name beyond the series limit, kept alive while
+  /// its measurement is added
+  /// </summary>
+  std::shared_ptr<const metric_properties> _uncached_properties;
+  series_limit _series_limit;
+  /// <summary>
+  /// Copy of the name of the overflow series that the limit views
+  /// </summary>
+  std::string _overflow_name;
+  /// <summary>
+  /// Frequencies of the names of all added measurements, only tracked once a
+  /// series limit is set
+  /// </summary>
+  std::unique_ptr<heavy_hitters> _heavy_hitters;
 
   std::mutex _measured_for_each_thread_lock;
-  std::unordered_map<std::string_view, bool> _measured_for_each_thread;
+  std::unordered_set<std::string_view> _measured_for_each_thread;
 };
 
 /// <summary>
@@ -332,28 +1106,127 @@ measurement_storage<T>& get_measurement_storage() {
 
 }  // namespace detail
 
+/// <summary>
+/// Adds a measurement to the series of the name and label set
+/// </summary>
+template <typename T>
+void add_measurement(std::string_view name, label_set_t labels,
+                     timestamp_t timestamp, T measurement_value) {
+  if (detail::is_disabled_by_prefix(name)) return;
+
+  if constexpr (std::is_same_v<T, distinct_key>) {
+    const auto properties = detail::get_configured_properties(name);
+    if (properties) {
+      if (!properties->enabled) return;
+      if (properties->sampling_rate < 1.0 &&
+          !detail::sample_measurement(properties->sampling_rate))
+        return;
+    }
+    if (labels != label_set_t{})
+      throw std::runtime_error{"Distinct keys can't have labels!"};
+    detail::add_distinct_key(name, timestamp, measurement_value);
+  } else {
+    // Applies the metric configuration with the properties cached in the
+    // storage
+    detail::get_measurement_storage<T>().add_configured_measurement(
+        measurement<T>{timestamp, std::move(measurement_value)}, name,
+        labels);
+  }
+}
+
+template <typename T>
+void add_measurement(std::string_view name, label_set_t labels,
+                     T measurement_value) {
+  add_measurement<T>(name, labels, now(), std::move(measurement_value));
+}
+
+template <typename T>
+void add_measurement(std::string_view name, timestamp_t timestamp,
+                     T measurement_value) {
+  add_measurement<T>(name, label_set_t{}, timestamp,
+                     std::move(measurement_value));
+}
+
 template <typename T>
 void add_measurement(std::string_view name, T measurement_value = T{}) {
-  auto timestamp = now();
-
-  auto& storage = detail::get_measurement_storage<T>();
-  auto thread_id = (is_measured_for_each_thread<T>(name))
-                       ? std::this_thread::get_id()
-                       : thread_id_all_threads;
-  storage.add_measurement(
-      measurement<T>{timestamp, std::move(measurement_value)}, name, thread_id);
+  add_measurement<T>(name, now(), std::move(measurement_value));
 }
 
+/// <summary>
+/// Returns the measurements of the series with timestamps in [begin;end]
+/// </summary>
 template <typename T>
 std::vector<measurement<T>> get_measurements(std::string_view name,
                                              timestamp_t begin = timestamp_t{},
                                              timestamp_t end = now()) {
+  if constexpr (std::is_same_v<T, distinct_key>) {
+    throw std::runtime_error{
+        "Distinct keys are not stored, call 'get_distinct_counts' instead!"};
+  } else {
+    if (is_measured_for_each_thread<T>(name))
+      throw std::runtime_error{
+          "Type is measured for each thread, call "
+          "'get_measurements_for_thread' instead!"};
+    const auto properties = detail::get_configured_properties(name);
+    return detail::get_measurement_storage<T>().get_copy_of_measurements(
+        name, thread_id_all_threads,
+        detail::apply_retention(properties.get(), begin), end);
+  }
+}
+
+/// <summary>
+/// Returns the measurements of the series of the name and label set with
+/// timestamps in [begin;end]
+/// </summary>
+template <typename T>
+std::vector<measurement<T>> get_measurements(std::string_view name,
+                                             label_set_t labels,
+                                             timestamp_t begin = timestamp_t{},
+                                             timestamp_t end = now()) {
+  if (labels == label_set_t{}) return get_measurements<T>(name, begin, end);
   if (is_measured_for_each_thread<T>(name))
     throw std::runtime_error{
-        "Type is measured for each thread, call 'get_measurements_for_thread' "
+        "Type is measured for each thread, call 'select_measurements' "
         "instead!"};
-  // TODO Filter
-  return detail::get_measurement_storage<T>().get_copy_of_measurements(name);
+  const auto properties = detail::get_configured_properties(name);
+  return detail::get_measurement_storage<T>().get_copy_of_measurements(
+      name, thread_id_all_threads,
+      detail::apply_retention(properties.get(), begin), end, labels);
+}
+
+/// <summary>
+/// Returns the measurements of each label set of the name that matches all
+/// matchers, with timestamps in [begin;end]. Series measured for each
+/// thread are merged over threads
+/// </summary>
+template <typename T>
+std::vector<labeled_measurements<T>> select_measurements(
+    std::string_view name, const std::vector<label_matcher>& matchers,
+    timestamp_t begin = timestamp_t{}, timestamp_t end = now()) {
+  const auto properties = detail::get_configured_properties(name);
+  return detail::get_measurement_storage<T>()
+      .get_copy_of_labeled_measurements(
+          name, matchers, nullptr,
+          detail::apply_retention(properties.get(), begin), end);
+}
+
+/// <summary>
+/// Aggregates the series of the name that match all matchers across the
+/// values of all other labels, e.g. all shards of each endpoint when
+/// grouped by {"endpoint"}. Each group has the measurements of all its
+/// series ordered by timestamp and a label set with only the given keys. No
+/// keys aggregate all matching series into one group
+/// </summary>
+template <typename T>
+std::vector<labeled_measurements<T>> aggregate_measurements(
+    std::string_view name, const std::vector<label_matcher>& matchers,
+    const std::vector<std::string_view>& group_by,
+    timestamp_t begin = timestamp_t{}, timestamp_t end = now()) {
+  const auto properties = detail::get_configured_properties(name);
+  return detail::get_measurement_storage<T>()
+      .get_copy_of_labeled_measurements(
+          name, matchers, &group_by,
+          detail::apply_retention(properties.get(), begin), end);
 }
 
 template <typename T>
@@ -364,8 +1237,9 @@ std::vector<measurement<T>> get_measurements_for_thread(
     throw std::runtime_error{
         "Type is not measured for each thread, call 'get_measurements' "
         "instead!"};
+  const auto properties = detail::get_configured_properties(name);
   return detail::get_measurement_storage<T>().get_copy_of_measurements(
-      name, thread_id);
+      name, thread_id, detail::apply_retention(properties.get(), begin), end);
 }
 
 template <typename T>
@@ -377,53 +1251,117 @@ get_measurements_for_all_threads(std::string_view name,
     throw std::runtime_error{
         "Type is not measured for each thread, call 'get_measurements' "
         "instead!"};
+  const auto properties = detail::get_configured_properties(name);
   return detail::get_measurement_storage<T>()
-      .get_copy_of_measurements_for_all_threads(name);
+      .get_copy_of_measurements_for_all_threads(
+          name, detail::apply_retention(properties.get(), begin), end);
+}
+
+/// <summary>
+/// Returns the most frequent names of measurements of the type, most frequent
+/// first, including the names that were redirected to the overflow series.
+/// Names are only tracked once set_series_limit was called
+/// </summary>
+template <typename T>
+std::vector<heavy_hitter> get_heavy_hitters() {
+  return detail::get_measurement_storage<T>().get_heavy_hitters();
+}
+
+/// <summary>
+/// Returns an upper bound of the number of measurements added with the name
+/// since set_series_limit was called, also for names without a series
+/// </summary>
+template <typename T>
+uint64_t estimate_measurement_count(std::string_view name) {
+  return detail::get_measurement_storage<T>().estimate_count(name);
 }
 
 template <typename T>
 void clear_measurements() {
-  detail::get_measurement_storage<T>().clear();
+  if constexpr (std::is_same_v<T, distinct_key>)
+    detail::clear_distinct_keys();
+  else
+    detail::get_measurement_storage<T>().clear();
 }
 
 template <typename T>
 void clear_measurements(std::string_view name) {
-  detail::get_measurement_storage<T>().clear(name);
+  if constexpr (std::is_same_v<T, distinct_key>)
+    detail::clear_distinct_keys(name);
+  else
+    detail::get_measurement_storage<T>().clear(name);
 }
 
 #pragma endregion
 
 #pragma region properties
 
+/// <summary>
+/// Keeps only the newest measurements of the series, cache_size_infinite
+/// keeps all of them again. Measurements that were already dropped stay
+/// dropped. A cache size in the metric configuration takes precedence
+/// </summary>
+template <typename T>
+void set_cache_size(std::string_view name, size_t cache_size) {
+  detail::get_measurement_storage<T>().set_storage_options(
+      name, cache_size == cache_size_infinite
+                ? storage_options{}
+                : storage_options{storage_mode::newest, cache_size});
+}
+
+/// <summary>
+/// Changes how the series keeps its measurements, e.g. as a bounded sample
+/// that represents the whole stream instead of only its newest part. The
+/// existing measurements are moved into the new kind of container, samples
+/// are drawn from them
+/// </summary>
 template <typename T>
-void set_cache_size(std::string_view name, size_t cache_size) {}
+void set_storage_options(std::string_view name, storage_options options) {
+  detail::get_measurement_storage<T>().set_storage_options(name, options);
+}
 
+/// <summary>
+/// Bounds the number of series of the type. Measurements that would create a
+/// series beyond the limit are added to the overflow series instead, and the
+/// most frequent names are tracked in a fixed amount of memory, so hot names
+/// can still be found without a series for each of them
+/// </summary>
 template <typename T>
-void measure_for_each_thread(std::string_view name) {
-  detail::get_measurement_storage<T>().set_measured_for_each_thread(name);
+void set_series_limit(series_limit limit) {
+  detail::get_measurement_storage<T>().set_series_limit(limit);
 }
 
 template <typename T>
-bool is_measured_for_each_thread(std::string_view name) {
-  return detail::get_measurement_storage<T>().is_measured_for_each_thread(name);
+void measure_for_each_thread(std::string_view name) {
+  detail::get_measurement_storage<T>().set_measured_for_each_thread(name);
 }
 
 /// <summary>
-/// Infinite cache size for measurements
+/// Returns whether the series is measured for each thread, either through
+/// measure_for_each_thread or the metric configuration
 /// </summary>
-constexpr size_t cache_size_infinite = std::numeric_limits<size_t>::max();
+template <typename T>
+bool is_measured_for_each_thread(std::string_view name) {
+  if (detail::get_measurement_storage<T>().is_measured_for_each_thread(name))
+    return true;
+  const auto properties = detail::get_configured_properties(name);
+  return properties && properties->for_each_thread;
+}
 
 #pragma endregion
 
 #pragma region helper_macros
 
+#define AS_CONCAT_IMPL(a, b) a##b
+#define AS_CONCAT(a, b) AS_CONCAT_IMPL(a, b)
+
 #define MEASURE_FUNCTION_CALL \
   as::add_measurement<as::function_call>(__FUNCTION__)
 
-#define MEASURE_FUNCTION_TIMING             \
-  volatile as::detail::FunctionTimingHelper \
-      __measure_function_timing_##__LINE##{ \
-    __FUNCTION__                            \
+#define MEASURE_FUNCTION_TIMING                         \
+  volatile as::detail::FunctionTimingHelper AS_CONCAT( \
+      __measure_function_timing_, __LINE__) {          \
+    __FUNCTION__                                       \
   }
 
 #pragma endregion
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace as {
+
+#pragma region metric_config
+
+/// <summary>
+/// Properties of series by name, e.g. parsed from a file like
+///
+///   # Applies to every series without a section of its own
+///   [*]
+///   sampling_rate = 0.5
+///
+///   [db.query]
+///   enabled = true
+///   for_each_thread = true
+///   cache_size = 1000    # or infinite
+///   retention = 10m      # ms, s, m or h, 0 keeps everything
+///
+/// Every section starts from the default metric_properties, sections don't
+/// inherit from [*]
+/// </summary>
+class AS_API metric_config {
+ public:
+  /// <exception cref="std::runtime_error">With the line of the first error
+  /// </exception>
+  static metric_config parse(std::string_view text);
+
+  /// <exception cref="std::runtime_error">If the file can't be read or
+  /// parsed</exception>
+  static metric_config load(const std::string& path);
+
+  void set_properties(std::string_view name, metric_properties properties);
+  void set_default_properties(metric_properties properties);
+
+  /// <summary>
+  /// Returns the properties of the series, the default properties if it has
+  /// none of its own, or nullptr if there are no default properties either
+  /// </summary>
+  const metric_properties* find(std::string_view name) const;
+
+  /// <summary>
+  /// Number of series with properties of their own
+  /// </summary>
+  size_t size() const;
+
+ private:
+  std::unordered_map<std::string_view, metric_properties> _properties;
+  bool _has_default = false;
+  metric_properties _default;
+};
+
+/// <summary>
+/// Makes the configuration apply to all measurements that are added from now
+/// on. The configuration is swapped atomically, every measurement sees
+/// either the old or the new configuration as a whole. The recording path
+/// skips the lookup entirely while no configuration is set
+/// </summary>
+/// <param name="config">Configuration to apply, nullptr to remove it
+/// </param>
+AS_API void set_metric_config(std::shared_ptr<const metric_config> config);
+
+AS_API std::shared_ptr<const metric_config> get_metric_config();
+
+#pragma endregion
+
+#pragma region metric_config_watcher
+
+struct metric_config_watcher_options {
+  std::string path;
+  std::chrono::milliseconds interval{1000};
+};
+
+/// <summary>
+/// Applies a configuration file with set_metric_config and re-applies it
+/// whenever its content changes. The file is polled, which works on every
+/// platform and file system. A file that fails to parse is reported by
+/// get_last_error and leaves the applied configuration as it is. The
+/// configuration stays applied after the watcher is destroyed
+/// </summary>
+class AS_API metric_config_watcher {
+ public:
+  /// <summary>
+  /// Applies the file and starts the background thread
+  /// </summary>
+  /// <exception cref="std::runtime_error">If the file can't be read or
+  /// parsed</exception>
+  explicit metric_config_watcher(metric_config_watcher_options options);
+  ~metric_config_watcher();
+
+  metric_config_watcher(const metric_config_watcher&) = delete;
+  metric_config_watcher& operator=(const metric_config_watcher&) = delete;
+
+  /// <summary>
+  /// Reads the file immediately and applies it if its content changed
+  /// </summary>
+  /// <returns>True if a new configuration was applied</returns>
+  bool reload();
+
+  /// <summary>
+  /// Returns the error of the last reload, empty if it succeeded
+  /// </summary>
+  std::string get_last_error() const;
+
+  /// <summary>
+  /// Number of configurations applied, including the initial one
+  /// </summary>
+  uint64_t get_reload_count() const;
+
+ private:
+  void run();
+
+  const metric_config_watcher_options _options;
+
+  mutable std::mutex _reload_lock;
+  std::string _content;
+  std::string _last_error;
+  uint64_t _reload_count;
+
+  std::mutex _stop_lock;
+  std::condition_variable _stop_signal;
+  bool _stop;
+  std::thread _thread;
+};
+
+#pragma endregion
+
+}  // namespace as
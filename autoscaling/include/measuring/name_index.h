@@ -0,0 +1,82 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+
+#include <algorithm>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+namespace as {
+
+namespace detail {
+
+/// <summary>
+/// Returns the names under the prefix, sorted by segment, of series of the
+/// given type or of any type for type id 0
+/// </summary>
+AS_API std::vector<std::string_view> get_series_names(std::string_view prefix,
+                                                      type_id_t type);
+
+}  // namespace detail
+
+/// <summary>
+/// Returns the names of the series of all types under the prefix. Names form
+/// a hierarchy of segments separated by dots, e.g. db.pool.wait and
+/// db.query.parse are both under the prefix db. They are kept in a trie of
+/// segments that is only updated when the first series of a name is
+/// created, so recording into existing series doesn't touch it and lookups
+/// don't visit the names under other prefixes. Prefixes match whole
+/// segments: "db" and "db." match db and db.pool.wait but not dbx, and the
+/// empty prefix matches every name. Names stay registered after their
+/// measurements were cleared
+/// </summary>
+AS_API std::vector<std::string_view> get_series_names(
+    std::string_view prefix = {});
+
+/// <summary>
+/// Returns the names of the series of the type under the prefix
+/// </summary>
+template <typename T>
+std::vector<std::string_view> get_series_names(std::string_view prefix = {}) {
+  return detail::get_series_names(prefix, get_type_id<T>());
+}
+
+/// <summary>
+/// Disables or enables recording of all names under the prefix, including
+/// names that are first recorded later. Measurements of disabled names are
+/// dropped when they are added. A name is disabled if any of its prefixes
+/// is, so enabling db.pool does not enable it while db is disabled. Adding
+/// measurements checks a snapshot of the disabled prefixes without locking
+/// </summary>
+AS_API void set_prefix_enabled(std::string_view prefix, bool enabled);
+
+/// <summary>
+/// Returns the measurements of all series of the type under the prefix with
+/// timestamps in [begin;end], including all label sets and threads, merged
+/// and ordered by timestamp
+/// </summary>
+template <typename T>
+std::vector<measurement<T>> get_measurements_by_prefix(
+    std::string_view prefix, timestamp_t begin = timestamp_t{},
+    timestamp_t end = now()) {
+  static const std::vector<std::string_view> all_labels;
+  std::vector<measurement<T>> ret;
+  auto& storage = detail::get_measurement_storage<T>();
+  for (auto name : get_series_names<T>(prefix)) {
+    const auto properties = detail::get_configured_properties(name);
+    for (auto& group : storage.get_copy_of_labeled_measurements(
+             name, {}, &all_labels,
+             detail::apply_retention(properties.get(), begin), end)) {
+      ret.insert(ret.end(), std::make_move_iterator(group.measurements.begin()),
+                 std::make_move_iterator(group.measurements.end()));
+    }
+  }
+  std::stable_sort(ret.begin(), ret.end(), [](const auto& l, const auto& r) {
+    return l.timestamp < r.timestamp;
+  });
+  return ret;
+}
+
+}  // namespace as
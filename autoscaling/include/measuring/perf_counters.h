@@ -0,0 +1,130 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+
+namespace as {
+
+#pragma region perf_counters
+
+/// <summary>
+/// Which kind of performance counters are available to the calling thread
+/// </summary>
+enum class perf_counter_source {
+  /// <summary>
+  /// CPU performance monitoring unit (cycles, instructions, cache misses) plus
+  /// the software counters
+  /// </summary>
+  hardware,
+  /// <summary>
+  /// Only the counters that the kernel maintains (task clock, page faults,
+  /// context switches), e.g. inside VMs without PMU access
+  /// </summary>
+  software,
+  /// <summary>
+  /// No counters, e.g. because perf_event_open is not permitted or the
+  /// platform is not Linux
+  /// </summary>
+  unavailable
+};
+
+/// <summary>
+/// Values of the performance counters of a single thread. Counters that are
+/// not available are zero
+/// </summary>
+struct perf_counter_values {
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  uint64_t cache_misses = 0;
+  timespan_t task_clock{0};
+  uint64_t page_faults = 0;
+  uint64_t context_switches = 0;
+  /// <summary>
+  /// Time in which the hardware counters were enabled, and the part of it in
+  /// which they were actually counting. The PMU multiplexes its registers if
+  /// more events are requested than it has, e.g. by other profilers, so the
+  /// hardware counts may only cover a fraction of the time
+  /// </summary>
+  timespan_t time_enabled{0};
+  timespan_t time_running{0};
+
+  /// <summary>
+  /// Returns true if the hardware counters didn't count all of the time, so
+  /// their scaled values are estimates
+  /// </summary>
+  bool is_multiplexed() const { return time_running < time_enabled; }
+
+  /// <summary>
+  /// Returns the values with the hardware counts extrapolated from the time
+  /// they were running to the time they were enabled, like perf stat does.
+  /// Counts of counters that never ran stay zero. Must only be applied once,
+  /// e.g. to the difference of two raw readings
+  /// </summary>
+  AS_API perf_counter_values get_scaled() const;
+
+  /// <summary>
+  /// Returns the number of instructions per cycle (IPC), or zero if no cycles
+  /// were counted. A low IPC means the code mostly waits for memory, which
+  /// more machines won't fix, a high IPC means it is compute bound
+  /// </summary>
+  double get_instructions_per_cycle() const {
+    if (!cycles) return 0.0;
+    return static_cast<double>(instructions) / static_cast<double>(cycles);
+  }
+};
+
+perf_counter_values operator-(const perf_counter_values& l,
+                              const perf_counter_values& r);
+
+/// <summary>
+/// Returns the counters that are available to the calling thread. The first
+/// call on a thread opens the counters (perf_event_open), falling back to
+/// software counters if the hardware counters can't be opened
+/// </summary>
+AS_API perf_counter_source get_perf_counter_source();
+
+/// <summary>
+/// Reads the current values of the counters of the calling thread, which
+/// count user-space events since the counters were opened. The hardware
+/// counts are raw, see perf_counter_values::get_scaled
+/// </summary>
+/// <returns>False if no counters are available</returns>
+AS_API bool read_thread_perf_counters(perf_counter_values& values);
+
+namespace detail {
+struct AS_API ScopePerfCountersHelper {
+  explicit ScopePerfCountersHelper(const char* name);
+  ~ScopePerfCountersHelper();
+
+ private:
+  const char* _name;
+  bool _valid;
+  perf_counter_values _start_values;
+};
+}  // namespace detail
+
+#pragma endregion
+
+#pragma region helper_macros
+
+/// <summary>
+/// Records the counter deltas of the current scope as a measurement of type
+/// perf_counter_values. The hardware counts are scaled if the counters were
+/// multiplexed, which is_multiplexed of the measurement tells. Records
+/// nothing if no counters are available
+/// </summary>
+#define MEASURE_SCOPE_PERF_COUNTERS(name)                                  \
+  as::detail::ScopePerfCountersHelper AS_CONCAT(__measure_perf_counters_, \
+                                                __LINE__) {               \
+    name                                                                  \
+  }
+
+/// <summary>
+/// Records the counter deltas of the current function under the same name
+/// that MEASURE_FUNCTION_TIMING uses
+/// </summary>
+#define MEASURE_FUNCTION_PERF_COUNTERS MEASURE_SCOPE_PERF_COUNTERS(__FUNCTION__)
+
+#pragma endregion
+
+}  // namespace as
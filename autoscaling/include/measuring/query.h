@@ -0,0 +1,85 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace as {
+
+#pragma region query
+
+/// <summary>
+/// Expression over measurement series, parsed once and compiled into a
+/// pipeline of incremental operators, e.g.
+///
+///   p99(function_timing{name="handle"}[1m]) /
+///       rate(periodic_event{name="req"}[1m])
+///
+/// Selectors name a type, a series and a window:
+/// type{name="series"}[window] with the types double, size_t, timespan,
+/// function_timing, memory, rate, periodic_event and function_call, and
+/// windows like 500ms, 10s, 5m or 1h. Further labels select the labeled
+/// series of the name that match all of them and combine them into one, e.g.
+/// {name="latency", endpoint="/a", shard!="3", region=~"eu-.*"}; without
+/// them only the unlabeled series is read. Values are converted to doubles
+/// in base units: timespans in seconds, memory in bytes and rates per
+/// second; events and calls count as 1.
+///
+/// Functions of selectors are last, count, sum, avg, min, max, rate (number
+/// of measurements per second), quantile(0.9, selector) and the shorthands
+/// p50, p90, p95, p99 and p999. They can be combined with numbers,
+/// parentheses, + - * /, comparisons < <= > >= and ! && ||, where
+/// conditions evaluate to 1 or 0. Functions of empty windows except count
+/// and rate are NaN, which makes every comparison involving them false.
+///
+/// Each distinct selector keeps the measurements of its window. Evaluations
+/// only read the measurements added since the previous evaluation and
+/// update the running state of the functions, e.g. sums, monotonic queues
+/// for min and max and order statistics for quantiles. Measurements that are
+/// added with a timestamp before the previous evaluation are missed.
+/// Evaluations must not run concurrently
+/// </summary>
+class AS_API query {
+ public:
+  /// <exception cref="std::runtime_error">If the text is not a valid query,
+  /// with the position of the error</exception>
+  explicit query(std::string_view text);
+  ~query();
+
+  query(const query&) = delete;
+  query& operator=(const query&) = delete;
+
+  /// <summary>
+  /// Evaluates the query at the given time. Timestamps before the previous
+  /// evaluation are treated like the previous evaluation
+  /// </summary>
+  double evaluate(timestamp_t timestamp = now());
+
+  const std::string& get_text() const;
+  /// <summary>
+  /// Number of distinct selectors, each read once per evaluation
+  /// </summary>
+  size_t get_window_count() const;
+  /// <summary>
+  /// Number of measurements read by all evaluations so far
+  /// </summary>
+  uint64_t get_samples_read() const;
+
+ private:
+  struct window;
+  struct node;
+  class parser;
+
+  const std::string _text;
+  std::vector<std::unique_ptr<window>> _windows;
+  std::vector<node> _nodes;
+  std::vector<double> _values;
+  uint64_t _samples_read;
+};
+
+#pragma endregion
+
+}  // namespace as
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace as {
+
+#pragma region resource_names
+
+/// <summary>
+/// Names of the series that the resource_sampler records. Memory values are
+/// of type memory, rates of type rate and counts of type size_t
+/// </summary>
+constexpr const char* process_rss_name = "process.rss";
+constexpr const char* process_peak_rss_name = "process.peak_rss";
+constexpr const char* process_virtual_memory_name = "process.virtual_memory";
+/// <summary>
+/// CPU seconds per second, i.e. the number of fully used cores
+/// </summary>
+constexpr const char* process_cpu_usage_name = "process.cpu_usage";
+constexpr const char* process_major_fault_rate_name =
+    "process.major_fault_rate";
+constexpr const char* process_threads_name = "process.threads";
+constexpr const char* process_open_fds_name = "process.open_fds";
+/// <summary>
+/// Bytes per second read from and written to the storage layer
+/// </summary>
+constexpr const char* process_io_read_rate_name = "process.io.read_rate";
+constexpr const char* process_io_write_rate_name = "process.io.write_rate";
+
+#pragma endregion
+
+#pragma region resource_sampler
+
+/// <summary>
+/// Raw resource usage of the process at a point in time
+/// </summary>
+struct process_resource_usage {
+  timestamp_t timestamp;
+  memory rss;
+  memory peak_rss;
+  memory virtual_memory;
+  timespan_t cpu_time{0};
+  uint64_t major_faults = 0;
+  size_t threads = 0;
+  size_t open_fds = 0;
+  /// <summary>
+  /// False if /proc/self/io is not readable, e.g. in some containers
+  /// </summary>
+  bool has_io = false;
+  uint64_t io_read_bytes = 0;
+  uint64_t io_write_bytes = 0;
+};
+
+struct resource_sampler_options {
+  std::chrono::milliseconds interval{1000};
+};
+
+/// <summary>
+/// Periodically records the resource usage of the process (memory, CPU,
+/// threads, file descriptors and I/O) into the series named above. The files
+/// in /proc/self are opened once and re-read with pread into a fixed buffer
+/// and parsed in place, so sampling does not allocate.
+///
+/// Only supported on Linux
+/// </summary>
+struct AS_API resource_sampler {
+  static bool is_supported();
+
+  /// <summary>
+  /// Opens the /proc files, takes the first sample and starts the background
+  /// thread
+  /// </summary>
+  /// <exception cref="std::runtime_error">If the platform is not supported or
+  /// the /proc files can't be opened</exception>
+  explicit resource_sampler(resource_sampler_options options = {});
+  ~resource_sampler();
+
+  resource_sampler(const resource_sampler&) = delete;
+  resource_sampler& operator=(const resource_sampler&) = delete;
+
+  /// <summary>
+  /// Takes and records a sample immediately. Rates are computed relative to
+  /// the previous sample
+  /// </summary>
+  /// <returns>False if the /proc files could not be read</returns>
+  bool sample();
+
+  /// <summary>
+  /// Reads the current resource usage without recording it
+  /// </summary>
+  bool read_usage(process_resource_usage& usage);
+
+ private:
+  void run();
+
+  const resource_sampler_options _options;
+
+  int _stat_fd;
+  int _statm_fd;
+  int _status_fd;
+  int _io_fd;
+  int _fd_dir_fd;
+  long _clock_ticks_per_second;
+  size_t _page_size;
+
+  std::mutex _sample_lock;
+  bool _has_previous_usage;
+  process_resource_usage _previous_usage;
+
+  std::mutex _stop_lock;
+  std::condition_variable _stop_signal;
+  bool _stop;
+  std::thread _thread;
+};
+
+#pragma endregion
+
+}  // namespace as
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "measuring/measurement.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace as {
+
+namespace detail {
+
+#pragma region samples
+
+/// <summary>
+/// Measurement reduced to its timestamp and numeric value, as evaluated by
+/// queries, composite policies and the decision journal
+/// </summary>
+using sample = std::pair<timestamp_t, double>;
+
+inline double to_double(double value) { return value; }
+inline double to_double(size_t value) { return static_cast<double>(value); }
+inline double to_double(timespan_t value) {
+  return std::chrono::duration<double>(value).count();
+}
+inline double to_double(const memory& value) {
+  return static_cast<double>(value.get_size());
+}
+inline double to_double(const rate& value) { return value.get_per_second(); }
+inline double to_double(periodic_event) { return 1.0; }
+inline double to_double(function_call) { return 1.0; }
+
+/// <summary>
+/// Truth value of a sample, NaN is false
+/// </summary>
+inline bool is_true(double value) { return !std::isnan(value) && value != 0.0; }
+
+/// <summary>
+/// Appends the samples of the unlabeled series of the name within
+/// [begin;end]
+/// </summary>
+template <typename T>
+void read_series(std::string_view name, timestamp_t begin, timestamp_t end,
+                 std::vector<sample>& samples) {
+  for (auto& m : get_measurements<T>(name, begin, end))
+    samples.emplace_back(m.timestamp, to_double(m.data));
+}
+
+/// <summary>
+/// Appends the samples of the unlabeled series of the name, or of all series
+/// of the name that match the matchers combined into one
+/// </summary>
+template <typename T>
+void read_series(std::string_view name,
+                 const std::vector<label_matcher>& matchers, timestamp_t begin,
+                 timestamp_t end, std::vector<sample>& samples) {
+  if (matchers.empty()) {
+    read_series<T>(name, begin, end, samples);
+    return;
+  }
+  for (auto& group :
+       aggregate_measurements<T>(name, matchers, {}, begin, end)) {
+    for (auto& m : group.measurements)
+      samples.emplace_back(m.timestamp, to_double(m.data));
+  }
+}
+
+/// <summary>
+/// Orders samples by timestamp, keeping samples with equal timestamps in the
+/// order they were read
+/// </summary>
+inline void sort_samples(std::vector<sample>& samples) {
+  std::stable_sort(samples.begin(), samples.end(),
+                   [](const sample& l, const sample& r) {
+                     return l.first < r.first;
+                   });
+}
+
+#pragma endregion
+
+}  // namespace detail
+
+}  // namespace as
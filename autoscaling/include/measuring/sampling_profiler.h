@@ -0,0 +1,153 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace as {
+
+#pragma region stack_sample
+
+/// <summary>
+/// Call stack of a thread, captured by the sampling profiler
+/// </summary>
+struct stack_sample {
+  static constexpr size_t max_depth = 32;
+
+  uint32_t thread_index = 0;
+  uint32_t depth = 0;
+  /// <summary>
+  /// Program counters, innermost frame first. Only the first 'depth' entries
+  /// are valid
+  /// </summary>
+  std::array<uintptr_t, max_depth> frames{};
+};
+
+/// <summary>
+/// Name under which the sampling profiler stores its samples. Samples are
+/// measured for each thread, so query them with
+/// get_measurements_for_thread/get_measurements_for_all_threads
+/// </summary>
+constexpr const char* sampled_stacks_name = "sampled_stacks";
+
+/// <summary>
+/// Returns a human readable name for the function containing the given
+/// program counter, or its hexadecimal address if no symbol is found
+/// </summary>
+AS_API std::string get_symbol_name(uintptr_t address);
+
+#pragma endregion
+
+#pragma region sampling_profiler
+
+struct sampling_profiler_options {
+  /// <summary>
+  /// Number of samples per second of CPU time consumed by a registered thread
+  /// </summary>
+  uint32_t frequency_hz = 99;
+  /// <summary>
+  /// Number of samples each thread can buffer between two collections
+  /// </summary>
+  size_t buffer_capacity_per_thread = 1024;
+  /// <summary>
+  /// Interval at which the background thread moves samples into the
+  /// measurement storage
+  /// </summary>
+  std::chrono::milliseconds collect_interval{100};
+  /// <summary>
+  /// Number of samples kept in the measurement storage for each thread, older
+  /// samples are dropped. Replaces the cache size of sampled_stacks_name
+  /// </summary>
+  size_t max_stored_samples_per_thread = 100000;
+};
+
+namespace detail {
+struct profiled_thread;
+}
+
+/// <summary>
+/// Statistical CPU profiler for code that can't be instrumented. Every
+/// registered thread gets a timer (timer_create) that raises SIGPROF on that
+/// thread after it consumed 1/frequency seconds of CPU time. The signal
+/// handler walks the frame pointer chain, which is async-signal-safe but
+/// requires code to be compiled with frame pointers
+/// (-fno-omit-frame-pointer), and pushes the stack into a lock-free buffer of
+/// the thread. A background thread moves the samples into the measurement
+/// storage as measurements of type stack_sample named sampled_stacks_name.
+///
+/// Only supported on Linux. Only one profiler can be running at a time. The
+/// SIGPROF handler stays installed after the profiler is destroyed and ignores
+/// signals from then on
+/// </summary>
+struct AS_API sampling_profiler {
+  /// <summary>
+  /// Returns true if sampling profiling is supported on this platform
+  /// </summary>
+  static bool is_supported();
+
+  /// <summary>
+  /// Installs the signal handler and starts the collector thread. No samples
+  /// are taken until threads are registered
+  /// </summary>
+  /// <exception cref="std::runtime_error">If the platform is not supported or
+  /// another profiler is already running</exception>
+  explicit sampling_profiler(sampling_profiler_options options = {});
+  /// <summary>
+  /// Stops sampling all registered threads and collects the remaining samples
+  /// </summary>
+  ~sampling_profiler();
+
+  sampling_profiler(const sampling_profiler&) = delete;
+  sampling_profiler& operator=(const sampling_profiler&) = delete;
+
+  /// <summary>
+  /// Starts sampling the calling thread
+  /// </summary>
+  /// <exception cref="std::runtime_error">If the sampling timer could not be
+  /// created or started</exception>
+  void register_this_thread();
+
+  /// <summary>
+  /// Stops sampling the calling thread. Threads must unregister before they
+  /// exit if the profiler outlives them
+  /// </summary>
+  void unregister_this_thread();
+
+  /// <summary>
+  /// Moves all buffered samples into the measurement storage
+  /// </summary>
+  void collect();
+
+  /// <summary>
+  /// Returns the number of samples that were dropped because a thread's
+  /// buffer was full
+  /// </summary>
+  uint64_t get_dropped_sample_count() const;
+
+ private:
+  void run();
+
+  const sampling_profiler_options _options;
+
+  mutable std::mutex _threads_lock;
+  std::vector<std::shared_ptr<detail::profiled_thread>> _threads;
+  uint64_t _dropped_samples_of_removed_threads;
+
+  std::mutex _collect_lock;
+  std::mutex _stop_lock;
+  std::condition_variable _stop_signal;
+  bool _stop;
+  std::thread _thread;
+};
+
+#pragma endregion
+
+}  // namespace as
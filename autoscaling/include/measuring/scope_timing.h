@@ -0,0 +1,178 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+#include "util/exemplars.h"
+#include "util/sketch.h"
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace as {
+
+#pragma region call_tree
+
+/// <summary>
+/// Snapshot of a single node of a call tree. A node represents one named scope
+/// reached through one specific chain of parent scopes
+/// </summary>
+struct call_tree_node {
+  std::string name;
+  /// <summary>
+  /// Number of times the scope was exited
+  /// </summary>
+  uint64_t count = 0;
+  /// <summary>
+  /// Time spent inside the scope, including time spent in child scopes
+  /// </summary>
+  timespan_t total_time{0};
+  /// <summary>
+  /// Time spent inside the scope, excluding time spent in child scopes
+  /// </summary>
+  timespan_t self_time{0};
+  /// <summary>
+  /// Distribution of the total time of the individual scope invocations
+  /// </summary>
+  timing_sketch total_time_sketch;
+  /// <summary>
+  /// Slowest invocations of the recent windows, slowest first. Only kept for
+  /// scopes registered with keep_exemplars
+  /// </summary>
+  std::vector<exemplar> exemplars;
+  std::vector<call_tree_node> children;
+};
+
+/// <summary>
+/// Snapshot of all scopes recorded on a single thread. The root node has no
+/// name and only serves as the parent of all outermost scopes
+/// </summary>
+struct call_tree {
+  thread_id_t thread_id;
+  uint32_t thread_index = 0;
+  /// <summary>
+  /// True for the merged tree of all exited threads
+  /// </summary>
+  bool exited_threads = false;
+  call_tree_node root;
+};
+
+/// <summary>
+/// Returns a snapshot of the call trees of all threads that ever entered a
+/// timed scope. Recording continues concurrently while the snapshot is taken.
+/// The trees of exited threads are merged into a single tree, see
+/// call_tree::exited_threads, so threads that come and go don't use up memory
+/// </summary>
+/// <returns>One call tree per running thread and the merged tree of all
+/// exited threads, if any</returns>
+AS_API std::vector<call_tree> get_call_trees();
+
+/// <summary>
+/// Merges the given call trees into a single tree. Nodes that are reached
+/// through the same chain of scope names are combined
+/// </summary>
+/// <param name="trees">Call trees, e.g. of multiple threads</param>
+/// <returns>Root node of the merged tree</returns>
+AS_API call_tree_node merge_call_trees(const std::vector<call_tree>& trees);
+
+/// <summary>
+/// Resets the counters of all call trees. Only the owning thread writes to a
+/// tree, so each thread applies the reset when it exits its next scope, and
+/// snapshots show the tree as empty until then. Scopes that are active while
+/// this is called will still be recorded when they are exited. The exemplars
+/// of functions are cleared right away
+/// </summary>
+AS_API void clear_call_trees();
+
+#pragma endregion
+
+#pragma region exemplars
+
+/// <summary>
+/// Keeps the slowest invocations of all scopes and MEASURE_FUNCTION_TIMING
+/// functions with the given name, together with the request id, thread and
+/// start time of each invocation. Applies to scopes on all threads, including
+/// the ones already entered. Invocations that are faster than the slowest ones
+/// of their window are rejected without locking, so this is cheap enough for
+/// hot scopes
+/// </summary>
+/// <param name="name">Name of the scope or function</param>
+/// <param name="count">Number of exemplars kept per window</param>
+/// <param name="window">Length of a window</param>
+AS_API void keep_exemplars(const char* name, size_t count,
+                           timespan_t window = std::chrono::minutes{1});
+
+/// <summary>
+/// Returns the slowest invocations of the MEASURE_FUNCTION_TIMING function,
+/// slowest first. Exemplars of timed scopes are part of their call trees
+/// </summary>
+AS_API std::vector<exemplar> get_function_exemplars(std::string_view name);
+
+/// <summary>
+/// Returns the slowest invocations of all functions registered with
+/// keep_exemplars by function name, slowest first
+/// </summary>
+AS_API std::unordered_map<std::string_view, std::vector<exemplar>>
+get_function_exemplars();
+
+/// <summary>
+/// Sets the id of the request the calling thread works on. Exemplars of
+/// scopes exited on this thread carry this id
+/// </summary>
+/// <returns>The previous request id</returns>
+AS_API uint64_t set_request_id(uint64_t request_id);
+
+/// <summary>
+/// Returns the id of the request the calling thread works on, 0 if none
+/// </summary>
+AS_API uint64_t get_request_id();
+
+#pragma endregion
+
+#pragma region scope_timing_helper
+
+namespace detail {
+
+struct thread_call_tree;
+
+/// <summary>
+/// Keeps the invocation if the function was registered with keep_exemplars
+/// </summary>
+AS_API void offer_function_exemplar(std::string_view name,
+                                    timestamp_t start_time,
+                                    timespan_t duration);
+
+struct AS_API ScopeTimingHelper {
+  explicit ScopeTimingHelper(const char* name);
+  ~ScopeTimingHelper();
+
+  ScopeTimingHelper(const ScopeTimingHelper&) = delete;
+  ScopeTimingHelper& operator=(const ScopeTimingHelper&) = delete;
+
+ private:
+  thread_call_tree* _tree;
+};
+
+}  // namespace detail
+
+#pragma endregion
+
+#pragma region helper_macros
+
+/// <summary>
+/// Records the time spent in the current scope into the call tree of the
+/// calling thread. Nested scopes become children of the enclosing scope. The
+/// name must be a string with static storage duration
+/// </summary>
+#define MEASURE_SCOPE_TIMING(name)                                 \
+  as::detail::ScopeTimingHelper AS_CONCAT(__measure_scope_timing_, \
+                                          __LINE__) {              \
+    name                                                           \
+  }
+
+#define MEASURE_FUNCTION_SCOPE_TIMING MEASURE_SCOPE_TIMING(__FUNCTION__)
+
+#pragma endregion
+
+}  // namespace as
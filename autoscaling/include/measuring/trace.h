@@ -0,0 +1,124 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace as {
+
+#pragma region span
+
+/// <summary>
+/// Named interval of time on a single thread. Spans are recorded by the timing
+/// helpers (MEASURE_FUNCTION_TIMING, MEASURE_SCOPE_TIMING) while a trace
+/// exporter is running
+/// </summary>
+struct timing_span {
+  const char* name = nullptr;
+  timestamp_t begin;
+  timestamp_t end;
+  uint32_t thread_index = 0;
+
+  timespan_t duration() const { return end - begin; }
+};
+
+namespace detail {
+
+/// <summary>
+/// Hands a span to the running trace exporter. Does nothing (apart from a
+/// single relaxed load) if no exporter is running
+/// </summary>
+AS_API void record_span(const char* name, timestamp_t begin, timestamp_t end);
+
+}  // namespace detail
+
+#pragma endregion
+
+#pragma region chrome_trace_exporter
+
+struct trace_export_options {
+  /// <summary>
+  /// Interval at which the background thread moves recorded spans to the file
+  /// </summary>
+  std::chrono::milliseconds flush_interval{100};
+  /// <summary>
+  /// Number of spans that each thread can buffer between two flushes. Spans
+  /// that do not fit are dropped. Only applies to threads that record their
+  /// first span after the exporter was created
+  /// </summary>
+  size_t buffer_capacity_per_thread = 1 << 14;
+};
+
+/// <summary>
+/// Streams all spans recorded while it is alive to a file in the Chrome
+/// trace-event JSON format, which can be loaded in chrome://tracing or the
+/// Perfetto UI. Each thread records into its own lock-free buffer, which a
+/// background thread drains periodically, so the trace is never held in
+/// memory as a whole. Only one exporter can be running at a time. When it
+/// stops, the exemplars of scopes and functions registered with
+/// keep_exemplars that started while it was running are added as instant
+/// events of the category 'exemplar' with the request id and duration
+/// </summary>
+struct AS_API chrome_trace_exporter {
+  /// <summary>
+  /// Opens the given file and starts recording spans
+  /// </summary>
+  /// <exception cref="std::runtime_error">If the file can't be opened or
+  /// another exporter is already running</exception>
+  explicit chrome_trace_exporter(const std::string& path,
+                                 trace_export_options options = {});
+  /// <summary>
+  /// Stops recording, writes all remaining spans and the exemplars and closes
+  /// the file
+  /// </summary>
+  ~chrome_trace_exporter();
+
+  chrome_trace_exporter(const chrome_trace_exporter&) = delete;
+  chrome_trace_exporter& operator=(const chrome_trace_exporter&) = delete;
+
+  /// <summary>
+  /// Writes all spans that were recorded up to now to the file
+  /// </summary>
+  void flush();
+
+  /// <summary>
+  /// Returns the number of spans written to the file so far
+  /// </summary>
+  uint64_t get_exported_span_count() const;
+
+  /// <summary>
+  /// Returns the number of spans that were dropped because a thread recorded
+  /// more spans between two flushes than its buffer could hold
+  /// </summary>
+  uint64_t get_dropped_span_count() const;
+
+ private:
+  void run();
+  void drain();
+  void write_exemplars();
+
+  std::ofstream _file;
+  const trace_export_options _options;
+  const uint64_t _epoch;
+  const timestamp_t _start_time;
+  bool _wrote_first_event;
+  std::string _write_buffer;
+  std::atomic<uint64_t> _exported_spans;
+  uint64_t _dropped_spans_at_start;
+
+  std::mutex _drain_lock;
+  std::mutex _stop_lock;
+  std::condition_variable _stop_signal;
+  bool _stop;
+  std::thread _thread;
+};
+
+#pragma endregion
+
+}  // namespace as
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "api.h"
+#include "scaling/scaling_policy.h"
+
+namespace as {
+
+#pragma region scaling_actuator
+
+/// <summary>
+/// Changes the capacity of a scaled resource, e.g. starts and stops worker
+/// processes or machines
+/// </summary>
+class AS_API scaling_actuator {
+ public:
+  virtual ~scaling_actuator() = default;
+
+  /// <summary>
+  /// Requests additional capacity. The capacity becomes effective
+  /// asynchronously, see current_capacity
+  /// </summary>
+  virtual void scale_out(size_t count) = 0;
+
+  /// <summary>
+  /// Removes capacity, the most recently added capacity first
+  /// </summary>
+  virtual void scale_in(size_t count) = 0;
+
+  /// <summary>
+  /// Returns the capacity that is running and ready to serve
+  /// </summary>
+  virtual size_t current_capacity() const = 0;
+
+  /// <summary>
+  /// Returns the requested capacity, including capacity that is still
+  /// starting
+  /// </summary>
+  virtual size_t target_capacity() const = 0;
+
+  /// <summary>
+  /// Scales out or in so that the target capacity matches the target
+  /// capacity of the decision. Decisions without an action are ignored
+  /// </summary>
+  void apply(const scaling_decision& decision);
+};
+
+#pragma endregion
+
+}  // namespace as
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+#include "util/sketch.h"
+
+namespace as {
+
+#pragma region workload
+
+/// <summary>
+/// Arrival and service characteristics of a scaled resource
+/// </summary>
+struct AS_API workload {
+  /// <summary>
+  /// Arriving jobs per second (lambda)
+  /// </summary>
+  double arrival_rate = 0.0;
+  /// <summary>
+  /// Mean time that one server needs for a job (1 / mu)
+  /// </summary>
+  timespan_t mean_service_time{0};
+
+  /// <summary>
+  /// Number of servers that would be busy on average (lambda / mu), in
+  /// Erlang
+  /// </summary>
+  double offered_load() const;
+};
+
+AS_API workload make_workload(const rate& arrival_rate,
+                              const timing_sketch& service_time);
+
+/// <summary>
+/// Derives the workload from recorded series: the arrival rate from the
+/// number of events in a periodic_event series within the window, and the
+/// mean service time from the function_timing measurements within the window
+/// </summary>
+/// <param name="arrival_name">Name of the periodic_event series</param>
+/// <param name="service_time_name">Name of the function_timing series</param>
+/// <param name="window">Timespan before end that is evaluated</param>
+AS_API workload observe_workload(std::string_view arrival_name,
+                                 std::string_view service_time_name,
+                                 timespan_t window, timestamp_t end = now());
+
+#pragma endregion
+
+#pragma region capacity_model
+
+/// <summary>
+/// Steady-state prediction for a workload served by a number of servers
+/// </summary>
+struct capacity_estimate {
+  size_t servers = 0;
+  /// <summary>
+  /// Fraction of time that each server is busy (rho = lambda / (c * mu))
+  /// </summary>
+  double utilization = 0.0;
+  /// <summary>
+  /// False if the arrival rate reaches the service rate of all servers. The
+  /// queue grows without bound then and the latencies are timespan_t::max()
+  /// </summary>
+  bool stable = false;
+  /// <summary>
+  /// Probability that an arriving job has to wait (Erlang C)
+  /// </summary>
+  double wait_probability = 1.0;
+  timespan_t mean_queue_wait{0};
+  timespan_t mean_response_time{0};
+  /// <summary>
+  /// Mean number of waiting jobs, by Little's law
+  /// </summary>
+  double mean_queue_length = 0.0;
+};
+
+enum class latency_measure {
+  /// <summary>
+  /// Time from arrival until a server starts the job
+  /// </summary>
+  queue_wait,
+  /// <summary>
+  /// Time from arrival until the job is completed
+  /// </summary>
+  response_time
+};
+
+struct service_level_objective {
+  /// <summary>
+  /// Latency that the quantile must not exceed
+  /// </summary>
+  timespan_t latency = std::chrono::milliseconds{100};
+  double quantile = 0.95;
+  latency_measure measure = latency_measure::response_time;
+  /// <summary>
+  /// Upper bound for the utilization, as headroom for bursts that the
+  /// steady-state model doesn't capture
+  /// </summary>
+  double max_utilization = 1.0;
+};
+
+/// <summary>
+/// Analytical M/M/c model: Poisson arrivals, exponential service times and c
+/// servers that take jobs from a shared first come, first served queue.
+/// All functions are closed-form or iterate over at most a few hundred
+/// servers, so they are cheap enough to be evaluated on every scaling
+/// decision
+/// </summary>
+namespace capacity_model {
+
+AS_API capacity_estimate estimate(const workload& workload, size_t servers);
+
+/// <summary>
+/// Returns the given quantile of the queue wait time or the response time
+/// with the given number of servers
+/// </summary>
+/// <param name="quantile">Quantile in [0;1), e.g. 0.95</param>
+/// <returns>The latency, or timespan_t::max() if the servers can't keep up
+/// </returns>
+AS_API timespan_t predict_latency(const workload& workload, size_t servers,
+                                  double quantile,
+                                  latency_measure measure =
+                                      latency_measure::response_time);
+
+/// <summary>
+/// Returns the smallest number of servers that meets the objective
+/// </summary>
+/// <returns>The number of servers, or zero if more than max_servers would be
+/// needed, e.g. because the latency objective is below the service time
+/// itself</returns>
+AS_API size_t required_servers(const workload& workload,
+                               const service_level_objective& objective,
+                               size_t max_servers = 1024);
+
+}  // namespace capacity_model
+
+#pragma endregion
+
+}  // namespace as
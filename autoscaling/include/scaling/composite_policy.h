@@ -0,0 +1,294 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+#include "measuring/query.h"
+#include "scaling/scaling_policy.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace as {
+
+#pragma region expression
+
+class composite_policy;
+
+/// <summary>
+/// Types of series that expressions can aggregate. Values are converted to
+/// doubles in base units: timespans in seconds, memory in bytes and rates
+/// per second
+/// </summary>
+enum class metric_type { double_value, size_value, timespan, memory, rate };
+
+template <typename T>
+constexpr metric_type get_metric_type() {
+  if constexpr (std::is_same_v<T, double>) {
+    return metric_type::double_value;
+  } else if constexpr (std::is_same_v<T, size_t>) {
+    return metric_type::size_value;
+  } else if constexpr (std::is_same_v<T, timespan_t>) {
+    return metric_type::timespan;
+  } else if constexpr (std::is_same_v<T, memory>) {
+    return metric_type::memory;
+  } else {
+    static_assert(std::is_same_v<T, rate>, "Unsupported metric type!");
+    return metric_type::rate;
+  }
+}
+
+enum class aggregation {
+  last,
+  mean,
+  min,
+  max,
+  sum,
+  count,
+  /// <summary>
+  /// Quantile of the values, e.g. 0.99 for the p99 of a latency series
+  /// </summary>
+  quantile,
+  /// <summary>
+  /// Least-squares slope in units per second, positive if the series rises
+  /// </summary>
+  slope
+};
+
+enum class operation : uint8_t {
+  constant,
+  aggregate,
+  add,
+  subtract,
+  multiply,
+  divide,
+  less,
+  less_equal,
+  greater,
+  greater_equal,
+  logical_and,
+  logical_or,
+  logical_not,
+  /// <summary>
+  /// Value of a compiled query, see as::query
+  /// </summary>
+  query
+};
+
+/// <summary>
+/// Handle of a node in the expression graph of a composite_policy.
+/// Conditions evaluate to 1 (true) or 0 (false); aggregates of windows
+/// without measurements evaluate to NaN, which makes every comparison
+/// involving them false
+/// </summary>
+class AS_API expression {
+ public:
+  expression(composite_policy* policy, uint32_t id);
+
+  composite_policy* get_policy() const;
+  uint32_t get_id() const;
+
+ private:
+  composite_policy* _policy;
+  uint32_t _id;
+};
+
+AS_API expression operator+(expression l, expression r);
+AS_API expression operator-(expression l, expression r);
+AS_API expression operator*(expression l, expression r);
+AS_API expression operator/(expression l, expression r);
+AS_API expression operator<(expression l, expression r);
+AS_API expression operator<=(expression l, expression r);
+AS_API expression operator>(expression l, expression r);
+AS_API expression operator>=(expression l, expression r);
+/// <summary>
+/// Both operands are always evaluated, there is no short-circuiting
+/// </summary>
+AS_API expression operator&&(expression l, expression r);
+AS_API expression operator||(expression l, expression r);
+AS_API expression operator!(expression e);
+
+AS_API expression operator+(expression l, double r);
+AS_API expression operator-(expression l, double r);
+AS_API expression operator*(expression l, double r);
+AS_API expression operator/(expression l, double r);
+AS_API expression operator<(expression l, double r);
+AS_API expression operator<=(expression l, double r);
+AS_API expression operator>(expression l, double r);
+AS_API expression operator>=(expression l, double r);
+
+#pragma endregion
+
+#pragma region composite_policy
+
+struct composite_policy_options {
+  size_t min_capacity = 1;
+  size_t max_capacity = 16;
+  /// <summary>
+  /// Minimal time between two scale outs
+  /// </summary>
+  std::chrono::milliseconds scale_out_cooldown{1000};
+  /// <summary>
+  /// Minimal time between any scaling and a following scale in
+  /// </summary>
+  std::chrono::milliseconds scale_in_cooldown{10000};
+};
+
+/// <summary>
+/// Work done by the last decision of a composite_policy
+/// </summary>
+struct composite_policy_statistics {
+  size_t series_reads = 0;
+  size_t aggregates = 0;
+  size_t nodes = 0;
+  size_t rules = 0;
+  timespan_t duration{0};
+};
+
+/// <summary>
+/// Policy that combines signals of several series with rules like
+/// "scale out if p99 latency > 100ms || (memory > 80% && rate rising)".
+///
+/// Expressions are nodes of a single graph. Identical aggregates and
+/// subexpressions are stored once, including operands of commutative
+/// operators in either order. Every decision reads each series once, over
+/// the largest window that any aggregate needs. It then computes each node
+/// once, so rules can share aggregates and subexpressions at no extra
+/// cost.
+///
+/// If any scale out rule holds, the capacity grows by the largest step of
+/// the scale out rules that hold. Otherwise, if any scale in rule holds, it
+/// shrinks by the largest step of those. Expressions and rules must be
+/// added before the policy is used concurrently with decide()
+/// </summary>
+class AS_API composite_policy : public scaling_policy {
+ public:
+  explicit composite_policy(composite_policy_options options = {});
+
+  composite_policy(const composite_policy&) = delete;
+  composite_policy& operator=(const composite_policy&) = delete;
+
+  /// <summary>
+  /// Returns an aggregate of the values of the series within the window
+  /// that ends at the time of the decision, excluding its start
+  /// </summary>
+  /// <param name="quantile">Quantile in [0;1] for aggregation::quantile,
+  /// ignored otherwise</param>
+  template <typename T>
+  expression aggregate(std::string_view name, aggregation kind,
+                       std::chrono::milliseconds window,
+                       double quantile = 0.5) {
+    return add_aggregate(name, get_metric_type<T>(), kind, window, quantile);
+  }
+
+  expression constant(double value);
+
+  /// <summary>
+  /// Returns the value of a query in the language of as::query, like
+  /// "p99(timespan{name=\"x\"}[1m]) > 0.1", so that rules can be read from
+  /// configuration. The query keeps its own windows and is evaluated
+  /// incrementally in every decision
+  /// </summary>
+  /// <exception cref="std::runtime_error">If the text is not a valid query
+  /// </exception>
+  expression from_query(std::string_view text);
+
+  /// <summary>
+  /// Returns the node that combines the operands with the operation
+  /// </summary>
+  /// <exception cref="std::runtime_error">If an operand belongs to another
+  /// policy or the operation is not binary</exception>
+  expression combine(operation op, expression l, expression r);
+
+  /// <exception cref="std::runtime_error">If the operand belongs to another
+  /// policy</exception>
+  expression negate(expression e);
+
+  /// <param name="reason">Reason of the decisions of the rule, copied
+  /// </param>
+  /// <exception cref="std::runtime_error">If the condition belongs to another
+  /// policy or the action is none</exception>
+  void add_rule(expression condition, scaling_action action, size_t step = 1,
+                std::string_view reason = {});
+
+  scaling_decision decide(const scaling_inputs& inputs,
+                          timestamp_t timestamp) override;
+  const char* get_name() const override;
+
+  /// <summary>
+  /// Returns the value of the expression in the last decision, NaN before
+  /// the first decision
+  /// </summary>
+  double get_value(expression e) const;
+
+  const composite_policy_statistics& get_statistics() const;
+  size_t get_node_count() const;
+
+ private:
+  struct series {
+    std::string_view name;
+    metric_type type;
+    timespan_t window;
+  };
+
+  struct aggregate_node {
+    uint32_t series_id;
+    aggregation kind;
+    timespan_t window;
+    double quantile;
+  };
+
+  struct node {
+    operation op;
+    uint32_t left;
+    uint32_t right;
+    double value;
+  };
+
+  struct rule {
+    uint32_t condition;
+    scaling_action action;
+    size_t step;
+    const char* reason;
+  };
+
+  // Constants by their bit pattern, so that NaN keeps the ordering strict
+  using node_key = std::tuple<operation, uint32_t, uint32_t, uint64_t>;
+
+  expression add_aggregate(std::string_view name, metric_type type,
+                           aggregation kind, std::chrono::milliseconds window,
+                           double quantile);
+  expression add_node(operation op, uint32_t left, uint32_t right,
+                      double value);
+  uint32_t get_id(expression e) const;
+  void evaluate(timestamp_t timestamp);
+  bool has_elapsed(timestamp_t since, std::chrono::milliseconds cooldown,
+                   timestamp_t timestamp) const;
+
+  const composite_policy_options _options;
+
+  std::vector<series> _series;
+  std::map<std::tuple<std::string_view, metric_type>, uint32_t> _series_ids;
+  std::vector<aggregate_node> _aggregates;
+  std::map<std::tuple<uint32_t, aggregation, int64_t, double>, uint32_t>
+      _aggregate_ids;
+  std::vector<node> _nodes;
+  std::map<node_key, uint32_t> _node_ids;
+  std::vector<std::unique_ptr<as::query>> _queries;
+  std::vector<rule> _rules;
+
+  std::vector<double> _values;
+  composite_policy_statistics _statistics;
+
+  bool _has_scaled_out;
+  timestamp_t _last_scale_out;
+  bool _has_scaled;
+  timestamp_t _last_scaling;
+};
+
+#pragma endregion
+
+}  // namespace as
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+#include "scaling/scaling_policy.h"
+
+#include <string>
+#include <vector>
+
+namespace as {
+
+#pragma region decision_record
+
+/// <summary>
+/// A scaling decision together with everything that led to it
+/// </summary>
+struct decision_record {
+  scaling_inputs inputs;
+  scaling_decision decision;
+  /// <summary>
+  /// Static name of the policy, see scaling_policy::get_name
+  /// </summary>
+  const char* policy_name = "";
+  /// <summary>
+  /// Version of the policy configuration, incremented by the scaling engine
+  /// whenever the configuration changes
+  /// </summary>
+  uint32_t policy_version = 0;
+};
+
+#pragma endregion
+
+#pragma region decision_journal
+
+/// <summary>
+/// Summary of the measurements of a series within a window. Timespans are
+/// summarized in seconds
+/// </summary>
+struct window_summary {
+  size_t count = 0;
+  double mean = 0.0;
+  double max = 0.0;
+};
+
+struct metric_windows {
+  window_summary before;
+  window_summary after;
+};
+
+/// <summary>
+/// A recorded decision joined with the windows of its driving metrics
+/// </summary>
+struct decision_impact {
+  timestamp_t timestamp;
+  decision_record record;
+  metric_windows latency;
+  metric_windows utilization;
+  metric_windows queue_length;
+  /// <summary>
+  /// Whether the capacity series reached the target capacity within the
+  /// after window, and how long that took
+  /// </summary>
+  bool reached_target = false;
+  timespan_t time_to_target{0};
+};
+
+struct decision_journal_options {
+  /// <summary>
+  /// Decisions are recorded in the series "<name>.decisions"
+  /// (decision_record)
+  /// </summary>
+  std::string name = "scaling";
+  /// <summary>
+  /// Series of the metrics that drive the decisions. Empty names are skipped
+  /// </summary>
+  std::string latency_name;       // timespan_t
+  std::string utilization_name;   // double
+  std::string queue_length_name;  // size_t
+  std::string capacity_name;      // size_t
+  std::chrono::milliseconds before_window{10000};
+  std::chrono::milliseconds after_window{30000};
+};
+
+/// <summary>
+/// Records scaling decisions as structured measurements and joins them with
+/// the metrics that drove them, to audit how effective and how fast scaling
+/// is. Thread-safe like the measurement storage it records into
+/// </summary>
+class AS_API decision_journal {
+ public:
+  explicit decision_journal(decision_journal_options options);
+
+  void record(const scaling_inputs& inputs, const scaling_decision& decision,
+              const char* policy_name, uint32_t policy_version);
+
+  std::vector<measurement<decision_record>> get_decisions(
+      timestamp_t begin = timestamp_t{}, timestamp_t end = now()) const;
+
+  /// <summary>
+  /// Returns the decisions in [begin;end], each joined with the windows of
+  /// the driving metrics before and after it. Every series is read once for
+  /// the whole range and the windows are located by binary search
+  /// </summary>
+  std::vector<decision_impact> get_impact(timestamp_t begin = timestamp_t{},
+                                          timestamp_t end = now()) const;
+
+  std::string_view get_decisions_name() const;
+  const decision_journal_options& get_options() const;
+
+ private:
+  const decision_journal_options _options;
+  std::string_view _decisions_name;
+  std::string_view _latency_name;
+  std::string_view _utilization_name;
+  std::string_view _queue_length_name;
+  std::string_view _capacity_name;
+};
+
+#pragma endregion
+
+}  // namespace as
@@ -0,0 +1,194 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+#include "scaling/actuator.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace as {
+
+#pragma region local_process_actuator
+
+/// <summary>
+/// Environment variables through which a worker process learns where to
+/// report to and which worker it is
+/// </summary>
+constexpr const char* worker_socket_env = "AS_WORKER_SOCKET";
+constexpr const char* worker_id_env = "AS_WORKER_ID";
+
+struct local_process_actuator_options {
+  /// <summary>
+  /// Prefix of the names of the recorded series
+  /// </summary>
+  std::string name = "fleet";
+  /// <summary>
+  /// Program and arguments of a worker process. The program is searched in
+  /// PATH
+  /// </summary>
+  std::vector<std::string> command;
+  /// <summary>
+  /// Path of the Unix socket that the workers report to. Empty means a path
+  /// in /tmp derived from the process id and the name
+  /// </summary>
+  std::string socket_path;
+  /// <summary>
+  /// Time that a worker gets to exit after SIGTERM before it is killed
+  /// </summary>
+  std::chrono::milliseconds stop_timeout{5000};
+  /// <summary>
+  /// Maximum number of distinct metric names that workers can report. Metrics
+  /// with further names are dropped, so workers can't grow the memory of the
+  /// actuator without bound
+  /// </summary>
+  size_t max_metric_names = 64;
+};
+
+/// <summary>
+/// Actuator that runs the capacity as worker processes on the local machine,
+/// so that a scaling loop can be exercised end to end on a single host.
+///
+/// Workers are started with the configured command and find the path of a
+/// Unix datagram socket and their id in the environment (see worker_reporter).
+/// A worker counts towards the current capacity once it reports that it is
+/// ready. Metrics that workers report are recorded as "<name>.<metric>"
+/// (double), metrics from processes that are not one of the workers are
+/// dropped. Additionally records:
+/// - "<name>.actuation_latency" (timespan_t): time from starting a worker
+///   until it reported ready
+/// - "<name>.capacity" (size_t): ready workers, whenever it changes
+///
+/// Only supported on Linux
+/// </summary>
+class AS_API local_process_actuator : public scaling_actuator {
+ public:
+  static bool is_supported();
+
+  /// <exception cref="std::runtime_error">If the platform is not supported,
+  /// the command is empty or the socket can't be created</exception>
+  explicit local_process_actuator(local_process_actuator_options options);
+
+  /// <summary>
+  /// Stops all workers
+  /// </summary>
+  ~local_process_actuator() override;
+
+  local_process_actuator(const local_process_actuator&) = delete;
+  local_process_actuator& operator=(const local_process_actuator&) = delete;
+
+  /// <exception cref="std::runtime_error">If a process can't be
+  /// started</exception>
+  void scale_out(size_t count) override;
+  void scale_in(size_t count) override;
+  size_t current_capacity() const override;
+  size_t target_capacity() const override;
+
+  /// <summary>
+  /// Blocks until the current capacity reaches at least the given value
+  /// </summary>
+  /// <returns>False on timeout</returns>
+  bool wait_for_capacity(size_t capacity, std::chrono::milliseconds timeout);
+
+  /// <summary>
+  /// Number of workers that exited without being asked to
+  /// </summary>
+  size_t get_failed_worker_count() const;
+
+  const std::string& get_socket_path() const;
+
+  /// <summary>
+  /// Number of metrics dropped because they came from an unknown worker or
+  /// exceeded max_metric_names
+  /// </summary>
+  uint64_t get_dropped_metric_count() const;
+
+ private:
+  struct worker_process {
+    uint32_t id;
+    int pid;
+    timestamp_t start_time;
+    bool ready;
+    bool stopping;
+    timestamp_t stop_time;
+  };
+
+  void run();
+  void receive_reports();
+  bool is_worker(uint32_t worker_id) const;
+  /// <summary>
+  /// Returns the interned series name of the metric, or an empty view if there
+  /// are already max_metric_names names
+  /// </summary>
+  std::string_view get_metric_name(std::string_view metric);
+  void reap_workers();
+  void record_capacity();
+
+  const local_process_actuator_options _options;
+  std::string _socket_path;
+  int _socket_fd;
+  std::string_view _actuation_latency_name;
+  std::string_view _capacity_name;
+  // Only accessed by the receiving thread. Keys view the interned names
+  std::unordered_map<std::string_view, std::string_view> _metric_names;
+  std::atomic<uint64_t> _dropped_metrics;
+
+  mutable std::mutex _workers_lock;
+  std::condition_variable _capacity_signal;
+  std::vector<worker_process> _workers;
+  uint32_t _next_worker_id;
+  size_t _ready_workers;
+  size_t _failed_workers;
+
+  std::atomic<bool> _stop;
+  std::thread _thread;
+};
+
+/// <summary>
+/// Reporting side of the local_process_actuator, used inside the worker
+/// processes
+/// </summary>
+class AS_API worker_reporter {
+ public:
+  /// <summary>
+  /// True if the process was started by a local_process_actuator
+  /// </summary>
+  static bool is_available();
+
+  /// <exception cref="std::runtime_error">If the process was not started by a
+  /// local_process_actuator</exception>
+  worker_reporter();
+  ~worker_reporter();
+
+  worker_reporter(const worker_reporter&) = delete;
+  worker_reporter& operator=(const worker_reporter&) = delete;
+
+  /// <summary>
+  /// Tells the actuator that the worker is ready to serve
+  /// </summary>
+  void report_ready();
+
+  /// <summary>
+  /// Reports a metric value. Names longer than 55 characters are truncated
+  /// </summary>
+  void report(std::string_view name, double value);
+
+  uint32_t get_worker_id() const;
+
+ private:
+  void send(uint8_t type, std::string_view name, double value);
+
+  std::string _socket_path;
+  uint32_t _worker_id;
+  int _socket_fd;
+};
+
+#pragma endregion
+
+}  // namespace as
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+
+namespace as {
+
+#pragma region scaling_decision
+
+enum class scaling_action { none, scale_out, scale_in };
+
+AS_API const char* to_string(scaling_action action);
+
+/// <summary>
+/// Observations of a scaled resource (a thread pool, a fleet of processes)
+/// over the last evaluation interval
+/// </summary>
+struct scaling_inputs {
+  /// <summary>
+  /// Current number of workers or replicas
+  /// </summary>
+  size_t current_capacity = 0;
+  /// <summary>
+  /// Observed latency quantile, e.g. the p95 of the queue wait time
+  /// </summary>
+  timespan_t latency{0};
+  /// <summary>
+  /// Number of samples that the latency is based on
+  /// </summary>
+  uint64_t latency_samples = 0;
+  /// <summary>
+  /// Fraction of the current capacity that was busy, in [0;1]
+  /// </summary>
+  double utilization = 0.0;
+  size_t queue_length = 0;
+};
+
+struct scaling_decision {
+  timestamp_t timestamp;
+  scaling_action action = scaling_action::none;
+  size_t current_capacity = 0;
+  size_t target_capacity = 0;
+  /// <summary>
+  /// Static description of the rule that led to the decision
+  /// </summary>
+  const char* reason = "";
+};
+
+#pragma endregion
+
+#pragma region scaling_policy
+
+/// <summary>
+/// Decides how much capacity a resource needs. Policies may keep state
+/// between decisions, e.g. for cooldowns, so a policy instance must only be
+/// used for a single resource
+/// </summary>
+class AS_API scaling_policy {
+ public:
+  virtual ~scaling_policy() = default;
+
+  /// <param name="inputs">Observations since the previous decision</param>
+  /// <param name="timestamp">Time of the decision, used for cooldowns</param>
+  virtual scaling_decision decide(const scaling_inputs& inputs,
+                                  timestamp_t timestamp) = 0;
+
+  /// <summary>
+  /// Returns a static name of the policy for journals and logs
+  /// </summary>
+  virtual const char* get_name() const;
+};
+
+struct latency_target_policy_options {
+  /// <summary>
+  /// Latency that should not be exceeded
+  /// </summary>
+  timespan_t target_latency = std::chrono::milliseconds{10};
+  /// <summary>
+  /// Latencies based on fewer samples are ignored
+  /// </summary>
+  uint64_t min_latency_samples = 1;
+  /// <summary>
+  /// Utilization that the capacity is sized for when scaling
+  /// </summary>
+  double target_utilization = 0.7;
+  /// <summary>
+  /// Scale out above this utilization, even if the latency is fine
+  /// </summary>
+  double scale_out_utilization = 0.9;
+  /// <summary>
+  /// Scale in only below this utilization and if the latency is below
+  /// scale_in_latency_fraction of the target. The gaps to the scale out
+  /// thresholds form the hysteresis band in which nothing changes
+  /// </summary>
+  double scale_in_utilization = 0.4;
+  double scale_in_latency_fraction = 0.5;
+  size_t min_capacity = 1;
+  size_t max_capacity = 16;
+  /// <summary>
+  /// Largest reduction of the capacity in a single decision
+  /// </summary>
+  size_t max_scale_in_step = 1;
+  /// <summary>
+  /// Minimal time between two scale outs
+  /// </summary>
+  std::chrono::milliseconds scale_out_cooldown{1000};
+  /// <summary>
+  /// Minimal time between any scaling and a following scale in
+  /// </summary>
+  std::chrono::milliseconds scale_in_cooldown{10000};
+};
+
+/// <summary>
+/// Scales out when the latency exceeds the target or the resource is
+/// saturated, and scales in slowly when both latency and utilization are
+/// well below their thresholds. The new capacity is sized so that the
+/// observed load would result in the target utilization
+/// </summary>
+class AS_API latency_target_policy : public scaling_policy {
+ public:
+  explicit latency_target_policy(latency_target_policy_options options = {});
+
+  scaling_decision decide(const scaling_inputs& inputs,
+                          timestamp_t timestamp) override;
+  const char* get_name() const override;
+
+  const latency_target_policy_options& get_options() const;
+
+ private:
+  bool has_elapsed(timestamp_t since, std::chrono::milliseconds cooldown,
+                   timestamp_t timestamp) const;
+
+  const latency_target_policy_options _options;
+  bool _has_scaled_out;
+  timestamp_t _last_scale_out;
+  bool _has_scaled;
+  timestamp_t _last_scaling;
+};
+
+#pragma endregion
+
+}  // namespace as
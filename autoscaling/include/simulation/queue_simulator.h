@@ -0,0 +1,144 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+#include "scaling/scaling_policy.h"
+#include "util/sketch.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace as {
+
+#pragma region load_profile
+
+/// <summary>
+/// Arrival rate in jobs per second at the given offset from the start of a
+/// simulation
+/// </summary>
+using load_profile = std::function<double(timespan_t offset)>;
+
+AS_API load_profile constant_load(double per_second);
+
+/// <summary>
+/// Replays a recorded series of arrival rates, e.g. a rate of requests that
+/// was measured in production. Each rate holds until the timestamp of the
+/// next one, offsets are relative to the first measurement
+/// </summary>
+AS_API load_profile recorded_load(std::vector<measurement<rate>> rates);
+
+#pragma endregion
+
+#pragma region queue_simulator
+
+struct queue_simulator_options {
+  /// <summary>
+  /// Prefix of the names of the recorded series
+  /// </summary>
+  std::string name = "simulation";
+  load_profile load = constant_load(10.0);
+  /// <summary>
+  /// Simulated time
+  /// </summary>
+  std::chrono::milliseconds duration{3600 * 1000};
+  /// <summary>
+  /// Virtual time at which the simulation starts
+  /// </summary>
+  timestamp_t start_time{};
+  /// <summary>
+  /// Mean of the exponentially distributed service time of a job
+  /// </summary>
+  timespan_t mean_service_time = std::chrono::milliseconds{100};
+  size_t initial_capacity = 1;
+  /// <summary>
+  /// Time from scaling out until the new capacity serves jobs
+  /// </summary>
+  std::chrono::milliseconds provisioning_delay{0};
+  /// <summary>
+  /// Interval in which the load profile is sampled. The arrival rate is
+  /// constant in between
+  /// </summary>
+  std::chrono::milliseconds load_resolution{1000};
+  std::chrono::milliseconds evaluation_interval{1000};
+  /// <summary>
+  /// Quantile of the queue wait time that is passed to the policy as latency
+  /// </summary>
+  double latency_quantile = 0.95;
+  uint64_t seed = 1;
+  /// <summary>
+  /// Records the series "<name>.capacity" (size_t), "<name>.utilization"
+  /// (double), "<name>.queue_length" (size_t) and "<name>.latency"
+  /// (timespan_t) at every evaluation, and the decisions in the journal
+  /// "<name>.decisions"
+  /// </summary>
+  bool record_series = true;
+  /// <summary>
+  /// Installs the virtual clock of the run process-wide for the duration of
+  /// run(), for policies that take timestamps themselves instead of using the
+  /// one passed to decide. As the clock is global, only one simulation with
+  /// this option may run at a time and no other code should take timestamps
+  /// while it runs
+  /// </summary>
+  bool install_clock = false;
+};
+
+struct simulation_result {
+  uint64_t arrived_jobs = 0;
+  uint64_t completed_jobs = 0;
+  /// <summary>
+  /// Time from arrival until a server started the job
+  /// </summary>
+  timing_sketch queue_wait_time;
+  /// <summary>
+  /// Time from arrival until the job was completed
+  /// </summary>
+  timing_sketch response_time;
+  /// <summary>
+  /// Capacity integrated over the simulated time, including capacity that
+  /// is still being provisioned or drained, as a measure of cost
+  /// </summary>
+  double capacity_seconds = 0.0;
+  size_t max_capacity = 0;
+  size_t final_capacity = 0;
+  uint64_t scale_outs = 0;
+  uint64_t scale_ins = 0;
+  /// <summary>
+  /// Decisions of the policy with an action. While capacity is provisioned,
+  /// a policy may repeat a decision that is already being carried out
+  /// </summary>
+  std::vector<scaling_decision> decisions;
+};
+
+/// <summary>
+/// Discrete-event simulation of an M/M/c queue whose number of servers c is
+/// controlled by a scaling policy. Jobs arrive as a Poisson process with the
+/// rate of the load profile and are served first come, first served.
+///
+/// The simulation jumps from event to event on a virtual_clock of its own, so
+/// an hour of traffic is simulated in a fraction of a second. The virtual
+/// time is passed explicitly to the policy and to the recorded measurements,
+/// so simulations can run concurrently, e.g. to compare policies in parallel,
+/// unless queue_simulator_options::install_clock is set
+/// </summary>
+class AS_API queue_simulator {
+ public:
+  /// <exception cref="std::runtime_error">If no load profile is given or an
+  /// interval is not positive</exception>
+  explicit queue_simulator(queue_simulator_options options = {});
+
+  /// <summary>
+  /// Runs the simulation from the start, so repeated runs with the same
+  /// seed and a fresh policy produce the same result
+  /// </summary>
+  simulation_result run(scaling_policy& policy) const;
+
+  const queue_simulator_options& get_options() const;
+
+ private:
+  const queue_simulator_options _options;
+};
+
+#pragma endregion
+
+}  // namespace as
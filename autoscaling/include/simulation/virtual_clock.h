@@ -0,0 +1,59 @@
+#pragma once
+
+#include "api.h"
+#include "measuring/measurement.h"
+
+#include <atomic>
+
+namespace as {
+
+#pragma region virtual_clock
+
+/// <summary>
+/// Clock that only moves when it is told to. Installed with set_clock or
+/// scoped_clock, it makes all timestamps of the library virtual, so that code
+/// can be run against simulated time
+/// </summary>
+class AS_API virtual_clock : public clock_source {
+ public:
+  explicit virtual_clock(timestamp_t start = timestamp_t{});
+
+  timestamp_t now() const override;
+
+  /// <summary>
+  /// Moves the clock to the given point in time
+  /// </summary>
+  /// <exception cref="std::runtime_error">If the point in time is before the
+  /// current time of the clock</exception>
+  void set(timestamp_t timestamp);
+
+  /// <summary>
+  /// Moves the clock forward by the given timespan
+  /// </summary>
+  /// <exception cref="std::runtime_error">If the timespan is
+  /// negative</exception>
+  void advance(timespan_t timespan);
+
+ private:
+  std::atomic<int64_t> _ns;
+};
+
+/// <summary>
+/// Installs a clock for the lifetime of the object and restores the
+/// previously installed clock afterwards
+/// </summary>
+class AS_API scoped_clock {
+ public:
+  explicit scoped_clock(const clock_source& clock);
+  ~scoped_clock();
+
+  scoped_clock(const scoped_clock&) = delete;
+  scoped_clock& operator=(const scoped_clock&) = delete;
+
+ private:
+  const clock_source* _previous;
+};
+
+#pragma endregion
+
+}  // namespace as
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace as {
+
+/// <summary>
+/// A single sample with the context needed to find the request it belongs to
+/// </summary>
+struct exemplar {
+  std::chrono::nanoseconds value{0};
+  std::chrono::high_resolution_clock::time_point timestamp;
+  uint64_t request_id = 0;
+  uint32_t thread_index = 0;
+};
+
+/// <summary>
+/// Orders exemplars from the largest to the smallest value
+/// </summary>
+inline bool is_slower(const exemplar& l, const exemplar& r) {
+  return l.value > r.value;
+}
+
+/// <summary>
+/// Keeps the K largest samples of each window, e.g. the slowest calls of a
+/// timed scope, in a bounded min-heap. Once the heap is full, samples that
+/// are not larger than its minimum are rejected with two relaxed atomic
+/// loads and without locking, which is the common case. Everything else is
+/// guarded by a mutex, so offering and reading are thread-safe. Windows are
+/// aligned to multiples of their length since the clock's epoch
+/// </summary>
+class top_exemplars {
+ public:
+  /// <param name="capacity">Number of exemplars kept per window, K</param>
+  top_exemplars(size_t capacity, std::chrono::nanoseconds window)
+      : _capacity(std::max<size_t>(capacity, 1)),
+        _window(std::max<int64_t>(window.count(), 1)),
+        _threshold(std::numeric_limits<int64_t>::min()),
+        _window_end(std::numeric_limits<int64_t>::min()) {
+    _heap.reserve(_capacity);
+  }
+
+  top_exemplars(const top_exemplars&) = delete;
+  top_exemplars& operator=(const top_exemplars&) = delete;
+
+  /// <returns>True if the sample is one of the K largest of its window so
+  /// far</returns>
+  bool offer(const exemplar& sample) {
+    const auto time = sample.timestamp.time_since_epoch().count();
+    if (sample.value.count() <= _threshold.load(std::memory_order_relaxed) &&
+        time < _window_end.load(std::memory_order_relaxed))
+      return false;
+
+    std::lock_guard<std::mutex> guard{_lock};
+    if (time >= _window_end.load(std::memory_order_relaxed)) roll(time);
+
+    if (_heap.size() == _capacity) {
+      if (!is_slower(sample, _heap.front())) return false;
+      std::pop_heap(_heap.begin(), _heap.end(), is_slower);
+      _heap.back() = sample;
+    } else {
+      _heap.push_back(sample);
+    }
+    std::push_heap(_heap.begin(), _heap.end(), is_slower);
+    if (_heap.size() == _capacity)
+      _threshold.store(_heap.front().value.count(), std::memory_order_relaxed);
+    return true;
+  }
+
+  /// <summary>
+  /// Returns the K largest exemplars of the current and the previous window,
+  /// largest first. Including the previous window means that a snapshot
+  /// taken right after a window started still has exemplars
+  /// </summary>
+  std::vector<exemplar> get_exemplars() const {
+    std::lock_guard<std::mutex> guard{_lock};
+    auto ret = _previous;
+    ret.insert(ret.end(), _heap.begin(), _heap.end());
+    std::sort(ret.begin(), ret.end(), is_slower);
+    if (ret.size() > _capacity) ret.resize(_capacity);
+    return ret;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard{_lock};
+    _heap.clear();
+    _previous.clear();
+    _threshold.store(std::numeric_limits<int64_t>::min(),
+                     std::memory_order_relaxed);
+  }
+
+  size_t capacity() const { return _capacity; }
+  std::chrono::nanoseconds window() const {
+    return std::chrono::nanoseconds{_window};
+  }
+
+ private:
+  /// <summary>
+  /// Starts the window that contains the given time
+  /// </summary>
+  void roll(int64_t time) {
+    const auto window_end = _window_end.load(std::memory_order_relaxed);
+    // The current window becomes the previous one only if it is adjacent
+    if (window_end != std::numeric_limits<int64_t>::min() &&
+        time < window_end + _window) {
+      _previous = std::move(_heap);
+    } else {
+      _previous.clear();
+    }
+    _heap.clear();
+    _heap.reserve(_capacity);
+
+    auto start = time - time % _window;
+    if (time < 0 && time % _window) start -= _window;
+    _threshold.store(std::numeric_limits<int64_t>::min(),
+                     std::memory_order_relaxed);
+    _window_end.store(start + _window, std::memory_order_relaxed);
+  }
+
+  const size_t _capacity;
+  const int64_t _window;
+  std::atomic<int64_t> _threshold;
+  std::atomic<int64_t> _window_end;
+  mutable std::mutex _lock;
+  std::vector<exemplar> _heap;
+  std::vector<exemplar> _previous;
+};
+
+}  // namespace as
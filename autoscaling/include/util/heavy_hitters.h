@@ -0,0 +1,238 @@
+#pragma once
+
+#include "math.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace as {
+
+/// <summary>
+/// Count-Min sketch (Cormode and Muthukrishnan, 2005) that estimates how often
+/// each key was added in a fixed amount of memory. Estimates never undercount
+/// and overcount by at most e / width of the total with a probability of
+/// 1 - exp(-depth). Uses conservative update, which only increments the
+/// counters that are equal to the current estimate and so overcounts less
+/// </summary>
+class count_min_sketch {
+ public:
+  /// <param name="width">Counters per row, at least 1</param>
+  /// <param name="depth">Number of rows, at least 1</param>
+  count_min_sketch(size_t width, size_t depth)
+      : _width(std::max<size_t>(width, 1)),
+        _depth(std::max<size_t>(depth, 1)),
+        _total(0),
+        _counters(_width * _depth, 0) {}
+
+  /// <returns>The estimate of the key after adding</returns>
+  uint64_t add(uint64_t hash, uint64_t count = 1) {
+    _total += count;
+    const auto target = estimate(hash) + count;
+    for (size_t row = 0; row < _depth; ++row) {
+      auto& counter = _counters[index(hash, row)];
+      counter = std::max(counter, target);
+    }
+    return target;
+  }
+
+  uint64_t estimate(uint64_t hash) const {
+    auto ret = std::numeric_limits<uint64_t>::max();
+    for (size_t row = 0; row < _depth; ++row)
+      ret = std::min(ret, _counters[index(hash, row)]);
+    return ret;
+  }
+
+  /// <summary>
+  /// Returns the sum of all counts added
+  /// </summary>
+  uint64_t get_total() const { return _total; }
+
+  void clear() {
+    std::fill(_counters.begin(), _counters.end(), 0);
+    _total = 0;
+  }
+
+ private:
+  /// <summary>
+  /// Derives the column of each row from a single hash through double
+  /// hashing (Kirsch and Mitzenmacher, 2006)
+  /// </summary>
+  size_t index(uint64_t hash, size_t row) const {
+    const auto mixed = math::mix_hash(hash);
+    const auto step = (mixed >> 32) | 1;
+    return row * _width + static_cast<size_t>((mixed + row * step) % _width);
+  }
+
+  size_t _width;
+  size_t _depth;
+  uint64_t _total;
+  std::vector<uint64_t> _counters;
+};
+
+struct heavy_hitter {
+  std::string name;
+  /// <summary>
+  /// Upper bound of the number of times the name was added
+  /// </summary>
+  uint64_t count = 0;
+  /// <summary>
+  /// Maximum overcount, the name was added at least count - error times
+  /// </summary>
+  uint64_t error = 0;
+};
+
+/// <summary>
+/// Tracks the most frequent names of a stream without storing every name,
+/// e.g. the hottest tenants among names with a tenant id. Space-Saving
+/// (Metwally et al., 2005) monitors a fixed number of names in a min-heap of
+/// their counts; a name that is not monitored replaces the least frequent
+/// one and inherits its count as the error. Every name with a frequency
+/// above total / capacity is guaranteed to be monitored. A Count-Min sketch
+/// estimates the frequency of all other names and tightens the estimate of
+/// monitored ones. Adding costs O(depth + log capacity) and allocates only
+/// when a name is replaced. Names are identified by their hash
+/// </summary>
+class heavy_hitters {
+ public:
+  /// <param name="capacity">Number of names monitored, at least 1</param>
+  /// <param name="width">Counters per row of the Count-Min sketch</param>
+  /// <param name="depth">Rows of the Count-Min sketch</param>
+  explicit heavy_hitters(size_t capacity, size_t width = 2048,
+                         size_t depth = 4)
+      : _capacity(std::max<size_t>(capacity, 1)), _sketch(width, depth) {
+    _counters.reserve(_capacity);
+    _heap.reserve(_capacity);
+  }
+
+  void add(std::string_view name, uint64_t count = 1) {
+    const auto hash = std::hash<std::string_view>{}(name);
+    _sketch.add(hash, count);
+
+    const auto itr = _slots.find(hash);
+    if (itr != _slots.end()) {
+      _counters[itr->second].count += count;
+      sift_down(_counters[itr->second].position);
+      return;
+    }
+    if (_counters.size() < _capacity) {
+      _slots.emplace(hash, _counters.size());
+      _heap.push_back(_counters.size());
+      _counters.push_back(counter{hash, std::string{name}, count, 0,
+                                  _heap.size() - 1});
+      sift_up(_heap.size() - 1);
+      return;
+    }
+
+    auto& replaced = _counters[_heap.front()];
+    _slots.erase(replaced.hash);
+    _slots.emplace(hash, _heap.front());
+    replaced.hash = hash;
+    replaced.name.assign(name);
+    replaced.error = replaced.count;
+    replaced.count += count;
+    sift_down(0);
+  }
+
+  /// <summary>
+  /// Returns the monitored names, most frequent first
+  /// </summary>
+  std::vector<heavy_hitter> get_top() const {
+    std::vector<heavy_hitter> ret;
+    ret.reserve(_counters.size());
+    for (auto& c : _counters)
+      ret.push_back(heavy_hitter{c.name, c.count, c.error});
+    std::sort(ret.begin(), ret.end(),
+              [](const heavy_hitter& l, const heavy_hitter& r) {
+                return l.count > r.count;
+              });
+    return ret;
+  }
+
+  /// <summary>
+  /// Returns an upper bound of the number of times the name was added, also
+  /// for names that are not monitored
+  /// </summary>
+  uint64_t estimate(std::string_view name) const {
+    const auto hash = std::hash<std::string_view>{}(name);
+    const auto ret = _sketch.estimate(hash);
+    const auto itr = _slots.find(hash);
+    if (itr == _slots.end()) return ret;
+    return std::min(ret, _counters[itr->second].count);
+  }
+
+  /// <summary>
+  /// Returns the sum of all counts added
+  /// </summary>
+  uint64_t get_total() const { return _sketch.get_total(); }
+
+  size_t capacity() const { return _capacity; }
+
+  void clear() {
+    _sketch.clear();
+    _counters.clear();
+    _heap.clear();
+    _slots.clear();
+  }
+
+ private:
+  struct counter {
+    uint64_t hash;
+    std::string name;
+    uint64_t count;
+    uint64_t error;
+    /// <summary>
+    /// Position of the counter in the heap
+    /// </summary>
+    size_t position;
+  };
+
+  bool less(size_t l, size_t r) const {
+    return _counters[_heap[l]].count < _counters[_heap[r]].count;
+  }
+
+  void swap_positions(size_t l, size_t r) {
+    std::swap(_heap[l], _heap[r]);
+    _counters[_heap[l]].position = l;
+    _counters[_heap[r]].position = r;
+  }
+
+  void sift_up(size_t position) {
+    while (position > 0) {
+      const auto parent = (position - 1) / 2;
+      if (!less(position, parent)) break;
+      swap_positions(position, parent);
+      position = parent;
+    }
+  }
+
+  void sift_down(size_t position) {
+    for (;;) {
+      auto smallest = position;
+      const auto left = 2 * position + 1;
+      const auto right = left + 1;
+      if (left < _heap.size() && less(left, smallest)) smallest = left;
+      if (right < _heap.size() && less(right, smallest)) smallest = right;
+      if (smallest == position) break;
+      swap_positions(position, smallest);
+      position = smallest;
+    }
+  }
+
+  size_t _capacity;
+  count_min_sketch _sketch;
+  std::vector<counter> _counters;
+  /// <summary>
+  /// Min-heap of the indices of the counters, ordered by count
+  /// </summary>
+  std::vector<size_t> _heap;
+  std::unordered_map<uint64_t, size_t> _slots;
+};
+
+}  // namespace as
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "math.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace as {
+
+/// <summary>
+/// HyperLogLog sketch (Flajolet et al., 2007) that estimates the number of
+/// distinct hashes added in 2^precision bytes, with a standard error of about
+/// 1.04 / sqrt(2^precision), e.g. 1.6% for the default precision of 12.
+/// Adding the same hash again does not change the sketch, and merging two
+/// sketches gives the sketch of the union of their hashes, so sketches of
+/// threads and windows can be combined in any order. Small cardinalities are
+/// estimated with linear counting. Hashes must be well distributed over all
+/// 64 bits, see math::mix_hash
+/// </summary>
+class hyperloglog {
+ public:
+  static constexpr uint32_t min_precision = 4;
+  static constexpr uint32_t max_precision = 16;
+
+  explicit hyperloglog(uint32_t precision = 12)
+      : _precision(check_precision(precision)),
+        _registers(size_t{1} << precision, 0) {}
+
+  void add(uint64_t hash) {
+    const auto index = static_cast<size_t>(hash >> (64 - _precision));
+    const auto bits = hash << _precision >> _precision;
+    // Position of the first set bit among the remaining 64 - p bits
+    const auto rank = static_cast<uint8_t>(
+        bits ? 64 - _precision - math::log2_floor(bits) : 65 - _precision);
+    auto& reg = _registers[index];
+    if (rank > reg) reg = rank;
+  }
+
+  /// <summary>
+  /// Adds all hashes of the other sketch, which must have the same precision
+  /// </summary>
+  void merge(const hyperloglog& other) {
+    if (other._precision != _precision)
+      throw std::runtime_error{
+          "Can't merge HyperLogLog sketches of different precisions"};
+    for (size_t idx = 0; idx < _registers.size(); ++idx)
+      _registers[idx] = std::max(_registers[idx], other._registers[idx]);
+  }
+
+  /// <summary>
+  /// Returns the estimated number of distinct hashes added
+  /// </summary>
+  double estimate() const {
+    const auto m = static_cast<double>(_registers.size());
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (auto reg : _registers) {
+      sum += std::ldexp(1.0, -static_cast<int>(reg));
+      if (!reg) ++zeros;
+    }
+    const auto estimate = alpha() * m * m / sum;
+    if (estimate <= 2.5 * m && zeros)
+      return m * std::log(m / static_cast<double>(zeros));
+    return estimate;
+  }
+
+  bool empty() const {
+    return std::all_of(_registers.begin(), _registers.end(),
+                       [](uint8_t reg) { return reg == 0; });
+  }
+
+  void clear() { std::fill(_registers.begin(), _registers.end(), 0); }
+
+  uint32_t get_precision() const { return _precision; }
+
+  /// <summary>
+  /// Returns the memory used by the registers in bytes
+  /// </summary>
+  size_t get_size() const { return _registers.size(); }
+
+ private:
+  static uint32_t check_precision(uint32_t precision) {
+    if (precision < min_precision || precision > max_precision)
+      throw std::runtime_error{"HyperLogLog precision must be in [4;16]"};
+    return precision;
+  }
+
+  double alpha() const {
+    switch (_registers.size()) {
+      case 16:
+        return 0.673;
+      case 32:
+        return 0.697;
+      case 64:
+        return 0.709;
+      default:
+        return 0.7213 / (1.0 + 1.079 / static_cast<double>(_registers.size()));
+    }
+  }
+
+  uint32_t _precision;
+  std::vector<uint8_t> _registers;
+};
+
+}  // namespace as
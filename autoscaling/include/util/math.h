@@ -1,7 +1,12 @@
 #pragma once
 
+#include <stdint.h>
 #include <type_traits>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace as {
 
 namespace math {
@@ -40,6 +45,36 @@ inline void hash_combine(size_t& hash, T const& val) {
   hash ^= hasher(val) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
 }
 
+/// <summary>
+/// Finalizer of MurmurHash3, spreads the bits of a hash so that hashes that
+/// only differ in few bits differ in about half of their bits
+/// </summary>
+inline uint64_t mix_hash(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+/// <summary>
+/// Returns floor(log2(value)) for a non-zero value
+/// </summary>
+inline uint32_t log2_floor(uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return static_cast<uint32_t>(index);
+#elif defined(__GNUC__)
+  return 63u - static_cast<uint32_t>(__builtin_clzll(value));
+#else
+  uint32_t result = 0;
+  while (value >>= 1) ++result;
+  return result;
+#endif
+}
+
 }  // namespace math
 
 }  // namespace as
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace as {
+
+namespace detail {
+
+/// <summary>
+/// Uniform random number in (0;1), never zero so that its logarithm is finite
+/// </summary>
+template <typename Generator>
+double uniform_open(Generator& generator) {
+  std::uniform_real_distribution<double> distribution;
+  double ret;
+  do {
+    ret = distribution(generator);
+  } while (ret <= 0.0);
+  return ret;
+}
+
+}  // namespace detail
+
+/// <summary>
+/// Uniform random sample of a fixed size over all elements ever inserted,
+/// using Algorithm L (Li, 1994). Once the reservoir is full, the number of
+/// elements to skip until the next replacement is drawn in advance, so
+/// inserting a skipped element is a single comparison and random numbers are
+/// only drawn for the rare replacements. Replacements write a random slot.
+/// Iterates in slot order, which is not the insertion order
+/// </summary>
+template <typename T>
+struct reservoir {
+  /// <param name="capacity">Size of the sample, at least 1</param>
+  explicit reservoir(size_t capacity, uint32_t seed = 1)
+      : _capacity(std::max<size_t>(capacity, 1)),
+        _count(0),
+        _next(0),
+        _weight(1.0),
+        _random(seed) {
+    _storage.reserve(_capacity);
+  }
+
+  void insert(T element) {
+    ++_count;
+    if (_storage.size() < _capacity) {
+      _storage.push_back(std::move(element));
+      if (_storage.size() == _capacity) {
+        _weight = std::exp(std::log(detail::uniform_open(_random)) /
+                           static_cast<double>(_capacity));
+        skip();
+      }
+      return;
+    }
+    if (_count < _next) return;
+
+    std::uniform_int_distribution<size_t> slot{0, _capacity - 1};
+    _storage[slot(_random)] = std::move(element);
+    _weight *= std::exp(std::log(detail::uniform_open(_random)) /
+                        static_cast<double>(_capacity));
+    skip();
+  }
+
+  void clear() {
+    _storage.clear();
+    _count = 0;
+    _next = 0;
+    _weight = 1.0;
+  }
+
+  size_t size() const { return _storage.size(); }
+  size_t capacity() const { return _capacity; }
+
+  /// <summary>
+  /// Returns the number of elements inserted, including the ones that were
+  /// not sampled
+  /// </summary>
+  uint64_t get_count() const { return _count; }
+
+  typename std::vector<T>::iterator begin() { return _storage.begin(); }
+  typename std::vector<T>::iterator end() { return _storage.end(); }
+  typename std::vector<T>::const_iterator begin() const {
+    return _storage.begin();
+  }
+  typename std::vector<T>::const_iterator end() const {
+    return _storage.end();
+  }
+
+ private:
+  /// <summary>
+  /// Draws the number of the next element that replaces a slot
+  /// </summary>
+  void skip() {
+    const auto skipped = std::floor(std::log(detail::uniform_open(_random)) /
+                                    std::log1p(-_weight));
+    // Far beyond any realistic count if the weight underflows
+    _next = _count + static_cast<uint64_t>(std::min(skipped, 1e18)) + 1;
+  }
+
+  size_t _capacity;
+  uint64_t _count;
+  uint64_t _next;
+  double _weight;
+  std::minstd_rand _random;
+  std::vector<T> _storage;
+};
+
+/// <summary>
+/// Weighted random sample of a fixed size in which the weight of an element
+/// grows exponentially with its position, e.g. its time in seconds, so that
+/// an element one half-life newer is twice as likely to be kept. This is
+/// forward decay (Cormode et al., 2009) combined with the weighted sampling
+/// of Efraimidis and Spirakis: every element gets the key
+/// decay * (position - landmark) - log(-log(u)) and the elements with the
+/// largest keys are kept. Keys are compared in log space relative to the
+/// first position, so they never overflow. Elements with a key below the
+/// smallest kept key, the common case for old elements, are rejected with a
+/// single comparison; replacements write the slot of the smallest key and
+/// cost O(log n). Iterates in slot order, which is not the insertion order
+/// </summary>
+template <typename T>
+struct decaying_reservoir {
+  /// <param name="capacity">Size of the sample, at least 1</param>
+  /// <param name="half_life">Half-life in units of the positions, zero or
+  /// less for a uniform sample</param>
+  decaying_reservoir(size_t capacity, double half_life, uint32_t seed = 1)
+      : _capacity(std::max<size_t>(capacity, 1)),
+        _half_life(half_life),
+        _decay(half_life > 0.0 ? std::log(2.0) / half_life : 0.0),
+        _has_landmark(false),
+        _landmark(0.0),
+        _count(0),
+        _random(seed) {
+    _storage.reserve(_capacity);
+    _keys.reserve(_capacity);
+  }
+
+  void insert(T element, double position) {
+    ++_count;
+    if (!_has_landmark) {
+      _has_landmark = true;
+      _landmark = position;
+    }
+    const auto key = _decay * (position - _landmark) -
+                     std::log(-std::log(detail::uniform_open(_random)));
+
+    if (_storage.size() < _capacity) {
+      _keys.emplace_back(key, _storage.size());
+      _storage.push_back(std::move(element));
+      std::push_heap(_keys.begin(), _keys.end(), std::greater<>{});
+      return;
+    }
+    if (key <= _keys.front().first) return;
+
+    std::pop_heap(_keys.begin(), _keys.end(), std::greater<>{});
+    auto& slot = _keys.back();
+    _storage[slot.second] = std::move(element);
+    slot.first = key;
+    std::push_heap(_keys.begin(), _keys.end(), std::greater<>{});
+  }
+
+  void clear() {
+    _storage.clear();
+    _keys.clear();
+    _has_landmark = false;
+    _count = 0;
+  }
+
+  size_t size() const { return _storage.size(); }
+  size_t capacity() const { return _capacity; }
+  double get_half_life() const { return _half_life; }
+
+  /// <summary>
+  /// Returns the number of elements inserted, including the ones that were
+  /// not sampled
+  /// </summary>
+  uint64_t get_count() const { return _count; }
+
+  typename std::vector<T>::iterator begin() { return _storage.begin(); }
+  typename std::vector<T>::iterator end() { return _storage.end(); }
+  typename std::vector<T>::const_iterator begin() const {
+    return _storage.begin();
+  }
+  typename std::vector<T>::const_iterator end() const {
+    return _storage.end();
+  }
+
+ private:
+  size_t _capacity;
+  double _half_life;
+  double _decay;
+  bool _has_landmark;
+  double _landmark;
+  uint64_t _count;
+  std::minstd_rand _random;
+  std::vector<T> _storage;
+  /// <summary>
+  /// Min-heap of the keys and slots of the sampled elements
+  /// </summary>
+  std::vector<std::pair<double, size_t>> _keys;
+};
+
+}  // namespace as
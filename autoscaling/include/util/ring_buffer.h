@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+namespace as {
+
+/// <summary>
+/// Bounded lock-free queue for exactly one producer thread and one consumer
+/// thread. The capacity is rounded up to the next power of two. Pushing never
+/// allocates and never blocks, so it is safe to call from signal handlers as
+/// long as copying T is
+/// </summary>
+template <typename T>
+struct spsc_ring_buffer {
+  /// <summary>
+  /// Creates a ring buffer that can hold at least the given number of elements
+  /// </summary>
+  explicit spsc_ring_buffer(size_t capacity)
+      : _capacity(round_up_to_power_of_two(capacity)),
+        _mask(_capacity - 1),
+        _storage(new T[_capacity]),
+        _read_idx(0),
+        _write_idx(0) {}
+
+  spsc_ring_buffer(const spsc_ring_buffer&) = delete;
+  spsc_ring_buffer& operator=(const spsc_ring_buffer&) = delete;
+
+  /// <summary>
+  /// Appends an element. Must only be called from the producer thread
+  /// </summary>
+  /// <returns>False if the buffer is full, in which case the element is
+  /// discarded</returns>
+  bool try_push(const T& element) {
+    const auto write_idx = _write_idx.load(std::memory_order_relaxed);
+    if (write_idx - _read_idx.load(std::memory_order_acquire) == _capacity)
+      return false;
+    _storage[write_idx & _mask] = element;
+    _write_idx.store(write_idx + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// <summary>
+  /// Removes the oldest element. Must only be called from the consumer thread
+  /// </summary>
+  /// <returns>False if the buffer is empty</returns>
+  bool try_pop(T& element) {
+    const auto read_idx = _read_idx.load(std::memory_order_relaxed);
+    if (read_idx == _write_idx.load(std::memory_order_acquire)) return false;
+    element = std::move(_storage[read_idx & _mask]);
+    _read_idx.store(read_idx + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// <summary>
+  /// Invokes the given function for all elements that are currently in the
+  /// buffer and removes them. Must only be called from the consumer thread
+  /// </summary>
+  /// <returns>Number of consumed elements</returns>
+  template <typename Func>
+  size_t consume_all(Func&& func) {
+    const auto read_idx = _read_idx.load(std::memory_order_relaxed);
+    const auto write_idx = _write_idx.load(std::memory_order_acquire);
+    for (auto idx = read_idx; idx != write_idx; ++idx) {
+      func(_storage[idx & _mask]);
+    }
+    _read_idx.store(write_idx, std::memory_order_release);
+    return write_idx - read_idx;
+  }
+
+  /// <summary>
+  /// Returns the number of elements in the buffer. The value is only a
+  /// snapshot if the other thread is active concurrently
+  /// </summary>
+  size_t size() const {
+    return _write_idx.load(std::memory_order_acquire) -
+           _read_idx.load(std::memory_order_acquire);
+  }
+
+  size_t capacity() const { return _capacity; }
+
+  bool empty() const { return size() == 0; }
+
+ private:
+  static size_t round_up_to_power_of_two(size_t value) {
+    size_t ret = 1;
+    while (ret < value) ret <<= 1;
+    return ret;
+  }
+
+  const size_t _capacity;
+  const size_t _mask;
+  std::unique_ptr<T[]> _storage;
+  // Keep the indices on separate cache lines so producer and consumer do not
+  // invalidate each other's cache line on every operation
+  alignas(64) std::atomic<size_t> _read_idx;
+  alignas(64) std::atomic<size_t> _write_idx;
+};
+
+}  // namespace as
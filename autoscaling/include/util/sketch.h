@@ -0,0 +1,234 @@
+#pragma once
+
+#include "math.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+
+namespace as {
+
+/// <summary>
+/// Fixed-size log-linear histogram of timespans. Every power of two is split
+/// into 8 linear sub-buckets, so quantiles are accurate to about 12.5%
+/// relative error. Recording is lock-free and safe to call from multiple
+/// threads concurrently
+/// </summary>
+struct timing_sketch {
+  static constexpr uint32_t sub_bucket_bits = 3;
+  static constexpr uint32_t sub_bucket_count = 1u << sub_bucket_bits;
+  /// <summary>
+  /// Largest power of two that gets its own buckets (2^40ns is ~18 minutes),
+  /// larger values are clamped into the last bucket
+  /// </summary>
+  static constexpr uint32_t max_exponent = 40;
+  static constexpr uint32_t bucket_count =
+      (max_exponent - sub_bucket_bits + 2) * sub_bucket_count;
+
+  timing_sketch() { clear(); }
+
+  timing_sketch(const timing_sketch& other) { *this = other; }
+
+  timing_sketch& operator=(const timing_sketch& other) {
+    if (this == &other) return *this;
+    for (size_t idx = 0; idx < bucket_count; ++idx) {
+      _buckets[idx].store(other._buckets[idx].load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+    }
+    _count.store(other._count.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+    _sum.store(other._sum.load(std::memory_order_relaxed),
+               std::memory_order_relaxed);
+    _max.store(other._max.load(std::memory_order_relaxed),
+               std::memory_order_relaxed);
+    return *this;
+  }
+
+  /// <summary>
+  /// Records a single timespan. Negative timespans are recorded as zero
+  /// </summary>
+  void record(std::chrono::nanoseconds value) {
+    const auto ns = static_cast<uint64_t>(std::max<int64_t>(value.count(), 0));
+    _buckets[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(ns, std::memory_order_relaxed);
+
+    auto current_max = _max.load(std::memory_order_relaxed);
+    while (ns > current_max &&
+           !_max.compare_exchange_weak(current_max, ns,
+                                       std::memory_order_relaxed)) {
+    }
+  }
+
+  /// <summary>
+  /// Records a single timespan like record(), but without atomic
+  /// read-modify-write operations. Only use this if the calling thread is the
+  /// only thread that ever records into this sketch, concurrent readers are
+  /// still fine
+  /// </summary>
+  void record_single_writer(std::chrono::nanoseconds value) {
+    const auto ns = static_cast<uint64_t>(std::max<int64_t>(value.count(), 0));
+    add_single_writer(_buckets[bucket_index(ns)], 1);
+    add_single_writer(_count, 1);
+    add_single_writer(_sum, ns);
+    if (ns > _max.load(std::memory_order_relaxed))
+      _max.store(ns, std::memory_order_relaxed);
+  }
+
+  /// <summary>
+  /// Adds all values recorded in the given sketch to this sketch
+  /// </summary>
+  void merge(const timing_sketch& other) {
+    for (size_t idx = 0; idx < bucket_count; ++idx) {
+      const auto other_count =
+          other._buckets[idx].load(std::memory_order_relaxed);
+      if (other_count)
+        _buckets[idx].fetch_add(other_count, std::memory_order_relaxed);
+    }
+    _count.fetch_add(other._count.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+    _sum.fetch_add(other._sum.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+    const auto other_max = other._max.load(std::memory_order_relaxed);
+    auto current_max = _max.load(std::memory_order_relaxed);
+    while (other_max > current_max &&
+           !_max.compare_exchange_weak(current_max, other_max,
+                                       std::memory_order_relaxed)) {
+    }
+  }
+
+  /// <summary>
+  /// Removes the values of an earlier copy of this sketch, leaving only the
+  /// values recorded since the copy was taken. The maximum can't be reverted
+  /// and remains the overall maximum. Must not be called while other threads
+  /// record into this sketch
+  /// </summary>
+  void subtract(const timing_sketch& earlier) {
+    const auto subtract_from = [](std::atomic<uint64_t>& counter,
+                                  const std::atomic<uint64_t>& other) {
+      const auto value = counter.load(std::memory_order_relaxed);
+      const auto other_value = other.load(std::memory_order_relaxed);
+      counter.store(value > other_value ? value - other_value : 0,
+                    std::memory_order_relaxed);
+    };
+    for (size_t idx = 0; idx < bucket_count; ++idx)
+      subtract_from(_buckets[idx], earlier._buckets[idx]);
+    subtract_from(_count, earlier._count);
+    subtract_from(_sum, earlier._sum);
+  }
+
+  /// <summary>
+  /// Removes all recorded values
+  /// </summary>
+  void clear() {
+    for (auto& bucket : _buckets) bucket.store(0, std::memory_order_relaxed);
+    _count.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+  }
+
+  /// <summary>
+  /// Returns the number of recorded values
+  /// </summary>
+  uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+
+  /// <summary>
+  /// Returns the exact sum of all recorded values
+  /// </summary>
+  std::chrono::nanoseconds sum() const {
+    return std::chrono::nanoseconds{
+        static_cast<int64_t>(_sum.load(std::memory_order_relaxed))};
+  }
+
+  /// <summary>
+  /// Returns the exact mean of all recorded values, or zero if the sketch is
+  /// empty
+  /// </summary>
+  std::chrono::nanoseconds mean() const {
+    const auto n = count();
+    if (!n) return std::chrono::nanoseconds{0};
+    return std::chrono::nanoseconds{
+        static_cast<int64_t>(_sum.load(std::memory_order_relaxed) / n)};
+  }
+
+  /// <summary>
+  /// Returns the exact maximum of all recorded values
+  /// </summary>
+  std::chrono::nanoseconds max() const {
+    return std::chrono::nanoseconds{
+        static_cast<int64_t>(_max.load(std::memory_order_relaxed))};
+  }
+
+  /// <summary>
+  /// Returns an approximation of the given quantile of the recorded values
+  /// </summary>
+  /// <param name="q">Quantile in [0;1], e.g. 0.99 for the 99th
+  /// percentile</param>
+  /// <returns>Approximated quantile, or zero if the sketch is empty</returns>
+  std::chrono::nanoseconds quantile(double q) const {
+    const auto n = count();
+    if (!n) return std::chrono::nanoseconds{0};
+    q = std::min(std::max(q, 0.0), 1.0);
+    const auto rank = std::max<uint64_t>(
+        1, static_cast<uint64_t>(q * static_cast<double>(n) + 0.5));
+
+    uint64_t seen = 0;
+    for (uint32_t idx = 0; idx < bucket_count; ++idx) {
+      seen += _buckets[idx].load(std::memory_order_relaxed);
+      if (seen >= rank) {
+        return std::chrono::nanoseconds{static_cast<int64_t>(
+            std::min(bucket_midpoint(idx),
+                     _max.load(std::memory_order_relaxed)))};
+      }
+    }
+    return max();
+  }
+
+  /// <summary>
+  /// Returns the bucket that the given value (in nanoseconds) falls into
+  /// </summary>
+  static uint32_t bucket_index(uint64_t ns) {
+    if (ns < sub_bucket_count) return static_cast<uint32_t>(ns);
+    const auto exponent = math::log2_floor(ns);
+    if (exponent > max_exponent) return bucket_count - 1;
+    const auto sub_bucket =
+        static_cast<uint32_t>(ns >> (exponent - sub_bucket_bits)) &
+        (sub_bucket_count - 1);
+    return (exponent - sub_bucket_bits + 1) * sub_bucket_count + sub_bucket;
+  }
+
+  /// <summary>
+  /// Returns the smallest value (in nanoseconds) that falls into the given
+  /// bucket
+  /// </summary>
+  static uint64_t bucket_lower_bound(uint32_t idx) {
+    if (idx < sub_bucket_count) return idx;
+    const auto exponent = idx / sub_bucket_count + sub_bucket_bits - 1;
+    const auto sub_bucket = idx % sub_bucket_count;
+    return (uint64_t{1} << exponent) +
+           (uint64_t{sub_bucket} << (exponent - sub_bucket_bits));
+  }
+
+ private:
+  static void add_single_writer(std::atomic<uint64_t>& counter,
+                                uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+
+  static uint64_t bucket_midpoint(uint32_t idx) {
+    if (idx < sub_bucket_count) return idx;
+    const auto exponent = idx / sub_bucket_count + sub_bucket_bits - 1;
+    return bucket_lower_bound(idx) +
+           ((uint64_t{1} << (exponent - sub_bucket_bits)) >> 1);
+  }
+
+  std::array<std::atomic<uint64_t>, bucket_count> _buckets;
+  std::atomic<uint64_t> _count;
+  std::atomic<uint64_t> _sum;
+  std::atomic<uint64_t> _max;
+};
+
+}  // namespace as
@@ -0,0 +1,343 @@
+#include "execution/instrumented_executor.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#pragma region instrumented_executor
+
+namespace {
+
+/// <summary>
+/// Executor and worker index of the calling thread, if it is a worker
+/// </summary>
+thread_local const void* t_executor = nullptr;
+thread_local size_t t_worker_idx = 0;
+
+int64_t to_ns(as::timestamp_t timestamp) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             timestamp.time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+as::instrumented_executor::instrumented_executor(executor_options options)
+    : _options(std::move(options)),
+      _start_time(now()),
+      _active_workers(0),
+      _next_worker(0),
+      _queued(0),
+      _unfinished(0),
+      _parked(0),
+      _stop_workers(false),
+      _last_collect_time(_start_time),
+      _stop(false) {
+  if (_options.worker_count == 0)
+    throw std::runtime_error{"Executor needs at least one worker!"};
+  const auto max_worker_count =
+      std::max(_options.worker_count, _options.max_worker_count);
+  _active_workers = _options.worker_count;
+
+  _queue_wait_name = intern_name(_options.name + ".queue_wait");
+  _execution_time_name = intern_name(_options.name + ".execution_time");
+  _queue_length_name = intern_name(_options.name + ".queue_length");
+  _utilization_name = intern_name(_options.name + ".utilization");
+
+  _workers.reserve(max_worker_count);
+  for (size_t idx = 0; idx < max_worker_count; ++idx) {
+    auto worker = std::make_unique<instrumented_executor::worker>(
+        _options.buffer_capacity_per_worker);
+    worker->busy_fraction_name = intern_name(
+        _options.name + ".worker." + std::to_string(idx) + ".busy_fraction");
+    _workers.push_back(std::move(worker));
+  }
+  // Start the threads only after all workers exist, as they steal from each
+  // other
+  for (size_t idx = 0; idx < _workers.size(); ++idx)
+    _workers[idx]->thread = std::thread{[this, idx]() { run_worker(idx); }};
+
+  _collector = std::thread{[this]() { run_collector(); }};
+}
+
+as::instrumented_executor::~instrumented_executor() {
+  {
+    std::lock_guard<std::mutex> guard{_stop_lock};
+    _stop = true;
+  }
+  _stop_signal.notify_one();
+  _collector.join();
+
+  {
+    std::lock_guard<std::mutex> guard{_park_lock};
+    _stop_workers = true;
+  }
+  _park_signal.notify_all();
+  _retire_signal.notify_all();
+  for (auto& worker : _workers) worker->thread.join();
+
+  collect();
+}
+
+void as::instrumented_executor::submit(std::function<void()> task) {
+  task_item item{std::move(task), now()};
+
+  const auto idx =
+      (t_executor == this)
+          ? t_worker_idx
+          : _next_worker.fetch_add(1, std::memory_order_relaxed) %
+                _active_workers.load(std::memory_order_relaxed);
+
+  _unfinished.fetch_add(1);
+  // Counted before the task is visible, so that the counter never underflows.
+  // A worker that sees the count before the task is pushed just tries again
+  _queued.fetch_add(1);
+  {
+    auto& worker = *_workers[idx];
+    std::lock_guard<std::mutex> guard{worker.queue_lock};
+    worker.queue.push_back(std::move(item));
+  }
+
+  // Pairs with the increment of _parked in run_worker: either the worker sees
+  // the queued task or we see the parked worker
+  if (_parked.load() > 0) {
+    std::lock_guard<std::mutex> guard{_park_lock};
+    _park_signal.notify_one();
+  }
+}
+
+void as::instrumented_executor::wait_for_idle() {
+  std::unique_lock<std::mutex> lock{_idle_lock};
+  _idle_signal.wait(lock, [this]() { return _unfinished.load() == 0; });
+}
+
+void as::instrumented_executor::set_worker_count(size_t worker_count) {
+  worker_count = std::clamp<size_t>(worker_count, 1, _workers.size());
+  {
+    std::lock_guard<std::mutex> guard{_park_lock};
+    _active_workers = worker_count;
+  }
+  // Wakes the added workers as well as the parked workers that were retired
+  _retire_signal.notify_all();
+  _park_signal.notify_all();
+}
+
+size_t as::instrumented_executor::get_worker_count() const {
+  return _active_workers.load(std::memory_order_relaxed);
+}
+
+size_t as::instrumented_executor::get_max_worker_count() const {
+  return _workers.size();
+}
+
+size_t as::instrumented_executor::get_queue_length() const {
+  return _queued.load(std::memory_order_relaxed);
+}
+
+as::executor_statistics as::instrumented_executor::get_statistics() const {
+  const auto timestamp = now();
+
+  executor_statistics ret;
+  ret.worker_count = get_worker_count();
+  ret.queue_length = get_queue_length();
+
+  int64_t busy_ns = 0;
+  for (auto& worker : _workers) {
+    ret.executed_tasks +=
+        worker->executed_tasks.load(std::memory_order_relaxed);
+    ret.failed_tasks += worker->failed_tasks.load(std::memory_order_relaxed);
+    ret.dropped_timings +=
+        worker->dropped_timings.load(std::memory_order_relaxed);
+    ret.queue_wait_time.merge(worker->queue_wait_time);
+    ret.execution_time.merge(worker->execution_time);
+    busy_ns += get_busy_ns(*worker, timestamp);
+  }
+  ret.busy_time = timespan_t{busy_ns};
+
+  const auto elapsed_ns = (timestamp - _start_time).count();
+  if (elapsed_ns > 0) {
+    ret.utilization = std::clamp(
+        static_cast<double>(busy_ns) /
+            (static_cast<double>(elapsed_ns) * ret.worker_count),
+        0.0, 1.0);
+  }
+  return ret;
+}
+
+void as::instrumented_executor::collect() {
+  std::lock_guard<std::mutex> guard{_collect_lock};
+  const auto timestamp = now();
+
+  for (auto& worker : _workers) {
+    worker->timings.consume_all([this](const task_timing& timing) {
+      add_measurement<timespan_t>(_queue_wait_name, timing.start_time,
+                                  timing.queue_wait);
+      add_measurement<timespan_t>(_execution_time_name, timing.start_time,
+                                  timing.execution_time);
+    });
+  }
+
+  add_measurement<size_t>(_queue_length_name, timestamp, get_queue_length());
+
+  const auto elapsed_ns = (timestamp - _last_collect_time).count();
+  if (elapsed_ns <= 0) return;
+
+  double total_busy_fraction = 0.0;
+  for (auto& worker : _workers) {
+    const auto busy_ns = get_busy_ns(*worker, timestamp);
+    const auto busy_fraction = std::clamp(
+        static_cast<double>(busy_ns - worker->collected_busy_ns) / elapsed_ns,
+        0.0, 1.0);
+    worker->collected_busy_ns = busy_ns;
+    add_measurement<double>(worker->busy_fraction_name, timestamp,
+                            busy_fraction);
+    total_busy_fraction += busy_fraction;
+  }
+  add_measurement<double>(_utilization_name, timestamp,
+                          std::min(total_busy_fraction / get_worker_count(),
+                                   1.0));
+  _last_collect_time = timestamp;
+}
+
+std::string_view as::instrumented_executor::get_queue_wait_name() const {
+  return _queue_wait_name;
+}
+
+std::string_view as::instrumented_executor::get_execution_time_name() const {
+  return _execution_time_name;
+}
+
+std::string_view as::instrumented_executor::get_queue_length_name() const {
+  return _queue_length_name;
+}
+
+std::string_view as::instrumented_executor::get_utilization_name() const {
+  return _utilization_name;
+}
+
+void as::instrumented_executor::run_worker(size_t idx) {
+  t_executor = this;
+  t_worker_idx = idx;
+  auto& self = *_workers[idx];
+
+  const auto is_retired = [this, idx]() { return idx >= _active_workers; };
+
+  task_item task;
+  for (;;) {
+    if (is_retired()) {
+      // Queued tasks are left to the active workers, which drain them before
+      // they stop
+      std::unique_lock<std::mutex> lock{_park_lock};
+      _retire_signal.wait(
+          lock, [&]() { return !is_retired() || _stop_workers; });
+      if (_stop_workers) break;
+      continue;
+    }
+
+    if (try_pop(idx, task)) {
+      execute(self, task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock{_park_lock};
+    _parked.fetch_add(1);
+    _park_signal.wait(lock, [&]() {
+      return _queued.load() > 0 || _stop_workers || is_retired();
+    });
+    _parked.fetch_sub(1);
+    if (_stop_workers && _queued.load() == 0) break;
+  }
+
+  t_executor = nullptr;
+}
+
+bool as::instrumented_executor::try_pop(size_t idx, task_item& task) {
+  // Own tasks in submission order
+  {
+    auto& worker = *_workers[idx];
+    std::lock_guard<std::mutex> guard{worker.queue_lock};
+    if (!worker.queue.empty()) {
+      task = std::move(worker.queue.front());
+      worker.queue.pop_front();
+      _queued.fetch_sub(1);
+      return true;
+    }
+  }
+
+  // Steal the most recently submitted task of another worker, which is the
+  // one its owner would get to last
+  for (size_t offset = 1; offset < _workers.size(); ++offset) {
+    auto& victim = *_workers[(idx + offset) % _workers.size()];
+    std::lock_guard<std::mutex> guard{victim.queue_lock};
+    if (!victim.queue.empty()) {
+      task = std::move(victim.queue.back());
+      victim.queue.pop_back();
+      _queued.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void as::instrumented_executor::execute(worker& worker, task_item& task) {
+  const auto start_time = now();
+  worker.task_start_ns.store(to_ns(start_time), std::memory_order_relaxed);
+
+  try {
+    task.func();
+  } catch (...) {
+    worker.failed_tasks.store(
+        worker.failed_tasks.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+  }
+  task.func = nullptr;
+
+  const auto end_time = now();
+  const auto queue_wait = start_time - task.submit_time;
+  const auto execution_time = end_time - start_time;
+
+  // Only this worker writes its counters, so no read-modify-write is needed
+  worker.busy_ns.store(
+      worker.busy_ns.load(std::memory_order_relaxed) + execution_time.count(),
+      std::memory_order_relaxed);
+  worker.task_start_ns.store(0, std::memory_order_relaxed);
+  worker.executed_tasks.store(
+      worker.executed_tasks.load(std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed);
+  worker.queue_wait_time.record_single_writer(queue_wait);
+  worker.execution_time.record_single_writer(execution_time);
+  if (!worker.timings.try_push(
+          task_timing{start_time, queue_wait, execution_time})) {
+    worker.dropped_timings.store(
+        worker.dropped_timings.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+  }
+
+  if (_unfinished.fetch_sub(1) == 1) {
+    std::lock_guard<std::mutex> guard{_idle_lock};
+    _idle_signal.notify_all();
+  }
+}
+
+int64_t as::instrumented_executor::get_busy_ns(const worker& worker,
+                                               timestamp_t timestamp) const {
+  auto busy_ns = worker.busy_ns.load(std::memory_order_relaxed);
+  const auto task_start_ns =
+      worker.task_start_ns.load(std::memory_order_relaxed);
+  if (task_start_ns)
+    busy_ns += std::max<int64_t>(to_ns(timestamp) - task_start_ns, 0);
+  return busy_ns;
+}
+
+void as::instrumented_executor::run_collector() {
+  std::unique_lock<std::mutex> lock{_stop_lock};
+  while (!_stop) {
+    _stop_signal.wait_for(lock, _options.collect_interval);
+    if (_stop) break;
+
+    lock.unlock();
+    collect();
+    lock.lock();
+  }
+}
+
+#pragma endregion
@@ -0,0 +1,125 @@
+#include "execution/self_scaling_executor.h"
+
+#include <algorithm>
+
+#pragma region self_scaling_executor
+
+as::self_scaling_executor::self_scaling_executor(
+    self_scaling_executor_options options)
+    : _options(std::move(options)),
+      _executor(make_executor_options(_options)),
+      _policy(_options.policy),
+      _worker_count_name(intern_name(_options.executor.name + ".worker_count")),
+      _journal(make_journal_options(_options, _executor)),
+      _previous_timestamp(now()),
+      _previous_statistics(_executor.get_statistics()),
+      _stop(false) {
+  add_measurement<size_t>(_worker_count_name, _executor.get_worker_count());
+  _thread = std::thread{[this]() { run(); }};
+}
+
+as::self_scaling_executor::~self_scaling_executor() {
+  {
+    std::lock_guard<std::mutex> guard{_stop_lock};
+    _stop = true;
+  }
+  _stop_signal.notify_one();
+  _thread.join();
+}
+
+void as::self_scaling_executor::submit(std::function<void()> task) {
+  _executor.submit(std::move(task));
+}
+
+void as::self_scaling_executor::wait_for_idle() { _executor.wait_for_idle(); }
+
+size_t as::self_scaling_executor::get_worker_count() const {
+  return _executor.get_worker_count();
+}
+
+as::instrumented_executor& as::self_scaling_executor::get_executor() {
+  return _executor;
+}
+
+const as::decision_journal& as::self_scaling_executor::get_journal() const {
+  return _journal;
+}
+
+as::scaling_decision as::self_scaling_executor::evaluate() {
+  std::lock_guard<std::mutex> guard{_evaluate_lock};
+
+  const auto timestamp = now();
+  const auto statistics = _executor.get_statistics();
+
+  auto queue_wait_time = statistics.queue_wait_time;
+  queue_wait_time.subtract(_previous_statistics.queue_wait_time);
+
+  scaling_inputs inputs;
+  inputs.current_capacity = statistics.worker_count;
+  inputs.latency = queue_wait_time.quantile(_options.latency_quantile);
+  inputs.latency_samples = queue_wait_time.count();
+  inputs.queue_length = statistics.queue_length;
+  const auto elapsed = timestamp - _previous_timestamp;
+  if (elapsed.count() > 0) {
+    const auto busy_time =
+        statistics.busy_time - _previous_statistics.busy_time;
+    inputs.utilization = std::clamp(
+        static_cast<double>(busy_time.count()) /
+            (static_cast<double>(elapsed.count()) * inputs.current_capacity),
+        0.0, 1.0);
+  }
+
+  const auto decision = _policy.decide(inputs, timestamp);
+  if (decision.action != scaling_action::none) {
+    _executor.set_worker_count(decision.target_capacity);
+    add_measurement<size_t>(_worker_count_name, timestamp,
+                            _executor.get_worker_count());
+  }
+  // The policy of an executor is configured once
+  _journal.record(inputs, decision, _policy.get_name(), 1);
+
+  _previous_timestamp = timestamp;
+  _previous_statistics = statistics;
+  return decision;
+}
+
+std::string_view as::self_scaling_executor::get_worker_count_name() const {
+  return _worker_count_name;
+}
+
+as::executor_options as::self_scaling_executor::make_executor_options(
+    const self_scaling_executor_options& options) {
+  auto ret = options.executor;
+  const auto min_capacity = std::max<size_t>(options.policy.min_capacity, 1);
+  const auto max_capacity =
+      std::max<size_t>(options.policy.max_capacity, min_capacity);
+  ret.worker_count = std::clamp(ret.worker_count, min_capacity, max_capacity);
+  ret.max_worker_count = max_capacity;
+  return ret;
+}
+
+as::decision_journal_options as::self_scaling_executor::make_journal_options(
+    const self_scaling_executor_options& options,
+    const instrumented_executor& executor) {
+  decision_journal_options ret;
+  ret.name = options.executor.name;
+  ret.latency_name = executor.get_queue_wait_name();
+  ret.utilization_name = executor.get_utilization_name();
+  ret.queue_length_name = executor.get_queue_length_name();
+  ret.capacity_name = options.executor.name + ".worker_count";
+  return ret;
+}
+
+void as::self_scaling_executor::run() {
+  std::unique_lock<std::mutex> lock{_stop_lock};
+  while (!_stop) {
+    _stop_signal.wait_for(lock, _options.evaluation_interval);
+    if (_stop) break;
+
+    lock.unlock();
+    evaluate();
+    lock.lock();
+  }
+}
+
+#pragma endregion
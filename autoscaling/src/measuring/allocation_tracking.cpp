@@ -0,0 +1,333 @@
+#include "measuring/allocation_tracking.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+#pragma region allocation_counters
+
+namespace {
+
+/// <summary>
+/// Number of operations after which a thread flushes its counters into the
+/// process-wide counters
+/// </summary>
+constexpr uint32_t flush_operations = 256;
+
+/// <summary>
+/// Allocations of at least this size are flushed immediately, so that large
+/// allocations show up in the process-wide counters without delay
+/// </summary>
+constexpr size_t flush_bytes = 64 * 1024;
+
+std::atomic<bool> s_enabled{false};
+
+std::atomic<uint64_t> s_allocated_bytes{0};
+std::atomic<uint64_t> s_freed_bytes{0};
+std::atomic<uint64_t> s_allocations{0};
+std::atomic<uint64_t> s_deallocations{0};
+
+/// <summary>
+/// Counters of a single thread. Trivially constructible and destructible, so
+/// accessing them from operator new does not require any initialization and
+/// remains valid while other thread-local objects are destroyed
+/// </summary>
+struct thread_allocation_state {
+  as::allocation_counters counters;
+  as::allocation_counters flushed;
+  /// <summary>
+  /// Highest live bytes of the thread since the innermost scope_memory
+  /// measurement started
+  /// </summary>
+  int64_t peak_live_bytes;
+  uint32_t pending_operations;
+  bool in_flush;
+  bool has_flusher;
+  bool exited;
+};
+
+thread_local thread_allocation_state t_state;
+
+void flush(thread_allocation_state& state);
+
+/// <summary>
+/// Flushes the remaining counters when the thread exits
+/// </summary>
+struct thread_allocation_flusher {
+  ~thread_allocation_flusher() {
+    t_state.exited = true;
+    flush(t_state);
+  }
+};
+
+void flush(thread_allocation_state& state) {
+  // Registering the flusher may allocate, which must not flush recursively
+  if (state.in_flush) return;
+  state.in_flush = true;
+
+  if (!state.has_flusher && !state.exited) {
+    state.has_flusher = true;
+    thread_local thread_allocation_flusher t_flusher;
+    (void)t_flusher;
+  }
+
+  const auto delta = state.counters - state.flushed;
+  state.flushed = state.counters;
+  state.pending_operations = 0;
+  s_allocated_bytes.fetch_add(delta.allocated_bytes, std::memory_order_relaxed);
+  s_freed_bytes.fetch_add(delta.freed_bytes, std::memory_order_relaxed);
+  s_allocations.fetch_add(delta.allocations, std::memory_order_relaxed);
+  s_deallocations.fetch_add(delta.deallocations, std::memory_order_relaxed);
+
+  state.in_flush = false;
+}
+
+/// <summary>
+/// The first operation of a thread flushes as well, which registers the
+/// flusher for the thread exit
+/// </summary>
+bool needs_flush(thread_allocation_state& state, size_t size) {
+  return ++state.pending_operations >= flush_operations ||
+         size >= flush_bytes || !state.has_flusher || state.exited;
+}
+
+void on_allocated(size_t size) {
+  auto& state = t_state;
+  state.counters.allocated_bytes += size;
+  ++state.counters.allocations;
+  const auto live_bytes = state.counters.live_bytes();
+  if (live_bytes > state.peak_live_bytes) state.peak_live_bytes = live_bytes;
+  if (needs_flush(state, size)) flush(state);
+}
+
+void on_freed(size_t size) {
+  auto& state = t_state;
+  state.counters.freed_bytes += size;
+  ++state.counters.deallocations;
+  if (needs_flush(state, size)) flush(state);
+}
+
+size_t get_usable_size(void* ptr) {
+#if defined(_WIN32)
+  return _msize(ptr);
+#elif defined(__APPLE__)
+  return malloc_size(ptr);
+#else
+  return malloc_usable_size(ptr);
+#endif
+}
+
+size_t get_aligned_usable_size(void* ptr, std::align_val_t alignment) {
+#if defined(_WIN32)
+  return _aligned_msize(ptr, static_cast<size_t>(alignment), 0);
+#else
+  (void)alignment;
+  return get_usable_size(ptr);
+#endif
+}
+
+void* allocate_aligned(size_t size, std::align_val_t alignment) {
+  auto align = static_cast<size_t>(alignment);
+  if (align < sizeof(void*)) align = sizeof(void*);
+#if defined(_WIN32)
+  return _aligned_malloc(size, align);
+#else
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, align, size) != 0) return nullptr;
+  return ptr;
+#endif
+}
+
+}  // namespace
+
+as::allocation_counters as::operator-(const allocation_counters& l,
+                                      const allocation_counters& r) {
+  allocation_counters ret;
+  ret.allocated_bytes = l.allocated_bytes - r.allocated_bytes;
+  ret.freed_bytes = l.freed_bytes - r.freed_bytes;
+  ret.allocations = l.allocations - r.allocations;
+  ret.deallocations = l.deallocations - r.deallocations;
+  return ret;
+}
+
+bool as::is_allocation_tracking_enabled() {
+  return s_enabled.load(std::memory_order_relaxed);
+}
+
+as::allocation_counters as::get_thread_allocation_counters() {
+  return t_state.counters;
+}
+
+as::allocation_counters as::get_process_allocation_counters() {
+  allocation_counters ret;
+  // Read the frees first, so that a concurrent flush can't make the live
+  // bytes negative
+  ret.freed_bytes = s_freed_bytes.load(std::memory_order_relaxed);
+  ret.deallocations = s_deallocations.load(std::memory_order_relaxed);
+  ret.allocated_bytes = s_allocated_bytes.load(std::memory_order_relaxed);
+  ret.allocations = s_allocations.load(std::memory_order_relaxed);
+  return ret;
+}
+
+void as::detail::enable_allocation_tracking() {
+  s_enabled.store(true, std::memory_order_relaxed);
+}
+
+void* as::detail::tracked_allocate(size_t size) {
+  auto* ptr = tracked_allocate_nothrow(size);
+  if (!ptr) throw std::bad_alloc{};
+  return ptr;
+}
+
+void* as::detail::tracked_allocate_nothrow(size_t size) noexcept {
+  auto* ptr = std::malloc(size ? size : 1);
+  if (ptr) on_allocated(get_usable_size(ptr));
+  return ptr;
+}
+
+void* as::detail::tracked_allocate_aligned(size_t size,
+                                           std::align_val_t alignment) {
+  auto* ptr = tracked_allocate_aligned_nothrow(size, alignment);
+  if (!ptr) throw std::bad_alloc{};
+  return ptr;
+}
+
+void* as::detail::tracked_allocate_aligned_nothrow(
+    size_t size, std::align_val_t alignment) noexcept {
+  auto* ptr = allocate_aligned(size ? size : 1, alignment);
+  if (ptr) on_allocated(get_aligned_usable_size(ptr, alignment));
+  return ptr;
+}
+
+void as::detail::tracked_deallocate(void* ptr) noexcept {
+  if (!ptr) return;
+  on_freed(get_usable_size(ptr));
+  std::free(ptr);
+}
+
+void as::detail::tracked_deallocate_aligned(
+    void* ptr, std::align_val_t alignment) noexcept {
+  if (!ptr) return;
+  on_freed(get_aligned_usable_size(ptr, alignment));
+#if defined(_WIN32)
+  _aligned_free(ptr);
+#else
+  std::free(ptr);
+#endif
+}
+
+#pragma endregion
+
+#pragma region scope_allocation_helper
+
+as::detail::ScopeAllocationHelper::ScopeAllocationHelper(const char* name)
+    : _name(name),
+      _valid(is_allocation_tracking_enabled()),
+      _start_allocated_bytes(t_state.counters.allocated_bytes) {}
+
+as::detail::ScopeAllocationHelper::~ScopeAllocationHelper() {
+  if (!_valid) return;
+
+  const auto allocated_bytes =
+      t_state.counters.allocated_bytes - _start_allocated_bytes;
+  add_measurement<memory>(_name,
+                          memory{static_cast<size_t>(allocated_bytes)});
+}
+
+#pragma endregion
+
+#pragma region scope_memory_helper
+
+as::detail::ScopeMemoryHelper::ScopeMemoryHelper(const char* name)
+    : _name(name),
+      _valid(is_allocation_tracking_enabled()),
+      _start_live_bytes(t_state.counters.live_bytes()),
+      _outer_peak_live_bytes(t_state.peak_live_bytes) {
+  // Track the peak of this scope separately and merge it back into the peak
+  // of the enclosing scope on exit
+  t_state.peak_live_bytes = _start_live_bytes;
+}
+
+as::detail::ScopeMemoryHelper::~ScopeMemoryHelper() {
+  auto& state = t_state;
+  const auto net_bytes = state.counters.live_bytes() - _start_live_bytes;
+  const auto peak_bytes = state.peak_live_bytes - _start_live_bytes;
+  state.peak_live_bytes =
+      std::max(state.peak_live_bytes, _outer_peak_live_bytes);
+  if (!_valid) return;
+
+  scope_memory value;
+  value.net = memory{static_cast<size_t>(std::max<int64_t>(net_bytes, 0))};
+  value.peak = memory{static_cast<size_t>(peak_bytes)};
+  add_measurement<scope_memory>(_name, value);
+}
+
+#pragma endregion
+
+#pragma region allocation_sampler
+
+as::allocation_sampler::allocation_sampler(allocation_sampler_options options)
+    : _options(options), _has_previous_sample(false), _stop(false) {
+  if (!is_allocation_tracking_enabled())
+    throw std::runtime_error{"Allocation tracking is not enabled!"};
+
+  sample();
+  _thread = std::thread{[this]() { run(); }};
+}
+
+as::allocation_sampler::~allocation_sampler() {
+  {
+    std::lock_guard<std::mutex> guard{_stop_lock};
+    _stop = true;
+  }
+  _stop_signal.notify_one();
+  _thread.join();
+}
+
+void as::allocation_sampler::sample() {
+  std::lock_guard<std::mutex> guard{_sample_lock};
+
+  const auto timestamp = now();
+  const auto counters = get_process_allocation_counters();
+  add_measurement<memory>(
+      heap_live_bytes_name,
+      memory{static_cast<size_t>(std::max<int64_t>(counters.live_bytes(), 0))});
+
+  if (_has_previous_sample) {
+    const auto elapsed = timestamp - _previous_timestamp;
+    const auto delta = counters - _previous_counters;
+    add_measurement<rate>(
+        heap_allocation_rate_name,
+        rate::from_delta(static_cast<double>(delta.allocated_bytes), elapsed));
+    add_measurement<rate>(
+        heap_allocation_count_rate_name,
+        rate::from_delta(static_cast<double>(delta.allocations), elapsed));
+  }
+
+  _previous_timestamp = timestamp;
+  _previous_counters = counters;
+  _has_previous_sample = true;
+}
+
+void as::allocation_sampler::run() {
+  std::unique_lock<std::mutex> lock{_stop_lock};
+  while (!_stop) {
+    _stop_signal.wait_for(lock, _options.interval);
+    if (_stop) break;
+
+    lock.unlock();
+    sample();
+    lock.lock();
+  }
+}
+
+#pragma endregion
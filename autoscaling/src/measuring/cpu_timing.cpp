@@ -0,0 +1,96 @@
+#include "measuring/cpu_timing.h"
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <time.h>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+#pragma region thread_cpu_usage
+
+as::thread_cpu_usage as::get_thread_cpu_usage(cpu_timing_mode mode) {
+  thread_cpu_usage usage;
+#if defined(__linux__)
+  timespec cpu_time;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_time) == 0) {
+    usage.cpu_time = std::chrono::seconds{cpu_time.tv_sec} +
+                     std::chrono::nanoseconds{cpu_time.tv_nsec};
+  }
+  if (mode == cpu_timing_mode::cpu_time_and_context_switches) {
+    rusage thread_usage;
+    if (getrusage(RUSAGE_THREAD, &thread_usage) == 0) {
+      usage.voluntary_context_switches =
+          static_cast<uint64_t>(thread_usage.ru_nvcsw);
+      usage.involuntary_context_switches =
+          static_cast<uint64_t>(thread_usage.ru_nivcsw);
+    }
+  }
+#elif defined(_WIN32)
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  if (GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time,
+                     &kernel_time, &user_time)) {
+    const auto to_100ns = [](const FILETIME& time) {
+      return (static_cast<uint64_t>(time.dwHighDateTime) << 32) |
+             time.dwLowDateTime;
+    };
+    usage.cpu_time = std::chrono::nanoseconds{
+        static_cast<int64_t>((to_100ns(kernel_time) + to_100ns(user_time)) *
+                             100)};
+  }
+#endif
+  return usage;
+}
+
+#pragma endregion
+
+#pragma region function_cpu_timing
+
+double as::cpu_timing_summary::get_cpu_fraction() const {
+  const auto wall = wall_time.sum().count();
+  if (!wall) return 0.0;
+  return static_cast<double>(on_cpu_time.sum().count()) /
+         static_cast<double>(wall);
+}
+
+as::cpu_timing_summary as::summarize_cpu_timings(
+    const std::vector<measurement<function_cpu_timing>>& measurements) {
+  cpu_timing_summary summary;
+  for (auto& measurement : measurements) {
+    auto& timing = measurement.data;
+    ++summary.count;
+    summary.wall_time.record(timing.wall_time);
+    summary.on_cpu_time.record(std::min(timing.cpu_time, timing.wall_time));
+    summary.off_cpu_time.record(timing.off_cpu_time());
+    summary.voluntary_context_switches += timing.voluntary_context_switches;
+    summary.involuntary_context_switches +=
+        timing.involuntary_context_switches;
+  }
+  return summary;
+}
+
+as::detail::FunctionCpuTimingHelper::FunctionCpuTimingHelper(
+    const char* name, cpu_timing_mode mode)
+    : _name(name),
+      _mode(mode),
+      _start_time(as::now()),
+      _start_usage(get_thread_cpu_usage(mode)) {}
+
+as::detail::FunctionCpuTimingHelper::~FunctionCpuTimingHelper() {
+  const auto end_usage = get_thread_cpu_usage(_mode);
+  const auto end_time = now();
+
+  function_cpu_timing timing;
+  timing.wall_time = end_time - _start_time;
+  timing.cpu_time = end_usage.cpu_time - _start_usage.cpu_time;
+  timing.voluntary_context_switches = end_usage.voluntary_context_switches -
+                                      _start_usage.voluntary_context_switches;
+  timing.involuntary_context_switches =
+      end_usage.involuntary_context_switches -
+      _start_usage.involuntary_context_switches;
+  add_measurement<function_cpu_timing>(_name, timing);
+}
+
+#pragma endregion
@@ -0,0 +1,310 @@
+#include "measuring/distinct_count.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#pragma region storage
+
+namespace {
+
+struct distinct_count_window {
+  as::timestamp_t start;
+  as::hyperloglog sketch;
+};
+
+/// <summary>
+/// Windows of one series recorded by one thread. Only the owning thread adds
+/// keys, so the lock is uncontended unless the series is read
+/// </summary>
+struct thread_distinct_counts {
+  explicit thread_distinct_counts(as::distinct_count_options options)
+      : options(options) {}
+
+  const as::distinct_count_options options;
+  std::mutex lock;
+  std::deque<distinct_count_window> windows;
+};
+
+struct distinct_count_series {
+  as::distinct_count_options options;
+  std::vector<std::shared_ptr<thread_distinct_counts>> threads;
+  /// <summary>
+  /// Windows of all threads that exited, merged into one set of windows
+  /// </summary>
+  std::shared_ptr<thread_distinct_counts> exited_threads;
+};
+
+struct distinct_count_registry {
+  std::mutex lock;
+  std::unordered_map<std::string_view, distinct_count_series> series;
+  std::unordered_map<std::string_view, as::distinct_count_options> options;
+  /// <summary>
+  /// Incremented whenever series are dropped, so that threads stop recording
+  /// into the windows of dropped series
+  /// </summary>
+  std::atomic<uint64_t> generation{0};
+};
+
+distinct_count_registry& get_distinct_count_registry() {
+  static distinct_count_registry s_registry;
+  return s_registry;
+}
+
+/// <summary>
+/// Merges the windows of the source into the target, of which the newest
+/// max_windows are kept
+/// </summary>
+void merge_counts(thread_distinct_counts& target,
+                  thread_distinct_counts& source) {
+  std::lock_guard<std::mutex> target_guard{target.lock};
+  std::lock_guard<std::mutex> source_guard{source.lock};
+  auto& windows = target.windows;
+  for (auto& window : source.windows) {
+    auto itr = std::lower_bound(
+        windows.begin(), windows.end(), window.start,
+        [](const distinct_count_window& w, as::timestamp_t start) {
+          return w.start < start;
+        });
+    if (itr != windows.end() && itr->start == window.start) {
+      itr->sketch.merge(window.sketch);
+    } else {
+      windows.insert(itr, std::move(window));
+    }
+  }
+  source.windows.clear();
+  const auto max_windows = std::max<size_t>(target.options.max_windows, 1);
+  while (windows.size() > max_windows) windows.pop_front();
+}
+
+// Set once the cache of the thread is destroyed, keys that are added on the
+// thread afterwards, e.g. by destructors of other thread_local objects, are
+// dropped
+thread_local bool t_cache_released = false;
+
+/// <summary>
+/// Windows of all series the calling thread recorded into, keyed by the
+/// interned name of the series
+/// </summary>
+struct thread_distinct_count_cache {
+  uint64_t generation = 0;
+  std::unordered_map<std::string_view,
+                     std::shared_ptr<thread_distinct_counts>>
+      counts;
+
+  ~thread_distinct_count_cache() {
+    t_cache_released = true;
+    retire();
+  }
+
+  /// <summary>
+  /// Folds the windows of the thread into the windows of exited threads of
+  /// their series and removes them from the series, so that a series only
+  /// keeps windows for the threads that still record into it
+  /// </summary>
+  void retire() {
+    auto& registry = get_distinct_count_registry();
+    std::lock_guard<std::mutex> guard{registry.lock};
+    for (auto& kv : counts) {
+      auto series = registry.series.find(kv.first);
+      if (series == registry.series.end()) continue;
+      auto& threads = series->second.threads;
+      const auto itr = std::find(threads.begin(), threads.end(), kv.second);
+      // The series was dropped and created again since
+      if (itr == threads.end()) continue;
+      auto& exited = series->second.exited_threads;
+      if (!exited) {
+        exited =
+            std::make_shared<thread_distinct_counts>(series->second.options);
+      }
+      merge_counts(*exited, *kv.second);
+      threads.erase(itr);
+    }
+    counts.clear();
+  }
+};
+
+/// <summary>
+/// Returns the cache of the calling thread, or nullptr if the thread is
+/// exiting and already released it
+/// </summary>
+thread_distinct_count_cache* get_thread_cache() {
+  if (t_cache_released) return nullptr;
+  thread_local thread_distinct_count_cache t_cache;
+  return &t_cache;
+}
+
+/// <summary>
+/// Returns the windows of the series recorded by the calling thread, or
+/// nullptr if the thread is exiting. Only the first key of a series on a
+/// thread takes the registry lock
+/// </summary>
+thread_distinct_counts* get_this_thread_counts(std::string_view name) {
+  auto& registry = get_distinct_count_registry();
+  auto* cache = get_thread_cache();
+  if (!cache) return nullptr;
+  const auto generation = registry.generation.load(std::memory_order_acquire);
+  if (cache->generation != generation) {
+    // Series that were not dropped would otherwise keep the windows
+    cache->retire();
+    cache->generation = generation;
+  }
+  const auto itr = cache->counts.find(name);
+  if (itr != cache->counts.end()) return itr->second.get();
+
+  const auto interned = as::intern_name(name);
+  std::lock_guard<std::mutex> guard{registry.lock};
+  auto series = registry.series.find(interned);
+  if (series == registry.series.end()) {
+    series = registry.series.emplace(interned, distinct_count_series{}).first;
+    as::detail::register_series_name(interned,
+                                     as::get_type_id<as::distinct_key>());
+    const auto options = registry.options.find(interned);
+    if (options != registry.options.end())
+      series->second.options = options->second;
+  }
+  auto counts =
+      std::make_shared<thread_distinct_counts>(series->second.options);
+  series->second.threads.push_back(counts);
+  return cache->counts.emplace(interned, std::move(counts))
+      .first->second.get();
+}
+
+as::timestamp_t get_window_start(as::timestamp_t timestamp,
+                                 as::timespan_t interval) {
+  const auto length = std::max<int64_t>(interval.count(), 1);
+  const auto time =
+      std::chrono::duration_cast<as::timespan_t>(timestamp.time_since_epoch())
+          .count();
+  auto start = time - time % length;
+  if (time < 0 && time % length) start -= length;
+  return as::timestamp_t{} +
+         std::chrono::duration_cast<as::timestamp_t::duration>(
+             as::timespan_t{start});
+}
+
+/// <summary>
+/// Returns the sketch of the window that contains the timestamp. Windows are
+/// usually entered in order, so the newest one is checked first
+/// </summary>
+as::hyperloglog* find_or_create_window(thread_distinct_counts& counts,
+                                       as::timestamp_t timestamp) {
+  const auto& options = counts.options;
+  const auto start = get_window_start(timestamp, options.rollup_interval);
+  auto& windows = counts.windows;
+  auto itr = windows.end();
+  while (itr != windows.begin() && std::prev(itr)->start > start) --itr;
+  if (itr != windows.begin() && std::prev(itr)->start == start)
+    return &std::prev(itr)->sketch;
+
+  // Too old to be kept
+  const auto max_windows = std::max<size_t>(options.max_windows, 1);
+  if (itr == windows.begin() && windows.size() >= max_windows) return nullptr;
+
+  itr = windows.insert(
+      itr, distinct_count_window{start, as::hyperloglog{options.precision}});
+  auto* sketch = &itr->sketch;
+  while (windows.size() > max_windows) windows.pop_front();
+  return sketch;
+}
+
+/// <summary>
+/// Merges the windows of all threads that overlap [begin;end] by the start
+/// of their window
+/// </summary>
+std::map<as::timestamp_t, as::hyperloglog> merge_windows(
+    std::string_view name, as::timestamp_t begin, as::timestamp_t end) {
+  std::map<as::timestamp_t, as::hyperloglog> ret;
+  std::vector<std::shared_ptr<thread_distinct_counts>> threads;
+  {
+    auto& registry = get_distinct_count_registry();
+    std::lock_guard<std::mutex> guard{registry.lock};
+    const auto series = registry.series.find(name);
+    if (series == registry.series.end()) return ret;
+    threads = series->second.threads;
+    if (series->second.exited_threads)
+      threads.push_back(series->second.exited_threads);
+  }
+
+  const auto properties = as::detail::get_configured_properties(name);
+  begin = as::detail::apply_retention(properties.get(), begin);
+  for (auto& counts : threads) {
+    std::lock_guard<std::mutex> guard{counts->lock};
+    const auto interval = counts->options.rollup_interval;
+    for (auto& window : counts->windows) {
+      if (window.start > end || window.start + interval <= begin) continue;
+      auto merged = ret.find(window.start);
+      if (merged == ret.end())
+        merged = ret.emplace(window.start, window.sketch).first;
+      else
+        merged->second.merge(window.sketch);
+    }
+  }
+  return ret;
+}
+
+}  // namespace
+
+void as::detail::add_distinct_key(std::string_view name, timestamp_t timestamp,
+                                  distinct_key key) {
+  auto* counts = get_this_thread_counts(name);
+  if (!counts) return;
+  std::lock_guard<std::mutex> guard{counts->lock};
+  if (auto* sketch = find_or_create_window(*counts, timestamp))
+    sketch->add(key.get_hash());
+}
+
+void as::detail::clear_distinct_keys() {
+  auto& registry = get_distinct_count_registry();
+  std::lock_guard<std::mutex> guard{registry.lock};
+  registry.series.clear();
+  registry.generation.fetch_add(1, std::memory_order_release);
+}
+
+void as::detail::clear_distinct_keys(std::string_view name) {
+  auto& registry = get_distinct_count_registry();
+  std::lock_guard<std::mutex> guard{registry.lock};
+  registry.series.erase(name);
+  registry.generation.fetch_add(1, std::memory_order_release);
+}
+
+#pragma endregion
+
+#pragma region distinct_count
+
+void as::set_distinct_count_options(std::string_view name,
+                                    distinct_count_options options) {
+  // Fail here instead of on the first key
+  hyperloglog{options.precision};
+
+  auto& registry = get_distinct_count_registry();
+  std::lock_guard<std::mutex> guard{registry.lock};
+  registry.options[intern_name(name)] = options;
+  registry.series.erase(name);
+  registry.generation.fetch_add(1, std::memory_order_release);
+}
+
+std::vector<as::measurement<as::hyperloglog>> as::get_distinct_counts(
+    std::string_view name, timestamp_t begin, timestamp_t end) {
+  std::vector<measurement<hyperloglog>> ret;
+  for (auto& kv : merge_windows(name, begin, end))
+    ret.emplace_back(kv.first, std::move(kv.second));
+  return ret;
+}
+
+double as::estimate_distinct_count(std::string_view name, timestamp_t begin,
+                                   timestamp_t end) {
+  auto windows = merge_windows(name, begin, end);
+  if (windows.empty()) return 0.0;
+
+  auto& merged = windows.begin()->second;
+  for (auto itr = std::next(windows.begin()); itr != windows.end(); ++itr)
+    merged.merge(itr->second);
+  return merged.estimate();
+}
+
+#pragma endregion
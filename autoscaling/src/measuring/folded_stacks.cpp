@@ -0,0 +1,89 @@
+#include "measuring/folded_stacks.h"
+
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+/// <summary>
+/// Appends a frame name to a folded stack. ';' separates frames and a newline
+/// separates stacks, so both are replaced
+/// </summary>
+void append_frame(std::string& stack, const std::string& name) {
+  if (!stack.empty()) stack += ';';
+  for (auto c : name) {
+    stack += (c == ';' || c == '\n' || c == '\r') ? '_' : c;
+  }
+}
+
+void write_node(std::ostream& stream, const as::call_tree_node& node,
+                std::string& stack, as::folded_stack_options options) {
+  const auto stack_size = stack.size();
+  append_frame(stack, node.name);
+
+  const auto weight = (options.weight == as::folded_stack_weight::self_time)
+                          ? static_cast<uint64_t>(node.self_time.count())
+                          : node.count;
+  if (weight) stream << stack << ' ' << weight << '\n';
+  if (options.exemplars) {
+    for (auto& exemplar : node.exemplars) {
+      stream << "# exemplar " << stack
+             << " duration_ns=" << exemplar.value.count()
+             << " request_id=" << exemplar.request_id << " timestamp_ns="
+             << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    exemplar.timestamp.time_since_epoch())
+                    .count()
+             << " thread=" << exemplar.thread_index << '\n';
+    }
+  }
+
+  for (auto& child : node.children) {
+    write_node(stream, child, stack, options);
+  }
+  stack.resize(stack_size);
+}
+
+/// <summary>
+/// Writes all children of the given root node, the root itself has no name
+/// and thus no frame
+/// </summary>
+void write_tree(std::ostream& stream, const as::call_tree_node& root,
+                const std::string& prefix, as::folded_stack_options options) {
+  std::string stack = prefix;
+  for (auto& child : root.children) {
+    write_node(stream, child, stack, options);
+  }
+}
+
+}  // namespace
+
+void as::write_folded_stacks(std::ostream& stream,
+                             const std::vector<call_tree>& trees,
+                             folded_stack_options options) {
+  if (options.merge_threads) {
+    write_tree(stream, merge_call_trees(trees), {}, options);
+    return;
+  }
+
+  for (auto& tree : trees) {
+    const auto prefix = tree.exited_threads
+                            ? std::string{"exited-threads"}
+                            : "thread-" + std::to_string(tree.thread_index);
+    write_tree(stream, tree.root, prefix, options);
+  }
+}
+
+std::future<void> as::export_folded_stacks(const std::string& path,
+                                           folded_stack_options options) {
+  return std::async(
+      std::launch::async,
+      [path, options](std::vector<call_tree> trees) {
+        std::ofstream file{path, std::ios::out | std::ios::trunc};
+        if (!file.is_open())
+          throw std::runtime_error{"Could not open file '" + path + "'!"};
+        write_folded_stacks(file, trees, options);
+        if (!file)
+          throw std::runtime_error{"Could not write file '" + path + "'!"};
+      },
+      get_call_trees());
+}
@@ -0,0 +1,73 @@
+#include "measuring/instrumented_mutex.h"
+
+#include <map>
+#include <memory>
+
+#pragma region lock_timing
+
+namespace {
+
+struct lock_timing_registry {
+  std::mutex lock;
+  std::map<std::string, std::unique_ptr<as::detail::lock_timing>, std::less<>>
+      timings;
+};
+
+lock_timing_registry& get_lock_timing_registry() {
+  static lock_timing_registry s_registry;
+  return s_registry;
+}
+
+}  // namespace
+
+as::detail::lock_timing& as::detail::get_lock_timing(std::string_view name) {
+  auto& registry = get_lock_timing_registry();
+  std::lock_guard<std::mutex> guard{registry.lock};
+
+  auto itr = registry.timings.find(name);
+  if (itr == registry.timings.end()) {
+    itr = registry.timings
+              .emplace(std::string{name}, std::make_unique<lock_timing>())
+              .first;
+  }
+  return *itr->second;
+}
+
+std::vector<as::lock_statistics> as::get_lock_statistics() {
+  auto& registry = get_lock_timing_registry();
+  std::lock_guard<std::mutex> guard{registry.lock};
+
+  std::vector<lock_statistics> ret;
+  ret.reserve(registry.timings.size());
+  for (auto& [name, timing] : registry.timings) {
+    lock_statistics statistics;
+    statistics.name = name;
+    statistics.acquisitions =
+        timing->acquisitions.load(std::memory_order_relaxed);
+    statistics.contended_acquisitions =
+        timing->contended_acquisitions.load(std::memory_order_relaxed);
+    statistics.contended_shared_acquisitions =
+        timing->contended_shared_acquisitions.load(std::memory_order_relaxed);
+    statistics.wait_time = timing->wait_time;
+    statistics.shared_wait_time = timing->shared_wait_time;
+    statistics.hold_time = timing->hold_time;
+    ret.push_back(std::move(statistics));
+  }
+  return ret;
+}
+
+void as::clear_lock_statistics() {
+  auto& registry = get_lock_timing_registry();
+  std::lock_guard<std::mutex> guard{registry.lock};
+
+  for (auto& [name, timing] : registry.timings) {
+    timing->acquisitions.store(0, std::memory_order_relaxed);
+    timing->contended_acquisitions.store(0, std::memory_order_relaxed);
+    timing->contended_shared_acquisitions.store(0, std::memory_order_relaxed);
+    timing->wait_time.clear();
+    timing->shared_wait_time.clear();
+    timing->hold_time.clear();
+  }
+}
+
+#pragma endregion
@@ -1,7 +1,173 @@
 #include "measuring/measurement.h"
+#include "measuring/scope_timing.h"
+#include "measuring/trace.h"
+
+#include <deque>
+#include <map>
+#include <regex>
+#include <string>
+#include <unordered_set>
 
 #pragma region time
-as::timestamp_t as::now() { return std::chrono::high_resolution_clock::now(); }
+namespace {
+std::atomic<const as::clock_source*> s_clock{nullptr};
+}
+
+as::timestamp_t as::now() {
+  const auto* clock = s_clock.load(std::memory_order_acquire);
+  return clock ? clock->now() : std::chrono::high_resolution_clock::now();
+}
+
+void as::set_clock(const clock_source* clock) {
+  s_clock.store(clock, std::memory_order_release);
+}
+
+const as::clock_source* as::get_clock() {
+  return s_clock.load(std::memory_order_acquire);
+}
+#pragma endregion
+
+#pragma region thread
+uint32_t as::get_thread_index() {
+  static std::atomic<uint32_t> s_next_index{0};
+  thread_local uint32_t t_index = s_next_index.fetch_add(1);
+  return t_index;
+}
+#pragma endregion
+
+#pragma region names
+std::string_view as::intern_name(std::string_view name) {
+  static std::mutex s_lock;
+  // Node based, so the strings never move
+  static std::unordered_set<std::string> s_names;
+
+  std::lock_guard<std::mutex> guard{s_lock};
+  return *s_names.emplace(name).first;
+}
+#pragma endregion
+
+#pragma region labels
+namespace {
+
+struct label_registry {
+  label_registry() {
+    sets.emplace_back();
+    ids.emplace(std::vector<as::label>{}, 0);
+  }
+
+  std::mutex lock;
+  // Indexed by the id of the label set, never relocates its elements
+  std::deque<std::vector<as::label>> sets;
+  std::map<std::vector<as::label>, uint32_t> ids;
+};
+
+label_registry& get_label_registry() {
+  static label_registry s_registry;
+  return s_registry;
+}
+
+}  // namespace
+
+as::label_set_t as::intern_labels(std::vector<label> labels) {
+  std::sort(labels.begin(), labels.end());
+  for (size_t idx = 1; idx < labels.size(); ++idx) {
+    if (labels[idx - 1].first == labels[idx].first)
+      throw std::runtime_error{"Duplicate label '" +
+                               std::string{labels[idx].first} + "'"};
+  }
+
+  auto& registry = get_label_registry();
+  {
+    std::lock_guard<std::mutex> guard{registry.lock};
+    const auto itr = registry.ids.find(labels);
+    if (itr != registry.ids.end()) return label_set_t{itr->second};
+  }
+
+  // New label sets are rare, intern their strings outside of the lock
+  for (auto& l : labels) {
+    l.first = intern_name(l.first);
+    l.second = intern_name(l.second);
+  }
+  std::lock_guard<std::mutex> guard{registry.lock};
+  const auto id = static_cast<uint32_t>(registry.sets.size());
+  const auto inserted = registry.ids.emplace(labels, id);
+  if (inserted.second) registry.sets.push_back(std::move(labels));
+  return label_set_t{inserted.first->second};
+}
+
+const std::vector<as::label>& as::get_labels(label_set_t labels) {
+  auto& registry = get_label_registry();
+  std::lock_guard<std::mutex> guard{registry.lock};
+  if (labels.id >= registry.sets.size())
+    throw std::runtime_error{"Unknown label set"};
+  return registry.sets[labels.id];
+}
+
+std::string_view as::get_label(label_set_t labels, std::string_view key) {
+  const auto& set = get_labels(labels);
+  const auto itr = std::lower_bound(
+      set.begin(), set.end(), key,
+      [](const label& l, std::string_view k) { return l.first < k; });
+  if (itr == set.end() || itr->first != key) return {};
+  return itr->second;
+}
+
+std::vector<as::label_set_t> as::detail::select_label_sets(
+    std::vector<label_set_t> label_sets,
+    const std::vector<label_matcher>& matchers) {
+  std::sort(label_sets.begin(), label_sets.end(),
+            [](label_set_t l, label_set_t r) { return l.id < r.id; });
+  label_sets.erase(std::unique(label_sets.begin(), label_sets.end()),
+                   label_sets.end());
+  if (matchers.empty()) return label_sets;
+
+  std::vector<std::regex> regexes;
+  regexes.reserve(matchers.size());
+  for (auto& matcher : matchers) {
+    const auto is_regex = matcher.type == label_match::regex ||
+                          matcher.type == label_match::not_regex;
+    regexes.emplace_back(is_regex ? matcher.value : std::string{});
+  }
+
+  const auto matches = [&](label_set_t labels) {
+    for (size_t idx = 0; idx < matchers.size(); ++idx) {
+      const auto& matcher = matchers[idx];
+      const auto value = get_label(labels, matcher.key);
+      bool match = false;
+      switch (matcher.type) {
+        case label_match::equal:
+          match = value == matcher.value;
+          break;
+        case label_match::not_equal:
+          match = value != matcher.value;
+          break;
+        case label_match::regex:
+          match = std::regex_match(value.begin(), value.end(), regexes[idx]);
+          break;
+        case label_match::not_regex:
+          match = !std::regex_match(value.begin(), value.end(), regexes[idx]);
+          break;
+      }
+      if (!match) return false;
+    }
+    return true;
+  };
+  label_sets.erase(
+      std::remove_if(label_sets.begin(), label_sets.end(),
+                     [&matches](label_set_t l) { return !matches(l); }),
+      label_sets.end());
+  return label_sets;
+}
+
+as::label_set_t as::detail::project_labels(
+    label_set_t labels, const std::vector<std::string_view>& keys) {
+  std::vector<label> projected;
+  for (auto& l : get_labels(labels)) {
+    if (std::find(keys.begin(), keys.end(), l.first) != keys.end())
+      projected.push_back(l);
+  }
+  return intern_labels(std::move(projected));
+}
 #pragma endregion
 
 #pragma region memory
@@ -53,6 +219,30 @@ as::memory as::literals::operator"" _GB(size_t size) {
 
 #pragma endregion
 
+#pragma region rate
+
+as::rate::rate() : _per_second(0) {}
+as::rate::rate(double per_second) : _per_second(per_second) {}
+
+double as::rate::get_per_second() const { return _per_second; }
+
+as::rate as::rate::from_delta(double delta, timespan_t timespan) {
+  if (timespan <= timespan_t{0}) return rate{};
+  return rate{delta / std::chrono::duration<double>(timespan).count()};
+}
+
+#pragma endregion
+
+#pragma region distinct_key
+
+as::distinct_key::distinct_key(std::string_view key)
+    : _hash(math::mix_hash(std::hash<std::string_view>{}(key))) {}
+as::distinct_key::distinct_key(uint64_t key) : _hash(math::mix_hash(key)) {}
+
+uint64_t as::distinct_key::get_hash() const { return _hash; }
+
+#pragma endregion
+
 #pragma region type_id
 
 as::type_id_t as::detail::TypeIDBase::next() {
@@ -68,7 +258,11 @@ as::detail::FunctionTimingHelper::FunctionTimingHelper(const char* name)
     : _name(name), _start_time(as::now()) {}
 
 as::detail::FunctionTimingHelper::~FunctionTimingHelper() {
-  add_measurement<function_timing>(_name, now() - _start_time);
+  const auto end_time = now();
+  const auto duration = end_time - _start_time;
+  add_measurement<function_timing>(_name, duration);
+  offer_function_exemplar(_name, _start_time, duration);
+  record_span(_name, _start_time, end_time);
 }
 
 #pragma endregion
@@ -0,0 +1,281 @@
+#include "measuring/metric_config.h"
+
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#pragma region metric_config
+
+namespace {
+
+std::atomic<bool> s_has_config{false};
+// Incremented whenever a configuration is set
+std::atomic<uint64_t> s_config_version{0};
+// Only accessed through std::atomic_load and std::atomic_store
+std::shared_ptr<const as::metric_config> s_config;
+
+std::string_view trim(std::string_view text) {
+  while (!text.empty() && std::isspace(static_cast<unsigned char>(text[0])))
+    text.remove_prefix(1);
+  while (!text.empty() &&
+         std::isspace(static_cast<unsigned char>(text[text.size() - 1])))
+    text.remove_suffix(1);
+  return text;
+}
+
+[[noreturn]] void fail(size_t line, const std::string& message) {
+  throw std::runtime_error{"Invalid metric configuration at line " +
+                           std::to_string(line) + ": " + message};
+}
+
+bool parse_bool(std::string_view value, size_t line) {
+  if (value == "true") return true;
+  if (value == "false") return false;
+  fail(line, "expected true or false");
+}
+
+double parse_double(std::string_view value, size_t line) {
+  const std::string text{value};
+  char* end = nullptr;
+  const auto ret = std::strtod(text.c_str(), &end);
+  if (text.empty() || end != text.c_str() + text.size())
+    fail(line, "expected a number");
+  return ret;
+}
+
+size_t parse_size(std::string_view value, size_t line) {
+  if (value == "infinite") return as::cache_size_infinite;
+  const std::string text{value};
+  char* end = nullptr;
+  const auto ret = std::strtoull(text.c_str(), &end, 10);
+  if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0])) ||
+      end != text.c_str() + text.size())
+    fail(line, "expected a size or infinite");
+  return static_cast<size_t>(ret);
+}
+
+std::chrono::milliseconds parse_duration(std::string_view value, size_t line) {
+  using rep = std::chrono::milliseconds::rep;
+  uint64_t count = 0;
+  const auto end = value.data() + value.size();
+  const auto result = std::from_chars(value.data(), end, count);
+  if (result.ptr == value.data()) fail(line, "expected a duration");
+  const auto unit = value.substr(result.ptr - value.data());
+  rep factor = 1;
+  if (unit == "s") {
+    factor = 1000;
+  } else if (unit == "m") {
+    factor = 60 * 1000;
+  } else if (unit == "h") {
+    factor = 60 * 60 * 1000;
+  } else if (unit != "ms" && !(unit.empty() && count == 0)) {
+    fail(line, "expected a unit of ms, s, m or h");
+  }
+  if (result.ec == std::errc::result_out_of_range ||
+      count > static_cast<uint64_t>(std::numeric_limits<rep>::max() / factor))
+    fail(line, "duration out of range");
+  return std::chrono::milliseconds{static_cast<rep>(count) * factor};
+}
+
+}  // namespace
+
+std::shared_ptr<const as::metric_properties>
+as::detail::get_configured_properties(std::string_view name) {
+  if (!s_has_config.load(std::memory_order_acquire)) return nullptr;
+  auto config = std::atomic_load(&s_config);
+  if (!config) return nullptr;
+  const auto* properties = config->find(name);
+  if (!properties) return nullptr;
+  // Shares the ownership of the whole configuration
+  return std::shared_ptr<const metric_properties>{std::move(config),
+                                                  properties};
+}
+
+uint64_t as::detail::get_metric_config_version() {
+  if (!s_has_config.load(std::memory_order_acquire)) return 0;
+  return s_config_version.load(std::memory_order_acquire);
+}
+
+bool as::detail::sample_measurement(double sampling_rate) {
+  thread_local std::minstd_rand t_random{get_thread_index() + 1};
+  return std::uniform_real_distribution<double>{}(t_random) < sampling_rate;
+}
+
+as::metric_config as::metric_config::parse(std::string_view text) {
+  metric_config ret;
+  std::string_view section;
+  metric_properties properties;
+  bool has_section = false;
+  const auto finish_section = [&]() {
+    if (!has_section) return;
+    if (section == "*") {
+      ret.set_default_properties(properties);
+    } else {
+      ret.set_properties(section, properties);
+    }
+  };
+
+  size_t line_number = 0;
+  while (!text.empty()) {
+    ++line_number;
+    const auto end = text.find('\n');
+    auto line = text.substr(0, end);
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+    const auto comment = line.find('#');
+    if (comment != std::string_view::npos) line = line.substr(0, comment);
+    line = trim(line);
+    if (line.empty()) continue;
+
+    if (line.front() == '[') {
+      if (line.back() != ']') fail(line_number, "expected ']'");
+      finish_section();
+      section = trim(line.substr(1, line.size() - 2));
+      if (section.empty()) fail(line_number, "expected a series name");
+      properties = metric_properties{};
+      has_section = true;
+      continue;
+    }
+
+    const auto equals = line.find('=');
+    if (equals == std::string_view::npos) fail(line_number, "expected '='");
+    if (!has_section) fail(line_number, "property outside of a section");
+    const auto key = trim(line.substr(0, equals));
+    const auto value = trim(line.substr(equals + 1));
+    if (key == "enabled") {
+      properties.enabled = parse_bool(value, line_number);
+    } else if (key == "sampling_rate") {
+      properties.sampling_rate = parse_double(value, line_number);
+      if (!(properties.sampling_rate >= 0.0 &&
+            properties.sampling_rate <= 1.0))
+        fail(line_number, "sampling_rate must be in [0;1]");
+    } else if (key == "for_each_thread") {
+      properties.for_each_thread = parse_bool(value, line_number);
+    } else if (key == "cache_size") {
+      properties.cache_size = parse_size(value, line_number);
+    } else if (key == "retention") {
+      properties.retention = parse_duration(value, line_number);
+    } else {
+      fail(line_number, "unknown property '" + std::string{key} + "'");
+    }
+  }
+  finish_section();
+  return ret;
+}
+
+as::metric_config as::metric_config::load(const std::string& path) {
+  std::ifstream file{path, std::ios::binary};
+  if (!file) throw std::runtime_error{"Can't read '" + path + "'!"};
+  std::stringstream content;
+  content << file.rdbuf();
+  return parse(content.str());
+}
+
+void as::metric_config::set_properties(std::string_view name,
+                                       metric_properties properties) {
+  _properties[intern_name(name)] = properties;
+}
+
+void as::metric_config::set_default_properties(metric_properties properties) {
+  _has_default = true;
+  _default = properties;
+}
+
+const as::metric_properties* as::metric_config::find(
+    std::string_view name) const {
+  auto itr = _properties.find(name);
+  if (itr != _properties.end()) return &itr->second;
+  return _has_default ? &_default : nullptr;
+}
+
+size_t as::metric_config::size() const { return _properties.size(); }
+
+void as::set_metric_config(std::shared_ptr<const metric_config> config) {
+  // The flag is only set once the configuration can be loaded
+  if (!config) s_has_config.store(false, std::memory_order_release);
+  const auto has_config = config != nullptr;
+  std::atomic_store(&s_config, std::move(config));
+  s_config_version.fetch_add(1, std::memory_order_release);
+  if (has_config) s_has_config.store(true, std::memory_order_release);
+}
+
+std::shared_ptr<const as::metric_config> as::get_metric_config() {
+  return std::atomic_load(&s_config);
+}
+
+#pragma endregion
+
+#pragma region metric_config_watcher
+
+as::metric_config_watcher::metric_config_watcher(
+    metric_config_watcher_options options)
+    : _options(std::move(options)), _reload_count(0), _stop(false) {
+  if (!reload()) throw std::runtime_error{_last_error};
+  _thread = std::thread{&metric_config_watcher::run, this};
+}
+
+as::metric_config_watcher::~metric_config_watcher() {
+  {
+    std::lock_guard<std::mutex> guard{_stop_lock};
+    _stop = true;
+  }
+  _stop_signal.notify_one();
+  _thread.join();
+}
+
+bool as::metric_config_watcher::reload() {
+  std::lock_guard<std::mutex> guard{_reload_lock};
+  std::ifstream file{_options.path, std::ios::binary};
+  if (!file) {
+    _last_error = "Can't read '" + _options.path + "'!";
+    return false;
+  }
+  std::stringstream stream;
+  stream << file.rdbuf();
+  auto content = stream.str();
+  if (_reload_count && content == _content) {
+    _last_error.clear();
+    return false;
+  }
+
+  try {
+    auto config =
+        std::make_shared<const metric_config>(metric_config::parse(content));
+    set_metric_config(std::move(config));
+  } catch (const std::runtime_error& e) {
+    _last_error = e.what();
+    return false;
+  }
+  _content = std::move(content);
+  _last_error.clear();
+  ++_reload_count;
+  return true;
+}
+
+std::string as::metric_config_watcher::get_last_error() const {
+  std::lock_guard<std::mutex> guard{_reload_lock};
+  return _last_error;
+}
+
+uint64_t as::metric_config_watcher::get_reload_count() const {
+  std::lock_guard<std::mutex> guard{_reload_lock};
+  return _reload_count;
+}
+
+void as::metric_config_watcher::run() {
+  std::unique_lock<std::mutex> lock{_stop_lock};
+  while (!_stop) {
+    _stop_signal.wait_for(lock, _options.interval);
+    if (_stop) break;
+
+    lock.unlock();
+    reload();
+    lock.lock();
+  }
+}
+
+#pragma endregion
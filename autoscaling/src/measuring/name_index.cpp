@@ -0,0 +1,167 @@
+#include "measuring/name_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+#pragma region name_index
+
+namespace {
+
+/// <summary>
+/// Node of the trie of name segments. Segments are views of interned names,
+/// so they stay valid
+/// </summary>
+struct name_node {
+  std::map<std::string_view, std::unique_ptr<name_node>> children;
+  /// <summary>
+  /// Full name if a series of it was created, empty otherwise
+  /// </summary>
+  std::string_view name;
+  std::vector<as::type_id_t> types;
+};
+
+struct name_index {
+  std::mutex lock;
+  name_node root;
+};
+
+name_index& get_name_index() {
+  static name_index s_index;
+  return s_index;
+}
+
+using prefix_set = std::unordered_set<std::string_view>;
+
+// Set while any prefix is disabled, so that recording doesn't need to look up
+// names otherwise
+std::atomic<bool> s_has_disabled_prefixes{false};
+// Interned prefixes without trailing dot. Only accessed through
+// std::atomic_load and std::atomic_store, and replaced as a whole under the
+// index lock, so recording can read it without locking
+std::shared_ptr<const prefix_set> s_disabled_prefixes;
+
+/// <summary>
+/// Removes a trailing dot, "db." is the same prefix as "db"
+/// </summary>
+std::string_view normalize_prefix(std::string_view prefix) {
+  if (!prefix.empty() && prefix.back() == '.') prefix.remove_suffix(1);
+  return prefix;
+}
+
+/// <summary>
+/// Calls the visitor with each segment of the name until it returns false
+/// </summary>
+template <typename Visitor>
+void for_each_segment(std::string_view name, Visitor visitor) {
+  if (name.empty()) return;
+  size_t begin = 0;
+  for (;;) {
+    const auto end = name.find('.', begin);
+    if (!visitor(name.substr(begin, end - begin))) return;
+    if (end == std::string_view::npos) return;
+    begin = end + 1;
+  }
+}
+
+/// <summary>
+/// Returns the node of the prefix, or nullptr if no name is under it
+/// </summary>
+const name_node* find_node(const name_node& root, std::string_view prefix) {
+  const auto* node = &root;
+  for_each_segment(normalize_prefix(prefix), [&node](std::string_view s) {
+    const auto itr = node->children.find(s);
+    node = itr == node->children.end() ? nullptr : itr->second.get();
+    return node != nullptr;
+  });
+  return node;
+}
+
+/// <summary>
+/// Returns the node of the interned prefix, creating the path to it
+/// </summary>
+name_node& find_or_create_node(name_node& root, std::string_view prefix) {
+  auto* node = &root;
+  for_each_segment(normalize_prefix(prefix), [&node](std::string_view s) {
+    auto& child = node->children[s];
+    if (!child) child = std::make_unique<name_node>();
+    node = child.get();
+    return true;
+  });
+  return *node;
+}
+
+void collect_names(const name_node& node, as::type_id_t type,
+                   std::vector<std::string_view>& names) {
+  if (!node.name.empty() &&
+      (!type || std::find(node.types.begin(), node.types.end(), type) !=
+                    node.types.end()))
+    names.push_back(node.name);
+  for (auto& kv : node.children) collect_names(*kv.second, type, names);
+}
+
+}  // namespace
+
+void as::detail::register_series_name(std::string_view name, type_id_t type) {
+  const auto interned = intern_name(name);
+  auto& index = get_name_index();
+  std::lock_guard<std::mutex> guard{index.lock};
+  auto& node = find_or_create_node(index.root, interned);
+  node.name = interned;
+  if (std::find(node.types.begin(), node.types.end(), type) ==
+      node.types.end())
+    node.types.push_back(type);
+}
+
+bool as::detail::is_disabled_by_prefix(std::string_view name) {
+  if (!s_has_disabled_prefixes.load(std::memory_order_acquire)) return false;
+
+  const auto disabled = std::atomic_load(&s_disabled_prefixes);
+  if (!disabled) return false;
+  // The empty prefix disables every name
+  if (disabled->count(std::string_view{})) return true;
+  for (auto end = name.find('.');; end = name.find('.', end + 1)) {
+    if (disabled->count(name.substr(0, end))) return true;
+    if (end == std::string_view::npos) return false;
+  }
+}
+
+std::vector<std::string_view> as::detail::get_series_names(
+    std::string_view prefix, type_id_t type) {
+  std::vector<std::string_view> ret;
+  auto& index = get_name_index();
+  std::lock_guard<std::mutex> guard{index.lock};
+  if (const auto* node = find_node(index.root, prefix))
+    collect_names(*node, type, ret);
+  return ret;
+}
+
+std::vector<std::string_view> as::get_series_names(std::string_view prefix) {
+  return detail::get_series_names(prefix, 0);
+}
+
+void as::set_prefix_enabled(std::string_view prefix, bool enabled) {
+  const auto interned = intern_name(normalize_prefix(prefix));
+  auto& index = get_name_index();
+  std::lock_guard<std::mutex> guard{index.lock};
+  const auto current = std::atomic_load(&s_disabled_prefixes);
+  const auto is_disabled = current && current->count(interned);
+  if (is_disabled == !enabled) return;
+
+  auto updated = current ? std::make_shared<prefix_set>(*current)
+                         : std::make_shared<prefix_set>();
+  if (enabled)
+    updated->erase(interned);
+  else
+    updated->insert(interned);
+  const auto has_disabled_prefixes = !updated->empty();
+  std::atomic_store(&s_disabled_prefixes,
+                    std::shared_ptr<const prefix_set>{std::move(updated)});
+  s_has_disabled_prefixes.store(has_disabled_prefixes,
+                                std::memory_order_release);
+}
+
+#pragma endregion
@@ -0,0 +1,254 @@
+#include "measuring/perf_counters.h"
+
+#include <algorithm>
+#include <array>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#pragma region perf_counters
+
+namespace {
+
+enum counter_slot {
+  slot_cycles,
+  slot_instructions,
+  slot_cache_misses,
+  slot_task_clock,
+  slot_page_faults,
+  slot_context_switches,
+  slot_count
+};
+
+#ifdef __linux__
+
+struct counter_definition {
+  counter_slot slot;
+  uint32_t type;
+  uint64_t config;
+};
+
+constexpr std::array<counter_definition, 3> hardware_counters{
+    {{slot_cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+     {slot_instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+     {slot_cache_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}}};
+
+constexpr std::array<counter_definition, 3> software_counters{
+    {{slot_task_clock, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+     {slot_page_faults, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+     {slot_context_switches, PERF_TYPE_SOFTWARE,
+      PERF_COUNT_SW_CONTEXT_SWITCHES}}};
+
+/// <summary>
+/// Counters that are opened as one group, so a single read() returns all of
+/// them, taken at the same instant, and the PMU schedules them together
+/// </summary>
+struct counter_group {
+  ~counter_group() { close_all(); }
+
+  void open_counter(const counter_definition& counter, uint64_t read_format) {
+    perf_event_attr attributes = {};
+    attributes.size = sizeof(attributes);
+    attributes.type = counter.type;
+    attributes.config = counter.config;
+    // User-space only, so that the counters work with the default
+    // perf_event_paranoid setting
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    attributes.read_format = read_format;
+
+    const auto fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes,
+                                             0, -1, leader_fd,
+                                             PERF_FLAG_FD_CLOEXEC));
+    if (fd < 0) return;
+
+    if (leader_fd < 0) leader_fd = fd;
+    fds[fd_count] = fd;
+    slots[fd_count++] = counter.slot;
+  }
+
+  bool has(counter_slot slot) const {
+    return std::find(slots.begin(), slots.begin() + fd_count, slot) !=
+           slots.begin() + fd_count;
+  }
+
+  void close_all() {
+    for (int idx = 0; idx < fd_count; ++idx) close(fds[idx]);
+    fd_count = 0;
+    leader_fd = -1;
+  }
+
+  int leader_fd = -1;
+  std::array<int, 3> fds{};
+  /// <summary>
+  /// Slots of the counters in the order in which they were added to the
+  /// group, which is the order of their values when the group is read
+  /// </summary>
+  std::array<counter_slot, 3> slots{};
+  int fd_count = 0;
+};
+
+/// <summary>
+/// Counters of a single thread. Hardware and software counters are separate
+/// groups, as the PMU only schedules a group if all of its counters fit and
+/// would otherwise multiplex the software counters along with the hardware
+/// counters. Only the hardware group is subject to multiplexing, so only it
+/// reads the times it was enabled and running
+/// </summary>
+struct thread_perf_counters {
+  static constexpr uint64_t hardware_read_format =
+      PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+      PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  bool open(bool with_hardware_counters) {
+    if (with_hardware_counters) {
+      for (auto& counter : hardware_counters)
+        hardware.open_counter(counter, hardware_read_format);
+      // Without cycles there is no point in the hardware counters
+      if (!hardware.has(slot_cycles)) {
+        hardware.close_all();
+        return false;
+      }
+    }
+    for (auto& counter : software_counters)
+      software.open_counter(counter, PERF_FORMAT_GROUP);
+    return hardware.leader_fd >= 0 || software.leader_fd >= 0;
+  }
+
+  bool read_values(as::perf_counter_values& values) const {
+    if (hardware.leader_fd < 0 && software.leader_fd < 0) return false;
+
+    std::array<uint64_t, slot_count> counts{};
+    // Layout: number of counters, time enabled, time running, then one value
+    // per counter
+    std::array<uint64_t, 3 + 3> hardware_buffer{};
+    if (hardware.leader_fd >= 0) {
+      if (!read_group(hardware, hardware_buffer.data(),
+                      sizeof(hardware_buffer), 3, counts))
+        return false;
+      values.time_enabled =
+          as::timespan_t{static_cast<int64_t>(hardware_buffer[1])};
+      values.time_running =
+          as::timespan_t{static_cast<int64_t>(hardware_buffer[2])};
+    }
+    // Layout: number of counters, then one value per counter
+    std::array<uint64_t, 1 + 3> software_buffer{};
+    if (software.leader_fd >= 0 &&
+        !read_group(software, software_buffer.data(), sizeof(software_buffer),
+                    1, counts))
+      return false;
+
+    values.cycles = counts[slot_cycles];
+    values.instructions = counts[slot_instructions];
+    values.cache_misses = counts[slot_cache_misses];
+    values.task_clock =
+        as::timespan_t{static_cast<int64_t>(counts[slot_task_clock])};
+    values.page_faults = counts[slot_page_faults];
+    values.context_switches = counts[slot_context_switches];
+    return true;
+  }
+
+  /// <summary>
+  /// Reads the group into the buffer and copies the values, which start
+  /// after the given number of header fields, into their slots
+  /// </summary>
+  static bool read_group(const counter_group& group, uint64_t* buffer,
+                         size_t size, size_t header_fields,
+                         std::array<uint64_t, slot_count>& counts) {
+    const auto bytes = ::read(group.leader_fd, buffer, size);
+    if (bytes < static_cast<ssize_t>(header_fields * sizeof(uint64_t)))
+      return false;
+    const auto count =
+        std::min<uint64_t>(buffer[0], static_cast<uint64_t>(group.fd_count));
+    for (uint64_t idx = 0; idx < count; ++idx)
+      counts[group.slots[idx]] = buffer[header_fields + idx];
+    return true;
+  }
+
+  as::perf_counter_source source = as::perf_counter_source::unavailable;
+  counter_group hardware;
+  counter_group software;
+};
+
+thread_perf_counters& get_this_thread_perf_counters() {
+  thread_local thread_perf_counters t_counters;
+  thread_local bool t_opened = false;
+  if (!t_opened) {
+    t_opened = true;
+    if (t_counters.open(true))
+      t_counters.source = as::perf_counter_source::hardware;
+    else if (t_counters.open(false))
+      t_counters.source = as::perf_counter_source::software;
+  }
+  return t_counters;
+}
+
+#endif
+
+}  // namespace
+
+as::perf_counter_values as::operator-(const perf_counter_values& l,
+                                      const perf_counter_values& r) {
+  perf_counter_values ret;
+  ret.cycles = l.cycles - r.cycles;
+  ret.instructions = l.instructions - r.instructions;
+  ret.cache_misses = l.cache_misses - r.cache_misses;
+  ret.task_clock = l.task_clock - r.task_clock;
+  ret.page_faults = l.page_faults - r.page_faults;
+  ret.context_switches = l.context_switches - r.context_switches;
+  ret.time_enabled = l.time_enabled - r.time_enabled;
+  ret.time_running = l.time_running - r.time_running;
+  return ret;
+}
+
+as::perf_counter_values as::perf_counter_values::get_scaled() const {
+  auto ret = *this;
+  if (!is_multiplexed() || time_running <= timespan_t{0}) return ret;
+
+  const auto factor = static_cast<double>(time_enabled.count()) /
+                      static_cast<double>(time_running.count());
+  const auto scale = [factor](uint64_t count) {
+    return static_cast<uint64_t>(static_cast<double>(count) * factor + 0.5);
+  };
+  ret.cycles = scale(cycles);
+  ret.instructions = scale(instructions);
+  ret.cache_misses = scale(cache_misses);
+  return ret;
+}
+
+as::perf_counter_source as::get_perf_counter_source() {
+#ifdef __linux__
+  return get_this_thread_perf_counters().source;
+#else
+  return perf_counter_source::unavailable;
+#endif
+}
+
+bool as::read_thread_perf_counters(perf_counter_values& values) {
+#ifdef __linux__
+  return get_this_thread_perf_counters().read_values(values);
+#else
+  return false;
+#endif
+}
+
+#pragma endregion
+
+#pragma region scope_perf_counters_helper
+
+as::detail::ScopePerfCountersHelper::ScopePerfCountersHelper(const char* name)
+    : _name(name), _valid(read_thread_perf_counters(_start_values)) {}
+
+as::detail::ScopePerfCountersHelper::~ScopePerfCountersHelper() {
+  if (!_valid) return;
+
+  perf_counter_values end_values;
+  if (!read_thread_perf_counters(end_values)) return;
+  add_measurement<perf_counter_values>(
+      _name, (end_values - _start_values).get_scaled());
+}
+
+#pragma endregion
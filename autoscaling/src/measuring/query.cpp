@@ -0,0 +1,667 @@
+#include "measuring/query.h"
+
+#include "measuring/samples.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <locale>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#pragma region query
+
+namespace {
+
+using as::detail::is_true;
+using as::detail::read_series;
+using as::detail::sample;
+
+constexpr auto not_a_number = std::numeric_limits<double>::quiet_NaN();
+
+enum class series_type {
+  double_value,
+  size_value,
+  timespan,
+  memory,
+  rate,
+  periodic_event,
+  function_call
+};
+
+/// <summary>
+/// Nearest-rank quantile of a multiset of values that supports insertions
+/// and removals in O(log n). The values up to the rank are kept in the lower
+/// set, so the quantile is the largest of them
+/// </summary>
+class order_statistic {
+ public:
+  explicit order_statistic(double quantile) : _quantile(quantile) {}
+
+  void insert(double value) {
+    if (!_lower.empty() && value <= *_lower.rbegin()) {
+      _lower.insert(value);
+    } else {
+      _upper.insert(value);
+    }
+    balance();
+  }
+
+  void erase(double value) {
+    auto itr = _lower.find(value);
+    if (itr != _lower.end()) {
+      _lower.erase(itr);
+    } else {
+      _upper.erase(_upper.find(value));
+    }
+    balance();
+  }
+
+  double get_quantile() const { return _quantile; }
+
+  double get_value() const {
+    return _lower.empty() ? not_a_number : *_lower.rbegin();
+  }
+
+ private:
+  void balance() {
+    const auto count = _lower.size() + _upper.size();
+    const auto rank = std::max<size_t>(
+        static_cast<size_t>(std::ceil(_quantile * static_cast<double>(count))),
+        count ? 1 : 0);
+    while (_lower.size() > rank) {
+      auto itr = std::prev(_lower.end());
+      _upper.insert(*itr);
+      _lower.erase(itr);
+    }
+    while (_lower.size() < rank) {
+      auto itr = _upper.begin();
+      _lower.insert(*itr);
+      _upper.erase(itr);
+    }
+  }
+
+  double _quantile;
+  std::multiset<double> _lower;
+  std::multiset<double> _upper;
+};
+
+/// <summary>
+/// Sliding-window minimum (std::less) or maximum (std::greater). Samples that
+/// can never become the extreme are dropped on insertion, so both insertion
+/// and eviction are O(1) amortized
+/// </summary>
+template <typename Compare>
+class monotonic_queue {
+ public:
+  void push(const sample& s) {
+    while (!_samples.empty() && !Compare{}(_samples.back().second, s.second))
+      _samples.pop_back();
+    _samples.push_back(s);
+  }
+
+  void evict(as::timestamp_t cutoff) {
+    while (!_samples.empty() && _samples.front().first <= cutoff)
+      _samples.pop_front();
+  }
+
+  double get_value() const {
+    return _samples.empty() ? not_a_number : _samples.front().second;
+  }
+
+ private:
+  std::deque<sample> _samples;
+};
+
+}  // namespace
+
+/// <summary>
+/// Measurements of a series within (timestamp - span;timestamp] together
+/// with the running state of the functions applied to them
+/// </summary>
+struct as::query::window {
+  series_type type;
+  std::string_view name;
+  std::vector<label_matcher> matchers;
+  timespan_t span;
+
+  std::deque<sample> samples;
+  double sum = 0.0;
+  bool track_min = false;
+  bool track_max = false;
+  monotonic_queue<std::less<double>> min;
+  monotonic_queue<std::greater<double>> max;
+  std::vector<order_statistic> quantiles;
+
+  bool has_read = false;
+  timestamp_t read_until;
+
+  size_t add_quantile(double quantile) {
+    for (size_t idx = 0; idx < quantiles.size(); ++idx) {
+      if (quantiles[idx].get_quantile() == quantile) return idx;
+    }
+    quantiles.emplace_back(quantile);
+    return quantiles.size() - 1;
+  }
+
+  void update(timestamp_t timestamp, uint64_t& samples_read) {
+    if (has_read && timestamp <= read_until) return;
+
+    // Only the measurements since the previous update, which the storage
+    // finds by binary search as long as they were added in timestamp order
+    auto begin = timestamp - span;
+    if (has_read) begin = std::max(begin, read_until + timespan_t{1});
+    std::vector<sample> added;
+    switch (type) {
+      case series_type::double_value:
+        read_series<double>(name, matchers, begin, timestamp, added);
+        break;
+      case series_type::size_value:
+        read_series<size_t>(name, matchers, begin, timestamp, added);
+        break;
+      case series_type::timespan:
+        read_series<timespan_t>(name, matchers, begin, timestamp, added);
+        break;
+      case series_type::memory:
+        read_series<memory>(name, matchers, begin, timestamp, added);
+        break;
+      case series_type::rate:
+        read_series<rate>(name, matchers, begin, timestamp, added);
+        break;
+      case series_type::periodic_event:
+        read_series<periodic_event>(name, matchers, begin, timestamp, added);
+        break;
+      case series_type::function_call:
+        read_series<function_call>(name, matchers, begin, timestamp, added);
+        break;
+    }
+    samples_read += added.size();
+    has_read = true;
+    read_until = timestamp;
+
+    // All added samples are newer than the ones in the window
+    as::detail::sort_samples(added);
+    for (auto& s : added) {
+      if (std::isnan(s.second)) continue;
+      samples.push_back(s);
+      sum += s.second;
+      if (track_min) min.push(s);
+      if (track_max) max.push(s);
+      for (auto& quantile : quantiles) quantile.insert(s.second);
+    }
+
+    const auto cutoff = timestamp - span;
+    while (!samples.empty() && samples.front().first <= cutoff) {
+      const auto value = samples.front().second;
+      sum -= value;
+      for (auto& quantile : quantiles) quantile.erase(value);
+      samples.pop_front();
+    }
+    // No drift of the running sum once the window is empty
+    if (samples.empty()) sum = 0.0;
+    min.evict(cutoff);
+    max.evict(cutoff);
+  }
+};
+
+struct as::query::node {
+  enum class kind {
+    constant,
+    function,
+    negate,
+    logical_not,
+    add,
+    subtract,
+    multiply,
+    divide,
+    less,
+    less_equal,
+    greater,
+    greater_equal,
+    logical_and,
+    logical_or
+  };
+
+  enum class function { last, count, sum, avg, min, max, rate, quantile };
+
+  kind op;
+  uint32_t left = 0;
+  uint32_t right = 0;
+  double value = 0.0;
+  function func = function::last;
+  uint32_t window = 0;
+  uint32_t quantile = 0;
+};
+
+/// <summary>
+/// Recursive descent parser that compiles the text into the windows and
+/// nodes of a query. Operands are added before the nodes that use them, so
+/// the root is the last node
+/// </summary>
+class as::query::parser {
+ public:
+  explicit parser(query& query) : _query(query), _text(query._text) {}
+
+  void parse() {
+    parse_or();
+    skip_space();
+    if (_pos != _text.size()) fail("unexpected input");
+  }
+
+ private:
+  using kind = node::kind;
+  using function = node::function;
+
+  [[noreturn]] void fail(const std::string& message) const {
+    throw std::runtime_error{"Invalid query at " + std::to_string(_pos) +
+                             ": " + message};
+  }
+
+  void skip_space() {
+    while (_pos < _text.size() &&
+           std::isspace(static_cast<unsigned char>(_text[_pos])))
+      ++_pos;
+  }
+
+  bool peek(std::string_view token) {
+    skip_space();
+    return _text.compare(_pos, token.size(), token) == 0;
+  }
+
+  bool accept(std::string_view token) {
+    if (!peek(token)) return false;
+    _pos += token.size();
+    return true;
+  }
+
+  void expect(std::string_view token) {
+    if (!accept(token)) fail("expected '" + std::string{token} + "'");
+  }
+
+  bool is_identifier_char(size_t pos, bool first) const {
+    if (pos >= _text.size()) return false;
+    const auto c = static_cast<unsigned char>(_text[pos]);
+    return std::isalpha(c) || c == '_' || (!first && std::isdigit(c));
+  }
+
+  std::string_view identifier() {
+    skip_space();
+    if (!is_identifier_char(_pos, true)) fail("expected an identifier");
+    const auto begin = _pos;
+    while (is_identifier_char(_pos, false)) ++_pos;
+    return std::string_view{_text}.substr(begin, _pos - begin);
+  }
+
+  bool is_number() {
+    skip_space();
+    return _pos < _text.size() &&
+           (std::isdigit(static_cast<unsigned char>(_text[_pos])) ||
+            _text[_pos] == '.');
+  }
+
+  double number() {
+    if (!is_number()) fail("expected a number");
+    // Parsed in the classic locale, as strtod would expect a decimal comma in
+    // e.g. a German locale of the process
+    std::istringstream stream{_text.substr(_pos)};
+    stream.imbue(std::locale::classic());
+    double value = 0.0;
+    stream >> value;
+    if (stream.fail()) fail("expected a number");
+    _pos = stream.eof() ? _text.size()
+                        : _pos + static_cast<size_t>(stream.tellg());
+    return value;
+  }
+
+  std::string_view string_literal() {
+    expect("\"");
+    const auto end = _text.find('"', _pos);
+    if (end == std::string::npos) fail("unterminated string");
+    const auto value = std::string_view{_text}.substr(_pos, end - _pos);
+    _pos = end + 1;
+    return value;
+  }
+
+  timespan_t duration() {
+    const auto value = number();
+    timespan_t ret;
+    if (accept("ms")) {
+      ret = std::chrono::duration_cast<timespan_t>(
+          std::chrono::duration<double, std::milli>(value));
+    } else if (accept("s")) {
+      ret = std::chrono::duration_cast<timespan_t>(
+          std::chrono::duration<double>(value));
+    } else if (accept("m")) {
+      ret = std::chrono::duration_cast<timespan_t>(
+          std::chrono::duration<double, std::ratio<60>>(value));
+    } else if (accept("h")) {
+      ret = std::chrono::duration_cast<timespan_t>(
+          std::chrono::duration<double, std::ratio<3600>>(value));
+    } else {
+      fail("expected a unit of ms, s, m or h");
+    }
+    if (ret <= timespan_t{0}) fail("window must be positive");
+    return ret;
+  }
+
+  uint32_t add_node(node n) {
+    _query._nodes.push_back(n);
+    return static_cast<uint32_t>(_query._nodes.size() - 1);
+  }
+
+  uint32_t add_binary(kind op, uint32_t left, uint32_t right) {
+    node n;
+    n.op = op;
+    n.left = left;
+    n.right = right;
+    return add_node(n);
+  }
+
+  uint32_t parse_or() {
+    auto left = parse_and();
+    while (accept("||")) left = add_binary(kind::logical_or, left, parse_and());
+    return left;
+  }
+
+  uint32_t parse_and() {
+    auto left = parse_comparison();
+    while (accept("&&"))
+      left = add_binary(kind::logical_and, left, parse_comparison());
+    return left;
+  }
+
+  uint32_t parse_comparison() {
+    auto left = parse_sum();
+    if (accept("<=")) return add_binary(kind::less_equal, left, parse_sum());
+    if (accept(">=")) return add_binary(kind::greater_equal, left, parse_sum());
+    if (accept("<")) return add_binary(kind::less, left, parse_sum());
+    if (accept(">")) return add_binary(kind::greater, left, parse_sum());
+    return left;
+  }
+
+  uint32_t parse_sum() {
+    auto left = parse_product();
+    while (true) {
+      if (accept("+")) {
+        left = add_binary(kind::add, left, parse_product());
+      } else if (accept("-")) {
+        left = add_binary(kind::subtract, left, parse_product());
+      } else {
+        return left;
+      }
+    }
+  }
+
+  uint32_t parse_product() {
+    auto left = parse_unary();
+    while (true) {
+      if (accept("*")) {
+        left = add_binary(kind::multiply, left, parse_unary());
+      } else if (accept("/")) {
+        left = add_binary(kind::divide, left, parse_unary());
+      } else {
+        return left;
+      }
+    }
+  }
+
+  uint32_t parse_unary() {
+    if (accept("!")) return add_binary(kind::logical_not, parse_unary(), 0);
+    if (accept("-")) return add_binary(kind::negate, parse_unary(), 0);
+    return parse_primary();
+  }
+
+  uint32_t parse_primary() {
+    if (accept("(")) {
+      const auto ret = parse_or();
+      expect(")");
+      return ret;
+    }
+    if (is_number()) {
+      node n;
+      n.op = kind::constant;
+      n.value = number();
+      return add_node(n);
+    }
+
+    const auto start = _pos;
+    const auto name = identifier();
+    node n;
+    n.op = kind::function;
+    double quantile = 0.0;
+    if (name == "last") {
+      n.func = function::last;
+    } else if (name == "count") {
+      n.func = function::count;
+    } else if (name == "sum") {
+      n.func = function::sum;
+    } else if (name == "avg") {
+      n.func = function::avg;
+    } else if (name == "min") {
+      n.func = function::min;
+    } else if (name == "max") {
+      n.func = function::max;
+    } else if (name == "rate") {
+      n.func = function::rate;
+    } else if (name == "quantile") {
+      n.func = function::quantile;
+    } else if (name == "p50" || name == "p90" || name == "p95" ||
+               name == "p99" || name == "p999") {
+      n.func = function::quantile;
+      const auto digits = name.substr(1);
+      quantile = std::stoi(std::string{digits}) /
+                 std::pow(10.0, static_cast<double>(digits.size()));
+    } else {
+      _pos = start;
+      fail("unknown function '" + std::string{name} + "'");
+    }
+
+    expect("(");
+    if (name == "quantile") {
+      quantile = number();
+      if (!(quantile >= 0.0 && quantile <= 1.0))
+        fail("quantile must be in [0;1]");
+      expect(",");
+    }
+    n.window = parse_selector();
+    expect(")");
+
+    auto& window = *_query._windows[n.window];
+    if (n.func == function::min) window.track_min = true;
+    if (n.func == function::max) window.track_max = true;
+    if (n.func == function::quantile)
+      n.quantile = static_cast<uint32_t>(window.add_quantile(quantile));
+    return add_node(n);
+  }
+
+  uint32_t parse_selector() {
+    const auto type_name = identifier();
+    series_type type;
+    if (type_name == "double") {
+      type = series_type::double_value;
+    } else if (type_name == "size_t") {
+      type = series_type::size_value;
+    } else if (type_name == "timespan" || type_name == "function_timing") {
+      type = series_type::timespan;
+    } else if (type_name == "memory") {
+      type = series_type::memory;
+    } else if (type_name == "rate") {
+      type = series_type::rate;
+    } else if (type_name == "periodic_event") {
+      type = series_type::periodic_event;
+    } else if (type_name == "function_call") {
+      type = series_type::function_call;
+    } else {
+      fail("unknown type '" + std::string{type_name} + "'");
+    }
+
+    expect("{");
+    std::string_view name;
+    std::vector<label_matcher> matchers;
+    do {
+      const auto key = identifier();
+      label_match type;
+      if (accept("=~")) {
+        type = label_match::regex;
+      } else if (accept("!~")) {
+        type = label_match::not_regex;
+      } else if (accept("!=")) {
+        type = label_match::not_equal;
+      } else {
+        expect("=");
+        type = label_match::equal;
+      }
+      const auto value_pos = _pos;
+      const auto value = string_literal();
+      if (key == "name") {
+        if (type != label_match::equal) fail("expected '='");
+        name = intern_name(value);
+        continue;
+      }
+      if (type == label_match::regex || type == label_match::not_regex) {
+        try {
+          std::regex{std::string{value}};
+        } catch (const std::regex_error&) {
+          _pos = value_pos;
+          fail("invalid regular expression");
+        }
+      }
+      matchers.push_back(
+          label_matcher{std::string{key}, type, std::string{value}});
+    } while (accept(","));
+    if (name.empty() && peek("}")) fail("expected the label 'name'");
+    expect("}");
+    expect("[");
+    const auto span = duration();
+    expect("]");
+
+    // Selectors of the same series and window share their state
+    auto& windows = _query._windows;
+    for (size_t idx = 0; idx < windows.size(); ++idx) {
+      const auto& w = *windows[idx];
+      if (w.type == type && w.name == name && w.matchers == matchers &&
+          w.span == span)
+        return static_cast<uint32_t>(idx);
+    }
+    auto w = std::make_unique<window>();
+    w->type = type;
+    w->name = name;
+    w->matchers = std::move(matchers);
+    w->span = span;
+    windows.push_back(std::move(w));
+    return static_cast<uint32_t>(windows.size() - 1);
+  }
+
+  query& _query;
+  const std::string& _text;
+  size_t _pos = 0;
+};
+
+as::query::query(std::string_view text) : _text(text), _samples_read(0) {
+  parser{*this}.parse();
+  _values.assign(_nodes.size(), not_a_number);
+}
+
+as::query::~query() = default;
+
+double as::query::evaluate(timestamp_t timestamp) {
+  for (auto& w : _windows) w->update(timestamp, _samples_read);
+
+  using kind = node::kind;
+  using function = node::function;
+  for (size_t idx = 0; idx < _nodes.size(); ++idx) {
+    const auto& node = _nodes[idx];
+    const auto l = _values[node.left];
+    const auto r = _values[node.right];
+    auto& value = _values[idx];
+    switch (node.op) {
+      case kind::constant:
+        value = node.value;
+        break;
+      case kind::function: {
+        const auto& w = *_windows[node.window];
+        const auto count = static_cast<double>(w.samples.size());
+        const auto empty = w.samples.empty();
+        switch (node.func) {
+          case function::last:
+            value = empty ? not_a_number : w.samples.back().second;
+            break;
+          case function::count:
+            value = count;
+            break;
+          case function::sum:
+            value = empty ? not_a_number : w.sum;
+            break;
+          case function::avg:
+            value = empty ? not_a_number : w.sum / count;
+            break;
+          case function::min:
+            value = w.min.get_value();
+            break;
+          case function::max:
+            value = w.max.get_value();
+            break;
+          case function::rate:
+            value = count / std::chrono::duration<double>(w.span).count();
+            break;
+          case function::quantile:
+            value = w.quantiles[node.quantile].get_value();
+            break;
+        }
+        break;
+      }
+      case kind::negate:
+        value = -l;
+        break;
+      case kind::logical_not:
+        value = !is_true(l);
+        break;
+      case kind::add:
+        value = l + r;
+        break;
+      case kind::subtract:
+        value = l - r;
+        break;
+      case kind::multiply:
+        value = l * r;
+        break;
+      case kind::divide:
+        value = r != 0.0 ? l / r : not_a_number;
+        break;
+      // Comparisons involving NaN are false
+      case kind::less:
+        value = l < r;
+        break;
+      case kind::less_equal:
+        value = l <= r;
+        break;
+      case kind::greater:
+        value = l > r;
+        break;
+      case kind::greater_equal:
+        value = l >= r;
+        break;
+      case kind::logical_and:
+        value = is_true(l) && is_true(r);
+        break;
+      case kind::logical_or:
+        value = is_true(l) || is_true(r);
+        break;
+    }
+  }
+  return _values.back();
+}
+
+const std::string& as::query::get_text() const { return _text; }
+
+size_t as::query::get_window_count() const { return _windows.size(); }
+
+uint64_t as::query::get_samples_read() const { return _samples_read; }
+
+#pragma endregion
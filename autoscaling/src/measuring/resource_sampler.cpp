@@ -0,0 +1,306 @@
+#include "measuring/resource_sampler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#pragma region proc_parsing
+
+namespace {
+
+/// <summary>
+/// Size of the buffer that the /proc files are read into. /proc/self/status is
+/// the largest of them with usually about 1.5KiB
+/// </summary>
+constexpr size_t proc_buffer_size = 4096;
+
+#ifdef __linux__
+
+/// <summary>
+/// Reads the whole file into the given buffer and null-terminates it. /proc
+/// files regenerate their content when read from offset zero, so the file
+/// descriptor can be reused for every sample
+/// </summary>
+bool read_proc_file(int fd, char* buffer, size_t buffer_size) {
+  if (fd < 0) return false;
+  const auto bytes = pread(fd, buffer, buffer_size - 1, 0);
+  if (bytes <= 0) return false;
+  buffer[bytes] = '\0';
+  return true;
+}
+
+/// <summary>
+/// Returns the value of a 'key: value' line, e.g. 'VmHWM:   1234 kB'
+/// </summary>
+bool find_value(const char* content, const char* key, uint64_t& value) {
+  const auto* line = strstr(content, key);
+  if (!line) return false;
+  value = strtoull(line + strlen(key), nullptr, 10);
+  return true;
+}
+
+/// <summary>
+/// Parses the fields of /proc/self/stat that we are interested in. The second
+/// field is the executable name in parentheses, which may contain spaces, so
+/// the remaining fields are counted from the last closing parenthesis
+/// </summary>
+bool parse_stat(const char* content, long clock_ticks_per_second,
+                as::process_resource_usage& usage) {
+  const auto* fields = strrchr(content, ')');
+  if (!fields) return false;
+  ++fields;
+
+  uint64_t user_ticks = 0, system_ticks = 0;
+  // The first field after the parenthesis is the third field of the file
+  int field_idx = 3;
+  const char* pos = fields;
+  while (*pos && field_idx <= 20) {
+    while (*pos == ' ') ++pos;
+    if (!*pos) break;
+
+    switch (field_idx) {
+      case 12:
+        usage.major_faults = strtoull(pos, nullptr, 10);
+        break;
+      case 14:
+        user_ticks = strtoull(pos, nullptr, 10);
+        break;
+      case 15:
+        system_ticks = strtoull(pos, nullptr, 10);
+        break;
+      case 20:
+        usage.threads = static_cast<size_t>(strtoull(pos, nullptr, 10));
+        break;
+      default:
+        break;
+    }
+
+    while (*pos && *pos != ' ') ++pos;
+    ++field_idx;
+  }
+  if (field_idx <= 20) return false;
+
+  const auto ticks = user_ticks + system_ticks;
+  usage.cpu_time = std::chrono::duration_cast<as::timespan_t>(
+      std::chrono::duration<double>(static_cast<double>(ticks) /
+                                    clock_ticks_per_second));
+  return true;
+}
+
+bool parse_statm(const char* content, size_t page_size,
+                 as::process_resource_usage& usage) {
+  char* end = nullptr;
+  const auto size_pages = strtoull(content, &end, 10);
+  if (end == content) return false;
+  const auto resident_pages = strtoull(end, nullptr, 10);
+  usage.virtual_memory = as::memory{size_pages * page_size};
+  usage.rss = as::memory{resident_pages * page_size};
+  return true;
+}
+
+/// <summary>
+/// Counts the entries of the already opened /proc/self/fd directory. Uses
+/// getdents64 directly because readdir allocates its buffer
+/// </summary>
+bool count_open_fds(int dir_fd, size_t& count) {
+  if (lseek(dir_fd, 0, SEEK_SET) != 0) return false;
+
+  struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+  };
+
+  alignas(8) char buffer[proc_buffer_size];
+  count = 0;
+  for (;;) {
+    const auto bytes = syscall(SYS_getdents64, dir_fd, buffer, sizeof(buffer));
+    if (bytes < 0) return false;
+    if (bytes == 0) break;
+
+    for (long offset = 0; offset < bytes;) {
+      const auto* entry =
+          reinterpret_cast<const linux_dirent64*>(buffer + offset);
+      if (entry->d_name[0] != '.') ++count;
+      offset += entry->d_reclen;
+    }
+  }
+  // Don't count the descriptor of the directory itself
+  if (count) --count;
+  return true;
+}
+
+int open_proc_file(const char* path) {
+  return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+void close_proc_file(int fd) {
+  if (fd >= 0) close(fd);
+}
+
+#endif
+
+}  // namespace
+
+#pragma endregion
+
+#pragma region resource_sampler
+
+bool as::resource_sampler::is_supported() {
+#ifdef __linux__
+  return true;
+#else
+  return false;
+#endif
+}
+
+as::resource_sampler::resource_sampler(resource_sampler_options options)
+    : _options(options),
+      _stat_fd(-1),
+      _statm_fd(-1),
+      _status_fd(-1),
+      _io_fd(-1),
+      _fd_dir_fd(-1),
+      _clock_ticks_per_second(100),
+      _page_size(4096),
+      _has_previous_usage(false),
+      _stop(false) {
+#ifdef __linux__
+  _stat_fd = open_proc_file("/proc/self/stat");
+  _statm_fd = open_proc_file("/proc/self/statm");
+  _status_fd = open_proc_file("/proc/self/status");
+  _io_fd = open_proc_file("/proc/self/io");
+  _fd_dir_fd = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  _clock_ticks_per_second = sysconf(_SC_CLK_TCK);
+  _page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+  if (_stat_fd < 0 || _statm_fd < 0) {
+    close_proc_file(_stat_fd);
+    close_proc_file(_statm_fd);
+    close_proc_file(_status_fd);
+    close_proc_file(_io_fd);
+    close_proc_file(_fd_dir_fd);
+    throw std::runtime_error{"Could not open /proc/self!"};
+  }
+#else
+  throw std::runtime_error{
+      "Resource sampling is not supported on this platform!"};
+#endif
+
+  sample();
+  _thread = std::thread{[this]() { run(); }};
+}
+
+as::resource_sampler::~resource_sampler() {
+  {
+    std::lock_guard<std::mutex> guard{_stop_lock};
+    _stop = true;
+  }
+  _stop_signal.notify_one();
+  _thread.join();
+
+#ifdef __linux__
+  close_proc_file(_stat_fd);
+  close_proc_file(_statm_fd);
+  close_proc_file(_status_fd);
+  close_proc_file(_io_fd);
+  close_proc_file(_fd_dir_fd);
+#endif
+}
+
+bool as::resource_sampler::read_usage(process_resource_usage& usage) {
+#ifdef __linux__
+  char buffer[proc_buffer_size];
+  usage.timestamp = now();
+
+  if (!read_proc_file(_stat_fd, buffer, sizeof(buffer)) ||
+      !parse_stat(buffer, _clock_ticks_per_second, usage))
+    return false;
+  if (!read_proc_file(_statm_fd, buffer, sizeof(buffer)) ||
+      !parse_statm(buffer, _page_size, usage))
+    return false;
+
+  uint64_t value = 0;
+  if (read_proc_file(_status_fd, buffer, sizeof(buffer)) &&
+      find_value(buffer, "VmHWM:", value)) {
+    usage.peak_rss = memory{value * 1024};
+  }
+
+  uint64_t read_bytes = 0, write_bytes = 0;
+  usage.has_io = read_proc_file(_io_fd, buffer, sizeof(buffer)) &&
+                 find_value(buffer, "\nread_bytes:", read_bytes) &&
+                 find_value(buffer, "\nwrite_bytes:", write_bytes);
+  usage.io_read_bytes = read_bytes;
+  usage.io_write_bytes = write_bytes;
+
+  if (_fd_dir_fd >= 0) count_open_fds(_fd_dir_fd, usage.open_fds);
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool as::resource_sampler::sample() {
+  std::lock_guard<std::mutex> guard{_sample_lock};
+
+  process_resource_usage usage;
+  if (!read_usage(usage)) return false;
+
+  add_measurement<memory>(process_rss_name, usage.rss);
+  add_measurement<memory>(process_peak_rss_name, usage.peak_rss);
+  add_measurement<memory>(process_virtual_memory_name, usage.virtual_memory);
+  add_measurement<size_t>(process_threads_name, usage.threads);
+  add_measurement<size_t>(process_open_fds_name, usage.open_fds);
+
+  if (_has_previous_usage) {
+    const auto elapsed = usage.timestamp - _previous_usage.timestamp;
+    const auto cpu_seconds = std::chrono::duration<double>(
+        usage.cpu_time - _previous_usage.cpu_time);
+    add_measurement<rate>(process_cpu_usage_name,
+                          rate::from_delta(cpu_seconds.count(), elapsed));
+    add_measurement<rate>(
+        process_major_fault_rate_name,
+        rate::from_delta(static_cast<double>(usage.major_faults -
+                                             _previous_usage.major_faults),
+                         elapsed));
+    if (usage.has_io && _previous_usage.has_io) {
+      add_measurement<rate>(
+          process_io_read_rate_name,
+          rate::from_delta(static_cast<double>(usage.io_read_bytes -
+                                               _previous_usage.io_read_bytes),
+                           elapsed));
+      add_measurement<rate>(
+          process_io_write_rate_name,
+          rate::from_delta(static_cast<double>(usage.io_write_bytes -
+                                               _previous_usage.io_write_bytes),
+                           elapsed));
+    }
+  }
+
+  _previous_usage = usage;
+  _has_previous_usage = true;
+  return true;
+}
+
+void as::resource_sampler::run() {
+  std::unique_lock<std::mutex> lock{_stop_lock};
+  while (!_stop) {
+    _stop_signal.wait_for(lock, _options.interval);
+    if (_stop) break;
+
+    lock.unlock();
+    sample();
+    lock.lock();
+  }
+}
+
+#pragma endregion
@@ -0,0 +1,388 @@
+#include "measuring/sampling_profiler.h"
+
+#include "util/ring_buffer.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <cstdlib>
+#endif
+
+#pragma region profiled_thread
+
+namespace as {
+namespace detail {
+
+struct raw_stack_sample {
+  // CLOCK_MONOTONIC, mapped to the clock of as::now when collected
+  int64_t monotonic_ns;
+  stack_sample sample;
+};
+
+struct profiled_thread {
+  explicit profiled_thread(size_t buffer_capacity)
+      : thread_id(std::this_thread::get_id()),
+        thread_index(get_thread_index()),
+        samples(buffer_capacity) {}
+
+  const thread_id_t thread_id;
+  const uint32_t thread_index;
+  spsc_ring_buffer<raw_stack_sample> samples;
+  // Only written from the signal handler of the owning thread
+  std::atomic<uint64_t> dropped_samples{0};
+  std::atomic<bool> unregistered{false};
+  // Whoever resets this flag deletes the timer, either the thread itself or
+  // the profiler when it is destroyed
+  std::atomic<bool> timer_armed{false};
+
+  uintptr_t stack_begin = 0;
+  uintptr_t stack_end = 0;
+#ifdef __linux__
+  timer_t timer{};
+#endif
+};
+
+}  // namespace detail
+}  // namespace as
+
+namespace {
+
+std::atomic<bool> s_profiler_running{false};
+
+#ifdef __linux__
+
+std::atomic<bool> s_sampling_enabled{false};
+std::atomic<uint32_t> s_handlers_in_flight{0};
+std::atomic<uint64_t> s_profiler_generation{0};
+bool s_handler_installed = false;
+
+// Set by register_this_thread on the owning thread before its timer is armed,
+// so the signal handler never triggers the lazy allocation of thread-local
+// storage. The pointer is only valid if the generation matches the running
+// profiler, threads that never unregistered keep a stale pointer otherwise
+thread_local as::detail::profiled_thread* t_profiled_thread = nullptr;
+thread_local uint64_t t_profiled_thread_generation = 0;
+
+as::detail::profiled_thread* get_this_profiled_thread() {
+  if (t_profiled_thread_generation !=
+      s_profiler_generation.load(std::memory_order_acquire))
+    return nullptr;
+  return t_profiled_thread;
+}
+
+/// <summary>
+/// Reads CLOCK_MONOTONIC directly, unlike as::now this never reaches a clock
+/// source that locks, so it is async-signal-safe
+/// </summary>
+int64_t get_monotonic_ns() {
+  timespec time{};
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+void delete_timer(as::detail::profiled_thread& thread) {
+  if (thread.timer_armed.exchange(false)) timer_delete(thread.timer);
+}
+
+/// <summary>
+/// Captures the call stack of the interrupted code by following the chain of
+/// saved frame pointers. Every frame pointer is checked against the bounds of
+/// the thread's stack before it is dereferenced, so a corrupted or missing
+/// chain ends the walk instead of crashing
+/// </summary>
+void walk_stack(const ucontext_t& context, uintptr_t stack_begin,
+                uintptr_t stack_end, as::stack_sample& sample) {
+  uintptr_t pc = 0;
+  uintptr_t fp = 0;
+#if defined(__x86_64__)
+  pc = static_cast<uintptr_t>(context.uc_mcontext.gregs[REG_RIP]);
+  fp = static_cast<uintptr_t>(context.uc_mcontext.gregs[REG_RBP]);
+#elif defined(__aarch64__)
+  pc = static_cast<uintptr_t>(context.uc_mcontext.pc);
+  fp = static_cast<uintptr_t>(context.uc_mcontext.regs[29]);
+#endif
+
+  sample.depth = 0;
+  if (!pc) return;
+  sample.frames[sample.depth++] = pc;
+
+  while (sample.depth < as::stack_sample::max_depth) {
+    if (fp < stack_begin || fp + 2 * sizeof(uintptr_t) > stack_end ||
+        fp % sizeof(uintptr_t) != 0)
+      break;
+
+    const auto* frame = reinterpret_cast<const uintptr_t*>(fp);
+    const auto next_fp = frame[0];
+    const auto return_address = frame[1];
+    if (!return_address) break;
+
+    sample.frames[sample.depth++] = return_address;
+    // The stack grows downwards, so the caller's frame must be above
+    if (next_fp <= fp) break;
+    fp = next_fp;
+  }
+}
+
+void handle_sigprof(int, siginfo_t*, void* context) {
+  // Only async-signal-safe operations from here on: no locks, no allocations
+  const auto saved_errno = errno;
+  s_handlers_in_flight.fetch_add(1, std::memory_order_acquire);
+
+  auto* thread = get_this_profiled_thread();
+  if (s_sampling_enabled.load(std::memory_order_acquire) && thread) {
+    as::detail::raw_stack_sample raw_sample;
+    raw_sample.monotonic_ns = get_monotonic_ns();
+    raw_sample.sample.thread_index = thread->thread_index;
+    walk_stack(*static_cast<ucontext_t*>(context), thread->stack_begin,
+               thread->stack_end, raw_sample.sample);
+
+    if (!thread->samples.try_push(raw_sample)) {
+      thread->dropped_samples.store(
+          thread->dropped_samples.load(std::memory_order_relaxed) + 1,
+          std::memory_order_relaxed);
+    }
+  }
+
+  s_handlers_in_flight.fetch_sub(1, std::memory_order_release);
+  errno = saved_errno;
+}
+
+void install_sigprof_handler() {
+  if (s_handler_installed) return;
+
+  struct sigaction action = {};
+  action.sa_sigaction = &handle_sigprof;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, nullptr) != 0)
+    throw std::runtime_error{"Could not install SIGPROF handler!"};
+  s_handler_installed = true;
+}
+
+void get_stack_bounds(uintptr_t& begin, uintptr_t& end) {
+  pthread_attr_t attributes;
+  if (pthread_getattr_np(pthread_self(), &attributes) != 0) return;
+
+  void* stack_address = nullptr;
+  size_t stack_size = 0;
+  if (pthread_attr_getstack(&attributes, &stack_address, &stack_size) == 0) {
+    begin = reinterpret_cast<uintptr_t>(stack_address);
+    end = begin + stack_size;
+  }
+  pthread_attr_destroy(&attributes);
+}
+
+#endif
+
+}  // namespace
+
+std::string as::get_symbol_name(uintptr_t address) {
+#ifdef __linux__
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void*>(address), &info) && info.dli_sname) {
+    int status = 0;
+    char* demangled =
+        abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    if (status == 0 && demangled) {
+      std::string ret{demangled};
+      free(demangled);
+      return ret;
+    }
+    return info.dli_sname;
+  }
+#endif
+  char buffer[2 + 2 * sizeof(uintptr_t) + 1];
+  snprintf(buffer, sizeof(buffer), "0x%llx",
+           static_cast<unsigned long long>(address));
+  return buffer;
+}
+
+#pragma endregion
+
+#pragma region sampling_profiler
+
+bool as::sampling_profiler::is_supported() {
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+  return true;
+#else
+  return false;
+#endif
+}
+
+as::sampling_profiler::sampling_profiler(sampling_profiler_options options)
+    : _options(options), _dropped_samples_of_removed_threads(0), _stop(false) {
+  if (!is_supported())
+    throw std::runtime_error{
+        "Sampling profiler is not supported on this platform!"};
+  if (_options.frequency_hz == 0)
+    throw std::runtime_error{"Sampling frequency must not be zero!"};
+
+  bool expected = false;
+  if (!s_profiler_running.compare_exchange_strong(expected, true))
+    throw std::runtime_error{"Another sampling profiler is already running!"};
+
+#ifdef __linux__
+  try {
+    install_sigprof_handler();
+  } catch (...) {
+    s_profiler_running = false;
+    throw;
+  }
+  ++s_profiler_generation;
+  s_sampling_enabled = true;
+#endif
+
+  measure_for_each_thread<stack_sample>(sampled_stacks_name);
+  set_cache_size<stack_sample>(sampled_stacks_name,
+                               _options.max_stored_samples_per_thread);
+  _thread = std::thread{[this]() { run(); }};
+}
+
+as::sampling_profiler::~sampling_profiler() {
+#ifdef __linux__
+  {
+    std::lock_guard<std::mutex> guard{_threads_lock};
+    for (auto& thread : _threads) delete_timer(*thread);
+  }
+  // Signals might still be pending after the timers are deleted, wait for all
+  // handlers that already started before freeing the buffers
+  s_sampling_enabled = false;
+  while (s_handlers_in_flight.load(std::memory_order_acquire) != 0) {
+    std::this_thread::yield();
+  }
+#endif
+
+  {
+    std::lock_guard<std::mutex> guard{_stop_lock};
+    _stop = true;
+  }
+  _stop_signal.notify_one();
+  _thread.join();
+
+  collect();
+  s_profiler_running = false;
+}
+
+void as::sampling_profiler::register_this_thread() {
+#ifdef __linux__
+  if (get_this_profiled_thread())
+    throw std::runtime_error{"Thread is already registered!"};
+
+  auto thread = std::make_shared<detail::profiled_thread>(
+      _options.buffer_capacity_per_thread);
+  get_stack_bounds(thread->stack_begin, thread->stack_end);
+
+  struct sigevent event = {};
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGPROF;
+  event._sigev_un._tid = static_cast<pid_t>(syscall(SYS_gettid));
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &thread->timer) != 0)
+    throw std::runtime_error{"Could not create sampling timer!"};
+  thread->timer_armed = true;
+
+  {
+    std::lock_guard<std::mutex> guard{_threads_lock};
+    _threads.push_back(thread);
+  }
+  t_profiled_thread = thread.get();
+  t_profiled_thread_generation = s_profiler_generation.load();
+
+  const auto period_ns = 1000000000ll / _options.frequency_hz;
+  struct itimerspec spec = {};
+  spec.it_interval.tv_sec = period_ns / 1000000000ll;
+  spec.it_interval.tv_nsec = period_ns % 1000000000ll;
+  spec.it_value = spec.it_interval;
+  if (timer_settime(thread->timer, 0, &spec, nullptr) != 0) {
+    unregister_this_thread();
+    throw std::runtime_error{"Could not start sampling timer!"};
+  }
+#endif
+}
+
+void as::sampling_profiler::unregister_this_thread() {
+#ifdef __linux__
+  auto* thread = get_this_profiled_thread();
+  if (!thread) return;
+
+  delete_timer(*thread);
+  // A signal that is still pending sees the null pointer and does nothing
+  t_profiled_thread = nullptr;
+  thread->unregistered = true;
+#endif
+}
+
+void as::sampling_profiler::collect() {
+  std::lock_guard<std::mutex> collect_guard{_collect_lock};
+
+  std::vector<std::shared_ptr<detail::profiled_thread>> threads;
+  {
+    std::lock_guard<std::mutex> guard{_threads_lock};
+    threads = _threads;
+  }
+
+#ifdef __linux__
+  // Samples are timestamped in the signal handler, where as::now can't be
+  // called, so they are shifted onto its clock here
+  const auto offset = now() - timestamp_t{timespan_t{get_monotonic_ns()}};
+#else
+  const timespan_t offset{0};
+#endif
+  auto& storage = detail::get_measurement_storage<stack_sample>();
+  for (auto& thread : threads) {
+    thread->samples.consume_all(
+        [&storage, &thread,
+         offset](const detail::raw_stack_sample& raw_sample) {
+          const auto timestamp =
+              timestamp_t{timespan_t{raw_sample.monotonic_ns}} + offset;
+          storage.add_measurement(
+              measurement<stack_sample>{timestamp, raw_sample.sample},
+              sampled_stacks_name, thread->thread_id);
+        });
+  }
+
+  // Unregistered threads no longer produce samples, so their buffers can go
+  // once they are drained
+  std::lock_guard<std::mutex> guard{_threads_lock};
+  auto iter = std::remove_if(_threads.begin(), _threads.end(),
+                             [this](const auto& thread) {
+                               if (!thread->unregistered ||
+                                   !thread->samples.empty())
+                                 return false;
+                               _dropped_samples_of_removed_threads +=
+                                   thread->dropped_samples;
+                               return true;
+                             });
+  _threads.erase(iter, _threads.end());
+}
+
+uint64_t as::sampling_profiler::get_dropped_sample_count() const {
+  std::lock_guard<std::mutex> guard{_threads_lock};
+  auto ret = _dropped_samples_of_removed_threads;
+  for (auto& thread : _threads) ret += thread->dropped_samples;
+  return ret;
+}
+
+void as::sampling_profiler::run() {
+  std::unique_lock<std::mutex> lock{_stop_lock};
+  while (!_stop) {
+    _stop_signal.wait_for(lock, _options.collect_interval);
+    if (_stop) break;
+
+    lock.unlock();
+    collect();
+    lock.lock();
+  }
+}
+
+#pragma endregion
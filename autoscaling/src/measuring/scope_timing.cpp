@@ -0,0 +1,467 @@
+#include "measuring/scope_timing.h"
+#include "measuring/trace.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#pragma region thread_call_tree
+
+namespace as {
+namespace detail {
+
+/// <summary>
+/// Maximum nesting depth of timed scopes. Scopes nested deeper than this are
+/// not recorded
+/// </summary>
+constexpr size_t max_scope_depth = 256;
+
+/// <summary>
+/// Live node of a call tree. Nodes are only ever created and written by the
+/// thread that owns the tree, other threads only read them. Children are kept
+/// in an intrusive singly linked list that is published with release
+/// semantics, so readers can traverse the tree without locking
+/// </summary>
+struct scope_node {
+  explicit scope_node(const char* name) : name(name) {}
+
+  const char* name;
+  std::atomic<scope_node*> first_child{nullptr};
+  std::atomic<scope_node*> next_sibling{nullptr};
+
+  // The sketch also tracks the number of invocations and the total time
+  timing_sketch total_time_sketch;
+  std::atomic<uint64_t> self_ns{0};
+
+  // Set at most once, under the lock of the call tree registry, by the owning
+  // thread or by keep_exemplars
+  std::atomic<top_exemplars*> exemplars{nullptr};
+  std::unique_ptr<top_exemplars> exemplars_storage;
+};
+
+struct scope_frame {
+  scope_node* node;
+  timestamp_t start_time;
+  uint64_t child_ns;
+};
+
+struct thread_call_tree {
+  thread_call_tree()
+      : thread_id(std::this_thread::get_id()),
+        thread_index(get_thread_index()),
+        root("") {}
+
+  const thread_id_t thread_id;
+  const uint32_t thread_index;
+  scope_node root;
+  // std::deque never relocates its elements on emplace_back, so pointers to
+  // nodes stay valid while the tree grows
+  std::deque<scope_node> nodes;
+
+  std::array<scope_frame, max_scope_depth> stack;
+  size_t depth = 0;
+
+  // Incremented by clear_call_trees. Only the owning thread writes to the
+  // nodes, so it clears them itself when it exits its next scope and then
+  // publishes the generation it cleared. Until then readers treat the tree
+  // as empty
+  std::atomic<uint64_t> clear_generation{0};
+  std::atomic<uint64_t> cleared_generation{0};
+};
+
+}  // namespace detail
+}  // namespace as
+
+namespace {
+
+struct exemplar_options {
+  size_t count;
+  as::timespan_t window;
+};
+
+struct call_tree_registry {
+  std::mutex lock;
+  std::vector<std::shared_ptr<as::detail::thread_call_tree>> trees;
+  // Merged trees of exited threads, so threads that come and go don't keep
+  // their trees alive
+  as::call_tree_node retired;
+  // Scope names for which exemplars are kept
+  std::unordered_map<std::string, exemplar_options> exemplars;
+};
+
+call_tree_registry& get_call_tree_registry() {
+  static call_tree_registry s_registry;
+  return s_registry;
+}
+
+thread_local uint64_t t_request_id = 0;
+
+using function_exemplar_map =
+    std::unordered_map<std::string_view, std::shared_ptr<as::top_exemplars>>;
+
+std::atomic<bool> s_has_function_exemplars{false};
+// Only accessed through std::atomic_load and std::atomic_store. Replaced as a
+// whole by keep_exemplars, so function timings can read it without locking
+std::shared_ptr<const function_exemplar_map> s_function_exemplars;
+
+/// <summary>
+/// Starts keeping exemplars for the node if it was registered with
+/// keep_exemplars. Must be called with the registry lock held
+/// </summary>
+void apply_exemplar_options(const call_tree_registry& registry,
+                            as::detail::scope_node& node) {
+  if (node.exemplars.load(std::memory_order_relaxed)) return;
+  const auto options = registry.exemplars.find(node.name);
+  if (options == registry.exemplars.end()) return;
+
+  node.exemplars_storage = std::make_unique<as::top_exemplars>(
+      options->second.count, options->second.window);
+  node.exemplars.store(node.exemplars_storage.get(),
+                       std::memory_order_release);
+}
+
+void apply_exemplar_options_recursively(const call_tree_registry& registry,
+                                        as::detail::scope_node& node) {
+  apply_exemplar_options(registry, node);
+  for (auto* child = node.first_child.load(std::memory_order_acquire); child;
+       child = child->next_sibling.load(std::memory_order_acquire)) {
+    apply_exemplar_options_recursively(registry, *child);
+  }
+}
+
+as::detail::scope_node* find_or_create_child(
+    as::detail::thread_call_tree& tree, as::detail::scope_node& parent,
+    const char* name) {
+  auto* const first_child = parent.first_child.load(std::memory_order_relaxed);
+  // Names are usually string literals, so comparing pointers is enough in the
+  // common case. The same name might still live at different addresses, e.g.
+  // when it is used from multiple translation units
+  for (auto* child = first_child; child;
+       child = child->next_sibling.load(std::memory_order_relaxed)) {
+    if (child->name == name) return child;
+  }
+  for (auto* child = first_child; child;
+       child = child->next_sibling.load(std::memory_order_relaxed)) {
+    if (std::strcmp(child->name, name) == 0) return child;
+  }
+
+  auto& node = tree.nodes.emplace_back(name);
+  {
+    auto& registry = get_call_tree_registry();
+    std::lock_guard<std::mutex> guard{registry.lock};
+    apply_exemplar_options(registry, node);
+  }
+  node.next_sibling.store(first_child, std::memory_order_relaxed);
+  parent.first_child.store(&node, std::memory_order_release);
+  return &node;
+}
+
+bool snapshot_node(const as::detail::scope_node& node,
+                   as::call_tree_node& snapshot) {
+  snapshot.name = node.name;
+  snapshot.total_time_sketch = node.total_time_sketch;
+  snapshot.count = snapshot.total_time_sketch.count();
+  snapshot.total_time = snapshot.total_time_sketch.sum();
+  snapshot.self_time = as::timespan_t{
+      static_cast<int64_t>(node.self_ns.load(std::memory_order_relaxed))};
+  if (auto* exemplars = node.exemplars.load(std::memory_order_acquire))
+    snapshot.exemplars = exemplars->get_exemplars();
+
+  for (auto* child = node.first_child.load(std::memory_order_acquire); child;
+       child = child->next_sibling.load(std::memory_order_acquire)) {
+    as::call_tree_node child_snapshot;
+    if (snapshot_node(*child, child_snapshot))
+      snapshot.children.push_back(std::move(child_snapshot));
+  }
+  // Children are prepended on creation, restore the order in which they were
+  // first entered
+  std::reverse(snapshot.children.begin(), snapshot.children.end());
+
+  return snapshot.count || !snapshot.children.empty();
+}
+
+void clear_node(as::detail::scope_node& node) {
+  node.total_time_sketch.clear();
+  node.self_ns.store(0, std::memory_order_relaxed);
+  if (auto* exemplars = node.exemplars.load(std::memory_order_acquire))
+    exemplars->clear();
+  for (auto* child = node.first_child.load(std::memory_order_acquire); child;
+       child = child->next_sibling.load(std::memory_order_acquire)) {
+    clear_node(*child);
+  }
+}
+
+/// <summary>
+/// Applies a pending clear_call_trees, must only be called by the owning
+/// thread of the tree
+/// </summary>
+void apply_pending_clear(as::detail::thread_call_tree& tree) {
+  const auto generation =
+      tree.clear_generation.load(std::memory_order_acquire);
+  if (generation == tree.cleared_generation.load(std::memory_order_relaxed))
+    return;
+  clear_node(tree.root);
+  tree.cleared_generation.store(generation, std::memory_order_release);
+}
+
+void merge_node(const as::call_tree_node& source, as::call_tree_node& target) {
+  target.count += source.count;
+  target.total_time += source.total_time;
+  target.self_time += source.self_time;
+  target.total_time_sketch.merge(source.total_time_sketch);
+  if (!source.exemplars.empty()) {
+    const auto count = std::max(target.exemplars.size(),
+                                source.exemplars.size());
+    target.exemplars.insert(target.exemplars.end(), source.exemplars.begin(),
+                            source.exemplars.end());
+    std::sort(target.exemplars.begin(), target.exemplars.end(),
+              as::is_slower);
+    target.exemplars.resize(count);
+  }
+
+  for (auto& source_child : source.children) {
+    auto target_child =
+        std::find_if(target.children.begin(), target.children.end(),
+                     [&source_child](const as::call_tree_node& child) {
+                       return child.name == source_child.name;
+                     });
+    if (target_child == target.children.end()) {
+      target.children.emplace_back();
+      target_child = target.children.end() - 1;
+      target_child->name = source_child.name;
+    }
+    merge_node(source_child, *target_child);
+  }
+}
+
+thread_local as::detail::thread_call_tree* t_tree = nullptr;
+thread_local bool t_tree_released = false;
+
+/// <summary>
+/// Merges the call tree of a thread into the retired tree once the thread
+/// exits and removes it from the registry
+/// </summary>
+struct thread_call_tree_owner {
+  std::shared_ptr<as::detail::thread_call_tree> tree;
+
+  ~thread_call_tree_owner() {
+    t_tree = nullptr;
+    t_tree_released = true;
+    if (!tree) return;
+
+    // Under the lock, so that clear_call_trees either clears the tree before
+    // it is merged or the retired tree after it was merged
+    auto& registry = get_call_tree_registry();
+    std::lock_guard<std::mutex> guard{registry.lock};
+    apply_pending_clear(*tree);
+    as::call_tree_node snapshot;
+    if (snapshot_node(tree->root, snapshot))
+      merge_node(snapshot, registry.retired);
+    registry.trees.erase(
+        std::remove(registry.trees.begin(), registry.trees.end(), tree),
+        registry.trees.end());
+  }
+};
+
+/// <summary>
+/// Returns the call tree of the calling thread, or nullptr if the thread is
+/// exiting and already retired its tree
+/// </summary>
+as::detail::thread_call_tree* get_this_thread_call_tree() {
+  if (t_tree) return t_tree;
+  if (t_tree_released) return nullptr;
+
+  thread_local thread_call_tree_owner t_owner;
+  t_owner.tree = std::make_shared<as::detail::thread_call_tree>();
+  {
+    auto& registry = get_call_tree_registry();
+    std::lock_guard<std::mutex> guard{registry.lock};
+    registry.trees.push_back(t_owner.tree);
+  }
+  t_tree = t_owner.tree.get();
+  return t_tree;
+}
+
+std::vector<std::shared_ptr<as::detail::thread_call_tree>>
+get_copy_of_call_trees() {
+  auto& registry = get_call_tree_registry();
+  std::lock_guard<std::mutex> guard{registry.lock};
+  return registry.trees;
+}
+
+}  // namespace
+
+std::vector<as::call_tree> as::get_call_trees() {
+  std::vector<call_tree> ret;
+  for (auto& tree : get_copy_of_call_trees()) {
+    call_tree snapshot;
+    snapshot.thread_id = tree->thread_id;
+    snapshot.thread_index = tree->thread_index;
+    const auto generation =
+        tree->clear_generation.load(std::memory_order_acquire);
+    // Otherwise the owning thread didn't yet apply the last clear
+    if (tree->cleared_generation.load(std::memory_order_acquire) == generation)
+      snapshot_node(tree->root, snapshot.root);
+    for (auto& child : snapshot.root.children) {
+      snapshot.root.total_time += child.total_time;
+    }
+    ret.push_back(std::move(snapshot));
+  }
+
+  call_tree retired;
+  retired.thread_id = thread_id_all_threads;
+  retired.exited_threads = true;
+  {
+    auto& registry = get_call_tree_registry();
+    std::lock_guard<std::mutex> guard{registry.lock};
+    retired.root = registry.retired;
+  }
+  if (!retired.root.children.empty()) {
+    for (auto& child : retired.root.children) {
+      retired.root.total_time += child.total_time;
+    }
+    ret.push_back(std::move(retired));
+  }
+  return ret;
+}
+
+as::call_tree_node as::merge_call_trees(const std::vector<call_tree>& trees) {
+  call_tree_node ret;
+  for (auto& tree : trees) {
+    merge_node(tree.root, ret);
+  }
+  return ret;
+}
+
+void as::clear_call_trees() {
+  {
+    auto& registry = get_call_tree_registry();
+    std::lock_guard<std::mutex> guard{registry.lock};
+    for (auto& tree : registry.trees) {
+      tree->clear_generation.fetch_add(1, std::memory_order_release);
+    }
+    registry.retired = call_tree_node{};
+  }
+  if (const auto functions = std::atomic_load(&s_function_exemplars)) {
+    for (auto& function : *functions) function.second->clear();
+  }
+}
+
+#pragma endregion
+
+#pragma region exemplars
+
+void as::keep_exemplars(const char* name, size_t count, timespan_t window) {
+  auto& registry = get_call_tree_registry();
+  std::lock_guard<std::mutex> guard{registry.lock};
+  registry.exemplars[name] = exemplar_options{count, window};
+  // Nodes that are created concurrently and not yet linked into their tree
+  // check the registered names under this lock themselves
+  for (auto& tree : registry.trees) {
+    apply_exemplar_options_recursively(registry, tree->root);
+  }
+
+  const auto function_name = intern_name(name);
+  auto functions = std::atomic_load(&s_function_exemplars);
+  if (functions && functions->count(function_name)) return;
+  auto updated = functions ? std::make_shared<function_exemplar_map>(*functions)
+                           : std::make_shared<function_exemplar_map>();
+  (*updated)[function_name] = std::make_shared<top_exemplars>(count, window);
+  std::atomic_store(&s_function_exemplars,
+                    std::shared_ptr<const function_exemplar_map>{updated});
+  s_has_function_exemplars.store(true, std::memory_order_release);
+}
+
+std::vector<as::exemplar> as::get_function_exemplars(std::string_view name) {
+  const auto functions = std::atomic_load(&s_function_exemplars);
+  if (!functions) return {};
+  auto itr = functions->find(name);
+  return itr != functions->end() ? itr->second->get_exemplars()
+                                 : std::vector<exemplar>{};
+}
+
+std::unordered_map<std::string_view, std::vector<as::exemplar>>
+as::get_function_exemplars() {
+  std::unordered_map<std::string_view, std::vector<exemplar>> ret;
+  const auto functions = std::atomic_load(&s_function_exemplars);
+  if (!functions) return ret;
+  for (auto& kv : *functions) ret[kv.first] = kv.second->get_exemplars();
+  return ret;
+}
+
+uint64_t as::set_request_id(uint64_t request_id) {
+  return std::exchange(t_request_id, request_id);
+}
+
+uint64_t as::get_request_id() { return t_request_id; }
+
+void as::detail::offer_function_exemplar(std::string_view name,
+                                         timestamp_t start_time,
+                                         timespan_t duration) {
+  if (!s_has_function_exemplars.load(std::memory_order_acquire)) return;
+  const auto functions = std::atomic_load(&s_function_exemplars);
+  auto itr = functions->find(name);
+  if (itr == functions->end()) return;
+  itr->second->offer(exemplar{duration, start_time, t_request_id,
+                              get_thread_index()});
+}
+
+#pragma endregion
+
+#pragma region scope_timing_helper
+
+as::detail::ScopeTimingHelper::ScopeTimingHelper(const char* name)
+    : _tree(get_this_thread_call_tree()) {
+  // Scopes entered while the thread exits are not recorded
+  if (!_tree) return;
+  auto& tree = *_tree;
+  if (tree.depth >= max_scope_depth) {
+    // Still count the depth so that the matching destructor knows it has
+    // nothing to record
+    ++tree.depth;
+    return;
+  }
+
+  auto& parent = tree.depth ? *tree.stack[tree.depth - 1].node : tree.root;
+  auto* node = find_or_create_child(tree, parent, name);
+  tree.stack[tree.depth++] = scope_frame{node, as::now(), 0};
+}
+
+as::detail::ScopeTimingHelper::~ScopeTimingHelper() {
+  if (!_tree) return;
+  const auto end_time = as::now();
+  auto& tree = *_tree;
+  if (tree.depth-- > max_scope_depth) return;
+
+  const auto& frame = tree.stack[tree.depth];
+  const auto total = end_time - frame.start_time;
+  const auto total_ns = static_cast<uint64_t>(std::max<int64_t>(
+      std::chrono::duration_cast<timespan_t>(total).count(), 0));
+  const auto self_ns = total_ns - std::min(total_ns, frame.child_ns);
+
+  apply_pending_clear(tree);
+  // Only the owning thread writes to its nodes, so there is no need for atomic
+  // read-modify-write operations
+  auto& node = *frame.node;
+  node.total_time_sketch.record_single_writer(
+      timespan_t{static_cast<int64_t>(total_ns)});
+  node.self_ns.store(node.self_ns.load(std::memory_order_relaxed) + self_ns,
+                     std::memory_order_relaxed);
+
+  if (tree.depth) tree.stack[tree.depth - 1].child_ns += total_ns;
+
+  if (auto* exemplars = node.exemplars.load(std::memory_order_acquire)) {
+    exemplars->offer(exemplar{timespan_t{static_cast<int64_t>(total_ns)},
+                              frame.start_time, t_request_id,
+                              tree.thread_index});
+  }
+
+  record_span(node.name, frame.start_time, end_time);
+}
+
+#pragma endregion
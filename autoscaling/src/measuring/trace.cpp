@@ -0,0 +1,348 @@
+#include "measuring/trace.h"
+
+#include "measuring/scope_timing.h"
+#include "util/ring_buffer.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#pragma region span_buffers
+
+namespace {
+
+/// <summary>
+/// Spans are written to the file in chunks of roughly this size
+/// </summary>
+constexpr size_t write_chunk_size = 1 << 16;
+
+/// <summary>
+/// Span together with the epoch of the exporter it was recorded for
+/// </summary>
+struct buffered_span {
+  as::timing_span span;
+  uint64_t epoch;
+};
+
+struct thread_span_buffer {
+  explicit thread_span_buffer(size_t capacity) : spans(capacity) {}
+
+  as::spsc_ring_buffer<buffered_span> spans;
+  std::atomic<uint64_t> dropped_spans{0};
+  std::atomic<bool> owner_exited{false};
+};
+
+struct span_buffer_registry {
+  std::mutex lock;
+  std::vector<std::shared_ptr<thread_span_buffer>> buffers;
+  std::atomic<size_t> buffer_capacity{0};
+  // Dropped spans of buffers that were already removed from the registry
+  std::atomic<uint64_t> dropped_spans_of_removed_buffers{0};
+};
+
+span_buffer_registry& get_span_buffer_registry() {
+  static span_buffer_registry s_registry;
+  return s_registry;
+}
+
+/// <summary>
+/// Epoch of the running exporter, 0 if none is running. Spans carry the epoch
+/// they were recorded for, and exporters skip spans of other epochs. So a span
+/// that is pushed while an exporter shuts down is never exported by the next
+/// one
+/// </summary>
+std::atomic<uint64_t> s_span_recording_epoch{0};
+std::atomic<uint64_t> s_last_span_epoch{0};
+std::atomic<bool> s_exporter_running{false};
+
+// The raw pointer is trivially destructible and thus cheaper to access than
+// the owner on every call. It also stays accessible while other thread_local
+// objects are destroyed, which might still record spans
+thread_local thread_span_buffer* t_span_buffer = nullptr;
+thread_local bool t_span_buffer_released = false;
+
+/// <summary>
+/// Marks the buffer of a thread once the thread exits, so that the exporter
+/// can release the buffer after draining it. Spans that are recorded on the
+/// thread afterwards, e.g. by destructors of other thread_local objects, are
+/// discarded
+/// </summary>
+struct thread_span_buffer_owner {
+  std::shared_ptr<thread_span_buffer> buffer;
+
+  ~thread_span_buffer_owner() {
+    t_span_buffer = nullptr;
+    t_span_buffer_released = true;
+    if (buffer) buffer->owner_exited.store(true, std::memory_order_release);
+  }
+};
+
+/// <summary>
+/// Returns the span buffer of the calling thread, or nullptr if the thread is
+/// exiting and already released it
+/// </summary>
+thread_span_buffer* get_this_thread_span_buffer() {
+  if (t_span_buffer) return t_span_buffer;
+  if (t_span_buffer_released) return nullptr;
+
+  thread_local thread_span_buffer_owner t_owner;
+  auto& registry = get_span_buffer_registry();
+  t_owner.buffer = std::make_shared<thread_span_buffer>(
+      registry.buffer_capacity.load(std::memory_order_relaxed));
+  {
+    std::lock_guard<std::mutex> guard{registry.lock};
+    registry.buffers.push_back(t_owner.buffer);
+  }
+  t_span_buffer = t_owner.buffer.get();
+  return t_span_buffer;
+}
+
+std::vector<std::shared_ptr<thread_span_buffer>> get_copy_of_span_buffers() {
+  auto& registry = get_span_buffer_registry();
+  std::lock_guard<std::mutex> guard{registry.lock};
+  return registry.buffers;
+}
+
+uint64_t get_total_dropped_spans() {
+  auto& registry = get_span_buffer_registry();
+  std::lock_guard<std::mutex> guard{registry.lock};
+  auto ret = registry.dropped_spans_of_removed_buffers.load();
+  for (auto& buffer : registry.buffers) {
+    ret += buffer->dropped_spans.load(std::memory_order_relaxed);
+  }
+  return ret;
+}
+
+/// <summary>
+/// Releases the buffers of all threads that exited and whose spans were all
+/// exported
+/// </summary>
+void remove_exited_span_buffers() {
+  auto& registry = get_span_buffer_registry();
+  std::lock_guard<std::mutex> guard{registry.lock};
+  auto iter = std::remove_if(registry.buffers.begin(), registry.buffers.end(),
+                             [&registry](const auto& buffer) {
+                               if (!buffer->owner_exited.load() ||
+                                   !buffer->spans.empty())
+                                 return false;
+                               registry.dropped_spans_of_removed_buffers +=
+                                   buffer->dropped_spans;
+                               return true;
+                             });
+  registry.buffers.erase(iter, registry.buffers.end());
+}
+
+double to_microseconds(as::timespan_t timespan) {
+  return std::chrono::duration<double, std::micro>(timespan).count();
+}
+
+void append_json_escaped(std::string& out, std::string_view str) {
+  for (auto c : str) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          out += escaped;
+        } else {
+          out += c;
+        }
+    }
+  }
+}
+
+void append_trace_event(std::string& out, const as::timing_span& span) {
+  out += "{\"name\":\"";
+  append_json_escaped(out, span.name);
+
+  char fields[128];
+  snprintf(fields, sizeof(fields),
+           "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%u}",
+           to_microseconds(span.begin.time_since_epoch()),
+           to_microseconds(span.duration()), span.thread_index);
+  out += fields;
+}
+
+void append_exemplar_event(std::string& out, std::string_view name,
+                           const as::exemplar& exemplar) {
+  out += "{\"name\":\"";
+  append_json_escaped(out, name);
+
+  // Request ids are strings, as JSON numbers lose precision beyond 2^53
+  char fields[192];
+  snprintf(fields, sizeof(fields),
+           "\",\"cat\":\"exemplar\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+           "\"pid\":0,\"tid\":%u,\"args\":{\"request_id\":\"%llu\","
+           "\"duration_us\":%.3f}}",
+           to_microseconds(exemplar.timestamp.time_since_epoch()),
+           exemplar.thread_index,
+           static_cast<unsigned long long>(exemplar.request_id),
+           to_microseconds(exemplar.value));
+  out += fields;
+}
+
+/// <summary>
+/// Collects the exemplars of the node and all of its children
+/// </summary>
+void collect_exemplars(
+    const as::call_tree_node& node,
+    std::vector<std::pair<std::string_view, as::exemplar>>& exemplars) {
+  for (auto& exemplar : node.exemplars)
+    exemplars.emplace_back(node.name, exemplar);
+  for (auto& child : node.children) collect_exemplars(child, exemplars);
+}
+
+}  // namespace
+
+void as::detail::record_span(const char* name, timestamp_t begin,
+                             timestamp_t end) {
+  const auto epoch = s_span_recording_epoch.load(std::memory_order_relaxed);
+  if (!epoch) return;
+
+  auto* buffer = get_this_thread_span_buffer();
+  if (!buffer) return;
+  buffered_span span;
+  span.span.name = name;
+  span.span.begin = begin;
+  span.span.end = end;
+  span.span.thread_index = get_thread_index();
+  span.epoch = epoch;
+  if (!buffer->spans.try_push(span)) {
+    buffer->dropped_spans.store(
+        buffer->dropped_spans.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+  }
+}
+
+#pragma endregion
+
+#pragma region chrome_trace_exporter
+
+as::chrome_trace_exporter::chrome_trace_exporter(const std::string& path,
+                                                 trace_export_options options)
+    : _options(options),
+      _epoch(s_last_span_epoch.fetch_add(1) + 1),
+      _start_time(now()),
+      _wrote_first_event(false),
+      _exported_spans(0),
+      _dropped_spans_at_start(0),
+      _stop(false) {
+  bool expected = false;
+  if (!s_exporter_running.compare_exchange_strong(expected, true))
+    throw std::runtime_error{"Another trace exporter is already running!"};
+
+  _file.open(path, std::ios::out | std::ios::trunc);
+  if (!_file.is_open()) {
+    s_exporter_running = false;
+    throw std::runtime_error{"Could not open trace file '" + path + "'!"};
+  }
+  // The array format is valid even if the closing bracket is missing, so a
+  // trace remains loadable if the process dies while exporting
+  _file << "[\n";
+
+  _write_buffer.reserve(write_chunk_size * 2);
+  _dropped_spans_at_start = get_total_dropped_spans();
+  get_span_buffer_registry().buffer_capacity =
+      _options.buffer_capacity_per_thread;
+  s_span_recording_epoch = _epoch;
+
+  _thread = std::thread{[this]() { run(); }};
+}
+
+as::chrome_trace_exporter::~chrome_trace_exporter() {
+  s_span_recording_epoch = 0;
+  {
+    std::lock_guard<std::mutex> guard{_stop_lock};
+    _stop = true;
+  }
+  _stop_signal.notify_one();
+  _thread.join();
+
+  drain();
+  write_exemplars();
+  _file << "\n]\n";
+  _file.close();
+
+  s_exporter_running = false;
+}
+
+void as::chrome_trace_exporter::flush() { drain(); }
+
+uint64_t as::chrome_trace_exporter::get_exported_span_count() const {
+  return _exported_spans.load();
+}
+
+uint64_t as::chrome_trace_exporter::get_dropped_span_count() const {
+  return get_total_dropped_spans() - _dropped_spans_at_start;
+}
+
+void as::chrome_trace_exporter::run() {
+  std::unique_lock<std::mutex> lock{_stop_lock};
+  while (!_stop) {
+    _stop_signal.wait_for(lock, _options.flush_interval);
+    if (_stop) break;
+
+    lock.unlock();
+    drain();
+    lock.lock();
+  }
+}
+
+void as::chrome_trace_exporter::drain() {
+  std::lock_guard<std::mutex> guard{_drain_lock};
+
+  uint64_t exported = 0;
+  for (auto& buffer : get_copy_of_span_buffers()) {
+    buffer->spans.consume_all([this, &exported](const buffered_span& span) {
+      // Left over from an earlier exporter
+      if (span.epoch != _epoch) return;
+
+      if (_wrote_first_event) _write_buffer += ",\n";
+      _wrote_first_event = true;
+      append_trace_event(_write_buffer, span.span);
+      ++exported;
+
+      if (_write_buffer.size() >= write_chunk_size) {
+        _file.write(_write_buffer.data(), _write_buffer.size());
+        _write_buffer.clear();
+      }
+    });
+  }
+
+  _file.write(_write_buffer.data(), _write_buffer.size());
+  _write_buffer.clear();
+  _file.flush();
+  _exported_spans += exported;
+
+  remove_exited_span_buffers();
+}
+
+void as::chrome_trace_exporter::write_exemplars() {
+  const auto trees = get_call_trees();
+  const auto functions = get_function_exemplars();
+  std::vector<std::pair<std::string_view, exemplar>> exemplars;
+  for (auto& tree : trees) collect_exemplars(tree.root, exemplars);
+  for (auto& kv : functions) {
+    for (auto& exemplar : kv.second) exemplars.emplace_back(kv.first, exemplar);
+  }
+
+  for (auto& [name, exemplar] : exemplars) {
+    // Started before the exporter
+    if (exemplar.timestamp < _start_time) continue;
+    if (_wrote_first_event) _write_buffer += ",\n";
+    _wrote_first_event = true;
+    append_exemplar_event(_write_buffer, name, exemplar);
+  }
+  _file.write(_write_buffer.data(), _write_buffer.size());
+  _write_buffer.clear();
+}
+
+#pragma endregion
@@ -0,0 +1,15 @@
+#include "scaling/actuator.h"
+
+#pragma region scaling_actuator
+
+void as::scaling_actuator::apply(const scaling_decision& decision) {
+  if (decision.action == scaling_action::none) return;
+
+  const auto current = target_capacity();
+  if (decision.target_capacity > current)
+    scale_out(decision.target_capacity - current);
+  else if (decision.target_capacity < current)
+    scale_in(current - decision.target_capacity);
+}
+
+#pragma endregion
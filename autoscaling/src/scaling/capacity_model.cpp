@@ -0,0 +1,234 @@
+#include "scaling/capacity_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#pragma region workload
+
+double as::workload::offered_load() const {
+  return arrival_rate *
+         std::chrono::duration<double>(mean_service_time).count();
+}
+
+as::workload as::make_workload(const rate& arrival_rate,
+                               const timing_sketch& service_time) {
+  return workload{arrival_rate.get_per_second(), service_time.mean()};
+}
+
+as::workload as::observe_workload(std::string_view arrival_name,
+                                  std::string_view service_time_name,
+                                  timespan_t window, timestamp_t end) {
+  const auto begin = end - window;
+  const auto in_window = [&](timestamp_t timestamp) {
+    return timestamp > begin && timestamp <= end;
+  };
+
+  size_t arrivals = 0;
+  for (auto& m : get_measurements<periodic_event>(arrival_name, begin, end)) {
+    if (in_window(m.timestamp)) ++arrivals;
+  }
+
+  timing_sketch service_time;
+  for (auto& m :
+       get_measurements<function_timing>(service_time_name, begin, end)) {
+    if (in_window(m.timestamp)) service_time.record(m.data);
+  }
+
+  return make_workload(rate::from_delta(static_cast<double>(arrivals), window),
+                       service_time);
+}
+
+#pragma endregion
+
+#pragma region capacity_model
+
+namespace {
+
+constexpr auto infinite_latency = as::timespan_t::max();
+
+/// <summary>
+/// Erlang C formula from the Erlang B value of the same number of servers,
+/// which avoids the factorials and powers of the textbook form
+/// </summary>
+double erlang_c(double erlang_b, double offered_load, size_t servers) {
+  const auto c = static_cast<double>(servers);
+  return c * erlang_b / (c - offered_load * (1.0 - erlang_b));
+}
+
+/// <summary>
+/// Erlang B value for the given number of servers, using the recursion
+/// B(k) = A * B(k - 1) / (k + A * B(k - 1)) with B(0) = 1
+/// </summary>
+double erlang_b(double offered_load, size_t servers) {
+  double b = 1.0;
+  for (size_t k = 1; k <= servers; ++k)
+    b = offered_load * b / (static_cast<double>(k) + offered_load * b);
+  return b;
+}
+
+as::timespan_t to_timespan(double seconds) {
+  if (!std::isfinite(seconds) ||
+      seconds >= static_cast<double>(infinite_latency.count()) / 1e9)
+    return infinite_latency;
+  return std::chrono::duration_cast<as::timespan_t>(
+      std::chrono::duration<double>(seconds));
+}
+
+/// <summary>
+/// Queue wait quantile: P(W > t) = C * exp(-(c * mu - lambda) * t)
+/// </summary>
+double queue_wait_quantile(double wait_probability, double drain_rate,
+                           double quantile) {
+  const auto tail = 1.0 - quantile;
+  if (tail >= wait_probability) return 0.0;
+  return std::log(wait_probability / tail) / drain_rate;
+}
+
+/// <summary>
+/// Response time quantile. The response time is the queue wait plus an
+/// independent exponential service time, so
+/// P(T > t) = (1 - C) * exp(-mu * t) + C * P(Exp(theta) + Exp(mu) > t)
+/// with theta = c * mu - lambda. This has no closed-form inverse and is
+/// solved by bisection
+/// </summary>
+double response_time_quantile(double wait_probability, double service_rate,
+                              double drain_rate, double quantile) {
+  const auto mu = service_rate;
+  const auto theta = drain_rate;
+  const auto tail_probability = [&](double t) {
+    const auto service_tail = std::exp(-mu * t);
+    double sum_tail;
+    if (std::abs(theta - mu) <= 1e-9 * mu) {
+      sum_tail = (1.0 + mu * t) * service_tail;
+    } else {
+      sum_tail = (mu * std::exp(-theta * t) - theta * service_tail) /
+                 (mu - theta);
+    }
+    return (1.0 - wait_probability) * service_tail +
+           wait_probability * sum_tail;
+  };
+
+  const auto tail = 1.0 - quantile;
+  double low = 0.0;
+  double high = 1.0 / std::min(mu, theta);
+  while (tail_probability(high) > tail) {
+    low = high;
+    high *= 2.0;
+  }
+  // 50 halvings bring the bracket below 1e-15 of its initial width
+  for (int idx = 0; idx < 50; ++idx) {
+    const auto mid = 0.5 * (low + high);
+    (tail_probability(mid) > tail ? low : high) = mid;
+  }
+  return high;
+}
+
+}  // namespace
+
+as::capacity_estimate as::capacity_model::estimate(const workload& workload,
+                                                   size_t servers) {
+  capacity_estimate ret;
+  ret.servers = servers;
+
+  const auto offered_load = workload.offered_load();
+  const auto c = static_cast<double>(servers);
+  ret.utilization = servers ? offered_load / c : 1.0;
+  ret.stable = servers && offered_load < c;
+  if (!ret.stable) {
+    ret.wait_probability = 1.0;
+    ret.mean_queue_wait = infinite_latency;
+    ret.mean_response_time = infinite_latency;
+    ret.mean_queue_length = std::numeric_limits<double>::infinity();
+    return ret;
+  }
+
+  const auto service_seconds =
+      std::chrono::duration<double>(workload.mean_service_time).count();
+  ret.wait_probability =
+      erlang_c(erlang_b(offered_load, servers), offered_load, servers);
+  // Wq = C / (c * mu - lambda)
+  const auto queue_wait_seconds =
+      offered_load > 0.0
+          ? ret.wait_probability * service_seconds / (c - offered_load)
+          : 0.0;
+  ret.mean_queue_wait = to_timespan(queue_wait_seconds);
+  ret.mean_response_time = to_timespan(queue_wait_seconds + service_seconds);
+  ret.mean_queue_length = workload.arrival_rate * queue_wait_seconds;
+  return ret;
+}
+
+as::timespan_t as::capacity_model::predict_latency(const workload& workload,
+                                                   size_t servers,
+                                                   double quantile,
+                                                   latency_measure measure) {
+  const auto offered_load = workload.offered_load();
+  if (!servers || offered_load >= static_cast<double>(servers))
+    return infinite_latency;
+  const auto service_seconds =
+      std::chrono::duration<double>(workload.mean_service_time).count();
+  if (service_seconds <= 0.0) return timespan_t{0};
+
+  quantile = std::clamp(quantile, 0.0, 1.0 - 1e-12);
+  const auto wait_probability =
+      erlang_c(erlang_b(offered_load, servers), offered_load, servers);
+  const auto service_rate = 1.0 / service_seconds;
+  const auto drain_rate =
+      (static_cast<double>(servers) - offered_load) * service_rate;
+
+  if (measure == latency_measure::queue_wait) {
+    return to_timespan(
+        queue_wait_quantile(wait_probability, drain_rate, quantile));
+  }
+  return to_timespan(response_time_quantile(wait_probability, service_rate,
+                                            drain_rate, quantile));
+}
+
+size_t as::capacity_model::required_servers(
+    const workload& workload, const service_level_objective& objective,
+    size_t max_servers) {
+  const auto offered_load = workload.offered_load();
+  const auto service_seconds =
+      std::chrono::duration<double>(workload.mean_service_time).count();
+  const auto quantile = std::clamp(objective.quantile, 0.0, 1.0 - 1e-12);
+  const auto target_seconds =
+      std::chrono::duration<double>(objective.latency).count();
+
+  // Even without waiting, the response time quantile is the service time
+  // quantile, which no number of servers can improve
+  if (objective.measure == latency_measure::response_time &&
+      service_seconds * -std::log(1.0 - quantile) > target_seconds)
+    return 0;
+
+  // Fewest servers that are stable and within the utilization bound
+  const auto max_utilization = std::clamp(objective.max_utilization, 0.0, 1.0);
+  size_t servers = static_cast<size_t>(std::floor(offered_load)) + 1;
+  if (max_utilization > 0.0) {
+    const auto bounded = std::ceil(offered_load / max_utilization);
+    servers = std::max(servers, static_cast<size_t>(bounded));
+  }
+  servers = std::max<size_t>(servers, 1);
+  if (servers > max_servers) return 0;
+  if (service_seconds <= 0.0) return servers;
+
+  const auto service_rate = 1.0 / service_seconds;
+  // The Erlang B recursion continues from the previous number of servers
+  auto b = erlang_b(offered_load, servers);
+  for (; servers <= max_servers; ++servers) {
+    const auto wait_probability = erlang_c(b, offered_load, servers);
+    const auto drain_rate =
+        (static_cast<double>(servers) - offered_load) * service_rate;
+    const auto latency =
+        objective.measure == latency_measure::queue_wait
+            ? queue_wait_quantile(wait_probability, drain_rate, quantile)
+            : response_time_quantile(wait_probability, service_rate,
+                                     drain_rate, quantile);
+    if (latency <= target_seconds) return servers;
+
+    const auto next = static_cast<double>(servers + 1);
+    b = offered_load * b / (next + offered_load * b);
+  }
+  return 0;
+}
+
+#pragma endregion
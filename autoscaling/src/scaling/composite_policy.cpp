@@ -0,0 +1,473 @@
+#include "scaling/composite_policy.h"
+
+#include "measuring/samples.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#pragma region expression
+
+as::expression::expression(composite_policy* policy, uint32_t id)
+    : _policy(policy), _id(id) {}
+
+as::composite_policy* as::expression::get_policy() const { return _policy; }
+
+uint32_t as::expression::get_id() const { return _id; }
+
+namespace {
+
+as::expression combine(as::operation op, as::expression l, as::expression r) {
+  return l.get_policy()->combine(op, l, r);
+}
+
+as::expression combine(as::operation op, as::expression l, double r) {
+  return combine(op, l, l.get_policy()->constant(r));
+}
+
+}  // namespace
+
+as::expression as::operator+(expression l, expression r) {
+  return combine(operation::add, l, r);
+}
+as::expression as::operator-(expression l, expression r) {
+  return combine(operation::subtract, l, r);
+}
+as::expression as::operator*(expression l, expression r) {
+  return combine(operation::multiply, l, r);
+}
+as::expression as::operator/(expression l, expression r) {
+  return combine(operation::divide, l, r);
+}
+as::expression as::operator<(expression l, expression r) {
+  return combine(operation::less, l, r);
+}
+as::expression as::operator<=(expression l, expression r) {
+  return combine(operation::less_equal, l, r);
+}
+as::expression as::operator>(expression l, expression r) {
+  return combine(operation::greater, l, r);
+}
+as::expression as::operator>=(expression l, expression r) {
+  return combine(operation::greater_equal, l, r);
+}
+as::expression as::operator&&(expression l, expression r) {
+  return combine(operation::logical_and, l, r);
+}
+as::expression as::operator||(expression l, expression r) {
+  return combine(operation::logical_or, l, r);
+}
+as::expression as::operator!(expression e) {
+  return e.get_policy()->negate(e);
+}
+
+as::expression as::operator+(expression l, double r) {
+  return combine(operation::add, l, r);
+}
+as::expression as::operator-(expression l, double r) {
+  return combine(operation::subtract, l, r);
+}
+as::expression as::operator*(expression l, double r) {
+  return combine(operation::multiply, l, r);
+}
+as::expression as::operator/(expression l, double r) {
+  return combine(operation::divide, l, r);
+}
+as::expression as::operator<(expression l, double r) {
+  return combine(operation::less, l, r);
+}
+as::expression as::operator<=(expression l, double r) {
+  return combine(operation::less_equal, l, r);
+}
+as::expression as::operator>(expression l, double r) {
+  return combine(operation::greater, l, r);
+}
+as::expression as::operator>=(expression l, double r) {
+  return combine(operation::greater_equal, l, r);
+}
+
+#pragma endregion
+
+#pragma region composite_policy
+
+namespace {
+
+using as::detail::is_true;
+using as::detail::read_series;
+using as::detail::sample;
+
+constexpr auto not_a_number = std::numeric_limits<double>::quiet_NaN();
+
+bool is_commutative(as::operation op) {
+  return op == as::operation::add || op == as::operation::multiply ||
+         op == as::operation::logical_and || op == as::operation::logical_or;
+}
+
+/// <summary>
+/// Least-squares slope of the samples in units per second
+/// </summary>
+double get_slope(std::vector<sample>::const_iterator first,
+                 std::vector<sample>::const_iterator last) {
+  const auto n = static_cast<double>(last - first);
+  if (n < 2.0) return not_a_number;
+  const auto origin = first->first;
+  double sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0;
+  for (auto itr = first; itr != last; ++itr) {
+    const auto x = std::chrono::duration<double>(itr->first - origin).count();
+    sum_x += x;
+    sum_y += itr->second;
+    sum_xx += x * x;
+    sum_xy += x * itr->second;
+  }
+  const auto denominator = n * sum_xx - sum_x * sum_x;
+  if (denominator <= 0.0) return not_a_number;
+  return (n * sum_xy - sum_x * sum_y) / denominator;
+}
+
+}  // namespace
+
+as::composite_policy::composite_policy(composite_policy_options options)
+    : _options(options), _has_scaled_out(false), _has_scaled(false) {}
+
+as::expression as::composite_policy::constant(double value) {
+  return add_node(operation::constant, 0, 0, value);
+}
+
+as::expression as::composite_policy::from_query(std::string_view text) {
+  // Identical texts share the query and its windows
+  uint32_t idx = 0;
+  while (idx < _queries.size() && _queries[idx]->get_text() != text) ++idx;
+  if (idx == _queries.size())
+    _queries.push_back(std::make_unique<as::query>(text));
+  return add_node(operation::query, idx, 0, 0.0);
+}
+
+as::expression as::composite_policy::combine(operation op, expression l,
+                                             expression r) {
+  if (op == operation::constant || op == operation::aggregate ||
+      op == operation::logical_not || op == operation::query)
+    throw std::runtime_error{"Operation is not binary!"};
+  auto left = get_id(l);
+  auto right = get_id(r);
+  // Normalized, so that a && b and b && a share the node
+  if (is_commutative(op) && right < left) std::swap(left, right);
+  return add_node(op, left, right, 0.0);
+}
+
+as::expression as::composite_policy::negate(expression e) {
+  return add_node(operation::logical_not, get_id(e), 0, 0.0);
+}
+
+void as::composite_policy::add_rule(expression condition,
+                                    scaling_action action, size_t step,
+                                    std::string_view reason) {
+  if (action == scaling_action::none)
+    throw std::runtime_error{"Rule needs an action!"};
+  const auto id = get_id(condition);
+  if (reason.empty()) reason = "composite rule";
+  // Interned names are null-terminated and stay valid
+  _rules.push_back(rule{id, action, std::max<size_t>(step, 1),
+                        intern_name(reason).data()});
+}
+
+as::scaling_decision as::composite_policy::decide(const scaling_inputs& inputs,
+                                                  timestamp_t timestamp) {
+  evaluate(timestamp);
+
+  scaling_decision decision;
+  decision.timestamp = timestamp;
+  decision.current_capacity = inputs.current_capacity;
+  decision.target_capacity = inputs.current_capacity;
+
+  const auto current = inputs.current_capacity;
+  const auto apply = [&](scaling_action action, size_t target,
+                         const char* reason) {
+    decision.action = action;
+    decision.target_capacity = target;
+    decision.reason = reason;
+    _has_scaled = true;
+    _last_scaling = timestamp;
+    if (action == scaling_action::scale_out) {
+      _has_scaled_out = true;
+      _last_scale_out = timestamp;
+    }
+  };
+
+  // Bounds are enforced regardless of cooldowns
+  if (current < _options.min_capacity) {
+    apply(scaling_action::scale_out, _options.min_capacity,
+          "capacity below minimum");
+    return decision;
+  }
+  if (current > _options.max_capacity) {
+    apply(scaling_action::scale_in, _options.max_capacity,
+          "capacity above maximum");
+    return decision;
+  }
+
+  size_t scale_out_step = 0;
+  size_t scale_in_step = 0;
+  const char* scale_out_reason = "";
+  const char* scale_in_reason = "";
+  for (auto& rule : _rules) {
+    if (!is_true(_values[rule.condition])) continue;
+    if (rule.action == scaling_action::scale_out) {
+      if (rule.step > scale_out_step) scale_out_reason = rule.reason;
+      scale_out_step = std::max(scale_out_step, rule.step);
+    } else {
+      if (rule.step > scale_in_step) scale_in_reason = rule.reason;
+      scale_in_step = std::max(scale_in_step, rule.step);
+    }
+  }
+
+  if (scale_out_step) {
+    const auto target =
+        std::min(current + scale_out_step, _options.max_capacity);
+    const auto cooled_down =
+        !_has_scaled_out ||
+        has_elapsed(_last_scale_out, _options.scale_out_cooldown, timestamp);
+    if (target > current && cooled_down)
+      apply(scaling_action::scale_out, target, scale_out_reason);
+  } else if (scale_in_step) {
+    const auto lowest =
+        current > scale_in_step ? current - scale_in_step : size_t{0};
+    const auto target = std::max(lowest, _options.min_capacity);
+    const auto cooled_down =
+        !_has_scaled ||
+        has_elapsed(_last_scaling, _options.scale_in_cooldown, timestamp);
+    if (target < current && cooled_down)
+      apply(scaling_action::scale_in, target, scale_in_reason);
+  }
+  return decision;
+}
+
+const char* as::composite_policy::get_name() const { return "composite"; }
+
+double as::composite_policy::get_value(expression e) const {
+  const auto id = get_id(e);
+  return id < _values.size() ? _values[id] : not_a_number;
+}
+
+const as::composite_policy_statistics& as::composite_policy::get_statistics()
+    const {
+  return _statistics;
+}
+
+size_t as::composite_policy::get_node_count() const { return _nodes.size(); }
+
+as::expression as::composite_policy::add_aggregate(
+    std::string_view name, metric_type type, aggregation kind,
+    std::chrono::milliseconds window, double quantile) {
+  const auto interned = intern_name(name);
+  auto series_itr = _series_ids.find({interned, type});
+  if (series_itr == _series_ids.end()) {
+    series_itr =
+        _series_ids
+            .emplace(std::make_tuple(interned, type),
+                     static_cast<uint32_t>(_series.size()))
+            .first;
+    _series.push_back(series{interned, type, timespan_t{0}});
+  }
+  auto& series = _series[series_itr->second];
+  series.window = std::max<timespan_t>(series.window, window);
+
+  if (kind != aggregation::quantile) quantile = 0.0;
+  const auto key = std::make_tuple(series_itr->second, kind,
+                                   static_cast<int64_t>(window.count()),
+                                   std::clamp(quantile, 0.0, 1.0));
+  auto itr = _aggregate_ids.find(key);
+  if (itr == _aggregate_ids.end()) {
+    itr = _aggregate_ids
+              .emplace(key, static_cast<uint32_t>(_aggregates.size()))
+              .first;
+    _aggregates.push_back(aggregate_node{series_itr->second, kind, window,
+                                         std::get<3>(key)});
+  }
+  return add_node(operation::aggregate, itr->second, 0, 0.0);
+}
+
+as::expression as::composite_policy::add_node(operation op, uint32_t left,
+                                              uint32_t right, double value) {
+  uint64_t value_bits = 0;
+  std::memcpy(&value_bits, &value, sizeof(value_bits));
+  const auto key = node_key{op, left, right, value_bits};
+  auto itr = _node_ids.find(key);
+  if (itr == _node_ids.end()) {
+    itr = _node_ids.emplace(key, static_cast<uint32_t>(_nodes.size())).first;
+    _nodes.push_back(node{op, left, right, value});
+  }
+  return expression{this, itr->second};
+}
+
+uint32_t as::composite_policy::get_id(expression e) const {
+  if (e.get_policy() != this || e.get_id() >= _nodes.size())
+    throw std::runtime_error{"Expression belongs to another policy!"};
+  return e.get_id();
+}
+
+void as::composite_policy::evaluate(timestamp_t timestamp) {
+  // Real time, as the duration measures the cost of the evaluation even if
+  // the decision is simulated
+  const auto start_time = std::chrono::high_resolution_clock::now();
+
+  // Every series once, over the largest window of its aggregates
+  std::vector<std::vector<sample>> samples(_series.size());
+  for (size_t idx = 0; idx < _series.size(); ++idx) {
+    const auto& series = _series[idx];
+    const auto begin = timestamp - series.window;
+    auto& out = samples[idx];
+    switch (series.type) {
+      case metric_type::double_value:
+        read_series<double>(series.name, begin, timestamp, out);
+        break;
+      case metric_type::size_value:
+        read_series<size_t>(series.name, begin, timestamp, out);
+        break;
+      case metric_type::timespan:
+        read_series<timespan_t>(series.name, begin, timestamp, out);
+        break;
+      case metric_type::memory:
+        read_series<memory>(series.name, begin, timestamp, out);
+        break;
+      case metric_type::rate:
+        read_series<rate>(series.name, begin, timestamp, out);
+        break;
+    }
+    as::detail::sort_samples(out);
+  }
+
+  // Every aggregate once
+  std::vector<double> aggregate_values(_aggregates.size(), not_a_number);
+  std::vector<double> scratch;
+  for (size_t idx = 0; idx < _aggregates.size(); ++idx) {
+    const auto& aggregate = _aggregates[idx];
+    const auto& series_samples = samples[aggregate.series_id];
+    // The window is (timestamp - window;timestamp], like observe_workload
+    const auto first = std::upper_bound(
+        series_samples.begin(), series_samples.end(),
+        timestamp - aggregate.window,
+        [](timestamp_t begin, const sample& s) { return begin < s.first; });
+    const auto last = series_samples.end();
+    const auto count = static_cast<size_t>(last - first);
+
+    auto& value = aggregate_values[idx];
+    if (aggregate.kind == aggregation::count) {
+      value = static_cast<double>(count);
+      continue;
+    }
+    if (!count) continue;
+
+    switch (aggregate.kind) {
+      case aggregation::last:
+        value = std::prev(last)->second;
+        break;
+      case aggregation::mean:
+      case aggregation::sum: {
+        double sum = 0.0;
+        for (auto itr = first; itr != last; ++itr) sum += itr->second;
+        value = aggregate.kind == aggregation::sum
+                    ? sum
+                    : sum / static_cast<double>(count);
+        break;
+      }
+      case aggregation::min:
+        value = std::min_element(first, last, [](const auto& l, const auto& r) {
+                  return l.second < r.second;
+                })->second;
+        break;
+      case aggregation::max:
+        value = std::max_element(first, last, [](const auto& l, const auto& r) {
+                  return l.second < r.second;
+                })->second;
+        break;
+      case aggregation::quantile: {
+        scratch.clear();
+        for (auto itr = first; itr != last; ++itr)
+          scratch.push_back(itr->second);
+        // Nearest rank
+        const auto rank = static_cast<size_t>(
+            std::ceil(aggregate.quantile * static_cast<double>(count)));
+        const auto nth = scratch.begin() + (rank ? rank - 1 : 0);
+        std::nth_element(scratch.begin(), nth, scratch.end());
+        value = *nth;
+        break;
+      }
+      case aggregation::slope:
+        value = get_slope(first, last);
+        break;
+      case aggregation::count:
+        break;
+    }
+  }
+
+  // Every node once. Operands are created before the nodes that use them,
+  // so the creation order is a topological order
+  _values.resize(_nodes.size());
+  for (size_t idx = 0; idx < _nodes.size(); ++idx) {
+    const auto& node = _nodes[idx];
+    const auto l = _values[node.left];
+    const auto r = _values[node.right];
+    auto& value = _values[idx];
+    switch (node.op) {
+      case operation::constant:
+        value = node.value;
+        break;
+      case operation::aggregate:
+        value = aggregate_values[node.left];
+        break;
+      case operation::add:
+        value = l + r;
+        break;
+      case operation::subtract:
+        value = l - r;
+        break;
+      case operation::multiply:
+        value = l * r;
+        break;
+      case operation::divide:
+        value = r != 0.0 ? l / r : not_a_number;
+        break;
+      // Comparisons involving NaN are false
+      case operation::less:
+        value = l < r;
+        break;
+      case operation::less_equal:
+        value = l <= r;
+        break;
+      case operation::greater:
+        value = l > r;
+        break;
+      case operation::greater_equal:
+        value = l >= r;
+        break;
+      case operation::logical_and:
+        value = is_true(l) && is_true(r);
+        break;
+      case operation::logical_or:
+        value = is_true(l) || is_true(r);
+        break;
+      case operation::logical_not:
+        value = !is_true(l);
+        break;
+      case operation::query:
+        value = _queries[node.left]->evaluate(timestamp);
+        break;
+    }
+  }
+
+  _statistics.series_reads = _series.size();
+  _statistics.aggregates = _aggregates.size();
+  _statistics.nodes = _nodes.size();
+  _statistics.rules = _rules.size();
+  _statistics.duration = std::chrono::high_resolution_clock::now() - start_time;
+}
+
+bool as::composite_policy::has_elapsed(timestamp_t since,
+                                       std::chrono::milliseconds cooldown,
+                                       timestamp_t timestamp) const {
+  return timestamp - since >= cooldown;
+}
+
+#pragma endregion
@@ -0,0 +1,166 @@
+#include "scaling/decision_journal.h"
+
+#include "measuring/samples.h"
+
+#include <algorithm>
+#include <utility>
+
+#pragma region decision_journal
+
+namespace {
+
+using as::detail::sample;
+
+/// <summary>
+/// Reads a series as samples sorted by timestamp
+/// </summary>
+template <typename T>
+std::vector<sample> read_series(std::string_view name, as::timestamp_t begin,
+                                as::timestamp_t end) {
+  std::vector<sample> ret;
+  if (name.empty()) return ret;
+  as::detail::read_series<T>(name, begin, end, ret);
+  as::detail::sort_samples(ret);
+  return ret;
+}
+
+std::vector<sample>::const_iterator lower_bound(
+    const std::vector<sample>& samples, as::timestamp_t timestamp) {
+  return std::lower_bound(samples.begin(), samples.end(), timestamp,
+                          [](const sample& s, as::timestamp_t timestamp) {
+                            return s.first < timestamp;
+                          });
+}
+
+std::vector<sample>::const_iterator upper_bound(
+    const std::vector<sample>& samples, as::timestamp_t timestamp) {
+  return std::upper_bound(samples.begin(), samples.end(), timestamp,
+                          [](as::timestamp_t timestamp, const sample& s) {
+                            return timestamp < s.first;
+                          });
+}
+
+as::window_summary summarize(std::vector<sample>::const_iterator first,
+                             std::vector<sample>::const_iterator last) {
+  as::window_summary ret;
+  if (first == last) return ret;
+  double sum = 0.0;
+  ret.max = first->second;
+  for (auto itr = first; itr != last; ++itr) {
+    sum += itr->second;
+    ret.max = std::max(ret.max, itr->second);
+    ++ret.count;
+  }
+  ret.mean = sum / static_cast<double>(ret.count);
+  return ret;
+}
+
+/// <summary>
+/// Before is [timestamp - before; timestamp), after is (timestamp; timestamp
+/// + after], so the measurement taken for the decision itself is in neither
+/// </summary>
+as::metric_windows get_windows(const std::vector<sample>& samples,
+                               as::timestamp_t timestamp,
+                               std::chrono::milliseconds before,
+                               std::chrono::milliseconds after) {
+  as::metric_windows ret;
+  ret.before = summarize(lower_bound(samples, timestamp - before),
+                         lower_bound(samples, timestamp));
+  ret.after = summarize(upper_bound(samples, timestamp),
+                        upper_bound(samples, timestamp + after));
+  return ret;
+}
+
+}  // namespace
+
+as::decision_journal::decision_journal(decision_journal_options options)
+    : _options(std::move(options)),
+      _decisions_name(intern_name(_options.name + ".decisions")),
+      _latency_name(intern_name(_options.latency_name)),
+      _utilization_name(intern_name(_options.utilization_name)),
+      _queue_length_name(intern_name(_options.queue_length_name)),
+      _capacity_name(intern_name(_options.capacity_name)) {}
+
+void as::decision_journal::record(const scaling_inputs& inputs,
+                                  const scaling_decision& decision,
+                                  const char* policy_name,
+                                  uint32_t policy_version) {
+  add_measurement<decision_record>(
+      _decisions_name, decision.timestamp,
+      decision_record{inputs, decision, policy_name, policy_version});
+}
+
+std::vector<as::measurement<as::decision_record>>
+as::decision_journal::get_decisions(timestamp_t begin, timestamp_t end) const {
+  auto ret = get_measurements<decision_record>(_decisions_name, begin, end);
+  std::stable_sort(ret.begin(), ret.end(),
+                   [](const auto& l, const auto& r) {
+                     return l.timestamp < r.timestamp;
+                   });
+  return ret;
+}
+
+std::vector<as::decision_impact> as::decision_journal::get_impact(
+    timestamp_t begin, timestamp_t end) const {
+  std::vector<decision_impact> ret;
+  const auto decisions = get_decisions(begin, end);
+  if (decisions.empty()) return ret;
+
+  const auto series_begin =
+      decisions.front().timestamp - _options.before_window;
+  const auto series_end = decisions.back().timestamp + _options.after_window;
+  const auto latency =
+      read_series<timespan_t>(_latency_name, series_begin, series_end);
+  const auto utilization =
+      read_series<double>(_utilization_name, series_begin, series_end);
+  const auto queue_length =
+      read_series<size_t>(_queue_length_name, series_begin, series_end);
+  const auto capacity =
+      read_series<size_t>(_capacity_name, series_begin, series_end);
+
+  ret.reserve(decisions.size());
+  for (auto& m : decisions) {
+    decision_impact impact;
+    impact.timestamp = m.timestamp;
+    impact.record = m.data;
+    impact.latency = get_windows(latency, m.timestamp, _options.before_window,
+                                 _options.after_window);
+    impact.utilization =
+        get_windows(utilization, m.timestamp, _options.before_window,
+                    _options.after_window);
+    impact.queue_length =
+        get_windows(queue_length, m.timestamp, _options.before_window,
+                    _options.after_window);
+
+    // First capacity measurement at or after the decision that reached the
+    // target
+    const auto& decision = m.data.decision;
+    if (decision.action != scaling_action::none) {
+      const auto target = static_cast<double>(decision.target_capacity);
+      const auto last =
+          upper_bound(capacity, m.timestamp + _options.after_window);
+      for (auto itr = lower_bound(capacity, m.timestamp); itr != last; ++itr) {
+        const auto reached = decision.action == scaling_action::scale_out
+                                 ? itr->second >= target
+                                 : itr->second <= target;
+        if (reached) {
+          impact.reached_target = true;
+          impact.time_to_target = itr->first - m.timestamp;
+          break;
+        }
+      }
+    }
+    ret.push_back(std::move(impact));
+  }
+  return ret;
+}
+
+std::string_view as::decision_journal::get_decisions_name() const {
+  return _decisions_name;
+}
+
+const as::decision_journal_options& as::decision_journal::get_options() const {
+  return _options;
+}
+
+#pragma endregion
@@ -0,0 +1,384 @@
+#include "scaling/local_process_actuator.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+#pragma region report_message
+
+namespace {
+
+enum class report_type : uint8_t { ready, metric };
+
+/// <summary>
+/// Datagram that a worker sends to the actuator
+/// </summary>
+struct report_message {
+  uint32_t worker_id;
+  uint8_t type;
+  char name[56];
+  double value;
+};
+
+#ifdef __linux__
+
+bool make_address(const std::string& path, sockaddr_un& address) {
+  if (path.size() >= sizeof(address.sun_path)) return false;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+#endif
+
+}  // namespace
+
+#pragma endregion
+
+#pragma region local_process_actuator
+
+bool as::local_process_actuator::is_supported() {
+#ifdef __linux__
+  return true;
+#else
+  return false;
+#endif
+}
+
+as::local_process_actuator::local_process_actuator(
+    local_process_actuator_options options)
+    : _options(std::move(options)),
+      _socket_fd(-1),
+      _dropped_metrics(0),
+      _next_worker_id(0),
+      _ready_workers(0),
+      _failed_workers(0),
+      _stop(false) {
+#ifdef __linux__
+  if (_options.command.empty())
+    throw std::runtime_error{"No worker command given!"};
+
+  _socket_path = _options.socket_path;
+  if (_socket_path.empty()) {
+    _socket_path = "/tmp/as-" + std::to_string(getpid()) + "-" +
+                   _options.name + ".sock";
+  }
+  sockaddr_un address;
+  if (!make_address(_socket_path, address))
+    throw std::runtime_error{"Socket path is too long!"};
+
+  _socket_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (_socket_fd < 0) throw std::runtime_error{"Could not create socket!"};
+  unlink(_socket_path.c_str());
+  if (bind(_socket_fd, reinterpret_cast<const sockaddr*>(&address),
+           sizeof(address)) != 0) {
+    close(_socket_fd);
+    throw std::runtime_error{"Could not bind socket!"};
+  }
+
+  _actuation_latency_name = intern_name(_options.name + ".actuation_latency");
+  _capacity_name = intern_name(_options.name + ".capacity");
+  _thread = std::thread{[this]() { run(); }};
+#else
+  throw std::runtime_error{
+      "Local process actuation is not supported on this platform!"};
+#endif
+}
+
+as::local_process_actuator::~local_process_actuator() {
+#ifdef __linux__
+  _stop = true;
+  _thread.join();
+
+  std::lock_guard<std::mutex> guard{_workers_lock};
+  for (auto& worker : _workers) {
+    if (!worker.stopping) kill(worker.pid, SIGTERM);
+  }
+
+  // Give the workers the stop timeout to exit on their own
+  const auto deadline = now() + _options.stop_timeout;
+  while (!_workers.empty() && now() < deadline) {
+    _workers.erase(std::remove_if(_workers.begin(), _workers.end(),
+                                  [](const worker_process& worker) {
+                                    return waitpid(worker.pid, nullptr,
+                                                   WNOHANG) == worker.pid;
+                                  }),
+                   _workers.end());
+    if (!_workers.empty())
+      std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  }
+  for (auto& worker : _workers) {
+    kill(worker.pid, SIGKILL);
+    waitpid(worker.pid, nullptr, 0);
+  }
+
+  close(_socket_fd);
+  unlink(_socket_path.c_str());
+#endif
+}
+
+void as::local_process_actuator::scale_out(size_t count) {
+#ifdef __linux__
+  std::vector<char*> argv;
+  for (auto& arg : _options.command)
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  argv.push_back(nullptr);
+
+  // Inherit the environment, except for our own variables
+  const auto socket_prefix = std::string{worker_socket_env} + "=";
+  const auto id_prefix = std::string{worker_id_env} + "=";
+  std::vector<char*> envp;
+  for (auto** env = environ; *env; ++env) {
+    if (strncmp(*env, socket_prefix.c_str(), socket_prefix.size()) == 0 ||
+        strncmp(*env, id_prefix.c_str(), id_prefix.size()) == 0)
+      continue;
+    envp.push_back(*env);
+  }
+  auto socket_env = socket_prefix + _socket_path;
+  envp.push_back(socket_env.data());
+  envp.push_back(nullptr);
+  envp.push_back(nullptr);
+
+  std::lock_guard<std::mutex> guard{_workers_lock};
+  for (size_t idx = 0; idx < count; ++idx) {
+    const auto id = _next_worker_id++;
+    auto id_env = id_prefix + std::to_string(id);
+    envp[envp.size() - 2] = id_env.data();
+
+    // Taken before the spawn, as the worker may report ready before
+    // posix_spawnp returns
+    const auto start_time = now();
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(),
+                     envp.data()) != 0)
+      throw std::runtime_error{"Could not start worker process!"};
+    _workers.push_back(worker_process{id, pid, start_time, false, false, {}});
+  }
+#endif
+}
+
+void as::local_process_actuator::scale_in(size_t count) {
+#ifdef __linux__
+  std::lock_guard<std::mutex> guard{_workers_lock};
+  for (auto itr = _workers.rbegin(); itr != _workers.rend() && count; ++itr) {
+    if (itr->stopping) continue;
+    kill(itr->pid, SIGTERM);
+    itr->stopping = true;
+    itr->stop_time = now();
+    // The worker stops serving right away
+    if (itr->ready) --_ready_workers;
+    --count;
+  }
+  record_capacity();
+#endif
+}
+
+size_t as::local_process_actuator::current_capacity() const {
+  std::lock_guard<std::mutex> guard{_workers_lock};
+  return _ready_workers;
+}
+
+size_t as::local_process_actuator::target_capacity() const {
+  std::lock_guard<std::mutex> guard{_workers_lock};
+  return std::count_if(
+      _workers.begin(), _workers.end(),
+      [](const worker_process& worker) { return !worker.stopping; });
+}
+
+bool as::local_process_actuator::wait_for_capacity(
+    size_t capacity, std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock{_workers_lock};
+  return _capacity_signal.wait_for(
+      lock, timeout, [&]() { return _ready_workers >= capacity; });
+}
+
+size_t as::local_process_actuator::get_failed_worker_count() const {
+  std::lock_guard<std::mutex> guard{_workers_lock};
+  return _failed_workers;
+}
+
+const std::string& as::local_process_actuator::get_socket_path() const {
+  return _socket_path;
+}
+
+uint64_t as::local_process_actuator::get_dropped_metric_count() const {
+  return _dropped_metrics.load(std::memory_order_relaxed);
+}
+
+void as::local_process_actuator::run() {
+#ifdef __linux__
+  while (!_stop) {
+    pollfd poll_fd{_socket_fd, POLLIN, 0};
+    if (poll(&poll_fd, 1, 50) > 0) receive_reports();
+    reap_workers();
+  }
+#endif
+}
+
+void as::local_process_actuator::receive_reports() {
+#ifdef __linux__
+  report_message message;
+  for (;;) {
+    const auto bytes =
+        recv(_socket_fd, &message, sizeof(message), MSG_DONTWAIT);
+    if (bytes != static_cast<ssize_t>(sizeof(message))) {
+      if (bytes < 0) return;
+      continue;
+    }
+    message.name[sizeof(message.name) - 1] = '\0';
+
+    if (message.type == static_cast<uint8_t>(report_type::metric)) {
+      const auto name = is_worker(message.worker_id)
+                            ? get_metric_name(message.name)
+                            : std::string_view{};
+      if (name.empty()) {
+        _dropped_metrics.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        add_measurement<double>(name, now(), message.value);
+      }
+      continue;
+    }
+
+    std::lock_guard<std::mutex> guard{_workers_lock};
+    // Taken under the lock, so that it can't be older than the start time of
+    // a worker that scale_out added in the meantime
+    const auto timestamp = now();
+    auto itr = std::find_if(_workers.begin(), _workers.end(),
+                            [&](const worker_process& worker) {
+                              return worker.id == message.worker_id;
+                            });
+    if (itr == _workers.end() || itr->ready || itr->stopping) continue;
+
+    itr->ready = true;
+    ++_ready_workers;
+    add_measurement<timespan_t>(_actuation_latency_name, timestamp,
+                                timestamp - itr->start_time);
+    record_capacity();
+    _capacity_signal.notify_all();
+  }
+#endif
+}
+
+bool as::local_process_actuator::is_worker(uint32_t worker_id) const {
+  std::lock_guard<std::mutex> guard{_workers_lock};
+  return std::any_of(
+      _workers.begin(), _workers.end(),
+      [worker_id](const worker_process& worker) {
+        return worker.id == worker_id;
+      });
+}
+
+std::string_view as::local_process_actuator::get_metric_name(
+    std::string_view metric) {
+  auto itr = _metric_names.find(metric);
+  if (itr != _metric_names.end()) return itr->second;
+  if (_metric_names.size() >= _options.max_metric_names) return {};
+
+  const auto name = intern_name(_options.name + "." + std::string{metric});
+  _metric_names.emplace(name.substr(name.size() - metric.size()), name);
+  return name;
+}
+
+void as::local_process_actuator::reap_workers() {
+#ifdef __linux__
+  const auto timestamp = now();
+  std::lock_guard<std::mutex> guard{_workers_lock};
+
+  bool capacity_changed = false;
+  for (auto itr = _workers.begin(); itr != _workers.end();) {
+    if (waitpid(itr->pid, nullptr, WNOHANG) != itr->pid) {
+      if (itr->stopping && timestamp - itr->stop_time > _options.stop_timeout)
+        kill(itr->pid, SIGKILL);
+      ++itr;
+      continue;
+    }
+
+    if (!itr->stopping) {
+      ++_failed_workers;
+      if (itr->ready) {
+        --_ready_workers;
+        capacity_changed = true;
+      }
+    }
+    itr = _workers.erase(itr);
+  }
+  if (capacity_changed) record_capacity();
+#endif
+}
+
+void as::local_process_actuator::record_capacity() {
+  add_measurement<size_t>(_capacity_name, _ready_workers);
+}
+
+#pragma endregion
+
+#pragma region worker_reporter
+
+bool as::worker_reporter::is_available() {
+#ifdef __linux__
+  return getenv(worker_socket_env) && getenv(worker_id_env);
+#else
+  return false;
+#endif
+}
+
+as::worker_reporter::worker_reporter() : _worker_id(0), _socket_fd(-1) {
+  if (!is_available())
+    throw std::runtime_error{"Process was not started as a worker!"};
+#ifdef __linux__
+  _socket_path = getenv(worker_socket_env);
+  _worker_id =
+      static_cast<uint32_t>(strtoul(getenv(worker_id_env), nullptr, 10));
+  _socket_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (_socket_fd < 0) throw std::runtime_error{"Could not create socket!"};
+#endif
+}
+
+as::worker_reporter::~worker_reporter() {
+#ifdef __linux__
+  if (_socket_fd >= 0) close(_socket_fd);
+#endif
+}
+
+void as::worker_reporter::report_ready() {
+  send(static_cast<uint8_t>(report_type::ready), {}, 0.0);
+}
+
+void as::worker_reporter::report(std::string_view name, double value) {
+  send(static_cast<uint8_t>(report_type::metric), name, value);
+}
+
+uint32_t as::worker_reporter::get_worker_id() const { return _worker_id; }
+
+void as::worker_reporter::send(uint8_t type, std::string_view name,
+                               double value) {
+#ifdef __linux__
+  report_message message = {};
+  message.worker_id = _worker_id;
+  message.type = type;
+  const auto length = std::min(name.size(), sizeof(message.name) - 1);
+  memcpy(message.name, name.data(), length);
+  message.value = value;
+
+  sockaddr_un address;
+  if (!make_address(_socket_path, address)) return;
+  sendto(_socket_fd, &message, sizeof(message), 0,
+         reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+#endif
+}
+
+#pragma endregion
@@ -0,0 +1,125 @@
+#include "scaling/scaling_policy.h"
+
+#include <algorithm>
+#include <cmath>
+
+#pragma region scaling_decision
+
+const char* as::to_string(scaling_action action) {
+  switch (action) {
+    case scaling_action::none:
+      return "none";
+    case scaling_action::scale_out:
+      return "scale_out";
+    case scaling_action::scale_in:
+      return "scale_in";
+  }
+  return "unknown";
+}
+
+#pragma endregion
+
+#pragma region scaling_policy
+
+const char* as::scaling_policy::get_name() const { return "custom"; }
+
+#pragma endregion
+
+#pragma region latency_target_policy
+
+as::latency_target_policy::latency_target_policy(
+    latency_target_policy_options options)
+    : _options(options), _has_scaled_out(false), _has_scaled(false) {}
+
+as::scaling_decision as::latency_target_policy::decide(
+    const scaling_inputs& inputs, timestamp_t timestamp) {
+  scaling_decision decision;
+  decision.timestamp = timestamp;
+  decision.current_capacity = inputs.current_capacity;
+  decision.target_capacity = inputs.current_capacity;
+
+  const auto current = inputs.current_capacity;
+  const auto apply = [&](scaling_action action, size_t target,
+                         const char* reason) {
+    decision.action = action;
+    decision.target_capacity = target;
+    decision.reason = reason;
+    _has_scaled = true;
+    _last_scaling = timestamp;
+    if (action == scaling_action::scale_out) {
+      _has_scaled_out = true;
+      _last_scale_out = timestamp;
+    }
+  };
+
+  // Bounds are enforced regardless of cooldowns
+  if (current < _options.min_capacity) {
+    apply(scaling_action::scale_out, _options.min_capacity,
+          "capacity below minimum");
+    return decision;
+  }
+  if (current > _options.max_capacity) {
+    apply(scaling_action::scale_in, _options.max_capacity,
+          "capacity above maximum");
+    return decision;
+  }
+
+  const auto has_latency =
+      inputs.latency_samples >= _options.min_latency_samples;
+  const auto latency_high =
+      has_latency && inputs.latency > _options.target_latency;
+  const auto latency_low =
+      !has_latency || static_cast<double>(inputs.latency.count()) <=
+                          static_cast<double>(_options.target_latency.count()) *
+                              _options.scale_in_latency_fraction;
+  const auto saturated = inputs.utilization >= _options.scale_out_utilization;
+  const auto underutilized =
+      inputs.utilization <= _options.scale_in_utilization &&
+      inputs.queue_length == 0;
+
+  // Capacity at which the observed load results in the target utilization
+  const auto needed = static_cast<size_t>(
+      std::ceil(static_cast<double>(current) * inputs.utilization /
+                _options.target_utilization));
+
+  if (latency_high || saturated) {
+    const auto target =
+        std::min(std::max(current + 1, needed), _options.max_capacity);
+    const auto cooled_down =
+        !_has_scaled_out ||
+        has_elapsed(_last_scale_out, _options.scale_out_cooldown, timestamp);
+    if (target > current && cooled_down) {
+      apply(scaling_action::scale_out, target,
+            latency_high ? "latency above target"
+                         : "utilization above threshold");
+    }
+  } else if (latency_low && underutilized) {
+    const auto lowest = current > _options.max_scale_in_step
+                            ? current - _options.max_scale_in_step
+                            : size_t{0};
+    const auto target = std::max({needed, lowest, _options.min_capacity});
+    const auto cooled_down =
+        !_has_scaled ||
+        has_elapsed(_last_scaling, _options.scale_in_cooldown, timestamp);
+    if (target < current && cooled_down)
+      apply(scaling_action::scale_in, target, "utilization below threshold");
+  }
+  return decision;
+}
+
+const char* as::latency_target_policy::get_name() const {
+  return "latency_target";
+}
+
+const as::latency_target_policy_options&
+as::latency_target_policy::get_options() const {
+  return _options;
+}
+
+bool as::latency_target_policy::has_elapsed(
+    timestamp_t since, std::chrono::milliseconds cooldown,
+    timestamp_t timestamp) const {
+  return timestamp - since >= cooldown;
+}
+
+#pragma endregion
@@ -0,0 +1,359 @@
+#include "simulation/queue_simulator.h"
+
+#include "scaling/actuator.h"
+#include "scaling/decision_journal.h"
+#include "simulation/virtual_clock.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_set>
+
+#pragma region load_profile
+
+as::load_profile as::constant_load(double per_second) {
+  return [per_second](timespan_t) { return per_second; };
+}
+
+as::load_profile as::recorded_load(std::vector<measurement<rate>> rates) {
+  return [rates = std::move(rates)](timespan_t offset) {
+    if (rates.empty()) return 0.0;
+    const auto timestamp = rates.front().timestamp + offset;
+    // Last rate that was recorded at or before the timestamp
+    auto itr = std::upper_bound(
+        rates.begin(), rates.end(), timestamp,
+        [](timestamp_t timestamp, const measurement<rate>& m) {
+          return timestamp < m.timestamp;
+        });
+    return std::prev(itr)->data.get_per_second();
+  };
+}
+
+#pragma endregion
+
+#pragma region simulation_run
+
+namespace {
+
+enum class event_type {
+  load_change,
+  arrival,
+  departure,
+  provisioned,
+  evaluation
+};
+
+struct event {
+  /// <summary>
+  /// Offset from the start of the simulation
+  /// </summary>
+  int64_t time_ns;
+  /// <summary>
+  /// Breaks ties between events at the same time in the order in which they
+  /// were scheduled, which keeps runs reproducible
+  /// </summary>
+  uint64_t sequence;
+  event_type type;
+  /// <summary>
+  /// Arrival time of the job for departures, id of the capacity for
+  /// provisioned events
+  /// </summary>
+  int64_t payload;
+};
+
+struct later_event {
+  bool operator()(const event& l, const event& r) const {
+    return std::tie(l.time_ns, l.sequence) > std::tie(r.time_ns, r.sequence);
+  }
+};
+
+/// <summary>
+/// State of a single run of a queue_simulator. Acts as the actuator of the
+/// simulated servers
+/// </summary>
+class simulation_run : public as::scaling_actuator {
+ public:
+  simulation_run(const as::queue_simulator_options& options,
+                 as::scaling_policy& policy)
+      : _options(options),
+        _policy(policy),
+        _clock(options.start_time),
+        _random(options.seed),
+        _capacity(options.initial_capacity) {
+    if (_options.record_series) {
+      _capacity_name = as::intern_name(_options.name + ".capacity");
+      _utilization_name = as::intern_name(_options.name + ".utilization");
+      _queue_length_name = as::intern_name(_options.name + ".queue_length");
+      _latency_name = as::intern_name(_options.name + ".latency");
+
+      as::decision_journal_options journal_options;
+      journal_options.name = _options.name;
+      journal_options.latency_name = _latency_name;
+      journal_options.utilization_name = _utilization_name;
+      journal_options.queue_length_name = _queue_length_name;
+      journal_options.capacity_name = _capacity_name;
+      _journal = std::make_unique<as::decision_journal>(journal_options);
+    }
+  }
+
+  as::simulation_result run() {
+    std::optional<as::scoped_clock> clock_guard;
+    if (_options.install_clock) clock_guard.emplace(_clock);
+    const auto end_ns = to_ns(_options.duration);
+
+    _result.max_capacity = _capacity;
+    schedule(0, event_type::load_change);
+    schedule(to_ns(_options.evaluation_interval), event_type::evaluation);
+
+    while (!_events.empty() && _events.top().time_ns <= end_ns) {
+      const auto next = _events.top();
+      _events.pop();
+      advance_to(next.time_ns);
+
+      switch (next.type) {
+        case event_type::load_change:
+          change_load();
+          break;
+        case event_type::arrival:
+          ++_result.arrived_jobs;
+          _queue.push_back(_time_ns);
+          dispatch();
+          schedule_arrival();
+          break;
+        case event_type::departure:
+          --_busy;
+          ++_result.completed_jobs;
+          _result.response_time.record(
+              as::timespan_t{_time_ns - next.payload});
+          dispatch();
+          break;
+        case event_type::provisioned:
+          provision(static_cast<uint64_t>(next.payload));
+          break;
+        case event_type::evaluation:
+          evaluate();
+          break;
+      }
+    }
+    advance_to(end_ns);
+
+    _result.final_capacity = _capacity;
+    return std::move(_result);
+  }
+
+  void scale_out(size_t count) override {
+    if (_options.provisioning_delay.count() <= 0) {
+      _capacity += count;
+      _result.max_capacity = std::max(_result.max_capacity, _capacity);
+      dispatch();
+      return;
+    }
+    for (size_t idx = 0; idx < count; ++idx) {
+      const auto id = _next_provision_id++;
+      _provisioning.push_back(id);
+      schedule(_time_ns + to_ns(_options.provisioning_delay),
+               event_type::provisioned, static_cast<int64_t>(id));
+    }
+  }
+
+  void scale_in(size_t count) override {
+    // Capacity that is still being provisioned is the most recent
+    while (count && !_provisioning.empty()) {
+      _cancelled.insert(_provisioning.back());
+      _provisioning.pop_back();
+      --count;
+    }
+    // Busy servers beyond the capacity finish their current job first
+    _capacity -= std::min(count, _capacity);
+  }
+
+  size_t current_capacity() const override { return _capacity; }
+
+  size_t target_capacity() const override {
+    return _capacity + _provisioning.size();
+  }
+
+ private:
+  template <typename Duration>
+  static int64_t to_ns(Duration duration) {
+    return std::chrono::duration_cast<as::timespan_t>(duration).count();
+  }
+
+  void schedule(int64_t time_ns, event_type type, int64_t payload = 0) {
+    _events.push(event{time_ns, _next_sequence++, type, payload});
+  }
+
+  int64_t exponential_ns(double mean_ns) {
+    return static_cast<int64_t>(std::llround(_exponential(_random) * mean_ns));
+  }
+
+  /// <summary>
+  /// Integrates the busy servers and the capacity up to the given time and
+  /// moves the virtual clock of the run there
+  /// </summary>
+  void advance_to(int64_t time_ns) {
+    const auto elapsed_ns = static_cast<double>(time_ns - _time_ns);
+    _interval_busy_ns += static_cast<double>(_busy) * elapsed_ns;
+    _result.capacity_seconds +=
+        static_cast<double>(std::max(_capacity, _busy) +
+                            _provisioning.size()) *
+        elapsed_ns / 1e9;
+    _time_ns = time_ns;
+    _clock.set(_options.start_time + as::timespan_t{time_ns});
+  }
+
+  void change_load() {
+    _rate = std::max(_options.load(as::timespan_t{_time_ns}), 0.0);
+    _next_load_change_ns = _time_ns + to_ns(_options.load_resolution);
+    schedule(_next_load_change_ns, event_type::load_change);
+    schedule_arrival();
+  }
+
+  /// <summary>
+  /// Schedules the next arrival if it falls before the next load change. As
+  /// interarrival times are memoryless, the load change can draw a new one
+  /// with the new rate instead
+  /// </summary>
+  void schedule_arrival() {
+    if (_rate <= 0.0) return;
+    const auto time_ns = _time_ns + exponential_ns(1e9 / _rate);
+    if (time_ns < _next_load_change_ns)
+      schedule(time_ns, event_type::arrival);
+  }
+
+  void dispatch() {
+    while (_busy < _capacity && !_queue.empty()) {
+      const auto arrival_ns = _queue.front();
+      _queue.pop_front();
+      ++_busy;
+
+      const as::timespan_t queue_wait{_time_ns - arrival_ns};
+      _result.queue_wait_time.record(queue_wait);
+      _interval_queue_wait_time.record(queue_wait);
+      schedule(_time_ns + exponential_ns(static_cast<double>(
+                              _options.mean_service_time.count())),
+               event_type::departure, arrival_ns);
+    }
+  }
+
+  void provision(uint64_t id) {
+    if (_cancelled.erase(id)) return;
+    // All capacity has the same delay, so it's provisioned in order
+    _provisioning.pop_front();
+    ++_capacity;
+    _result.max_capacity = std::max(_result.max_capacity, _capacity);
+    dispatch();
+  }
+
+  void evaluate() {
+    const auto interval_ns = _time_ns - _last_evaluation_ns;
+
+    as::scaling_inputs inputs;
+    inputs.current_capacity = _capacity;
+    inputs.latency =
+        _interval_queue_wait_time.quantile(_options.latency_quantile);
+    inputs.latency_samples = _interval_queue_wait_time.count();
+    inputs.queue_length = _queue.size();
+    if (_capacity && interval_ns > 0) {
+      const auto capacity_ns =
+          static_cast<double>(interval_ns) * static_cast<double>(_capacity);
+      inputs.utilization =
+          std::clamp(_interval_busy_ns / capacity_ns, 0.0, 1.0);
+    } else if (!_capacity) {
+      inputs.utilization = _queue.empty() ? 0.0 : 1.0;
+    }
+
+    const auto timestamp = _clock.now();
+    const auto decision = _policy.decide(inputs, timestamp);
+    if (decision.action != as::scaling_action::none) {
+      apply(decision);
+      _result.decisions.push_back(decision);
+      if (decision.action == as::scaling_action::scale_out)
+        ++_result.scale_outs;
+      else
+        ++_result.scale_ins;
+    }
+
+    if (_options.record_series) {
+      _journal->record(inputs, decision, _policy.get_name(), 1);
+      as::add_measurement<size_t>(_capacity_name, timestamp, _capacity);
+      as::add_measurement<double>(_utilization_name, timestamp,
+                                  inputs.utilization);
+      as::add_measurement<size_t>(_queue_length_name, timestamp,
+                                  inputs.queue_length);
+      as::add_measurement<as::timespan_t>(_latency_name, timestamp,
+                                          inputs.latency);
+    }
+
+    _interval_queue_wait_time.clear();
+    _interval_busy_ns = 0.0;
+    _last_evaluation_ns = _time_ns;
+    schedule(_time_ns + to_ns(_options.evaluation_interval),
+             event_type::evaluation);
+  }
+
+  const as::queue_simulator_options& _options;
+  as::scaling_policy& _policy;
+  as::virtual_clock _clock;
+  std::mt19937_64 _random;
+  std::exponential_distribution<double> _exponential{1.0};
+
+  std::string_view _capacity_name;
+  std::string_view _utilization_name;
+  std::string_view _queue_length_name;
+  std::string_view _latency_name;
+  std::unique_ptr<as::decision_journal> _journal;
+
+  std::priority_queue<event, std::vector<event>, later_event> _events;
+  uint64_t _next_sequence = 0;
+  int64_t _time_ns = 0;
+
+  double _rate = 0.0;
+  int64_t _next_load_change_ns = 0;
+
+  /// <summary>
+  /// Arrival times of the jobs that wait for a server
+  /// </summary>
+  std::deque<int64_t> _queue;
+  size_t _busy = 0;
+  size_t _capacity;
+  std::deque<uint64_t> _provisioning;
+  std::unordered_set<uint64_t> _cancelled;
+  uint64_t _next_provision_id = 0;
+
+  int64_t _last_evaluation_ns = 0;
+  double _interval_busy_ns = 0.0;
+  as::timing_sketch _interval_queue_wait_time;
+
+  as::simulation_result _result;
+};
+
+}  // namespace
+
+#pragma endregion
+
+#pragma region queue_simulator
+
+as::queue_simulator::queue_simulator(queue_simulator_options options)
+    : _options(std::move(options)) {
+  if (!_options.load) throw std::runtime_error{"No load profile given!"};
+  if (_options.load_resolution.count() <= 0 ||
+      _options.evaluation_interval.count() <= 0)
+    throw std::runtime_error{"Simulation intervals must be positive!"};
+}
+
+as::simulation_result as::queue_simulator::run(scaling_policy& policy) const {
+  return simulation_run{_options, policy}.run();
+}
+
+const as::queue_simulator_options& as::queue_simulator::get_options() const {
+  return _options;
+}
+
+#pragma endregion
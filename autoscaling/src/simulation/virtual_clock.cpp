@@ -0,0 +1,42 @@
+#include "simulation/virtual_clock.h"
+
+#include <stdexcept>
+
+#pragma region virtual_clock
+
+as::virtual_clock::virtual_clock(timestamp_t start)
+    : _ns(std::chrono::duration_cast<timespan_t>(start.time_since_epoch())
+              .count()) {}
+
+as::timestamp_t as::virtual_clock::now() const {
+  return timestamp_t{std::chrono::duration_cast<timestamp_t::duration>(
+      timespan_t{_ns.load(std::memory_order_acquire)})};
+}
+
+void as::virtual_clock::set(timestamp_t timestamp) {
+  const auto ns =
+      std::chrono::duration_cast<timespan_t>(timestamp.time_since_epoch())
+          .count();
+  if (ns < _ns.load(std::memory_order_relaxed))
+    throw std::runtime_error{"Virtual clock can't go backwards!"};
+  _ns.store(ns, std::memory_order_release);
+}
+
+void as::virtual_clock::advance(timespan_t timespan) {
+  if (timespan.count() < 0)
+    throw std::runtime_error{"Virtual clock can't go backwards!"};
+  _ns.fetch_add(timespan.count(), std::memory_order_acq_rel);
+}
+
+#pragma endregion
+
+#pragma region scoped_clock
+
+as::scoped_clock::scoped_clock(const clock_source& clock)
+    : _previous(get_clock()) {
+  set_clock(&clock);
+}
+
+as::scoped_clock::~scoped_clock() { set_clock(_previous); }
+
+#pragma endregion